@@ -0,0 +1,97 @@
+#ifndef ARCHIVE_HPP
+#define ARCHIVE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Forward declaration of libzip archive handle
+struct zip;
+
+// What kind of image an entry holds, guessed from its file extension
+enum class ImageKind
+{
+    Unknown,
+    Tape,     // .tap, .tzx
+    Disk,     // .trd, .scl, .fdi, .udi
+    Snapshot, // .z80, .sna, .szx
+};
+
+// Read-only bytes of an image. Either a memory-mapped file or an owned buffer
+// (decompressed zip entry or virtual tape). Blocks parsed from the image keep
+// spans into these bytes, so the image must outlive them - hold it by shared_ptr.
+class ImageData
+{
+private:
+    void *mapping;              // mmap() base, nullptr if owned buffer is used
+    size_t mappingSize;         // size of the mapping
+    std::vector<uint8_t> owned; // owned bytes when not mapped
+
+public:
+    ImageData();
+    ~ImageData();
+    ImageData(const ImageData &) = delete;
+    ImageData &operator=(const ImageData &) = delete;
+
+    // Map a plain file into memory. Falls back to reading it if mmap is not possible
+    bool mapFile(const std::string &fileName);
+
+    // Take ownership of already prepared bytes
+    void assign(std::vector<uint8_t> &&data);
+
+    // Buffer that will be filled by the caller (used for chunked zip decompression)
+    uint8_t *allocate(size_t size);
+
+    std::span<const uint8_t> bytes() const;
+    size_t size() const { return bytes().size(); }
+    bool isMapped() const { return mapping != nullptr; }
+};
+
+// One file inside an archive (or the plain file itself)
+struct ArchiveEntry
+{
+    std::string name;   // Name inside archive (or file name for plain files)
+    ImageKind kind;     // Guessed from extension
+    uint64_t size;      // Uncompressed size in bytes
+    uint64_t zipIndex;  // Index inside zip archive
+};
+
+// Image container: a plain file (one entry, memory-mapped) or a zip archive
+// (every tape, disk and snapshot entry indexed, decompressed on first access)
+class Archive
+{
+private:
+    std::string fileName;
+    zip *zipArchive; // nullptr for plain files
+    std::vector<ArchiveEntry> entries;
+    std::vector<std::shared_ptr<ImageData>> cache; // decompressed/mapped entries, filled lazily
+
+    bool openZip();
+
+public:
+    Archive();
+    ~Archive();
+    Archive(const Archive &) = delete;
+    Archive &operator=(const Archive &) = delete;
+
+    // Open a plain image or a zip archive. Only the directory is read here
+    bool open(const std::string &fileName);
+    void close();
+
+    size_t getEntryCount() const { return entries.size(); }
+    const ArchiveEntry &getEntry(size_t index) const { return entries[index]; }
+
+    // Index of the first entry of the given kind, or -1 if there is none
+    int findFirst(ImageKind kind) const;
+
+    // Bytes of the entry. Mapped or decompressed on first access and cached after that
+    std::shared_ptr<const ImageData> getData(size_t index);
+
+    // Guess image kind by file extension
+    static ImageKind kindFromName(const std::string &name);
+};
+
+#endif // ARCHIVE_HPP
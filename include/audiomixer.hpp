@@ -0,0 +1,83 @@
+#ifndef AUDIOMIXER_HPP
+#define AUDIOMIXER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include "ringbuffer.hpp"
+
+#define MIXER_SAMPLE_RATE 44100 // Rate every source renders at
+#define MIXER_BLOCK_FRAMES 1024 // Frames mixed in one pass
+#define MIXER_PREFILL_FRAMES 2048 // Fullest source must have this much queued before sources are played (~46 ms)
+#define MIXER_MAX_RATE_ADJUST 0.005 // Playback speed may differ from nominal by half a percent
+#define MIXER_PHASE_ONE (1ULL << 32) // One input frame in resampler position units
+
+// Combines all sound sources (beeper, AY, ...) into one interleaved stereo stream.
+// Every source renders into its own SPSC ring buffer on the emulation side,
+// the mixer reads them all from the audio thread and adds them with saturation.
+// All sources play from one shared position in emulated time: they are primed together,
+// and a source that falls behind has its late frames dropped instead of lagging for good.
+// No SDL here: output device is AudioOutput, offline renders can call mix() directly.
+class AudioMixer
+{
+private:
+    struct Source
+    {
+        RingBuffer<int16_t> *ring; // Interleaved stereo samples, owned by the source
+        int16_t lastLeft;          // Last played frame, held when the source is late
+        int16_t lastRight;
+        size_t owed;               // Frames played as held level while others played, dropped when they arrive
+    };
+    std::vector<Source> sources;
+    std::vector<int16_t> scratch; // One block of one source
+    size_t prefillFrames;         // Frames the fullest source must have queued to start playing
+    bool primed;                  // Sources are playing, false until prefilled and after all ran dry
+
+    // Emulation thread can wait for the audio thread to take samples
+    std::atomic<uint64_t> mixedFrames; // Frames produced since start
+    std::mutex waitMutex;
+    std::condition_variable mixedSignal;
+
+    // Fractional resampler, all state is used on the audio thread only
+    std::atomic<uint64_t> rateStep;     // Input frames per output frame, 32.32 fixed point
+    uint64_t phase;                     // Position between previous and current input frame
+    int16_t previous[2];                // Input frames around the position
+    int16_t current[2];
+    std::vector<int16_t> resampleInput; // Mixed input for one chunk
+
+    // Mix sources at nominal rate
+    void mixSources(int16_t *out, size_t frames);
+
+    // Read frames of one source into scratch, taking at most shared frames and padding with its last frame
+    void readSource(Source &source, size_t frames, size_t shared);
+
+public:
+    AudioMixer();
+
+    // Register source. Must be done before audio output starts
+    void addSource(RingBuffer<int16_t> *ring);
+
+    // Queue depth needed before a source plays (MIXER_PREFILL_FRAMES by default).
+    // Offline rendering mixes exactly what was emulated and sets 0
+    void setPrefill(size_t frames) { prefillFrames = frames; }
+
+    // Produce frames of mixed stereo samples
+    void mix(int16_t *out, size_t frames);
+
+    // Play input faster (ratio > 1) or slower, used by rate control to hold latency.
+    // Clamped to 1 +- MIXER_MAX_RATE_ADJUST
+    void setRate(double ratio);
+    double getRate() const;
+
+    // Frames waiting in the fullest source ring (how far emulation is ahead of the speaker)
+    size_t getQueuedFrames() const;
+
+    // Block until the next mix() call or timeout. Returns false on timeout
+    bool waitForMix(std::chrono::milliseconds timeout);
+};
+
+#endif // AUDIOMIXER_HPP
@@ -0,0 +1,56 @@
+#ifndef AUDIOOUTPUT_HPP
+#define AUDIOOUTPUT_HPP
+
+#include <SDL3/SDL.h>
+#include <vector>
+#include <atomic>
+#include "audiomixer.hpp"
+
+#define AUDIO_TARGET_LATENCY_MS 40 // Default audio queued ahead of the speaker
+#define AUDIO_RATE_GAIN 0.01       // Rate change per relative latency error (50% too much -> +0.5%)
+#define AUDIO_LATENCY_SMOOTHING 0.05 // Weight of a new latency reading in the running average
+
+// The only SDL audio device of the emulator.
+// SDL pulls data through a stream callback, which asks the mixer for it.
+class AudioOutput
+{
+private:
+    SDL_AudioStream *audioStream;
+    SDL_AudioDeviceID audioDevice;
+    AudioMixer *mixer;
+    std::vector<int16_t> outBuffer; // Preallocated block for the callback
+
+    // Dynamic rate control: emulated and sound card clocks never match exactly,
+    // playback is nudged faster or slower to keep queued audio at the target
+    std::atomic<bool> rateControl;
+    std::atomic<int> targetLatency; // Frames
+    double averageLatency;          // Smoothed measured latency in frames (audio thread only)
+
+    // Measure queued audio and set mixer rate
+    void updateRate(SDL_AudioStream *stream);
+
+    // SDL asks for more data
+    static void SDLCALL audioCallback(void *userdata, SDL_AudioStream *stream, int additionalAmount, int totalAmount);
+    void feedStream(SDL_AudioStream *stream, int bytes);
+
+public:
+    AudioOutput();
+    ~AudioOutput();
+
+    // Open default playback device and start pulling from mixer
+    bool initialize(AudioMixer *mixer);
+    void cleanup();
+
+    // Device is open and pulls samples
+    bool isRunning() const { return audioDevice != 0; }
+
+    // Rate control is for timer paced emulation. When emulation follows the audio clock it must be off
+    void setRateControl(bool enabled) { rateControl.store(enabled, std::memory_order_relaxed); }
+    bool getRateControl() const { return rateControl.load(std::memory_order_relaxed); }
+
+    // Audio kept queued ahead of the speaker (rings + SDL stream)
+    void setTargetLatency(int ms) { targetLatency.store(ms * MIXER_SAMPLE_RATE / 1000, std::memory_order_relaxed); }
+    int getTargetLatency() const { return targetLatency.load(std::memory_order_relaxed) * 1000 / MIXER_SAMPLE_RATE; }
+};
+
+#endif // AUDIOOUTPUT_HPP
@@ -2,9 +2,36 @@
 #define AY8912_HPP
 
 #include <cstdint>
-#include <SDL3/SDL.h>
 #include <thread>
 #include <atomic>
+#include "ringbuffer.hpp"
+#include "decimator.hpp"
+#include "ayrecorder.hpp"
+
+#define AY_RING_SAMPLES 16384    // Ring size in int16 samples (8192 stereo frames)
+#define AY_QUEUE_WRITES 4096     // Register writes waiting for the render thread
+#define AY_CPU_FREQUENCY 3500000 // T-states per second used for sample timing
+#define AY_RESET_REGISTER 0xFF   // Pseudo register in write queue: reset the chip
+#define AY_RENDER_FRAMES 256     // Stereo frames rendered by the chip at once
+#define AY_CHIP_FREQUENCY 1773400 // AY clock on ZX Spectrum 128
+#define AY_SAMPLE_RATE 44100      // Output sample rate
+#define AY_NATIVE_RATE (AY_CHIP_FREQUENCY / 8) // Tone counters step rate, used in high quality mode
+
+// Register write from CPU, stamped with emulated time
+struct AYWrite
+{
+    uint64_t tstate; // When the write happened
+    uint8_t reg;     // Register number (or AY_RESET_REGISTER)
+    uint8_t value;   // Written value
+};
+
+// Register file as the CPU sees it (machine state save/restore)
+struct AYState
+{
+    uint8_t registers[16];
+    uint8_t selectedRegister;
+    bool addressLatch;
+};
 
 // Forward declaration of AY38910 class
 class AY38910;
@@ -16,24 +43,55 @@ private:
     uint8_t registers[16]; // 14 registers (0-13), 14-15 unused
     uint8_t selectedRegister;
     bool addressLatch;
+    uint8_t sentRegisters[16]; // Values last queued for the chip (differ from registers after silent writes)
+    bool silent;               // Writes change registers only: nothing queued, nothing recorded
 
-    // Audio streaming
-    SDL_AudioStream *audioStream;
-    SDL_AudioDeviceID audioDevice;
+    // Rendered samples for the mixer
+    RingBuffer<int16_t> ring;
     bool initialized;
 
+    // Emulation thread -> render thread. Chip itself is touched only by the render thread
+    RingBuffer<AYWrite> writeQueue;
+    std::atomic<uint64_t> emulatedClock; // T-states emulated so far, render thread waits on it
+    uint64_t renderedSamples;            // Samples produced since start (render thread only)
+    std::atomic<uint8_t> stereoMode;     // Requested panning (AY_STEREO_*), set by UI thread
+
+    // High quality mode: chip runs at its native counter rate, output is decimated to AY_SAMPLE_RATE
+    std::atomic<bool> highQuality; // Requested mode, set by UI thread
+    bool activeHighQuality;        // Mode chip is configured for (render thread only)
+    Decimator decimator;
+    int16_t nativeBlock[AY_RENDER_FRAMES * 2 * 8]; // Native rate samples for one output block
+    uint8_t chipRegisters[14];     // Registers written to chip, to restore them after mode switch
+
     // Audio processing thread
     std::thread audioThread;
     std::atomic<bool> audioThreadRunning;
+    bool threaded;          // false: setClock renders on the calling thread (offline rendering)
+    uint64_t renderedClock; // Emulated time everything is rendered up to (render thread only)
 
     // AY-3-8910 emulator instance
     AY38910 *ayChip;
 
+    // Register log to VGM/PSG file
+    AYRecorder recorder;
+
+    // Produce samples up to given emulated time (render thread only)
+    void renderTo(uint64_t tstate);
+
+    // Set chip sample rate for current quality mode and restore its registers (render thread only)
+    void configureChip();
+
+    // Apply queued register writes and render up to given emulated time (render thread only)
+    void renderPending(uint64_t clock);
+
 public:
-    AY8912();
+    // highQuality selects native rate synthesis with polyphase decimation (more CPU)
+    AY8912(bool highQuality = false, size_t ringSamples = AY_RING_SAMPLES);
     ~AY8912();
 
-    bool initialize();
+    // threaded = false renders in setClock on the emulation thread, so samples are
+    // in the ring as soon as setClock returns (offline rendering, no real time)
+    bool initialize(bool threaded = true);
     void cleanup();
 
     // Port handlers for ZX Spectrum 128
@@ -43,8 +101,50 @@ public:
     // Reset the chip
     void reset();
 
+    // Forget the register number written to FFFD, registers stay
+    void clearLatch()
+    {
+        selectedRegister = 0;
+        addressLatch = false;
+    }
+
+    // Register file as the CPU sees it (snapshots)
+    uint8_t getRegister(int reg) const { return registers[reg & 0x0F]; }
+    uint8_t getSelectedRegister() const { return selectedRegister; }
+
+    // Register file to and from a flat block. Registers the chip has other values in are written
+    // to it at ticks, like CPU writes, so a restore changes the sound without resetting it
+    void saveState(AYState &state) const;
+    void loadState(const AYState &state);
+
+    // Silent: frames that will be thrown away (run-ahead) do not reach the chip or the log
+    void setSilent(bool enable) { silent = enable; }
+
     // Audio processing
     void processAudio();
+
+    // Emulated time of the running instruction, used to stamp register writes
+    long long ticks;
+
+    // Emulation has reached given T-state: render everything before it
+    void setClock(uint64_t tstate);
+
+    // Channel panning: AY_STEREO_MONO, AY_STEREO_ABC or AY_STEREO_ACB. Applied by render thread
+    void setStereoMode(uint8_t mode) { stereoMode.store(mode, std::memory_order_relaxed); }
+    uint8_t getStereoMode() const { return stereoMode.load(std::memory_order_relaxed); }
+
+    // AY clock in Hz (AY_CHIP_FREQUENCY on Spectrum). Call before rendering starts
+    void setChipFrequency(uint32_t frequency);
+
+    // Native rate synthesis on/off. Applied by render thread
+    void setHighQuality(bool enabled) { highQuality.store(enabled, std::memory_order_relaxed); }
+    bool isHighQuality() const { return highQuality.load(std::memory_order_relaxed); }
+
+    // Samples for the mixer
+    RingBuffer<int16_t> *getOutput() { return &ring; }
+
+    // Register write log. Start and stop from any thread
+    AYRecorder *getRecorder() { return &recorder; }
 };
 
 #endif // AY8912_HPP
@@ -0,0 +1,103 @@
+#ifndef AYPLAYER_HPP
+#define AYPLAYER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "ay8912.hpp"
+#include "memory.hpp"
+#include "port.hpp"
+#include "z80.hpp"
+
+#define AYPLAYER_FRAME_TICKS (AY_CPU_FREQUENCY / 50) // One 50 Hz step of playback
+#define AYPLAYER_DEFAULT_SECONDS 180                 // Length of songs that do not say it (looped VGM, AY)
+#define AYPLAYER_WAV_BUFFER_BYTES (256 * 1024)       // WAV writer buffers, small so many conversions fit in memory
+
+// Music files the player understands
+enum class AYFileFormat
+{
+    Unknown,
+    VGM, // Register writes with 44100 Hz waits (only AY-3-8910 commands are played)
+    PSG, // Register writes grouped by 50 Hz frames
+    AY,  // ZXAYEMUL: Z80 player code and data, run on our own Z80
+};
+
+// Plays AY music through the emulator's own AY8912 (and so AY38910 and its block renderer).
+// Time advances in 50 Hz steps of emulated T-states, samples appear in the AY8912 ring,
+// the same way they do when a game plays music.
+class AYPlayer
+{
+private:
+    std::vector<uint8_t> data; // Whole file
+    AYFileFormat format;
+    std::unique_ptr<AY8912> ay;
+
+    uint64_t ticks;        // Emulated time played so far
+    uint64_t frames;       // 50 Hz steps played
+    uint64_t lengthFrames; // Song end
+    uint64_t fadeFrames;   // Fade out before the end (AY files)
+    uint64_t readSamples;  // Samples taken by read()
+    bool ended;            // Data stream ended
+
+    // VGM and PSG stream
+    size_t position;      // Next command
+    uint64_t streamTicks; // Time of the next command
+    uint64_t vgmSamples;  // VGM: waits so far in samples
+
+    // AY files: a bare 64K Spectrum running the player code
+    int songCount;
+    std::unique_ptr<Memory> memory;
+    std::unique_ptr<Port> ports;
+    std::unique_ptr<Z80> cpu;
+    uint64_t cpuTicks;
+
+    // Register write at emulated time
+    void writeRegister(uint64_t tstate, uint8_t reg, uint8_t value);
+
+    bool startVgm();
+    bool startPsg();
+    bool startAy(int song);
+
+    // Execute stream commands up to given time
+    void runVgm(uint64_t until);
+    void runPsg(uint64_t until);
+    void runAy(uint64_t until);
+
+    // Big-endian relative pointer of AY files, returns offset in data or 0 when outside the file
+    size_t ayPointer(size_t offset) const;
+
+public:
+    AYPlayer();
+
+    // Read and identify file. Returns false if it is not VGM, PSG or AY
+    bool load(const std::string &fileName);
+
+    AYFileFormat getFormat() const { return format; }
+    int getSongCount() const { return songCount; }
+
+    // Reset the chip and start given song from the beginning (AY files have several)
+    bool start(int song = 0);
+
+    // Play next 1/50 second. Returns false when the song is over
+    bool playFrame();
+
+    // Emulated time played, the mixer and Pacer count in it
+    uint64_t getTicks() const { return ticks; }
+    double getLengthSeconds() const { return lengthFrames / 50.0; }
+
+    // Samples for the mixer (real time playback). Valid after start()
+    RingBuffer<int16_t> *getOutput() { return ay->getOutput(); }
+
+    // Take up to frames rendered stereo frames with fade out applied (offline rendering)
+    size_t read(int16_t *out, size_t frames);
+};
+
+// Render a song to WAV as fast as possible. Returns false on errors
+bool convertMusicFile(const std::string &input, const std::string &output, int song);
+
+// Convert every VGM, PSG and AY file of a directory to WAV next to it on a pool of
+// jobs threads (0 = one per core). Every song is one task. Returns number of failed songs
+int convertMusicDirectory(const std::string &directory, int jobs);
+
+#endif // AYPLAYER_HPP
@@ -0,0 +1,117 @@
+#ifndef AYRECORDER_HPP
+#define AYRECORDER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include "ringbuffer.hpp"
+
+#define AYREC_RING_WRITES 65536 // Register writes buffered between flushes (~1 MB, only while recording)
+#define AYREC_FLUSH_MS 20       // Flush thread wakes up this often
+#define AYREC_SAMPLE_RATE 44100 // VGM time base
+#define AYREC_CPU_FREQUENCY 3500000 // T-states per second, same time base as AY8912
+#define AYREC_CHIP_FREQUENCY 1773400 // AY clock written to the VGM header
+
+// Pseudo registers in the log stream (real ones are 0-13)
+#define AYREC_RESET 0xFF // Chip reset, all registers become 0
+#define AYREC_START 0xFE // Recording starts at this T-state, current registers follow
+#define AYREC_STOP 0xFD  // Recording ends at this T-state
+#define AYREC_FRAME 0xFC // 50 Hz interrupt, PSG frame boundary
+
+enum class AYLogFormat
+{
+    VGM, // Sample accurate (44100 Hz) waits, plays in every VGM player
+    PSG, // One step per 50 Hz frame, the classic ZX format
+};
+
+// Entry of the log ring
+struct AYLogEntry
+{
+    uint64_t tstate;
+    uint8_t reg;
+    uint8_t value;
+};
+
+// Records every AY register write with its emulated time into a VGM or PSG file.
+// Emulation thread only appends entries to a lock-free ring allocated by start();
+// formatting and disk writes happen on a flush thread.
+// Start and stop are requested from any thread and applied by the emulation thread
+// at the next frame, so the file always begins and ends on a frame boundary.
+class AYRecorder
+{
+private:
+    std::unique_ptr<RingBuffer<AYLogEntry>> ring; // Only while a recording needs it
+    std::atomic<uint32_t> requested; // Recording wanted: its session number, 0 = none (UI thread)
+    uint32_t activeSession;          // Session entries are recorded for, 0 = none (emulation thread)
+    uint32_t sessions;               // Sessions started so far (UI thread)
+    std::atomic<uint32_t> dropped; // Entries lost because the ring was full
+
+    // Flush thread and its file
+    std::thread flusher;
+    std::atomic<bool> flushing;  // Flush thread is running
+    std::atomic<bool> finished;  // STOP entry was written out
+    FILE *file;
+    AYLogFormat format;
+
+    // Log state, flush thread only
+    bool started;            // START entry seen, entries before it are from an earlier recording
+    bool stopSeen;           // STOP entry seen: emulation pushes nothing more until the next start
+    uint64_t startTstate;    // T-state recording started at
+    uint64_t writtenSamples; // VGM: samples waited so far
+    uint32_t pendingFrames;  // PSG: frames not written out yet
+    uint64_t lastTstate;     // Time of the last entry, end of a recording that was not stopped cleanly
+    std::vector<uint8_t> out; // Bytes for the next fwrite
+
+    void flushLoop();
+    // Format one entry into out
+    void put(const AYLogEntry &entry);
+    void putWrite(uint8_t reg, uint8_t value);
+    void putVgmWait(uint64_t samples);
+    void putPsgFrames();
+    // Write header with final sizes (VGM) and close the file
+    void finish(uint64_t tstate);
+
+    void push(uint64_t tstate, uint8_t reg, uint8_t value)
+    {
+        AYLogEntry entry = {tstate, reg, value};
+        if (ring->write(&entry, 1) == 0)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    AYRecorder();
+    ~AYRecorder();
+
+    // Create the file and arm recording. It starts at the next frame of the emulation
+    bool start(const std::string &fileName, AYLogFormat logFormat);
+
+    // Disarm recording: emulation writes the end at its next frame
+    void requestStop() { requested.store(0, std::memory_order_release); }
+
+    // Disarm recording and wait until the file is complete (emulation must be running
+    // to reach the next frame; gives up after a short time and closes the file as it is)
+    void stop();
+
+    bool isRecording() const { return requested.load(std::memory_order_relaxed) != 0; }
+
+    // Emulation thread: register write
+    void write(uint64_t tstate, uint8_t reg, uint8_t value)
+    {
+        if (activeSession)
+        {
+            push(tstate, reg, value);
+        }
+    }
+
+    // Emulation thread: frame ended at tstate. Applies start and stop requests.
+    // registers are the values the chip holds now, written at the start of a recording
+    void frame(uint64_t tstate, const uint8_t *registers);
+};
+
+#endif // AYRECORDER_HPP
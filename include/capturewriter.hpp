@@ -0,0 +1,89 @@
+#ifndef CAPTUREWRITER_HPP
+#define CAPTUREWRITER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define CAPTURE_BUFFER_BYTES (4 * 1024 * 1024) // Size of each of the two buffers
+
+// Writes a stream of bytes to a file or pipe ("-" is stdout) on a background thread.
+// Double buffered: caller fills one buffer while the other one is being written,
+// so emulation waits only if the disk is slower than emulation for a whole buffer.
+class CaptureWriter
+{
+private:
+    FILE *file;
+    bool ownsFile; // false for stdout
+    bool seekable; // Regular file, header can be rewritten at the end
+
+    std::vector<uint8_t> buffers[2];
+    int front;   // Buffer being filled by caller
+    size_t fill; // Bytes in front buffer
+
+    // Writer thread state, protected by mutex
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool backPending; // Back buffer waits to be written
+    size_t backSize;  // Bytes in back buffer
+    bool stopping;
+    std::atomic<bool> failed;
+    uint64_t written; // Bytes handed to the writer so far
+
+    void writerLoop();
+
+    // Hand front buffer to the writer, waits if previous one is still being written
+    void submit();
+
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    // Create file ("-" for stdout) and start writer thread. bufferBytes is the size of each buffer
+    bool open(const std::string &fileName, size_t bufferBytes = CAPTURE_BUFFER_BYTES);
+
+    // Queue bytes for writing
+    void write(const void *data, size_t bytes);
+
+    // Wait until everything queued so far is written
+    void flush();
+
+    // Overwrite bytes at given offset (e.g. file header with final sizes). Regular files only
+    bool rewrite(uint64_t offset, const void *data, size_t bytes);
+
+    // Write the rest, stop thread and close the file. Returns false if any write failed
+    bool close();
+
+    bool isOpen() const { return file != nullptr; }
+    bool isSeekable() const { return seekable; }
+    uint64_t getWritten() const { return written + fill; }
+};
+
+// 16-bit PCM WAV on top of CaptureWriter. Sizes in the header are set on close
+// (for pipes they stay at maximum, which players treat as "until the end").
+class WavWriter
+{
+private:
+    CaptureWriter out;
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint64_t dataBytes;
+
+    void writeHeader(bool final);
+
+public:
+    WavWriter();
+
+    bool open(const std::string &fileName, uint32_t sampleRate, uint16_t channels, size_t bufferBytes = CAPTURE_BUFFER_BYTES);
+    void write(const int16_t *samples, size_t frames);
+    bool close();
+    bool isOpen() const { return out.isOpen(); }
+};
+
+#endif // CAPTUREWRITER_HPP
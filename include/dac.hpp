@@ -0,0 +1,91 @@
+#ifndef DAC_HPP
+#define DAC_HPP
+
+#include <cstdint>
+#include <atomic>
+#include "ringbuffer.hpp"
+#include "audiomixer.hpp"
+
+#define DAC_SAMPLE_RATE MIXER_SAMPLE_RATE // Output sample rate
+#define DAC_CPU_FREQUENCY 3500000         // T-states per second used for sample timing
+#define DAC_RING_SAMPLES 16384            // Ring size in int16 samples (8192 stereo frames)
+#define DAC_MAX_EVENTS 8192               // Writes buffered between renders (an OUT takes at least 11 T-states)
+#define DAC_RENDER_FRAMES 256             // Stereo frames rendered before they go to the ring
+#define DAC_CHANNELS 4                    // SounDrive: 0, 1 left, 2, 3 right
+#define DAC_ALL_CHANNELS 0xFF             // Event channel of Covox writes
+#define DAC_LEVEL_SCALE 32                // int16 step of one DAC step (two full channels stay below 1/4 scale)
+
+// DAC ports (low byte, Pentagon decoding)
+#define DAC_PORT_COVOX 0xFB      // Covox: one 8-bit DAC, heard on both sides
+#define DAC_PORT_SOUNDRIVE1 0x0F // SounDrive channel 1 (left)
+#define DAC_PORT_SOUNDRIVE2 0x1F // SounDrive channel 2 (left, Kempston is read only)
+#define DAC_PORT_SOUNDRIVE3 0x4F // SounDrive channel 3 (right)
+#define DAC_PORT_SOUNDRIVE4 0x5F // SounDrive channel 4 (right)
+
+// Write to a DAC, stamped with emulated time
+struct DacEvent
+{
+    uint64_t tstate; // When the write happened
+    uint8_t channel; // 0-3 or DAC_ALL_CHANNELS
+    uint8_t value;   // Unsigned sample, 128 is silence
+};
+
+// Covox and SounDrive 8-bit DACs. Sample playing loops write thousands of times per frame,
+// so a write only appends to a fixed event array. At frame end (or when the array is full)
+// events are turned into samples: levels are held between events, a sample with an event
+// inside gets the average of its levels (box filter), runs of constant level are SIMD fills.
+// Output ring is one of the mixer sources.
+class Dac
+{
+private:
+    // Emulation thread writes samples, mixer reads them on audio thread
+    RingBuffer<int16_t> ring;
+
+    DacEvent events[DAC_MAX_EVENTS]; // Writes not rendered yet, in time order
+    size_t eventCount;
+
+    uint8_t levels[DAC_CHANNELS]; // DAC values at render position
+    int32_t left, right;          // Output levels at render position
+    uint64_t position;            // Render position in 1/(DAC_CPU_FREQUENCY*DAC_SAMPLE_RATE) s units
+    int64_t accumulatedLeft;      // Level integrated over the part of the sample already passed
+    int64_t accumulatedRight;
+
+    alignas(16) int16_t block[DAC_RENDER_FRAMES * 2]; // Samples waiting for the ring
+    size_t blockFrames;
+
+    std::atomic<bool> enabled; // Set by UI thread, gates port writes
+
+    // Advance render position with current levels up to given T-state
+    void renderTo(uint64_t tstate);
+    // Append count frames of current level
+    void fill(size_t count);
+    // Append one frame
+    void put(int16_t l, int16_t r);
+    // Move rendered frames to the ring
+    void flushBlock();
+    // Render all buffered events
+    void renderEvents();
+
+public:
+    explicit Dac(size_t ringSamples = DAC_RING_SAMPLES);
+
+    // Emulated time of the running instruction, used to stamp writes
+    long long ticks;
+
+    // Port handler, called for every DAC port
+    void writePort(uint16_t port, uint8_t value);
+
+    // Back to silence
+    void reset();
+
+    // Emulation has reached given T-state: render everything before it
+    void setClock(uint64_t tstate);
+
+    void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Samples for the mixer
+    RingBuffer<int16_t> *getOutput() { return &ring; }
+};
+
+#endif // DAC_HPP
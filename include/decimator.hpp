@@ -0,0 +1,60 @@
+#ifndef DECIMATOR_HPP
+#define DECIMATOR_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#define DECIMATOR_PHASES 64 // Sub-sample positions of an output sample between two input samples
+#define DECIMATOR_TAPS 128  // Filter length in input samples (multiple of 4 for SIMD)
+
+// Lowpass kernel for every phase, cutoff a bit below output Nyquist
+struct DecimatorKernel
+{
+    alignas(16) float taps[DECIMATOR_PHASES][DECIMATOR_TAPS];
+};
+
+// Polyphase FIR sample rate converter for stereo int16 streams, made for
+// going down from a high synthesis rate to the output rate (any ratio).
+// Input position of every output sample is tracked in integers, so nothing drifts.
+// Usage: write(needed(n) input frames), then read(n output frames).
+class Decimator
+{
+private:
+    uint32_t inputRate;
+    uint32_t outputRate;
+
+    // Read-only and the same for every converter with these rates (all AY chips of all machines)
+    std::shared_ptr<const DecimatorKernel> kernel;
+
+    // Input history, one vector per channel so taps are contiguous for SIMD
+    std::vector<float> left;
+    std::vector<float> right;
+    uint64_t inputBase;   // Index of left[0] in the whole input stream
+    uint64_t inputCount;  // Input frames written so far
+    uint64_t outputCount; // Output frames read so far
+
+    static std::shared_ptr<const DecimatorKernel> kernelFor(uint32_t inputRate, uint32_t outputRate);
+    static void buildKernel(DecimatorKernel &kernel, uint32_t inputRate, uint32_t outputRate);
+
+    // First input frame used by given output frame
+    uint64_t firstInput(uint64_t output) const { return output * inputRate / outputRate; }
+
+public:
+    Decimator(uint32_t inputRate, uint32_t outputRate);
+
+    // Forget history, start from silence
+    void reset();
+
+    // Input frames still missing for reading given number of output frames
+    size_t needed(size_t frames) const;
+
+    // Append interleaved stereo input
+    void write(const int16_t *in, size_t frames);
+
+    // Produce interleaved stereo output. Enough input must be written before (see needed)
+    void read(int16_t *out, size_t frames);
+};
+
+#endif // DECIMATOR_HPP
@@ -0,0 +1,196 @@
+#ifndef MACHINE_HPP
+#define MACHINE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <functional>
+#include <span>
+#include <vector>
+#include "memory.hpp"
+#include "port.hpp"
+#include "z80.hpp"
+#include "ula.hpp"
+#include "kempston.hpp"
+#include "sound.hpp"
+#include "tape.hpp"
+#include "taperecorder.hpp"
+#include "turbosound.hpp"
+#include "dac.hpp"
+#include "audiomixer.hpp"
+#include "scheduler.hpp"
+
+#define MACHINE_SCREEN_WIDTH 352  // ULA output with border
+#define MACHINE_SCREEN_HEIGHT 288
+#define MACHINE_STATE_VERSION 1 // Bump when MachineState or any part of it changes
+#define MACHINE_QUIET_RING_SAMPLES 1024 // Sound ring size for hosts that never mix (batch jobs without wav=)
+
+// Whole emulated machine as one flat block of fixed size, small parts first and RAM last.
+// Rewind, run-ahead, quick save and forked batch jobs copy it at memcpy speed.
+// ROM images are kept as pointers, so a block is valid only in the process that saved it;
+// snapshot files are the portable format. Host input, settings and sound output are not part of it
+struct MachineState
+{
+    uint32_t version; // MACHINE_STATE_VERSION
+    uint32_t size;    // sizeof(MachineState)
+    long long totalTicks;
+    long long frames;
+    Z80State cpu;
+    ULAState ula;
+    SchedulerState scheduler;
+    TapeState tape;
+    TurboSoundState turboSound;
+    MemoryState memory;
+};
+
+// ZX Spectrum hardware wired together: CPU, memory, ports, ULA, tape, beeper, AY, DACs.
+// No window, no audio device and no real time here (libzxcore): the UI emulator and the
+// headless runner both drive a Machine, one instruction or one frame at a time
+class Machine
+{
+private:
+    std::unique_ptr<Memory> memory;             // RAM and ROM memory management
+    std::unique_ptr<Port> ports;                // Input/output port handling
+    std::unique_ptr<Z80> cpu;                   // Zilog Z80 CPU emulation
+    std::unique_ptr<ULA> ula;                   // Sinclair ULA (graphics and keyboard controller)
+    std::unique_ptr<Kempston> kempston;         // Kempston joystick interface
+    std::unique_ptr<Sound> sound;               // Beeper sound system
+    std::unique_ptr<Tape> tape;                 // Tape loading system
+    std::unique_ptr<TapeRecorder> tapeRecorder; // Blocks saved by running programs
+    std::unique_ptr<TurboSound> turboSound;     // AY-3-8912 sound chip, second one behind TurboSound selection
+    std::unique_ptr<Dac> dac;                   // Covox and SounDrive DACs
+    std::unique_ptr<AudioMixer> mixer;          // Mixes beeper, AY and DAC sources into one stream
+    Scheduler scheduler;                        // Timed hardware events, ULA and tape register theirs
+
+    long long totalTicks; // T-states executed since start()
+    long long frames;     // Frames finished since start()
+    bool frameDone;       // Set by endFrame() during step()
+
+    // Frames that will be thrown away: no sound, no MIC or SAVE recording, no frame handler,
+    // requests from other threads wait for a real frame
+    bool silent;
+    std::vector<uint8_t> runAheadState; // Machine at the real frame end while running ahead
+
+    // Extra frame end work of the host (screen to UI), called after sound is rendered
+    std::function<void(uint64_t)> frameHandler;
+
+    // Tape saving. Recorder is filled by emulation thread, the host writes it to file under the mutex
+    std::mutex recorderMutex;
+
+    // Seek requests from other threads, applied by step() (-1 = nothing requested)
+    std::atomic<int> pendingTapeBlock;
+    std::atomic<long long> pendingTapeTicks;
+    std::atomic<bool> pendingTapePlay;
+
+    // File open/save requests from other threads, applied by step()
+    std::mutex fileRequestMutex;
+    std::atomic<bool> fileRequested;
+    std::string pendingOpen;
+    std::string pendingSave;
+    std::string pendingTape;
+    int pendingOpenEntry; // Archive entries picked for the open and tape requests (-1: none)
+    int pendingTapeEntry;
+    void applyFileRequests();
+
+    // Frame end event of the ULA: interrupt and sound rendering
+    void endFrame(uint64_t tstate);
+
+    // Is the 48K BASIC ROM with SA-BYTES paged in now?
+    bool isSaBytes();
+    // Store block described by IX/DE/A and return from SA-BYTES as after successful save
+    void trapSaveBytes();
+
+public:
+    Machine();
+    ~Machine();
+
+    // Create and connect all chips. threadedSound = false renders AY on the emulation
+    // thread at frame end (offline runs, samples are ready when the frame is).
+    // ringSamples sizes the ring of every sound source; full rings drop what is rendered
+    bool initialize(bool threadedSound = true, size_t ringSamples = SOUND_RING_SAMPLES);
+
+    // Stop sound render threads
+    void cleanup();
+
+    // Load ROM and select the machine emulation starts with (128K ROM, CMOS Z80)
+    void prepare();
+
+    // Replace ROM with a file: 16K runs as 48K, 32K as 128K (ROM 0 and 1). Call after prepare()
+    bool loadRom(const std::string &filePath);
+
+    // Reset time to zero and start the first frame
+    void start();
+
+    // Begin a new frame now, keeping the time (after a snapshot replaced the whole machine)
+    void restartFrame();
+
+    // Execute one instruction with everything that goes with it (tape, ULA, sound clocks).
+    // Returns true when it finished a frame
+    bool step();
+
+    // Run until the end of the current frame
+    void runFrame();
+
+    // Run-ahead, at a frame end: run frames more with the current input, silent and with only
+    // the last one drawn, then restore the machine. Screen buffer keeps that future frame,
+    // so input shows up frames earlier. Real frames are not drawn after it, the screen would
+    // only be overwritten by the next run-ahead: call getUla()->setRendering(true) to stop
+    void runAhead(int frames);
+
+    // Machine state between two instructions. The buffer needs getStateSize() bytes, aligned as
+    // new[] aligns. loadState restores the time of the state as well; with keepClock the state
+    // continues from the machine's own time instead, so sound goes on without a gap (rewind, quick load)
+    static constexpr size_t getStateSize() { return sizeof(MachineState); }
+    bool saveState(std::span<uint8_t> buffer) const;
+    bool loadState(std::span<const uint8_t> buffer, bool keepClock = false);
+
+    // Tape. Seeks and play may be requested from any thread, they apply before the next instruction
+    bool loadTape(const std::string &filePath);
+    // Stop playback and prepare another tape in the background. From any thread: the player
+    // is reset on the emulation thread before the loader touches the tape containers
+    // Entry picks one tape of a zip, -1 the first one
+    void requestTape(const std::string &filePath, int entry = -1);
+    void playTape();
+    void requestPlayTape() { pendingTapePlay = true; }
+    void requestTapeBlock(int block) { pendingTapeBlock = block; }
+    void requestTapeTicks(long long ticks) { pendingTapeTicks = ticks; }
+
+    // Snapshots (.sna, .z80, .szx by extension)
+    bool loadSnapshot(const std::string &filePath);
+    bool saveSnapshot(const std::string &filePath);
+
+    // Snapshot or ROM file (.rom, .bin: machine restarts with it), for the File menu.
+    // Entry >= 0 loads that snapshot entry of a zip instead
+    bool openFile(const std::string &filePath, int entry = -1);
+
+    // Same from another thread: done before the next instruction
+    void requestOpen(const std::string &filePath, int entry = -1);
+    void requestSave(const std::string &filePath);
+
+    // Switched from the UI thread, read by the emulation thread
+    std::atomic<bool> saveTrap;  // Catch ROM SA-BYTES and store the block instantly
+    std::atomic<bool> recordMic; // Decode MIC output of programs with own save routines
+
+    void setFrameHandler(std::function<void(uint64_t)> handler) { frameHandler = std::move(handler); }
+
+    long long getTicks() const { return totalTicks; }
+    long long getFrames() const { return frames; }
+    uint32_t *getScreen() { return ula->getScreenBuffer(); }
+
+    Memory *getMemory() { return memory.get(); }
+    Port *getPorts() { return ports.get(); }
+    Z80 *getCpu() { return cpu.get(); }
+    ULA *getUla() { return ula.get(); }
+    Kempston *getKempston() { return kempston.get(); }
+    Sound *getSound() { return sound.get(); }
+    Tape *getTape() { return tape.get(); }
+    TapeRecorder *getTapeRecorder() { return tapeRecorder.get(); }
+    std::mutex &getRecorderMutex() { return recorderMutex; }
+    TurboSound *getTurboSound() { return turboSound.get(); }
+    Dac *getDac() { return dac.get(); }
+    AudioMixer *getMixer() { return mixer.get(); }
+};
+
+#endif // MACHINE_HPP
@@ -2,16 +2,46 @@
 #define MEMORY_HPP
 
 #include <cstdint>
+#include <memory>
+#include <functional>
+
+#define MEMORY_DIRTY_PAGE_SIZE 1024                          // RAM write tracking granularity
+#define MEMORY_DIRTY_PAGES (8 * 16384 / MEMORY_DIRTY_PAGE_SIZE) // 128 pages, bit N is RAM offset N * 1K
+#define MEMORY_DIRTY_WORDS (MEMORY_DIRTY_PAGES / 64)
+#define MEMORY_SCREEN_SIZE 0x1B00 // Bitmap and attributes at the start of the shown bank
+
+// RAM and paging as one flat block, RAM last (machine state save/restore).
+// ROM slots are pointers, with the limits that come with it (see MachineState)
+struct MemoryState
+{
+    const uint8_t *rom[3];
+    bool is48;
+    uint8_t bankMapping[4];
+    bool ULAShadow;
+    uint8_t isTrDos;
+    uint8_t bank[8][16384];
+};
 
 class Memory
 {
 private:
     uint8_t bank[8][16384]; // banks of memory
-    uint8_t rom[3][16384];  // banks of ROMs. 0 - zxspectrum 48 or 1st rom of 128. 1 - second rom of 128. 2 - trdos rom
+    const uint8_t *rom[3];  // banks of ROMs. 0 - zxspectrum 48 or 1st rom of 128. 1 - second rom of 128. 2 - trdos rom
+    std::unique_ptr<uint8_t[]> romCopy; // Private ROM pages, only when ROM area is writable
+    bool romWritable;       // Writes to 0000-3FFF go to romCopy
+    // ROM writes land at romWrite[offset & romWriteMask]: romCopy with a full mask when
+    // writable, otherwise romSink with mask 0, so WriteByte does not test romWritable
+    uint8_t *romWrite;
+    uint16_t romWriteMask;
+    uint8_t romSink;
     bool is48;              // machine version
     uint8_t bankMapping[4]; // Which bank mapped now
     bool ULAShadow;         // is ULA read from shadow rom?
     uint8_t isTrDos;           // is TR DOS rom enabled?
+    uint64_t dirty[MEMORY_DIRTY_WORDS]; // 1K RAM pages written since clearDirty()
+    std::function<void()> screenWriteHandler; // Shown screen is about to change
+
+    void markBankDirty(int number);
 
 public:
     // Constructor
@@ -37,7 +67,28 @@ public:
     void change48(bool is48s);
     void writePort(uint16_t port, uint8_t value); // handler for 7ffd
     bool getIs48() const { return is48; }         // Getter for is48 flag
-    bool canWriteRom;                             // Can we overwrite ROM, as in Baltika version? Its public, because test need it
+    uint8_t getPort7ffd() const;                  // Paging as last written to 7ffd (bank, shadow screen, ROM)
+    uint8_t *getBank(int number) // RAM bank for bulk copies (snapshots), counts as written
+    {
+        markBankDirty(number & 0x07);
+        return bank[number & 0x07];
+    }
+    // Page a ROM image into slot 0-2. Images are shared and read-only (RomRegistry), only pointer is kept
+    void setRom(int slot, const uint8_t *image);
+    // Make ROM area writable, as in Baltika version or for tests: ROMs are copied to private pages first
+    void setRomWritable(bool writable);
+    bool isRomWritable() const { return romWritable; }
+    // Whole RAM and paging at memcpy speed. Writable ROM pages are not part of it and stay as they are
+    void saveState(MemoryState &state) const;
+    void loadState(const MemoryState &state);
+    // RAM pages written since last clear, bit N = bytes N * MEMORY_DIRTY_PAGE_SIZE of banks 0-7 in a row.
+    // Every write through WriteByte, getBank and loadState marks its pages (rewind stores only those)
+    void getDirty(uint64_t pages[MEMORY_DIRTY_WORDS]) const;
+    void setDirty(const uint64_t pages[MEMORY_DIRTY_WORDS]);
+    void clearDirty();
+    // Called before a write to the bitmap or attributes of the shown bank and before the shown
+    // bank is switched, so the ULA draws the beam up to now with the old contents
+    void setScreenWriteHandler(std::function<void()> handler) { screenWriteHandler = std::move(handler); }
     void enableTrDos(bool is);                    // enable trdos rom or not
     bool checkTrDos(void);
 };
@@ -0,0 +1,60 @@
+#ifndef PACER_HPP
+#define PACER_HPP
+
+#include <cstdint>
+#include <atomic>
+#include "audiomixer.hpp"
+
+#define PACER_MAX_LAG_NS 100000000LL  // Behind schedule more than this (100 ms): restart timing instead of catching up
+#define PACER_AUDIO_FRAMES MIXER_PREFILL_FRAMES // Audio mode: emulate next frame when less than this is queued
+#define PACER_AUDIO_TIMEOUT_MS 40 // Audio mode: audio thread silent this long means no device, use timer
+
+// How emulation speed is kept at real time
+enum class PacingMode
+{
+    Timer, // Sleep until the frame is due on monotonic clock (absolute deadlines, no drift)
+    Audio, // Sleep until the sound device has taken enough samples: audio clock drives emulation
+};
+
+// Keeps emulation at real speed one frame at a time. Emulation thread calls waitFrame()
+// after every frame and sleeps there; nothing spins, so an idle machine costs almost no host CPU.
+class Pacer
+{
+private:
+    std::atomic<PacingMode> mode; // Set by UI thread
+    std::atomic<int> frequency;   // Emulated T-states per second
+    int activeFrequency;          // Frequency timing was started with
+    AudioMixer *mixer;            // Audio clock source (nullptr = timer only)
+
+    int64_t startTime;  // Monotonic time of timing start, ns
+    long long baseTicks; // T-state at timing start
+
+    // Sleep until absolute monotonic time in ns
+    static void sleepUntil(int64_t time);
+
+    // Wait for frame end on the timer
+    void waitTimer(long long ticks);
+
+public:
+    Pacer();
+
+    // Monotonic clock in ns
+    static int64_t now();
+
+    // Audio mode needs the mixer. Without it (no sound device) timer is always used
+    void setMixer(AudioMixer *audioMixer) { mixer = audioMixer; }
+
+    void setMode(PacingMode newMode) { mode.store(newMode, std::memory_order_relaxed); }
+    PacingMode getMode() const { return mode.load(std::memory_order_relaxed); }
+
+    // Emulated CPU frequency (48K and 128K differ)
+    void setFrequency(int hz) { frequency.store(hz, std::memory_order_relaxed); }
+
+    // Count time from now, ticks is the current T-state (after pause, turbo, reset)
+    void restart(long long ticks);
+
+    // Frame ending at T-state ticks was emulated: sleep until it is time for the next one
+    void waitFrame(long long ticks);
+};
+
+#endif // PACER_HPP
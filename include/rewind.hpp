@@ -0,0 +1,78 @@
+#ifndef REWIND_HPP
+#define REWIND_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "memory.hpp"
+
+class Machine;
+
+#define REWIND_FRAMES (60 * 50)             // History length: 60 seconds, one state per frame
+#define REWIND_KEYFRAME_INTERVAL 50         // Whole RAM once a second, written pages in between
+#define REWIND_MAX_BYTES (64 * 1024 * 1024) // Oldest seconds are dropped above this
+#define REWIND_MAX_PENDING 50               // Frames waiting for the worker before captures are skipped
+
+// Hold-to-rewind history. Every frame keeps the small part of MachineState and only the
+// 1K RAM pages written since the frame before (Memory dirty bitmap); every
+// REWIND_KEYFRAME_INTERVAL frames all RAM is kept. The emulation thread only copies pages,
+// a worker thread deflates them. A state is rebuilt from its keyframe and the deltas after it.
+// capture() and stepBack() are called by the emulation thread
+class Rewind
+{
+private:
+    struct Entry
+    {
+        bool keyframe;
+        uint64_t pages[MEMORY_DIRTY_WORDS]; // RAM pages in data, in page order
+        std::vector<uint8_t> head;          // MachineState up to the RAM
+        std::vector<uint8_t> data;          // Pages, deflated by the worker
+        size_t rawSize;                     // Size of pages before deflate
+    };
+
+    std::deque<Entry> history; // Oldest first, all deflated
+    std::deque<Entry> pending; // Captured, waiting for the worker
+    size_t historyBytes;       // Memory used by history
+    int keyframes;             // Keyframes in history
+    bool busy;                 // Worker has an entry out of pending
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable wake; // Work for the worker
+    std::condition_variable idle; // Worker has nothing left
+    std::thread worker;
+
+    // Emulation thread only
+    std::vector<uint8_t> state; // Whole MachineState, RAM rebuilt here on restore
+    std::vector<uint8_t> pages; // Inflated pages of one entry
+    int sinceKeyframe;          // Frames captured after the last keyframe
+
+    void work();
+    // Drop whole keyframe groups from the front while over any limit (mutex held)
+    void trim();
+    // Put state of the last history entry into the machine (mutex held)
+    bool restoreLast(Machine &machine);
+
+public:
+    Rewind();
+    ~Rewind();
+
+    // Frame has ended: store it
+    void capture(Machine &machine);
+
+    // Go one frame back: newest frame is dropped and the one before it restored.
+    // False when there is nothing older
+    bool stepBack(Machine &machine);
+
+    // Forget everything (other machine, other program)
+    void clear();
+
+    // Frames that can be stepped back and memory they take (any thread)
+    size_t getFrames();
+    size_t getBytes();
+};
+
+#endif // REWIND_HPP
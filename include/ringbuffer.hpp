@@ -0,0 +1,90 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// Storage is allocated once in the constructor and left uninitialized, so pages the producer
+// never reaches are not committed. Read and write only copy elements.
+// Positions grow forever and are masked on access, so capacity is a power of two.
+template <typename T>
+class RingBuffer
+{
+private:
+    std::unique_ptr<T[]> buffer;
+    size_t size;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; // Next position to write (changed by producer only)
+    alignas(64) std::atomic<size_t> tail; // Next position to read (changed by consumer only)
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit RingBuffer(size_t capacity) : head(0), tail(0)
+    {
+        size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        buffer.reset(new T[size]);
+        mask = size - 1;
+    }
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    size_t capacity() const { return size; }
+
+    // Elements ready to be read
+    size_t available() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Room left for writing
+    size_t space() const { return capacity() - available(); }
+
+    // Producer: append up to count elements. Returns how many were written
+    size_t write(const T *data, size_t count)
+    {
+        size_t writePos = head.load(std::memory_order_relaxed);
+        size_t readPos = tail.load(std::memory_order_acquire);
+        count = std::min(count, capacity() - (writePos - readPos));
+
+        // Copy in up to two parts: till the end of storage and from its beginning
+        size_t offset = writePos & mask;
+        size_t first = std::min(count, capacity() - offset);
+        std::copy(data, data + first, buffer.get() + offset);
+        std::copy(data + first, data + count, buffer.get());
+
+        head.store(writePos + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: take up to count elements. Returns how many were read
+    size_t read(T *data, size_t count)
+    {
+        size_t readPos = tail.load(std::memory_order_relaxed);
+        size_t writePos = head.load(std::memory_order_acquire);
+        count = std::min(count, writePos - readPos);
+
+        size_t offset = readPos & mask;
+        size_t first = std::min(count, capacity() - offset);
+        std::copy(buffer.get() + offset, buffer.get() + offset + first, data);
+        std::copy(buffer.get(), buffer.get() + (count - first), data + first);
+
+        tail.store(readPos + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: drop everything that is not read yet
+    void clear()
+    {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};
+
+#endif // RINGBUFFER_HPP
@@ -0,0 +1,38 @@
+#ifndef ROMREGISTRY_HPP
+#define ROMREGISTRY_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#define ROM_PAGE_SIZE 16384 // One ROM page as paged in at 0000-3FFF
+
+// Built in ROM images
+enum RomImage
+{
+    ROM_48,        // ZX Spectrum 48K BASIC
+    ROM_128_0,     // 128K editor and menu
+    ROM_128_1,     // 128K BASIC (48K ROM with 128K changes)
+    ROM_TRDOS_504, // Beta Disk TR-DOS 5.04T
+    ROM_TRDOS_604, // Beta Disk TR-DOS 6.04
+    ROM_DIAG,      // Diagnostic ROM
+    ROM_DIAG2,     // DiagROM v1.73
+    ROM_IMAGE_COUNT
+};
+
+// ROM images shared by every Memory of the process. Built in ROMs are copied once into
+// page aligned memory that is then made read-only, ROM files are mapped read-only from
+// disk. Memory only keeps pointers: a machine costs no ROM memory and no ROM copying,
+// and a stray write faults instead of changing the ROM of all machines
+class RomRegistry
+{
+public:
+    // Built in image, ROM_PAGE_SIZE bytes
+    static const uint8_t *get(RomImage image);
+
+    // ROM file mapped read-only, size is a multiple of ROM_PAGE_SIZE (up to 4 pages).
+    // Mapping stays until the process ends, mapping the same path again returns it. nullptr on error
+    static const uint8_t *mapFile(const std::string &filePath, size_t &size);
+};
+
+#endif // ROMREGISTRY_HPP
@@ -0,0 +1,80 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <functional>
+
+#define SCHEDULER_MAX_EVENTS 16 // Event slots devices can register
+#define SCHEDULER_NEVER UINT64_MAX
+
+// Called when the event is due, with the T-state it was scheduled for
+typedef std::function<void(uint64_t tstate)> EventHandler;
+
+// Pending deadlines in heap order (machine state save/restore). Handlers are not part of it
+struct SchedulerState
+{
+    uint64_t when[SCHEDULER_MAX_EVENTS];
+    int id[SCHEDULER_MAX_EVENTS];
+    int size;
+};
+
+// Timed hardware events keyed by absolute T-state (frame end, beam lines, tape edges).
+// Devices register a handler once and schedule its next deadline; the emulation loop
+// runs the CPU until the earliest deadline and calls run(), nothing polls per T-state.
+// Min-heap of at most SCHEDULER_MAX_EVENTS entries, one per event, no allocation after add().
+class Scheduler
+{
+private:
+    struct Entry
+    {
+        uint64_t when; // Absolute T-state
+        int id;        // Event handler
+    };
+
+    EventHandler handlers[SCHEDULER_MAX_EVENTS];
+    int handlerCount;
+
+    Entry heap[SCHEDULER_MAX_EVENTS];        // heap[0] is the earliest
+    int heapSize;
+    int positions[SCHEDULER_MAX_EVENTS];     // Heap index of every event, -1 when not scheduled
+    uint64_t nextDeadline;                   // heap[0].when or SCHEDULER_NEVER
+
+    void place(int index, const Entry &entry);
+    void siftUp(int index);
+    void siftDown(int index);
+    void remove(int index);
+    void fireDue(uint64_t now);
+
+public:
+    Scheduler();
+
+    // Register event, returns its id (-1 when all slots are taken)
+    int add(EventHandler handler);
+
+    // Set deadline of event, replaces the one it had
+    void schedule(int id, uint64_t when);
+    void cancel(int id);
+    bool isScheduled(int id) const { return id >= 0 && positions[id] >= 0; }
+
+    // Drop all deadlines (machine restarts its time), handlers stay registered
+    void clear();
+
+    // Deadlines to and from a flat block. Heap is kept as it is, so events due at the
+    // same T-state fire in the same order after a restore. shift moves every deadline
+    void saveState(SchedulerState &state) const;
+    void loadState(const SchedulerState &state, int64_t shift = 0);
+
+    // Earliest deadline, SCHEDULER_NEVER when nothing is scheduled
+    uint64_t next() const { return nextDeadline; }
+
+    // Fire every event due at or before now, earliest first. Handlers may schedule again
+    void run(uint64_t now)
+    {
+        if (now >= nextDeadline)
+        {
+            fireDue(now);
+        }
+    }
+};
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Machine;
+class Archive;
+
+#define SNAPSHOT_BANK_SIZE 16384
+
+enum class SnapshotFormat
+{
+    Unknown,
+    Sna, // 48K: 27 byte header + RAM, PC on stack. 128K: PC, 7FFD and the other banks follow
+    Z80, // v1 (48K) to v3, pages RLE compressed
+    Szx, // ZX-State blocks, pages zlib compressed
+};
+
+// Machine state as snapshot files keep it
+struct SnapshotData
+{
+    uint16_t AF, BC, DE, HL;
+    uint16_t AF_, BC_, DE_, HL_;
+    uint16_t IX, IY, SP, PC, MEMPTR;
+    uint8_t I, R, IM;
+    bool IFF1, IFF2;
+
+    bool is128;       // 128K paging, otherwise 48K with banks 5, 2, 0 at 4000, 8000, C000
+    uint8_t port7ffd; // Last write to 7FFD (128K)
+    uint8_t border;
+
+    bool hasAy;
+    uint8_t aySelected;
+    uint8_t ayRegisters[16];
+
+    uint8_t banks[8][SNAPSHOT_BANK_SIZE];
+};
+
+// Snapshot files: load into a Machine and save from it.
+// Files are read whole, decoded into SnapshotData and only then copied into the
+// machine bank by bank, so a broken file leaves the machine as it was
+class Snapshot
+{
+private:
+    static bool decodeSna(const std::vector<uint8_t> &file, SnapshotData &data);
+    static bool decodeZ80(const std::vector<uint8_t> &file, SnapshotData &data);
+    static bool decodeSzx(const std::vector<uint8_t> &file, SnapshotData &data);
+    static void encodeSna(const SnapshotData &data, std::vector<uint8_t> &file);
+    static void encodeZ80(const SnapshotData &data, std::vector<uint8_t> &file);
+    static bool encodeSzx(const SnapshotData &data, std::vector<uint8_t> &file);
+
+public:
+    // Format by file extension
+    static SnapshotFormat formatOf(const std::string &filePath);
+    static bool isSnapshotFile(const std::string &filePath) { return formatOf(filePath) != SnapshotFormat::Unknown; }
+
+    static bool load(Machine &machine, const std::string &filePath);
+    // Snapshot entry of an opened archive (.sna, .z80 or .szx inside a zip)
+    static bool load(Machine &machine, Archive &archive, size_t index);
+    static bool save(Machine &machine, const std::string &filePath);
+
+    // Machine <-> SnapshotData
+    static void capture(Machine &machine, SnapshotData &data);
+    static void apply(const SnapshotData &data, Machine &machine);
+
+    static bool decode(const std::vector<uint8_t> &file, SnapshotFormat format, SnapshotData &data);
+    static bool encode(const SnapshotData &data, SnapshotFormat format, std::vector<uint8_t> &file);
+
+    // .z80 RLE: "ED ED count byte" for runs of 5+ equal bytes and for any run of EDs.
+    // unpack stops when out is full; false when input ends first or a run overflows
+    static bool unpackZ80(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize);
+    static void packZ80(const uint8_t *in, size_t size, std::vector<uint8_t> &out);
+};
+
+#endif // SNAPSHOT_HPP
@@ -1,28 +1,77 @@
 #ifndef SOUND_HPP
 #define SOUND_HPP
 
-#include <SDL3/SDL.h>
+#include <cstdint>
 #include <memory>
 #include <atomic>
+#include <vector>
+#include "ringbuffer.hpp"
+#include "audiomixer.hpp"
 
+#define SOUND_SAMPLE_RATE MIXER_SAMPLE_RATE // Output sample rate
+#define SOUND_CPU_FREQUENCY 3500000         // T-states per second used for sample timing
+#define SOUND_RING_SAMPLES 16384            // Ring size in int16 samples (8192 stereo frames, ~186 ms)
+
+// Band-limited step synthesis
+#define BLEP_PHASES 64 // Sub-sample positions of an edge
+#define BLEP_TAPS 16   // Kernel length in samples (multiple of 4 for SIMD)
+
+// How beeper level changes are turned into samples
+enum class BeeperMode
+{
+    Square, // Level held for whole samples (cheap, aliases)
+    Blep,   // Every edge placed as a band-limited step at its exact sub-sample position
+};
+
+// Beeper. Renders EAR level changes into its ring buffer, which is one of the mixer sources
 class Sound
 {
 private:
-    SDL_AudioStream *audioStream;
-    SDL_AudioDeviceID audioDevice;
     bool initialized;
     long long ticksPassed;
     bool lastMicBit;
     bool lastEarBit;
 
+    // Emulation thread writes samples, mixer reads them on audio thread
+    RingBuffer<int16_t> ring; // Interleaved stereo samples
+    uint64_t samplePhase;     // Part of the next sample already passed, in 1/SOUND_CPU_FREQUENCY units
+
+    // Band-limited step synthesis state
+    std::atomic<BeeperMode> beeperMode; // Requested mode (set by UI thread)
+    BeeperMode activeMode;              // Mode used by emulation thread now
+    alignas(16) float blepKernel[BLEP_PHASES][BLEP_TAPS]; // Band-limited impulse for every sub-sample phase
+    alignas(16) float blepDelta[BLEP_TAPS];               // Pending level changes, [0] is sample blepStart
+    uint64_t blepStart;                                   // Absolute number of the first pending sample
+    float blepLevel;                                      // Integrated level before blepStart
+    float highPassIn;                                     // DC blocker input history
+    float highPassOut;                                    // DC blocker output history
+
+    // Precompute windowed-sinc kernel table
+    void buildBlepKernel();
+    // Add band-limited step of given size at absolute T-state
+    void blepEdge(long long tstate, float delta);
+    // Integrate and output all samples before absolute sample number
+    void blepFlush(uint64_t sample);
+
 public:
-    Sound();
+    explicit Sound(size_t ringSamples = SOUND_RING_SAMPLES);
     ~Sound();
 
     bool initialize();
     void cleanup();
     void writePort(uint16_t port, uint8_t value);
     void generateAudio(long long ticks, bool value);
+
+    // Samples for the mixer
+    RingBuffer<int16_t> *getOutput() { return &ring; }
+
+    // Emulation has reached given T-state: render the level held since last change,
+    // so the mixer gets a steady stream even when the speaker is not toggled
+    void setClock(long long tstate);
+
+    // Beeper synthesis mode. Safe to call from UI thread
+    void setBeeperMode(BeeperMode mode) { beeperMode.store(mode, std::memory_order_relaxed); }
+    BeeperMode getBeeperMode() const { return beeperMode.load(std::memory_order_relaxed); }
     long long ticks;
 };
 
@@ -1,25 +1,31 @@
 #ifndef TAPE_HPP
 #define TAPE_HPP
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
+#include "archive.hpp"
 
 // Structure to represent a TAP block
 struct TapBlock
 {
-    uint16_t length;           // Length of the block (including flag and checksum)
-    uint8_t flag;              // Flag byte (0x00 for headers, 0xFF for data blocks)
-    std::vector<uint8_t> data; // Data bytes (without length, flag, and checksum)
-    uint8_t checksum;          // Checksum byte
-    bool isValid;              // Whether the checksum is valid
+    uint16_t length = 0;            // Length of the block (including flag and checksum)
+    uint8_t flag = 0;               // Flag byte (0x00 for headers, 0xFF for data blocks)
+    std::span<const uint8_t> data;  // View of block bytes (flag, data and checksum) inside the tape image
+    uint8_t checksum = 0;           // Checksum byte
+    bool isValid = false;           // Whether the checksum is valid
 
     // Header-specific fields (only valid for header blocks)
-    uint8_t fileType;     // Type of file (0=Program, 1=Number array, 2=Character array, 3=Bytes)
-    std::string filename; // Filename (10 characters, padded with spaces)
-    uint16_t dataLength;  // Length of the data block
-    uint16_t param1;      // Parameter 1 (depends on file type)
-    uint16_t param2;      // Parameter 2 (depends on file type)
+    uint8_t fileType = 0;     // Type of file (0=Program, 1=Number array, 2=Character array, 3=Bytes)
+    std::string filename;     // Filename (10 characters, padded with spaces)
+    uint16_t dataLength = 0;  // Length of the data block
+    uint16_t param1 = 0;      // Parameter 1 (depends on file type)
+    uint16_t param2 = 0;      // Parameter 2 (depends on file type)
 };
 
 // Structure to represent a bit stream impulse
@@ -29,21 +35,103 @@ struct TapeImpulse
     bool value;     // Signal value (true/false)
 };
 
+// Where a block starts inside the bit stream
+struct TapeBlockStart
+{
+    size_t impulseIndex; // First impulse of the block (start of pilot tone)
+    uint64_t ticks;      // T-states from the beginning of the tape
+};
+
+// Blocks of a prepared tape as other threads (tape browser) see them. Never changed once
+// published and holds the image its blocks point into, so a copy stays valid whatever
+// the loader does next
+struct TapeBlockList
+{
+    std::shared_ptr<const ImageData> image;
+    std::vector<TapBlock> blocks;
+    std::vector<uint64_t> blockTicks; // Start of every block in T-states from the tape start
+    uint64_t length = 0;              // Whole tape in T-states
+};
+
+// Playback cursor (machine state save/restore). Tape image itself is not part of it
+struct TapeState
+{
+    uint64_t impulseIndex;
+    uint32_t impulseTicks;
+    bool played;
+};
+
+// State of background tape loading
+enum class TapeLoadState
+{
+    Idle,    // Nothing is being loaded
+    Loading, // Worker thread parses the file and generates impulses
+    Ready,   // Whole tape is prepared
+    Failed,  // File could not be loaded
+};
+
+// Running tick total is stored every TAPE_CHECKPOINT_STEP impulses for seeking by time
+#define TAPE_CHECKPOINT_STEP 256
+// Tape waiting for the background loader is checked again after this many T-states
+#define TAPE_WAIT_TICKS 3500
+
 class Tape
 {
 private:
-    std::vector<uint8_t> tapeData;
+    std::shared_ptr<const ImageData> tapeImage; // Mapped or decompressed tape file. Blocks point into it
     std::vector<TapBlock> tapBlocks;    // Store parsed TAP blocks
     std::vector<TapeImpulse> bitStream; // Store generated bit stream
     size_t currentImpulseIndex;         // Index of current impulse in bit stream
     uint32_t currentImpulseTicks;       // Ticks elapsed in current impulse
 
+    // Tape index, built together with the bit stream
+    std::vector<TapeBlockStart> blockStarts; // Start of every block
+    std::vector<uint64_t> checkpoints;       // Ticks before impulse N * TAPE_CHECKPOINT_STEP
+    uint64_t totalTicks;                     // Length of the whole tape in ticks
+
+    // Rebuild tick checkpoints for a bit stream set as a whole (test streams)
+    void buildCheckpoints();
+
+    // Background loading. bitStream, blockStarts and checkpoints are reserved to their
+    // final size before generation starts, so the worker only appends and never moves
+    // elements already published through readyImpulses/readyBlocks
+    std::thread loaderThread;
+    std::atomic<TapeLoadState> loadState;
+    std::atomic<bool> cancelLoad;       // Ask worker to stop
+    std::atomic<size_t> readyImpulses;  // Impulses that can be played
+    std::atomic<size_t> readyBlocks;    // Blocks with all impulses generated
+    std::atomic<size_t> parsedBlocks;   // Blocks found in the file (0 while parsing)
+    std::atomic<uint64_t> imageHash;    // FNV-1a of the tape image, set by the loader (0 until then)
+    std::atomic<uint32_t> loadCount;    // Background loads started so far
+
+    mutable std::mutex blockListMutex;
+    std::shared_ptr<const TapeBlockList> blockList; // Published when the whole bit stream is ready
+
+    // Hand a copy of the blocks to other threads once their impulses are complete
+    void publishBlockList();
+
+    // Cursor as of the last publishCursor(), for threads other than the playing one
+    std::atomic<uint64_t> shownPosition;
+    std::atomic<size_t> shownBlock;
+
+    // Worker thread body
+    void loadWorker(std::string fileName, int entry);
+
+    // Generate impulses of one block and extend the tape index
+    void appendBlockImpulses(const TapBlock &block);
+
+    // Add one impulse, keeping tick checkpoints and tape length up to date
+    void pushImpulse(uint32_t ticks, bool value);
+
     // Helper function to validate checksum
-    bool validateChecksum(const std::vector<uint8_t> &blockData);
+    bool validateChecksum(std::span<const uint8_t> blockData);
 
     // Helper function to parse header information
     void parseHeaderInfo(TapBlock &block);
 
+    // Build a block viewing payload (flag + data + checksum) and add it to tapBlocks
+    void addBlock(std::span<const uint8_t> payload);
+
     uint tapePilotLenHeader; // How many impulses in pilot tone for header
     uint tapePilotLenData;   // and for data
     uint tapePilot;          // Lenght in ticks how many ticks in one impulse
@@ -64,47 +152,78 @@ public:
     // Reset tape state
     void reset();
 
-    // Load tape file
-    bool loadFile(const std::string &fileName);
+    // Load tape file (.tap, .tzx or a tape inside .zip: given entry, or the first one for -1)
+    bool loadFile(const std::string &fileName, int entry = -1);
+
+    // Load and prepare tape file on a worker thread. Returns immediately
+    // Blocks become playable as soon as their impulses are generated.
+    // Resets the playback cursor: call it on the thread that plays the tape (Machine::requestTape)
+    void loadFileAsync(const std::string &fileName, int entry = -1);
+
+    // Stop the background loader (if any) and wait for it, leaving the state idle.
+    // Call before loadFile on a tape that may be loading in the background
+    void stopLoading();
+
+    // Background loading state and progress (0.0 - 1.0), safe to call from any thread
+    TapeLoadState getLoadState() const { return loadState.load(std::memory_order_acquire); }
+    float getLoadProgress() const;
+
+    // Hash of the loaded .tap/.tzx bytes (also when inside a zip), computed while loading so
+    // nobody reads the file again for it (tape cache key). Valid once loadFile returned or
+    // the load state is Ready, 0 before
+    uint64_t getImageHash() const { return imageHash.load(std::memory_order_acquire); }
+
+    // Background loads started so far. A load requested after reading n has finished once
+    // this differs from n and the load state is Ready or Failed
+    uint32_t getLoadCount() const { return loadCount.load(std::memory_order_acquire); }
+
+    // Load given tape entry of an already opened archive
+    bool loadEntry(Archive &archive, size_t index);
 
     // Load virtual tape data directly
-    void loadVirtualTape(const std::vector<uint8_t> &data);
+    void loadVirtualTape(std::span<const uint8_t> data);
 
     // Parse TAP file format
-    void parseTap(const std::vector<uint8_t> &data);
+    // Blocks keep views into data, so it must live as long as blocks (normally it is tapeImage)
+    void parseTap(std::span<const uint8_t> data);
 
     // Parse TZX file format
-    void parseTzx(const std::vector<uint8_t> &data);
+    void parseTzx(std::span<const uint8_t> data);
 
     // TZX block parsers
-    size_t parseTzxStandardSpeedBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxTurboSpeedBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxPureToneBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxPulseSequenceBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxPureDataBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxDirectRecordingBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxPauseBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxGroupStartBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxGroupEndBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxJumpBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxLoopStartBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxLoopEndBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxCallSequenceBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxReturnSequenceBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxSelectBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxStop48KBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxSetLevelBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxTextDescriptionBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxMessageBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxArchiveInfoBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxHardwareTypeBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxCustomInfoBlock(const std::vector<uint8_t> &data, size_t pos);
-    size_t parseTzxGlueBlock(const std::vector<uint8_t> &data, size_t pos);
+    size_t parseTzxStandardSpeedBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxTurboSpeedBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxPureToneBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxPulseSequenceBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxPureDataBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxDirectRecordingBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxPauseBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxGroupStartBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxGroupEndBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxJumpBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxLoopStartBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxLoopEndBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxCallSequenceBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxReturnSequenceBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxSelectBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxStop48KBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxSetLevelBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxTextDescriptionBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxMessageBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxArchiveInfoBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxHardwareTypeBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxCustomInfoBlock(std::span<const uint8_t> data, size_t pos);
+    size_t parseTzxGlueBlock(std::span<const uint8_t> data, size_t pos);
 
     // Prepare bit stream from parsed blocks
     void prepareBitStream();
 
-    // Get number of parsed blocks
+    // Blocks of the last completely prepared tape, nullptr before and while loading.
+    // The only block access for threads other than the playing one
+    std::shared_ptr<const TapeBlockList> getBlockList() const;
+
+    // Get number of parsed blocks (only blocks ready for playback while loading).
+    // Block access below is for the thread that plays the tape
     size_t getBlockCount() const;
 
     // Get a specific block
@@ -116,9 +235,44 @@ public:
     // For testing purposes: set up a test bit stream
     void setTestBitStream(const std::vector<TapeImpulse> &testStream);
 
+    // Seeking is available only when no background loading is running
+    // Move playback to the start of block n (pilot tone). O(1)
+    bool seekToBlock(size_t n);
+
+    // Move playback to given T-state offset from the tape start. O(log n)
+    bool seekToTime(uint64_t ticks);
+
+    // Current playback position in T-states from the tape start. Playing thread only
+    uint64_t getPosition() const;
+
+    // Total tape length in T-states (0 while loading)
+    uint64_t getLength() const;
+
+    // Block being played now (or the last one started before the position). Playing thread only
+    size_t getCurrentBlock() const;
+
+    // Playing thread copies position and block for other threads (Machine does it at frame end),
+    // which read them with getShownPosition/getShownBlock. Seeks show up at the next publish
+    void publishCursor();
+    uint64_t getShownPosition() const { return shownPosition.load(std::memory_order_relaxed); }
+    size_t getShownBlock() const { return shownBlock.load(std::memory_order_relaxed); }
+
+    // Position of block start in T-states
+    uint64_t getBlockTicks(size_t n) const;
+
+    // Cursor and motor to and from a flat block. A cursor past the prepared impulses stops the tape
+    void saveCursor(TapeState &state) const;
+    void restoreCursor(const TapeState &state);
+
     bool isTapePlayed;
     bool isTapeTurbo; // Turboload mode flag
     bool getNextBit();
+
+    // Play ticks T-states at once (same as ticks calls of getNextBit), returns the level after them
+    bool advance(uint32_t ticks);
+
+    // T-states until advance() can return a new level, 0 when tape is stopped
+    uint32_t ticksToEdge() const;
 };
 
 #endif // TAPE_HPP
@@ -0,0 +1,55 @@
+#ifndef TAPECACHE_HPP
+#define TAPECACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+
+class Machine;
+
+#define TAPE_CACHE_SETTLE_FRAMES 50 // Frames out of the loader after the tape stopped before storing
+#define TAPE_CACHE_LOADER_START 0x0556 // ROM LD-BYTES
+#define TAPE_CACHE_LOADER_END 0x0605   // End of LD-8-BITS, the edge loop included
+
+// Machines stored right after a tape has loaded, so the next open of the same tape can
+// resume at once instead of loading again. Entries are .szx files named by a hash of the
+// tape image (Tape::getImageHash) and the machine model, in a directory of their own.
+// watch() arms storing for the tape just opened; update() is called by the emulation thread
+// at every frame end and stores the machine when the tape has played to its last block, has
+// stopped and the program has run outside the ROM loader for TAPE_CACHE_SETTLE_FRAMES frames
+class TapeCache
+{
+private:
+    std::string directory;
+
+    std::mutex mutex; // Watch state, set by the UI thread and used by the emulation thread
+    bool watching;
+    uint64_t watchedKey;
+    bool watchedIs48;
+    bool tapeStarted; // Tape has been played since watch()
+    int settled;      // Frames in a row the load looked finished
+
+public:
+    // Directory is created when missing
+    explicit TapeCache(const std::string &directory);
+
+    // Key of a loaded tape image for a machine model. The image hash comes from the tape loader,
+    // so finding the key does not read the file again
+    static uint64_t keyOf(uint64_t imageHash, bool is48);
+
+    std::string pathOf(uint64_t key) const;
+    bool has(uint64_t key) const;
+
+    // Machine now <-> cache entry
+    bool store(Machine &machine, uint64_t key);
+    bool restore(Machine &machine, uint64_t key);
+
+    // Store the machine once loading of the tape with key has finished. cancel() forgets it
+    void watch(uint64_t key, bool is48);
+    void cancel();
+
+    // Frame end on the emulation thread. True when the machine has just been stored
+    bool update(Machine &machine);
+};
+
+#endif // TAPECACHE_HPP
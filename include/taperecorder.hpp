@@ -0,0 +1,80 @@
+#ifndef TAPERECORDER_HPP
+#define TAPERECORDER_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Address of SA-BYTES routine in the 48K ROM. Called with IX = start, DE = length, A = flag
+#define ROM_SA_BYTES 0x04C2
+// SA/LD-RET: restores border, checks BREAK and returns to the SA-BYTES caller
+#define ROM_SA_LD_RET 0x053F
+
+// Ticks without MIC edge treated as the end of a block (pilot pulse is 2168)
+#define RECORDER_GAP_TICKS 10000
+// Minimal pilot length (in half pulses) before sync is accepted
+#define RECORDER_MIN_PILOT 256
+
+// Collects saved blocks in TAP format (flag + data + checksum each)
+// Blocks come either directly from the SAVE trap or from decoding MIC edges
+class TapeRecorder
+{
+private:
+    std::vector<std::vector<uint8_t>> blocks; // Recorded blocks
+
+    // MIC pulse decoder state
+    enum class DecoderState
+    {
+        Pilot, // Counting pilot pulses
+        Sync,  // First sync pulse seen, waiting for second one
+        Data,  // Collecting bits
+    };
+    DecoderState state;
+    bool micLevel;           // Last MIC level written to port
+    bool haveEdge;           // lastEdge holds a real edge
+    uint64_t lastEdge;       // T-state of last MIC edge
+    uint32_t pilotCount;     // Pilot half pulses in a row
+    uint64_t pilotSum;       // Sum of their lengths, for average
+    uint32_t bitThreshold;   // Pair of halves longer than this is bit 1
+    uint32_t firstHalf;      // First half of the current bit
+    bool haveHalf;           // firstHalf is valid
+    uint8_t currentByte;     // Bits collected so far (MSB first)
+    int bitCount;            // How many bits in currentByte
+    std::vector<uint8_t> current; // Bytes of the block being decoded
+
+    // Feed one half pulse (time between two MIC edges) to the decoder
+    void halfPulse(uint32_t ticks);
+
+    // Start looking for the next pilot tone
+    void restartPilot();
+
+public:
+    TapeRecorder();
+
+    // Forget all recorded blocks and decoder state
+    void clear();
+
+    // Add block from SAVE trap. Checksum is calculated here
+    void addBlock(uint8_t flag, std::span<const uint8_t> data);
+
+    // Called on every write to port 0xFE. Only MIC (bit 3) changes are used
+    void micWrite(uint64_t tstate, uint8_t value);
+
+    // Called on every MIC level change
+    void micEdge(uint64_t tstate);
+
+    // Finish block being decoded (end of saving). Incomplete last byte is dropped
+    void flush();
+
+    size_t getBlockCount() const { return blocks.size(); }
+    const std::vector<uint8_t> &getBlock(size_t index) const { return blocks[index]; }
+
+    // Write recorded blocks as .tap (length-prefixed blocks)
+    bool saveTap(const std::string &fileName) const;
+
+    // Write recorded blocks as .tzx (standard speed data blocks, ID 0x10)
+    bool saveTzx(const std::string &fileName) const;
+};
+
+#endif // TAPERECORDER_HPP
@@ -0,0 +1,87 @@
+#ifndef TURBOSOUND_HPP
+#define TURBOSOUND_HPP
+
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include "ay8912.hpp"
+
+#define TURBOSOUND_CHIPS 2
+#define TURBOSOUND_SELECT_FIRST 0xFF  // Written to FFFD: following accesses go to chip 0
+#define TURBOSOUND_SELECT_SECOND 0xFE // Written to FFFD: following accesses go to chip 1
+
+// Chip selection and both register files (machine state save/restore)
+struct TurboSoundState
+{
+    int selected;
+    AYState chips[TURBOSOUND_CHIPS];
+};
+
+// NedoPC TurboSound: two AY-3-8912 behind ports FFFD/BFFD. Writing FFh or FEh to FFFD
+// selects the chip, everything else goes to the selected one.
+// Every chip renders into its own ring, both are mixer sources.
+// When disabled the second chip is never selected and stays silent (plain 128K).
+class TurboSound
+{
+private:
+    std::unique_ptr<AY8912> chips[TURBOSOUND_CHIPS];
+    int selected;               // Chip port accesses go to (emulation thread)
+    std::atomic<bool> enabled;  // Set by UI thread
+
+    // Second chip selected while disabled: back to the first one with its latch cleared (emulation thread)
+    void checkSelection();
+
+public:
+    // Chips get rings of ringSamples int16 samples
+    explicit TurboSound(size_t ringSamples = AY_RING_SAMPLES);
+
+    bool initialize(bool threaded = true);
+    void cleanup();
+
+    // Port handlers for FFFD/BFFD
+    void writePort(uint16_t port, uint8_t value);
+    uint8_t readPort(uint16_t port);
+
+    // Reset both chips, first one selected
+    void reset();
+
+    // Registers of both chips and the selection, set ticks first: changed registers are written then
+    void saveState(TurboSoundState &state) const;
+    void loadState(const TurboSoundState &state);
+
+    // Emulated time of the running instruction, stamps register writes
+    void setTicks(long long ticks)
+    {
+        chips[0]->ticks = ticks;
+        chips[1]->ticks = ticks;
+    }
+
+    // Emulation has reached given T-state
+    void setClock(uint64_t tstate)
+    {
+        chips[0]->setClock(tstate);
+        chips[1]->setClock(tstate);
+    }
+
+    AY8912 *getChip(int index) { return chips[index].get(); }
+
+    // Register writes of both chips stay off the sound (run-ahead frames)
+    void setSilent(bool silent)
+    {
+        chips[0]->setSilent(silent);
+        chips[1]->setSilent(silent);
+    }
+
+    // Disabling drops the second chip selection and its register latch at the next port access,
+    // selection belongs to the emulation thread
+    void setEnabled(bool enable);
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Settings applied to both chips
+    void setStereoMode(uint8_t mode);
+    uint8_t getStereoMode() const { return chips[0]->getStereoMode(); }
+    void setHighQuality(bool highQuality);
+    bool isHighQuality() const { return chips[0]->isHighQuality(); }
+};
+
+#endif // TURBOSOUND_HPP
@@ -3,9 +3,32 @@
 
 #include <cstdint>
 #include <memory>
+#include <functional>
 #include "memory.hpp"
 #include "port.hpp"
 #include "tape.hpp"
+#include "scheduler.hpp"
+
+// Beam, flash and timing as one flat block (machine state save/restore).
+// Keyboard is host input and the screen buffer is output, neither is part of it
+struct ULAState
+{
+    uint64_t frameStart;
+    uint64_t tapeClock;
+    long long ticks;
+    uint32_t clock;
+    uint32_t horClock;
+    int line;
+    bool flash;
+    int flashCnt;
+    int frameCnt;
+    uint8_t borderColor;
+    bool audioState;
+    uint32_t clockFlyback;
+    uint32_t clockEndFrame;
+    uint32_t clockBottomRight;
+    uint32_t clockPerLine;
+};
 
 class ULA
 {
@@ -13,7 +36,7 @@ private:
     Memory *memory;
     Tape *tape;
 
-    // Screen buffer (256x192 pixels with border)
+    // Screen buffer (256x192 pixels with border), made when something is first drawn
     uint32_t *screenBuffer;
 
     // Pre-calculated color values for faster lookup
@@ -36,17 +59,38 @@ private:
 
     // Private helper functions
     void drawPixel(int);
+    void allocateScreen();
     uint32_t getPixelColorFast(uint8_t x, uint8_t y);
     bool audioState; // ula audio input state
     uint32_t clockFlyback;
     uint32_t clockEndFrame;
     uint32_t clockBottomRight;
     uint32_t clockPerLine;
+    bool rendering; // Beam draws into the screen buffer, otherwise only its position moves
+
+    // Timed events: frame end, end of every beam line, tape edges
+    Scheduler *scheduler;
+    int frameEvent;
+    int lineEvent;
+    int tapeEvent;
+    uint64_t frameStart; // Absolute T-state the current frame started at
+    uint64_t tapeClock;  // Absolute T-state the tape is played up to
+    std::function<void(uint64_t)> frameHandler;
+
+    // Draw beam positions up to given clock of the frame
+    void renderTo(uint32_t target);
+    // Event handlers
+    void endLine(uint64_t tstate);
+    void endFrame(uint64_t tstate);
+    void tapeEdge(uint64_t tstate);
 
 public:
-    // ULA internal clock state
+    // ULA internal clock state: clock of the frame the beam has been drawn up to
     uint32_t clock;
 
+    // Emulated time of the running instruction, border changes are drawn from it
+    long long ticks;
+
     // Constructor
     ULA(Memory *mem, Tape *tap);
 
@@ -57,16 +101,40 @@ public:
     uint8_t readPort(uint16_t port);
     void writePort(uint16_t port, uint8_t value);
 
-    // Get screen buffer
+    // Get screen buffer (made black if nothing has been drawn yet)
     uint32_t *getScreenBuffer();
 
-    // Process a single ULA tick
-    // Returns internal clock state. If 0 - screen is ready, generate interrupt
-    int oneTick();
+    // Register frame, line and tape events. Call once before start()
+    void setScheduler(Scheduler *sched);
+
+    // Begin first frame at given absolute T-state
+    void start(uint64_t tstate);
+
+    // Called at frame end (screen is ready, generate interrupt), with the T-state of it
+    void setFrameHandler(std::function<void(uint64_t)> handler) { frameHandler = std::move(handler); }
+
+    // Frames nobody sees (run-ahead, batch jobs) skip drawing, the beam only moves. A machine that
+    // never draws has no screen buffer at all. Not part of the state
+    void setRendering(bool enable) { rendering = enable; }
+
+    // Draw the whole screen from memory as it is now, with the current border (after a state was
+    // restored without running it). Beam position of the running frame is kept
+    void redrawScreen();
+
+    // Tape was started, stopped or moved: play it on from given T-state
+    void syncTape(uint64_t tstate);
 
     // Reset ULA state
     void reset();
 
+    // Border colour (0-7), set directly when a snapshot is loaded
+    uint8_t getBorder() const { return borderColor; }
+    void setBorder(uint8_t color) { borderColor = color & 0x07; }
+
+    // Internal state to and from a flat block. shift moves the absolute T-states
+    void saveState(ULAState &state) const;
+    void loadState(const ULAState &state, int64_t shift = 0);
+
     // Keyboard handling functions
     void setKeyState(int halfRow, uint8_t keyMask);
     void setKeyDown(int halfRow, int keyBit);
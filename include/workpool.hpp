@@ -0,0 +1,40 @@
+#ifndef WORKPOOL_HPP
+#define WORKPOOL_HPP
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fixed set of worker threads running independent tasks 0..count-1.
+// Every worker has its own queue and takes tasks from its front; a worker that runs
+// dry steals from the back of the others, so long and short tasks even out without
+// a shared queue every worker waits on
+class WorkPool
+{
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    int threadCount;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    bool takeOwn(int worker, size_t &task);
+    bool steal(int worker, size_t &task);
+
+public:
+    // threads = 0 uses one thread per hardware core
+    explicit WorkPool(int threads = 0);
+
+    int getThreads() const { return threadCount; }
+
+    // Run task(index, worker) for every index below count, returns when all are done
+    void run(size_t count, const std::function<void(size_t, int)> &task);
+};
+
+#endif // WORKPOOL_HPP
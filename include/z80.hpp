@@ -15,6 +15,17 @@
 #define FLAG_N 0x02  // Add/Subtract Flag (N) - bit 1
 #define FLAG_C 0x01  // Carry Flag (C) - bit 0
 
+// Everything the CPU carries from one instruction to the next, as one flat block
+struct Z80State
+{
+    uint16_t AF, BC, DE, HL;
+    uint16_t AF_, BC_, DE_, HL_;
+    uint16_t IX, IY, SP, PC, MEMPTR;
+    uint8_t I, R, IM;
+    bool IFF1, IFF2, HALT, InterruptPending;
+    bool isNMOS;
+};
+
 class Z80
 {
 public:
@@ -132,6 +143,10 @@ public:
     bool isNMOS;    // cpu type NMOS (true, default) or Zilog/SGS (false)
     void NMI(void); // Non Maskable Interrupt
 
+    // Registers and interrupt state to and from a flat block (machine state save/restore)
+    void saveState(Z80State &state) const;
+    void loadState(const Z80State &state);
+
 private:
     // Flag update functions
     void UpdateSZFlags(uint8_t result);
@@ -1,9 +1,9 @@
 #!/bin/sh
 
-for i in `ls *.vgm`; do
-    echo "Converting $i"
-    ./vgm2wav $i `basename $i .vgm`.wav 0
-done
+# VGM, PSG and AY files are converted by the emulator on all cores:
+#   emulator --convert-music <dir> [--jobs N]
+EMULATOR=${EMULATOR:-../../emulator}
+"$EMULATOR" --convert-music .
 
 for i in `ls *.nsf`; do
     echo "Converting $i"
@@ -44,6 +44,13 @@ enum
     CHIP_TYPE_YM2610B = 0x23,
 };
 
+enum
+{
+    AY_STEREO_MONO = 0x00, // All channels in both outputs
+    AY_STEREO_ABC = 0x01,  // A left, B center, C right
+    AY_STEREO_ACB = 0x02,  // A left, C center, B right
+};
+
 class AY38910
 {
 public:
@@ -76,6 +83,15 @@ public:
     /** Returns left (16 bits) and right (16 bits) channels if next sound sample */
     uint32_t getSample();
 
+    /**
+     * Renders given number of stereo frames (left, right) to out.
+     * Produces the same sound as calling getSample() for every frame, but counters
+     * are advanced by whole runs of samples up to the next tone/noise/envelope event,
+     * and every run is written as one constant block.
+     * Samples are halved to fit into int16: silence is 0, full level is 32767.
+     */
+    void render(int16_t *out, size_t frames);
+
     /** Set chip clock external frequency */
     void setFrequency( uint32_t frequency );
 
@@ -94,8 +110,11 @@ public:
     /** Changes volume level. Default level is 100! */
     void setVolume(uint16_t volume);
 
-    /** TODO: */
-    //void setStereoMode(uint8_t mode);
+    /** Sets channel panning: AY_STEREO_MONO (default), AY_STEREO_ABC or AY_STEREO_ACB */
+    void setStereoMode(uint8_t mode);
+
+    /** Returns current panning mode */
+    uint8_t getStereoMode() const { return m_stereoMode; }
 
 private:
     /** Chip Type. */
@@ -179,8 +198,36 @@ private:
     /** user volume level */
     uint16_t m_userVolume = 100;
 
+    /** Panning mode */
+    uint8_t m_stereoMode = AY_STEREO_MONO;
+
+    /** Left and right gain of channels A, B, C (256 is full level). Last item is padding */
+    uint32_t m_panLeft[4] = { 256, 256, 256, 0 };
+    uint32_t m_panRight[4] = { 256, 256, 256, 0 };
+
     /** Recalculates volume tables */
     void calcVolumeTables();
+
+    /** Advances tone, noise and envelope generators by one sample */
+    void step();
+
+    /** Noise counter reached its period */
+    void noiseEvent();
+
+    /** Envelope counter reached its period */
+    void envelopeEvent();
+
+    /** Channel has non-zero volume or uses envelope */
+    bool isAudible(int chan) const;
+
+    /** Number of samples before the next audible counter event (sample, where step() may change output) */
+    uint32_t quietSamples() const;
+
+    /** Advances all generators by given number of samples without producing output */
+    void skip(uint32_t samples);
+
+    /** Mixes channels with current generator state, returns left (16 bits) and right (16 bits) */
+    uint32_t mix() const;
 };
 
 
@@ -26,6 +26,13 @@ SOFTWARE.
 
 #include <stdint.h>
 #include <stdlib.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #define AY38910_DEBUG 1
 
@@ -37,6 +44,9 @@ SOFTWARE.
 
 #define YM2149_PIN26_LOW   (0x10)
 
+// Runs shorter than this are rendered sample by sample
+#define AY38910_MIN_RUN    (4)
+
 /*
 
 Normalized voltage
@@ -310,6 +320,12 @@ void AY38910::write(uint8_t reg, uint16_t value)
 }
 
 uint32_t AY38910::getSample()
+{
+    step();
+    return mix();
+}
+
+void AY38910::step()
 {
     for (int i=0; i<3; i++)
     {
@@ -325,16 +341,7 @@ uint32_t AY38910::getSample()
     if (m_counterNoise >= m_periodNoise)
     {
         m_counterNoise = 0;
-        m_noiseRecalc = !m_noiseRecalc;
-        if ( m_noiseRecalc )
-        {
-            // The Random Number Generator of the 8910 is a 17-bit shift
-            // register. The input to the shift register is bit0 XOR bit3
-            // (bit0 is the output).
-            m_rng ^= (((m_rng & 1) ^ ((m_rng >> 3) & 1)) << 17);
-            m_rng >>= 1;
-            m_noiseHigh = !!(m_rng & 1);
-        }
+        noiseEvent();
     }
 
     if ( !m_holding )
@@ -347,24 +354,44 @@ uint32_t AY38910::getSample()
             if (m_counterEnv >= m_periodE)
             {
                 m_counterEnv = 0;
-                m_envVolume += m_attack ? 1: -1;
-                if ( m_envVolume > m_envStepMask ) // if overflow happened, we reached the boundary: low or high
-                {
-                    m_holding = m_hold;
-                    // step back
-                    m_envVolume -= m_attack ? 1: -1;
-                    if ( !m_continue ) m_envVolume = 0;
-                    else if ( m_alternate && m_hold ) m_envVolume ^= m_envStepMask;
-                    else if ( !m_hold && !m_alternate ) m_envVolume ^= m_envStepMask;
-                    else if ( !m_hold && m_alternate ) m_attack = !m_attack;
-                }
+                envelopeEvent();
             }
         }
     }
+}
 
-    uint32_t left = 0;
-    uint32_t right = 0;
+void AY38910::noiseEvent()
+{
+    m_noiseRecalc = !m_noiseRecalc;
+    if ( m_noiseRecalc )
+    {
+        // The Random Number Generator of the 8910 is a 17-bit shift
+        // register. The input to the shift register is bit0 XOR bit3
+        // (bit0 is the output).
+        m_rng ^= (((m_rng & 1) ^ ((m_rng >> 3) & 1)) << 17);
+        m_rng >>= 1;
+        m_noiseHigh = !!(m_rng & 1);
+    }
+}
+
+void AY38910::envelopeEvent()
+{
+    m_envVolume += m_attack ? 1: -1;
+    if ( m_envVolume > m_envStepMask ) // if overflow happened, we reached the boundary: low or high
+    {
+        m_holding = m_hold;
+        // step back
+        m_envVolume -= m_attack ? 1: -1;
+        if ( !m_continue ) m_envVolume = 0;
+        else if ( m_alternate && m_hold ) m_envVolume ^= m_envStepMask;
+        else if ( !m_hold && !m_alternate ) m_envVolume ^= m_envStepMask;
+        else if ( !m_hold && m_alternate ) m_attack = !m_attack;
+    }
+}
 
+uint32_t AY38910::mix() const
+{
+    uint32_t level[3];
     for(int chan=0; chan<3; chan++)
     {
 // Two variant for calculating enable field. Both work
@@ -372,19 +399,205 @@ uint32_t AY38910::getSample()
 //                       ( ((m_mixer >> (3 + chan)) & 1) || m_noiseHigh );
         bool enabled = ( ((m_mixer >> chan) & 1) == 0 && m_channelOutput[chan] ) ||
                        ( ((m_mixer >> (3 + chan)) & 1) == 0 && m_noiseHigh );
-        if (m_useEnvelope[chan])
+        // TODO: Evelope must have it's own table
+        uint8_t volume = m_useEnvelope[chan] ? m_envVolume : m_amplitude[chan];
+        level[chan] = m_levelTable[enabled ? volume: 0];
+    }
+
+#if defined(__SSE4_1__)
+    // All three channels are panned at once: [A B C 0] * gains, then horizontal sums
+    __m128i levels = _mm_setr_epi32( level[0], level[1], level[2], 0 );
+    __m128i l = _mm_mullo_epi32( levels, _mm_loadu_si128( reinterpret_cast<const __m128i *>( m_panLeft ) ) );
+    __m128i r = _mm_mullo_epi32( levels, _mm_loadu_si128( reinterpret_cast<const __m128i *>( m_panRight ) ) );
+    __m128i sum = _mm_hadd_epi32( l, r );
+    sum = _mm_hadd_epi32( sum, sum ); // [left right left right]
+    sum = _mm_min_epu32( _mm_srli_epi32( sum, 8 ), _mm_set1_epi32( 65535 ) );
+    uint32_t left = _mm_cvtsi128_si32( sum );
+    uint32_t right = _mm_extract_epi32( sum, 1 );
+#elif defined(__aarch64__)
+    uint32x4_t levels = { level[0], level[1], level[2], 0 };
+    uint32_t left = vaddvq_u32( vmulq_u32( levels, vld1q_u32( m_panLeft ) ) ) >> 8;
+    uint32_t right = vaddvq_u32( vmulq_u32( levels, vld1q_u32( m_panRight ) ) ) >> 8;
+    if ( left > 65535 ) left = 65535;
+    if ( right > 65535 ) right = 65535;
+#else
+    uint32_t left = 0;
+    uint32_t right = 0;
+    for(int chan=0; chan<3; chan++)
+    {
+        left += level[chan] * m_panLeft[chan];
+        right += level[chan] * m_panRight[chan];
+    }
+    left >>= 8;
+    right >>= 8;
+/*    left /= 3;*/ if ( left > 65535 ) left = 65535;
+/*    right /= 3;*/ if ( right > 65535 ) right = 65535;
+#endif
+    return (left<<16) | right;
+}
+
+// Samples before counter reaches period: counter + n * scale stays below period for all of them
+static inline uint32_t samplesBefore(uint32_t counter, uint32_t period, uint32_t scale)
+{
+    // Event on the next sample is the common case for fast generators, no division needed
+    if ( counter + scale >= period ) return 0;
+    if ( scale == 0 ) return UINT32_MAX;
+    return (period - counter - 1) / scale;
+}
+
+// Advances counter by given samples the same way step() does, returns number of events.
+// Counter restarts from 0 after every event
+static inline uint32_t advanceCounter(uint32_t &counter, uint32_t period, uint32_t scale, uint32_t samples)
+{
+    // Most runs end before the counter reaches its period, no division needed then
+    uint64_t reached = counter + static_cast<uint64_t>( samples ) * scale;
+    if ( reached < period )
+    {
+        counter = static_cast<uint32_t>( reached );
+        return 0;
+    }
+    uint32_t first = samplesBefore( counter, period, scale );
+    samples -= first + 1;
+    counter = 0;
+    if ( scale == 0 ) return 1;
+    uint32_t every = samplesBefore( 0, period, scale ) + 1;
+    counter = (samples % every) * scale;
+    return 1 + samples / every;
+}
+
+bool AY38910::isAudible(int chan) const
+{
+    return m_useEnvelope[chan] || m_amplitude[chan] != 0;
+}
+
+uint32_t AY38910::quietSamples() const
+{
+    // Only generators, which can be heard, end the run. Others are advanced by skip() in bulk
+    uint32_t samples = UINT32_MAX;
+    bool noise = false;
+    bool envelope = false;
+    for (int i=0; i<3; i++)
+    {
+        if ( !isAudible(i) ) continue;
+        if ( ((m_mixer >> i) & 1) == 0 )
         {
-            // TODO: Evelope must have it's own table
-            left += m_levelTable[enabled ? m_envVolume: 0];
-            right += m_levelTable[enabled ? m_envVolume: 0];
+            uint32_t tone = samplesBefore( m_counter[i], m_period[i], m_toneFrequencyScale );
+            if ( tone < samples ) samples = tone;
         }
-        else
+        noise |= ((m_mixer >> (3 + i)) & 1) == 0;
+        envelope |= m_useEnvelope[i];
+    }
+    if ( noise )
+    {
+        uint32_t next = samplesBefore( m_counterNoise, m_periodNoise, m_toneFrequencyScale );
+        if ( next < samples ) samples = next;
+    }
+    if ( envelope && !m_holding && m_periodE > 0 )
+    {
+        uint32_t env = samplesBefore( m_counterEnv, m_periodE, m_envFrequencyScale );
+        if ( env < samples ) samples = env;
+    }
+    return samples;
+}
+
+void AY38910::skip(uint32_t samples)
+{
+    for (int i=0; i<3; i++)
+    {
+        uint32_t events = advanceCounter( m_counter[i], m_period[i], m_toneFrequencyScale, samples );
+        if ( events & 1 ) m_channelOutput[i] = !m_channelOutput[i];
+    }
+
+    uint32_t events = advanceCounter( m_counterNoise, m_periodNoise, m_toneFrequencyScale, samples );
+    while ( events-- ) noiseEvent();
+
+    if ( !m_holding && m_periodE > 0 )
+    {
+        events = advanceCounter( m_counterEnv, m_periodE, m_envFrequencyScale, samples );
+        while ( events-- )
         {
-            left += m_levelTable[enabled ? m_amplitude[chan]: 0];
-            right += m_levelTable[enabled ? m_amplitude[chan]: 0];
+            envelopeEvent();
+            if ( m_holding )
+            {
+                // step() does not count while envelope is holding
+                m_counterEnv = 0;
+                break;
+            }
         }
     }
-/*    left /= 3;*/ if ( left > 65535 ) left = 65535;
-/*    right /= 3;*/ if ( right > 65535 ) right = 65535;
-    return (left<<16) | right;
+}
+
+void AY38910::render(int16_t *out, size_t frames)
+{
+    while ( frames > 0 )
+    {
+        // Output does not change until the next counter event, write the whole run at once
+        size_t run = quietSamples();
+        if ( run >= AY38910_MIN_RUN )
+        {
+            if ( run > frames ) run = frames;
+            skip( run );
+            uint32_t sample = mix();
+            int16_t left = static_cast<int16_t>( (sample >> 16) >> 1 );
+            int16_t right = static_cast<int16_t>( (sample & 0xFFFF) >> 1 );
+            size_t i = 0;
+#if defined(__SSE2__)
+            __m128i pattern = _mm_set_epi16( right, left, right, left, right, left, right, left );
+            for (; i + 4 <= run; i += 4)
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i *>( out + i * 2 ), pattern );
+            }
+#elif defined(__ARM_NEON)
+            int16x8_t pattern = { left, right, left, right, left, right, left, right };
+            for (; i + 4 <= run; i += 4)
+            {
+                vst1q_s16( out + i * 2, pattern );
+            }
+#endif
+            for (; i < run; i++)
+            {
+                out[i * 2] = left;
+                out[i * 2 + 1] = right;
+            }
+            out += run * 2;
+            frames -= run;
+            continue;
+        }
+
+        // Events come every few samples (high tone, fast noise): stepping sample by sample
+        // is cheaper than counting runs, do it for a while before looking again
+        size_t count = frames < AY38910_MIN_RUN ? frames : AY38910_MIN_RUN;
+        for (size_t i = 0; i < count; i++)
+        {
+            step();
+            uint32_t sample = mix();
+            out[0] = static_cast<int16_t>( (sample >> 16) >> 1 );
+            out[1] = static_cast<int16_t>( (sample & 0xFFFF) >> 1 );
+            out += 2;
+        }
+        frames -= count;
+    }
+}
+
+void AY38910::setStereoMode(uint8_t mode)
+{
+    // Gains of A, B, C. Center channel goes to both sides, side channels leak a bit
+    // to the other side, so headphones do not sound too wide
+    static const uint32_t panning[3][2][3] =
+    {
+        { { 256, 256, 256 }, { 256, 256, 256 } }, // AY_STEREO_MONO
+        { { 256, 160,  64 }, {  64, 160, 256 } }, // AY_STEREO_ABC
+        { { 256,  64, 160 }, {  64, 256, 160 } }, // AY_STEREO_ACB
+    };
+    if ( mode > AY_STEREO_ACB )
+    {
+        LOGE( "Unknown stereo mode %d\n", mode );
+        mode = AY_STEREO_MONO;
+    }
+    m_stereoMode = mode;
+    for (int chan=0; chan<3; chan++)
+    {
+        m_panLeft[chan] = panning[mode][0][chan];
+        m_panRight[chan] = panning[mode][1][chan];
+    }
 }
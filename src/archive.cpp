@@ -0,0 +1,257 @@
+#include "archive.hpp"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <zip.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Size of one decompression step. Entry is inflated straight into its final buffer
+static const size_t ZIP_CHUNK = 64 * 1024;
+
+ImageData::ImageData() : mapping(nullptr), mappingSize(0)
+{
+}
+
+ImageData::~ImageData()
+{
+    if (mapping)
+    {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+    }
+}
+
+bool ImageData::mapFile(const std::string &fileName)
+{
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+            // Data is read sequentially by parsers
+            madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+            mapping = ptr;
+            mappingSize = st.st_size;
+            ::close(fd);
+            return true;
+        }
+    }
+    ::close(fd);
+
+    // mmap is not possible (empty file, special file) - read it the old way
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open file: " << fileName << std::endl;
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    owned.resize(size);
+    if (size > 0 && !file.read(reinterpret_cast<char *>(owned.data()), size))
+    {
+        std::cerr << "Failed to read file: " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ImageData::assign(std::vector<uint8_t> &&data)
+{
+    owned = std::move(data);
+}
+
+uint8_t *ImageData::allocate(size_t size)
+{
+    owned.resize(size);
+    return owned.data();
+}
+
+std::span<const uint8_t> ImageData::bytes() const
+{
+    if (mapping)
+    {
+        return std::span<const uint8_t>(static_cast<const uint8_t *>(mapping), mappingSize);
+    }
+    return std::span<const uint8_t>(owned.data(), owned.size());
+}
+
+Archive::Archive() : zipArchive(nullptr)
+{
+}
+
+Archive::~Archive()
+{
+    close();
+}
+
+// Lower-case extension check helper
+static bool hasExtension(const std::string &lowerName, const char *ext)
+{
+    size_t len = strlen(ext);
+    return lowerName.length() >= len && lowerName.compare(lowerName.length() - len, len, ext) == 0;
+}
+
+ImageKind Archive::kindFromName(const std::string &name)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    if (hasExtension(lower, ".tap") || hasExtension(lower, ".tzx"))
+        return ImageKind::Tape;
+    if (hasExtension(lower, ".trd") || hasExtension(lower, ".scl") || hasExtension(lower, ".fdi") || hasExtension(lower, ".udi"))
+        return ImageKind::Disk;
+    if (hasExtension(lower, ".z80") || hasExtension(lower, ".sna") || hasExtension(lower, ".szx"))
+        return ImageKind::Snapshot;
+    return ImageKind::Unknown;
+}
+
+bool Archive::open(const std::string &name)
+{
+    close();
+    fileName = name;
+
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (hasExtension(lower, ".zip"))
+    {
+        return openZip();
+    }
+
+    // Plain file is a single entry, mapped on first access
+    struct stat st;
+    if (stat(name.c_str(), &st) != 0)
+    {
+        std::cerr << "Failed to open file: " << name << std::endl;
+        return false;
+    }
+    ArchiveEntry entry;
+    entry.name = name;
+    entry.kind = kindFromName(name);
+    entry.size = st.st_size;
+    entry.zipIndex = 0;
+    entries.push_back(entry);
+    cache.resize(1);
+    return true;
+}
+
+bool Archive::openZip()
+{
+    std::cout << "ZIP file detected: " << fileName << std::endl;
+
+    int err = 0;
+    zipArchive = zip_open(fileName.c_str(), ZIP_RDONLY, &err);
+    if (!zipArchive)
+    {
+        std::cerr << "Failed to open ZIP file: " << fileName << " (error: " << err << ")" << std::endl;
+        return false;
+    }
+
+    // Only the central directory is read here, no entry is decompressed yet
+    zip_int64_t numEntries = zip_get_num_entries(zipArchive, 0);
+    for (zip_int64_t i = 0; i < numEntries; i++)
+    {
+        zip_stat_t st;
+        if (zip_stat_index(zipArchive, i, 0, &st) != 0 || !(st.valid & ZIP_STAT_NAME))
+            continue;
+
+        ImageKind kind = kindFromName(st.name);
+        if (kind == ImageKind::Unknown)
+            continue; // readme.txt, screenshots, inlays and so on
+
+        ArchiveEntry entry;
+        entry.name = st.name;
+        entry.kind = kind;
+        entry.size = (st.valid & ZIP_STAT_SIZE) ? st.size : 0;
+        entry.zipIndex = i;
+        entries.push_back(entry);
+    }
+    cache.resize(entries.size());
+
+    std::cout << "Indexed " << entries.size() << " images in " << fileName << std::endl;
+    return true;
+}
+
+void Archive::close()
+{
+    if (zipArchive)
+    {
+        zip_close(zipArchive);
+        zipArchive = nullptr;
+    }
+    entries.clear();
+    // Images already handed out stay alive through their shared_ptr
+    cache.clear();
+}
+
+int Archive::findFirst(ImageKind kind) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].kind == kind)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+std::shared_ptr<const ImageData> Archive::getData(size_t index)
+{
+    if (index >= entries.size())
+        return nullptr;
+    if (cache[index])
+        return cache[index];
+
+    auto image = std::make_shared<ImageData>();
+    const ArchiveEntry &entry = entries[index];
+
+    if (!zipArchive)
+    {
+        if (!image->mapFile(fileName))
+            return nullptr;
+    }
+    else
+    {
+        zip_file_t *file = zip_fopen_index(zipArchive, entry.zipIndex, 0);
+        if (!file)
+        {
+            std::cerr << "Failed to open file from ZIP: " << entry.name << std::endl;
+            return nullptr;
+        }
+
+        // Inflate chunk by chunk directly into the final buffer - no temporary copies
+        uint8_t *out = image->allocate(entry.size);
+        uint64_t done = 0;
+        zip_int64_t bytesRead = 0;
+        while (done < entry.size)
+        {
+            size_t chunk = std::min<uint64_t>(ZIP_CHUNK, entry.size - done);
+            bytesRead = zip_fread(file, out + done, chunk);
+            if (bytesRead <= 0)
+                break;
+            done += bytesRead;
+        }
+        zip_fclose(file);
+
+        if (bytesRead < 0 || done != entry.size)
+        {
+            std::cerr << "Error reading file from ZIP: " << entry.name << std::endl;
+            return nullptr;
+        }
+        std::cout << "Extracted " << done << " bytes from " << entry.name << std::endl;
+    }
+
+    cache[index] = image;
+    return image;
+}
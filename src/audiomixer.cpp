@@ -0,0 +1,192 @@
+#include "audiomixer.hpp"
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+AudioMixer::AudioMixer() : scratch(MIXER_BLOCK_FRAMES * 2), prefillFrames(MIXER_PREFILL_FRAMES), primed(false), mixedFrames(0),
+                           rateStep(MIXER_PHASE_ONE), phase(MIXER_PHASE_ONE), resampleInput(MIXER_BLOCK_FRAMES * 2)
+{
+    previous[0] = previous[1] = 0;
+    current[0] = current[1] = 0;
+}
+
+void AudioMixer::addSource(RingBuffer<int16_t> *ring)
+{
+    sources.push_back({ring, 0, 0, 0});
+}
+
+// Read frames of one source into scratch. Shared is how far all sources move on in this block;
+// what this source cannot deliver of it is owed and skipped once it arrives, so the source
+// stays at the same emulated time as the others
+void AudioMixer::readSource(Source &source, size_t frames, size_t shared)
+{
+    while (source.owed > 0)
+    {
+        size_t skipped = source.ring->read(scratch.data(), std::min<size_t>(source.owed, MIXER_BLOCK_FRAMES) * 2) / 2;
+        if (skipped == 0)
+        {
+            break;
+        }
+        source.owed -= skipped;
+    }
+
+    size_t got = source.ring->read(scratch.data(), shared * 2) & ~static_cast<size_t>(1);
+    // Never owe more than the ring holds, a source silent that long starts afresh
+    source.owed = std::min(source.owed + shared - got / 2, source.ring->capacity() / 2);
+    if (got > 0)
+    {
+        source.lastLeft = scratch[got - 2];
+        source.lastRight = scratch[got - 1];
+    }
+
+    // Source is late or silent: hold its level instead of clicking to zero
+    for (size_t i = got; i < frames * 2; i += 2)
+    {
+        scratch[i] = source.lastLeft;
+        scratch[i + 1] = source.lastRight;
+    }
+}
+
+// Saturating add of count samples
+static void addSaturate(int16_t *out, const int16_t *in, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_adds_epi16(a, b));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+        vst1q_s16(out + i, vqaddq_s16(vld1q_s16(out + i), vld1q_s16(in + i)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        out[i] = static_cast<int16_t>(std::clamp(out[i] + in[i], -32768, 32767));
+    }
+}
+
+// Mix all sources block by block
+void AudioMixer::mixSources(int16_t *out, size_t frames)
+{
+    while (frames > 0)
+    {
+        size_t block = std::min<size_t>(frames, MIXER_BLOCK_FRAMES);
+
+        // Sources produce samples in bursts (AY once per frame), so they are played only after
+        // the fullest has prefillFrames queued, and all wait together again once it ran dry.
+        // Held frames while waiting are not owed: emulated time did not move on
+        size_t queued = getQueuedFrames();
+        if (!primed && queued >= prefillFrames)
+        {
+            primed = true;
+        }
+        size_t shared = 0;
+        if (primed)
+        {
+            shared = std::min(block, queued);
+            primed = shared == block;
+        }
+
+        std::fill(out, out + block * 2, 0);
+        for (Source &source : sources)
+        {
+            readSource(source, block, shared);
+            addSaturate(out, scratch.data(), block * 2);
+        }
+        out += block * 2;
+        frames -= block;
+        mixedFrames.fetch_add(block, std::memory_order_release);
+    }
+}
+
+void AudioMixer::setRate(double ratio)
+{
+    ratio = std::clamp(ratio, 1.0 - MIXER_MAX_RATE_ADJUST, 1.0 + MIXER_MAX_RATE_ADJUST);
+    rateStep.store(static_cast<uint64_t>(ratio * MIXER_PHASE_ONE + 0.5), std::memory_order_relaxed);
+}
+
+double AudioMixer::getRate() const
+{
+    return static_cast<double>(rateStep.load(std::memory_order_relaxed)) / MIXER_PHASE_ONE;
+}
+
+// Mix sources and play them slightly faster or slower than MIXER_SAMPLE_RATE.
+// Linear interpolation between two input frames is enough for a ratio within half a percent.
+// Position is kept as 32.32 fixed point: resampled[n] lies between previous and current input frame.
+void AudioMixer::mix(int16_t *out, size_t frames)
+{
+    uint64_t step = rateStep.load(std::memory_order_relaxed);
+    if (step == MIXER_PHASE_ONE && (phase & (MIXER_PHASE_ONE - 1)) == 0)
+    {
+        // Nominal rate and no fraction pending: sources go straight to output
+        mixSources(out, frames);
+        if (frames > 0)
+        {
+            // Resampling continues from the last frame played
+            previous[0] = current[0] = out[frames * 2 - 2];
+            previous[1] = current[1] = out[frames * 2 - 1];
+            phase = MIXER_PHASE_ONE;
+        }
+    }
+    else
+    {
+        while (frames > 0)
+        {
+            // Input needed for this chunk: one frame for every whole step of the position
+            size_t chunk = std::min<size_t>(frames, MIXER_BLOCK_FRAMES / 2);
+            size_t needed = static_cast<size_t>((phase + (chunk - 1) * step) >> 32);
+            mixSources(resampleInput.data(), needed);
+
+            const int16_t *input = resampleInput.data();
+            for (size_t i = 0; i < chunk; i++)
+            {
+                while (phase >= MIXER_PHASE_ONE)
+                {
+                    previous[0] = current[0];
+                    previous[1] = current[1];
+                    current[0] = *input++;
+                    current[1] = *input++;
+                    phase -= MIXER_PHASE_ONE;
+                }
+                int32_t fraction = static_cast<int32_t>(phase >> 17); // 0..32767, product fits int32
+                out[i * 2] = static_cast<int16_t>(previous[0] + (((current[0] - previous[0]) * fraction) >> 15));
+                out[i * 2 + 1] = static_cast<int16_t>(previous[1] + (((current[1] - previous[1]) * fraction) >> 15));
+                phase += step;
+            }
+            out += chunk * 2;
+            frames -= chunk;
+        }
+    }
+
+    // Wake emulation thread waiting for room in the rings. Lock is held only for a moment
+    {
+        std::lock_guard<std::mutex> lock(waitMutex);
+    }
+    mixedSignal.notify_all();
+}
+
+size_t AudioMixer::getQueuedFrames() const
+{
+    size_t queued = 0;
+    for (const Source &source : sources)
+    {
+        queued = std::max(queued, source.ring->available() / 2);
+    }
+    return queued;
+}
+
+bool AudioMixer::waitForMix(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(waitMutex);
+    uint64_t seen = mixedFrames.load(std::memory_order_acquire);
+    return mixedSignal.wait_for(lock, timeout, [&]
+                                { return mixedFrames.load(std::memory_order_acquire) != seen; });
+}
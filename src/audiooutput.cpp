@@ -0,0 +1,131 @@
+#include "audiooutput.hpp"
+#include <iostream>
+#include <algorithm>
+
+AudioOutput::AudioOutput() : audioStream(nullptr), audioDevice(0), mixer(nullptr), outBuffer(MIXER_BLOCK_FRAMES * 2),
+                             rateControl(false), targetLatency(AUDIO_TARGET_LATENCY_MS * MIXER_SAMPLE_RATE / 1000), averageLatency(0)
+{
+}
+
+AudioOutput::~AudioOutput()
+{
+    cleanup();
+}
+
+bool AudioOutput::initialize(AudioMixer *audioMixer)
+{
+    // Check if audio subsystem is available
+    if (!(SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
+    {
+        std::cerr << "SDL audio subsystem not initialized, skipping sound initialization" << std::endl;
+        return false;
+    }
+    mixer = audioMixer;
+
+    SDL_AudioSpec desired_spec;
+    SDL_zero(desired_spec);
+    desired_spec.format = SDL_AUDIO_S16;
+    desired_spec.freq = MIXER_SAMPLE_RATE;
+    desired_spec.channels = 2;
+
+    audioStream = SDL_CreateAudioStream(&desired_spec, &desired_spec);
+    if (!audioStream)
+    {
+        printf("Error creating audio stream: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // Create and open audio device, then bind the stream to it
+    audioDevice = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &desired_spec);
+    if (!audioDevice)
+    {
+        printf("Error opening audio device: %s\n", SDL_GetError());
+        SDL_DestroyAudioStream(audioStream);
+        audioStream = nullptr;
+        return false;
+    }
+
+    // Device pulls mixed samples when it needs them
+    if (!SDL_SetAudioStreamGetCallback(audioStream, audioCallback, this))
+    {
+        printf("Error setting audio callback: %s\n", SDL_GetError());
+    }
+
+    // Bind the audio stream to the device
+    if (!SDL_BindAudioStream(audioDevice, audioStream))
+    {
+        printf("Error binding audio stream: %s\n", SDL_GetError());
+        SDL_CloseAudioDevice(audioDevice);
+        SDL_DestroyAudioStream(audioStream);
+        audioStream = nullptr;
+        audioDevice = 0;
+        return false;
+    }
+
+    // Start audio playback
+    SDL_ResumeAudioDevice(audioDevice);
+
+    std::cout << "Audio output initialized successfully" << std::endl;
+    return true;
+}
+
+void AudioOutput::cleanup()
+{
+    // Close the audio device first, so callback is not called anymore
+    if (audioDevice)
+    {
+        SDL_CloseAudioDevice(audioDevice);
+        audioDevice = 0;
+    }
+
+    if (audioStream)
+    {
+        SDL_DestroyAudioStream(audioStream);
+        audioStream = nullptr;
+    }
+}
+
+// Called by SDL from its audio thread
+void SDLCALL AudioOutput::audioCallback(void *userdata, SDL_AudioStream *stream, int additionalAmount, int totalAmount)
+{
+    (void)totalAmount;
+    static_cast<AudioOutput *>(userdata)->feedStream(stream, additionalAmount);
+}
+
+// Proportional control on smoothed latency. Rings fill in frame-sized bursts,
+// so single readings jump by 20 ms; the average follows only the slow drift
+void AudioOutput::updateRate(SDL_AudioStream *stream)
+{
+    if (!rateControl.load(std::memory_order_relaxed))
+    {
+        mixer->setRate(1.0);
+        averageLatency = 0;
+        return;
+    }
+
+    int streamBytes = SDL_GetAudioStreamQueued(stream);
+    double latency = static_cast<double>(mixer->getQueuedFrames()) + std::max(streamBytes, 0) / (2 * sizeof(int16_t));
+    if (averageLatency == 0)
+    {
+        averageLatency = latency;
+    }
+    averageLatency += (latency - averageLatency) * AUDIO_LATENCY_SMOOTHING;
+
+    double target = targetLatency.load(std::memory_order_relaxed);
+    double error = (averageLatency - target) / target;
+    mixer->setRate(1.0 + error * AUDIO_RATE_GAIN); // Mixer clamps to +-0.5%
+}
+
+// Give SDL requested amount of bytes in large blocks
+void AudioOutput::feedStream(SDL_AudioStream *stream, int bytes)
+{
+    updateRate(stream);
+    size_t frames = bytes / (2 * sizeof(int16_t));
+    while (frames > 0)
+    {
+        size_t block = std::min(frames, outBuffer.size() / 2);
+        mixer->mix(outBuffer.data(), block);
+        SDL_PutAudioStreamData(stream, outBuffer.data(), block * 2 * sizeof(int16_t));
+        frames -= block;
+    }
+}
@@ -2,28 +2,39 @@
 #include "chips/ay-3-8910.h"
 #include <iostream>
 #include <cstring>
-#include <SDL3/SDL.h>
 #include <thread>
-#include <chrono>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 
-AY8912::AY8912() : selectedRegister(0),
+AY8912::AY8912(bool highQuality, size_t ringSamples) : selectedRegister(0),
                    addressLatch(false),
-                   audioStream(nullptr),
-                   audioDevice(0),
+                   silent(false),
+                   ring(ringSamples),
                    initialized(false),
-                   audioThreadRunning(false)
+                   writeQueue(AY_QUEUE_WRITES),
+                   emulatedClock(0),
+                   renderedSamples(0),
+                   stereoMode(AY_STEREO_ABC),
+                   highQuality(highQuality),
+                   activeHighQuality(highQuality),
+                   decimator(AY_NATIVE_RATE, AY_SAMPLE_RATE),
+                   audioThreadRunning(false),
+                   threaded(true),
+                   renderedClock(0),
+                   ticks(0)
 {
     // Initialize registers
     std::memset(registers, 0, sizeof(registers));
+    std::memset(sentRegisters, 0, sizeof(sentRegisters));
+    std::memset(chipRegisters, 0, sizeof(chipRegisters));
 
     // Initialize the vgm_decoder AY-3-8910 emulator
     ayChip = new AY38910(CHIP_TYPE_AY8910, 0);
-    ayChip->setFrequency(1773400);     // ZX Spectrum clock frequency
-    ayChip->setSampleFrequency(44100); // Audio sample frequency
+    ayChip->setFrequency(AY_CHIP_FREQUENCY); // ZX Spectrum clock frequency
     ayChip->setVolume(100);
-    ayChip->reset();
+    ayChip->setStereoMode(AY_STEREO_ABC);
+    configureChip();
 }
 
 AY8912::~AY8912()
@@ -36,101 +47,38 @@ AY8912::~AY8912()
     }
 }
 
-bool AY8912::initialize()
+// Start rendering thread. Samples go to our ring buffer, mixer takes them from there
+bool AY8912::initialize(bool threadedRendering)
 {
-    // Check if audio subsystem is available
-    if (!(SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
-    {
-        std::cerr << "SDL audio subsystem not initialized, skipping AY8912 sound initialization" << std::endl;
-        return false;
-    }
-
-    SDL_AudioSpec desired_spec;
-    SDL_zero(desired_spec);
-    desired_spec.format = SDL_AUDIO_S16;
-    desired_spec.freq = 44100;
-    desired_spec.channels = 2;
-
-    audioStream = SDL_CreateAudioStream(&desired_spec, &desired_spec);
-    if (!audioStream)
-    {
-        printf("Error creating AY8912 audio stream: %s\n", SDL_GetError());
-        return false;
-    }
-
-    // Create and open audio device, then bind the stream to it
-    audioDevice = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &desired_spec);
-    if (!audioDevice)
-    {
-        printf("Error opening AY8912 audio device: %s\n", SDL_GetError());
-        SDL_DestroyAudioStream(audioStream);
-        audioStream = nullptr;
-        return false;
-    }
+    initialized = true;
+    threaded = threadedRendering;
 
-    // Bind the audio stream to the device
-    if (!SDL_BindAudioStream(audioDevice, audioStream))
+    // Start audio processing thread
+    if (threaded)
     {
-        printf("Error binding AY8912 audio stream: %s\n", SDL_GetError());
-        SDL_CloseAudioDevice(audioDevice);
-        SDL_DestroyAudioStream(audioStream);
-        audioStream = nullptr;
-        audioDevice = 0;
-        return false;
+        audioThreadRunning = true;
+        audioThread = std::thread(&AY8912::processAudio, this);
     }
 
-    // Start audio playback
-    SDL_ResumeAudioDevice(audioDevice);
-
-    // Start audio processing thread
-    audioThreadRunning = true;
-    audioThread = std::thread(&AY8912::processAudio, this);
-
-    initialized = true;
-
-    // Test configuration: Set up a simple tone for testing
-    // Configure channel A for a 1000Hz tone
-    // Period = Clock / (16 * Frequency) = 1773400 / (16 * 1000) = 110.8375 ≈ 111
-    // if (ayChip) {
-    //     ayChip->write(0, 111 & 0xFF);        // FTR_A - fine tune register A (low byte)
-    //     ayChip->write(1, (111 >> 8) & 0x0F); // CTR_A - coarse tune register A (high nibble)
-    //     ayChip->write(7, 0xFE);              // Mixer - enable tone for channel A (bit 0 = 0), disable noise (bits 3-5 = 1)
-    //     ayChip->write(8, 0x0F);              // Amplitude A - set maximum volume for channel A
-    // }
-
     std::cout << "AY8912 sound system initialized successfully" << std::endl;
     return true;
 }
 
 void AY8912::cleanup()
 {
-    // Stop audio processing thread first
+    // Stop audio processing thread
     if (audioThreadRunning)
     {
         audioThreadRunning = false;
+        // Wake the thread if it waits for emulated time
+        emulatedClock.fetch_add(1, std::memory_order_release);
+        emulatedClock.notify_all();
         if (audioThread.joinable())
         {
             audioThread.join();
         }
     }
 
-    // Only clean up SDL audio resources if they were successfully initialized
-    // and if SDL is still initialized (not shut down yet)
-    if (initialized && (SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
-    {
-        if (audioDevice)
-        {
-            SDL_CloseAudioDevice(audioDevice);
-            audioDevice = 0;
-        }
-
-        if (audioStream)
-        {
-            SDL_DestroyAudioStream(audioStream);
-            audioStream = nullptr;
-        }
-    }
-
     initialized = false;
 }
 
@@ -138,14 +86,14 @@ void AY8912::reset()
 {
     // Reset registers
     std::memset(registers, 0, sizeof(registers));
+    std::memset(sentRegisters, 0, sizeof(sentRegisters));
     selectedRegister = 0;
     addressLatch = false;
 
-    // Reset the AY-3-8910 chip
-    if (ayChip)
-    {
-        ayChip->reset();
-    }
+    // Reset the AY-3-8910 chip in order with register writes
+    AYWrite write = {static_cast<uint64_t>(ticks), AY_RESET_REGISTER, 0};
+    writeQueue.write(&write, 1);
+    recorder.write(write.tstate, AYREC_RESET, 0);
 }
 
 void AY8912::writePort(uint16_t port, uint8_t value)
@@ -166,16 +114,51 @@ void AY8912::writePort(uint16_t port, uint8_t value)
         {
             registers[selectedRegister] = value;
             addressLatch = false; // Reset latch after writing data
+            if (silent)
+            {
+                return;
+            }
+            sentRegisters[selectedRegister] = value;
 
-            // Pass the register write to the AY-3-8910 emulator
-            if (ayChip)
+            // Pass the register write to the render thread, stamped with current T-state
+            AYWrite write = {static_cast<uint64_t>(ticks), selectedRegister, value};
+            if (writeQueue.write(&write, 1) == 0)
             {
-                ayChip->write(selectedRegister, value);
+                printf("AY8912: write queue is full, register write lost\n");
             }
+            recorder.write(write.tstate, selectedRegister, value);
         }
     }
 }
 
+void AY8912::saveState(AYState &state) const
+{
+    std::memcpy(state.registers, registers, sizeof(state.registers));
+    state.selectedRegister = selectedRegister;
+    state.addressLatch = addressLatch;
+}
+
+void AY8912::loadState(const AYState &state)
+{
+    std::memcpy(registers, state.registers, sizeof(registers));
+    for (uint8_t reg = 0; reg <= 13; reg++)
+    {
+        if (sentRegisters[reg] == registers[reg])
+        {
+            continue;
+        }
+        sentRegisters[reg] = registers[reg];
+        AYWrite write = {static_cast<uint64_t>(ticks), reg, registers[reg]};
+        if (writeQueue.write(&write, 1) == 0)
+        {
+            printf("AY8912: write queue is full, register write lost\n");
+        }
+        recorder.write(write.tstate, reg, registers[reg]);
+    }
+    selectedRegister = state.selectedRegister & 0x0F;
+    addressLatch = state.addressLatch;
+}
+
 uint8_t AY8912::readPort(uint16_t port)
 {
     // Check for address/data select port (0xFFFD) - bits 15-14 must be 11, bits 1-0 must be 01
@@ -195,36 +178,132 @@ uint8_t AY8912::readPort(uint16_t port)
     return 0;
 }
 
-void AY8912::processAudio()
+// Emulation has reached given T-state
+// Called by emulation thread once per frame
+void AY8912::setClock(uint64_t tstate)
 {
-    const int bufferSize = 1024;                      // Process 1024 samples at a time
-    std::vector<int16_t> audioBuffer(bufferSize * 2); // Stereo samples
+    recorder.frame(tstate, registers);
+    if (!threaded)
+    {
+        renderPending(tstate);
+        return;
+    }
+    emulatedClock.store(tstate, std::memory_order_release);
+    emulatedClock.notify_one();
+}
 
-    while (audioThreadRunning)
+void AY8912::setChipFrequency(uint32_t frequency)
+{
+    ayChip->setFrequency(frequency);
+    configureChip();
+}
+
+// Chip runs either at the output rate or at AY_NATIVE_RATE, where one sample is exactly
+// one step of tone counters (clock / 8), so short periods do not alias.
+// Changing sample rate resets the chip, registers are written back after that.
+void AY8912::configureChip()
+{
+    ayChip->setSampleFrequency(activeHighQuality ? AY_NATIVE_RATE : AY_SAMPLE_RATE);
+    for (uint8_t reg = 0; reg < sizeof(chipRegisters); reg++)
+    {
+        ayChip->write(reg, chipRegisters[reg]);
+    }
+    decimator.reset();
+}
+
+// Produce samples up to given emulated time
+// Sample number is calculated from T-states directly, so nothing drifts
+void AY8912::renderTo(uint64_t tstate)
+{
+    uint64_t target = tstate * AY_SAMPLE_RATE / AY_CPU_FREQUENCY;
+    if (target <= renderedSamples)
+    {
+        return;
+    }
+
+    // Emulation was paused or jumped far ahead: do not render that gap
+    if (target - renderedSamples > AY_RING_SAMPLES / 2)
     {
-        if (initialized && audioStream && ayChip)
+        renderedSamples = target - AY_RING_SAMPLES / 2;
+    }
+
+    // Chip renders whole stereo blocks, already halved to int16
+    // (silent chip adds nothing to the mix and full volume fits)
+    int16_t block[AY_RENDER_FRAMES * 2];
+    while (renderedSamples < target)
+    {
+        size_t frames = std::min<uint64_t>(target - renderedSamples, AY_RENDER_FRAMES);
+        if (activeHighQuality)
         {
-            // Generate audio samples using the AY-3-8910 emulator
-            bool silentAudio = true;
-            for (int i = 0; i < bufferSize; i++)
-            {
-                uint32_t sample = ayChip->getSample();
-
-                // Convert unsigned 16-bit to signed 16-bit
-                int16_t left = static_cast<int16_t>(((sample >> 16) & 0xFFFF) - 32768);
-                int16_t right = static_cast<int16_t>((sample & 0xFFFF) - 32768);
-                audioBuffer[i * 2] = left;           // Left channel
-                audioBuffer[i * 2 + 1] = right;      // Right channel
-                if (left > -32768 || right > -32768) // we should not overflow audio by silence samples
-                    silentAudio = false;
-            }
+            // About 5 native samples per output sample, nativeBlock has room for 8
+            size_t native = decimator.needed(frames);
+            ayChip->render(nativeBlock, native);
+            decimator.write(nativeBlock, native);
+            decimator.read(block, frames);
+        }
+        else
+        {
+            ayChip->render(block, frames);
+        }
+        ring.write(block, frames * 2);
+        renderedSamples += frames;
+    }
+}
 
-            // Put audio data into the stream
-            if (!silentAudio)
-                SDL_PutAudioStreamData(audioStream, audioBuffer.data(), bufferSize * 2 * sizeof(int16_t));
+// Render thread: sleeps until emulation moves on, then renders everything up to that time
+void AY8912::processAudio()
+{
+    while (audioThreadRunning)
+    {
+        uint64_t clock = emulatedClock.load(std::memory_order_acquire);
+        if (clock == renderedClock)
+        {
+            emulatedClock.wait(clock, std::memory_order_acquire);
+            continue;
         }
+        renderPending(clock);
+    }
+}
+
+// Apply queued register writes, rendering samples up to the timestamp of every write before applying it.
+// Digidrums and envelope tricks sound right because every write lands on its own sample.
+void AY8912::renderPending(uint64_t clock)
+{
+    renderedClock = clock;
+    if (!initialized || !ayChip)
+    {
+        return;
+    }
 
-        // For 44100 Hz sample rate and 1024 samples, we need to sleep for about 23ms
-        std::this_thread::sleep_for(std::chrono::microseconds(19000));
+    // Panning change from UI
+    uint8_t mode = stereoMode.load(std::memory_order_relaxed);
+    if (mode != ayChip->getStereoMode())
+    {
+        ayChip->setStereoMode(mode);
+    }
+
+    // Quality change from UI
+    bool quality = highQuality.load(std::memory_order_relaxed);
+    if (quality != activeHighQuality)
+    {
+        activeHighQuality = quality;
+        configureChip();
+    }
+
+    AYWrite write;
+    while (writeQueue.read(&write, 1) == 1)
+    {
+        renderTo(write.tstate);
+        if (write.reg == AY_RESET_REGISTER)
+        {
+            std::memset(chipRegisters, 0, sizeof(chipRegisters));
+            ayChip->reset();
+        }
+        else
+        {
+            chipRegisters[write.reg] = write.value;
+            ayChip->write(write.reg, write.value);
+        }
     }
+    renderTo(clock);
 }
@@ -0,0 +1,536 @@
+#include "ayplayer.hpp"
+#include "capturewriter.hpp"
+#include "formats/vgm_format.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <set>
+
+AYPlayer::AYPlayer() : format(AYFileFormat::Unknown), ticks(0), frames(0), lengthFrames(0), fadeFrames(0), readSamples(0),
+                       ended(true), position(0), streamTicks(0), vgmSamples(0), songCount(0), cpuTicks(0)
+{
+    ay = std::make_unique<AY8912>();
+}
+
+bool AYPlayer::load(const std::string &fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open music file: " << fileName << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    format = AYFileFormat::Unknown;
+    songCount = 1;
+    if (data.size() >= sizeof(VgmHeader) && std::memcmp(data.data(), "Vgm ", 4) == 0)
+    {
+        format = AYFileFormat::VGM;
+    }
+    else if (data.size() >= 16 && std::memcmp(data.data(), "PSG\x1A", 4) == 0)
+    {
+        format = AYFileFormat::PSG;
+    }
+    else if (data.size() >= 20 && std::memcmp(data.data(), "ZXAYEMUL", 8) == 0)
+    {
+        format = AYFileFormat::AY;
+        songCount = data[16] + 1;
+    }
+    else
+    {
+        std::cerr << "Not a VGM, PSG or AY file: " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool AYPlayer::start(int song)
+{
+    // Fresh chip: its sample counter starts at T-state 0 with the song.
+    // Rendering happens in setClock on the calling thread, nothing runs in the background
+    ay = std::make_unique<AY8912>();
+    ay->initialize(false);
+    ticks = 0;
+    frames = 0;
+    fadeFrames = 0;
+    readSamples = 0;
+    lengthFrames = AYPLAYER_DEFAULT_SECONDS * 50;
+    ended = false;
+    position = 0;
+    streamTicks = 0;
+    vgmSamples = 0;
+
+    switch (format)
+    {
+    case AYFileFormat::VGM:
+        return startVgm();
+    case AYFileFormat::PSG:
+        return startPsg();
+    case AYFileFormat::AY:
+        return startAy(song);
+    default:
+        return false;
+    }
+}
+
+void AYPlayer::writeRegister(uint64_t tstate, uint8_t reg, uint8_t value)
+{
+    ay->ticks = tstate;
+    ay->writePort(0xFFFD, reg);
+    ay->writePort(0xBFFD, value);
+}
+
+bool AYPlayer::playFrame()
+{
+    if (ended || frames >= lengthFrames)
+    {
+        return false;
+    }
+    uint64_t frameEnd = ticks + AYPLAYER_FRAME_TICKS;
+    switch (format)
+    {
+    case AYFileFormat::VGM:
+        runVgm(frameEnd);
+        break;
+    case AYFileFormat::PSG:
+        runPsg(frameEnd);
+        break;
+    case AYFileFormat::AY:
+        runAy(frameEnd);
+        break;
+    default:
+        return false;
+    }
+    ay->setClock(frameEnd);
+    ticks = frameEnd;
+    frames++;
+    return true;
+}
+
+size_t AYPlayer::read(int16_t *out, size_t count)
+{
+    size_t got = ay->getOutput()->read(out, count * 2) / 2;
+
+    // Linear fade over the last fadeFrames of the song
+    if (fadeFrames > 0)
+    {
+        uint64_t fadeLength = fadeFrames * AY_SAMPLE_RATE / 50;
+        uint64_t fadeStart = lengthFrames * AY_SAMPLE_RATE / 50 - fadeLength;
+        for (size_t i = 0; i < got; i++)
+        {
+            uint64_t sample = readSamples + i;
+            if (sample >= fadeStart)
+            {
+                int32_t gain = static_cast<int32_t>(256 - std::min<uint64_t>(256, (sample - fadeStart) * 256 / fadeLength));
+                out[i * 2] = static_cast<int16_t>(out[i * 2] * gain / 256);
+                out[i * 2 + 1] = static_cast<int16_t>(out[i * 2 + 1] * gain / 256);
+            }
+        }
+    }
+    readSamples += got;
+    return got;
+}
+
+// VGM: header tells where data starts and which clock the chip runs at.
+// Waits are in 44100 Hz samples, converted to T-states rounding up,
+// so AY8912 puts every write on exactly the sample VGM asks for
+bool AYPlayer::startVgm()
+{
+    VgmHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (!header.ay8910Clock)
+    {
+        std::cerr << "VGM file has no AY-3-8910 data" << std::endl;
+        return false;
+    }
+    ay->setChipFrequency(header.ay8910Clock & 0x3FFFFFFF);
+
+    position = 0x40;
+    if (header.version >= 0x150 && header.vgmDataOffset)
+    {
+        position = header.vgmDataOffset + 0x34;
+    }
+    if (header.totalSamples)
+    {
+        // Looped part is played once
+        lengthFrames = (static_cast<uint64_t>(header.totalSamples) * 50 + AY_SAMPLE_RATE - 1) / AY_SAMPLE_RATE;
+    }
+    return position < data.size();
+}
+
+void AYPlayer::runVgm(uint64_t until)
+{
+    while (!ended && streamTicks < until)
+    {
+        if (position >= data.size())
+        {
+            ended = true;
+            break;
+        }
+        uint8_t command = data[position];
+        size_t length = 1;
+        uint32_t wait = 0;
+        if (command == 0xA0 && position + 2 < data.size())
+        {
+            // Second chip (bit 7 of register) is not there
+            if (!(data[position + 1] & 0x80))
+            {
+                writeRegister(streamTicks, data[position + 1] & 0x0F, data[position + 2]);
+            }
+            length = 3;
+        }
+        else if (command == 0x61 && position + 2 < data.size())
+        {
+            wait = data[position + 1] | (data[position + 2] << 8);
+            length = 3;
+        }
+        else if (command == 0x62)
+        {
+            wait = 735;
+        }
+        else if (command == 0x63)
+        {
+            wait = 882;
+        }
+        else if (command == 0x66)
+        {
+            ended = true;
+            break;
+        }
+        else if (command == 0x67 && position + 6 < data.size())
+        {
+            // Data block: 67 66 tt ssssssss
+            uint32_t size;
+            std::memcpy(&size, &data[position + 3], 4);
+            length = 7 + size;
+        }
+        else if ((command & 0xF0) == 0x70)
+        {
+            wait = (command & 0x0F) + 1;
+        }
+        else if ((command & 0xF0) == 0x80)
+        {
+            wait = command & 0x0F; // YM2612 DAC write and wait
+        }
+        else
+        {
+            // Commands of other chips, only their length matters
+            static const struct
+            {
+                uint8_t first, last, length;
+            } lengths[] = {
+                {0x30, 0x3F, 2}, {0x40, 0x4E, 3}, {0x4F, 0x50, 2}, {0x51, 0x5F, 3}, {0x68, 0x68, 12},
+                {0x90, 0x91, 5}, {0x92, 0x92, 6}, {0x93, 0x93, 11}, {0x94, 0x94, 2}, {0x95, 0x95, 5},
+                {0xA1, 0xBF, 3}, {0xC0, 0xDF, 4}, {0xE0, 0xFF, 5}};
+            length = 0;
+            for (const auto &range : lengths)
+            {
+                if (command >= range.first && command <= range.last)
+                {
+                    length = range.length;
+                }
+            }
+            if (length == 0)
+            {
+                std::cerr << "Unknown VGM command " << std::hex << int(command) << std::dec << ", stopping" << std::endl;
+                ended = true;
+                break;
+            }
+        }
+        position += length;
+        if (wait)
+        {
+            vgmSamples += wait;
+            streamTicks = (vgmSamples * AY_CPU_FREQUENCY + AY_SAMPLE_RATE - 1) / AY_SAMPLE_RATE;
+        }
+    }
+}
+
+bool AYPlayer::startPsg()
+{
+    ay->setChipFrequency(AY_CHIP_FREQUENCY);
+    position = 16;
+    lengthFrames = UINT64_MAX; // Ends with the data
+    return true;
+}
+
+// PSG: FF ends a frame, FE nn skips nn*4 frames, FD ends the song, rr vv writes a register
+void AYPlayer::runPsg(uint64_t until)
+{
+    while (!ended && streamTicks < until)
+    {
+        if (position >= data.size() || data[position] == 0xFD)
+        {
+            ended = true;
+            break;
+        }
+        uint8_t command = data[position++];
+        if (command == 0xFF)
+        {
+            streamTicks += AYPLAYER_FRAME_TICKS;
+        }
+        else if (command == 0xFE && position < data.size())
+        {
+            streamTicks += static_cast<uint64_t>(data[position++]) * 4 * AYPLAYER_FRAME_TICKS;
+        }
+        else if (command < 16 && position < data.size())
+        {
+            writeRegister(streamTicks, command, data[position++]);
+        }
+        else
+        {
+            position++;
+        }
+    }
+}
+
+size_t AYPlayer::ayPointer(size_t offset) const
+{
+    if (offset + 1 >= data.size())
+    {
+        return 0;
+    }
+    int16_t relative = static_cast<int16_t>((data[offset] << 8) | data[offset + 1]);
+    int64_t target = static_cast<int64_t>(offset) + relative;
+    return (target > 0 && static_cast<size_t>(target) < data.size()) ? static_cast<size_t>(target) : 0;
+}
+
+// ZXAYEMUL: memory is set up as the format describes, a small driver at 0000h calls
+// INIT once and then INTERRUPT (or IM 2 handler) on every 50 Hz interrupt
+bool AYPlayer::startAy(int song)
+{
+    ay->setChipFrequency(AY_CHIP_FREQUENCY);
+    if (song < 0 || song >= songCount)
+    {
+        std::cerr << "AY file has only " << songCount << " songs" << std::endl;
+        return false;
+    }
+    size_t songs = ayPointer(18);
+    size_t songData = songs ? ayPointer(songs + song * 4 + 2) : 0;
+    if (!songData || songData + 14 > data.size())
+    {
+        std::cerr << "Damaged AY file" << std::endl;
+        return false;
+    }
+    uint16_t songLength = (data[songData + 4] << 8) | data[songData + 5];
+    uint16_t fadeLength = (data[songData + 6] << 8) | data[songData + 7];
+    uint16_t registerValue = (data[songData + 8] << 8) | data[songData + 9];
+    size_t points = ayPointer(songData + 10);
+    size_t blocks = ayPointer(songData + 12);
+    if (!points || !blocks || points + 6 > data.size())
+    {
+        std::cerr << "Damaged AY file" << std::endl;
+        return false;
+    }
+    uint16_t stack = (data[points] << 8) | data[points + 1];
+    uint16_t init = (data[points + 2] << 8) | data[points + 3];
+    uint16_t interrupt = (data[points + 4] << 8) | data[points + 5];
+    if (songLength)
+    {
+        lengthFrames = songLength;
+        fadeFrames = std::min<uint64_t>(fadeLength, songLength);
+    }
+
+    // 48K machine with writable ROM area is a flat 64K RAM
+    memory = std::make_unique<Memory>();
+    memory->change48(true);
+    memory->setRomWritable(true);
+    for (uint32_t address = 0; address < 0x10000; address++)
+    {
+        memory->WriteByte(address, address < 0x100 ? 0xC9 : (address < 0x4000 ? 0xFF : 0x00));
+    }
+    memory->WriteByte(0x0038, 0xFB); // EI, RET follows
+
+    // Data blocks: address, length, relative offset; list ends with address 0
+    for (size_t block = blocks; block + 6 <= data.size(); block += 6)
+    {
+        uint16_t address = (data[block] << 8) | data[block + 1];
+        if (address == 0)
+        {
+            break;
+        }
+        uint32_t length = (data[block + 2] << 8) | data[block + 3];
+        size_t offset = ayPointer(block + 4);
+        if (!offset)
+        {
+            continue;
+        }
+        length = std::min<uint32_t>({length, 0x10000u - address, static_cast<uint32_t>(data.size() - offset)});
+        if (init == 0 && block == blocks)
+        {
+            init = address;
+        }
+        for (uint32_t i = 0; i < length; i++)
+        {
+            memory->WriteByte(address + i, data[offset + i]);
+        }
+    }
+
+    // DI; CALL init; then IM 2: EI; HALT; JR loop  or  IM 1: EI; HALT; CALL interrupt; JR loop
+    std::vector<uint8_t> driver = {0xF3, 0xCD, uint8_t(init & 0xFF), uint8_t(init >> 8)};
+    if (interrupt == 0)
+    {
+        driver.insert(driver.end(), {0xED, 0x5E, 0xFB, 0x76, 0x18, 0xFA});
+    }
+    else
+    {
+        driver.insert(driver.end(), {0xED, 0x56, 0xFB, 0x76, 0xCD, uint8_t(interrupt & 0xFF), uint8_t(interrupt >> 8), 0x18, 0xF7});
+    }
+    for (size_t i = 0; i < driver.size(); i++)
+    {
+        memory->WriteByte(i, driver[i]);
+    }
+
+    // Player talks to AY on FFFD/BFFD. Beeper writes and keyboard reads go nowhere
+    ports = std::make_unique<Port>();
+    ports->RegisterWriteHandler(0xFD, [this](uint16_t port, uint8_t value)
+                                { ay->writePort(port, value); });
+    ports->RegisterReadHandler(0xFD, [this](uint16_t port) -> uint8_t
+                               { return ay->readPort(port); });
+    ports->RegisterWriteHandler(0xFE, [](uint16_t, uint8_t) {});
+    ports->RegisterReadHandler(0xFE, [](uint16_t) -> uint8_t
+                               { return 0xFF; });
+
+    cpu = std::make_unique<Z80>(memory.get(), ports.get());
+    cpu->isNMOS = false;
+    cpu->AF = cpu->BC = cpu->DE = cpu->HL = registerValue;
+    cpu->AF_ = cpu->BC_ = cpu->DE_ = cpu->HL_ = registerValue;
+    cpu->IX = cpu->IY = registerValue;
+    cpu->I = 3;
+    cpu->SP = stack;
+    cpu->PC = 0;
+    cpuTicks = 0;
+    return true;
+}
+
+// Run player code, one interrupt at the start of every frame
+void AYPlayer::runAy(uint64_t until)
+{
+    cpu->InterruptPending = true;
+    while (cpuTicks < until)
+    {
+        ay->ticks = cpuTicks;
+        cpuTicks += cpu->ExecuteOneInstruction();
+    }
+}
+
+bool convertMusicFile(const std::string &input, const std::string &output, int song)
+{
+    AYPlayer player;
+    if (!player.load(input) || !player.start(song))
+    {
+        return false;
+    }
+    WavWriter wav;
+    if (!wav.open(output, AY_SAMPLE_RATE, 2, AYPLAYER_WAV_BUFFER_BYTES))
+    {
+        return false;
+    }
+    int16_t block[AY_RENDER_FRAMES * 2];
+    while (player.playFrame())
+    {
+        size_t got;
+        while ((got = player.read(block, AY_RENDER_FRAMES)) > 0)
+        {
+            wav.write(block, got);
+        }
+    }
+    return wav.close();
+}
+
+int convertMusicDirectory(const std::string &directory, int jobs)
+{
+    struct Task
+    {
+        std::string input;
+        std::string output;
+        int song;
+    };
+    std::vector<Task> tasks;
+    std::set<std::string> outputs;
+
+    // Every song is a task of its own, so one long AY collection does not hold up the pool
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+    {
+        if (!entry.is_regular_file())
+        {
+            continue;
+        }
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension != ".vgm" && extension != ".psg" && extension != ".ay")
+        {
+            continue;
+        }
+        std::string input = entry.path().string();
+        std::filesystem::path base = entry.path();
+        base.replace_extension();
+        int songs = 1;
+        if (extension == ".ay")
+        {
+            AYPlayer probe;
+            songs = probe.load(input) ? probe.getSongCount() : 1;
+        }
+        for (int song = 0; song < songs; song++)
+        {
+            std::string output = base.string() + (songs > 1 ? "-" + std::to_string(song) : "") + ".wav";
+            if (!outputs.insert(output).second)
+            {
+                // tune.vgm and tune.psg side by side: keep both
+                output = input + (songs > 1 ? "-" + std::to_string(song) : "") + ".wav";
+                outputs.insert(output);
+            }
+            tasks.push_back({input, output, song});
+        }
+    }
+    if (error)
+    {
+        std::cerr << "Failed to read directory " << directory << ": " << error.message() << std::endl;
+        return -1;
+    }
+
+    if (jobs <= 0)
+    {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    jobs = std::min<int>(jobs, std::max<size_t>(tasks.size(), 1));
+
+    // Workers take the next task from a shared counter: no queue, no lock, no idle worker while work is left
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    std::mutex printMutex;
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 size_t index;
+                                 while ((index = next.fetch_add(1, std::memory_order_relaxed)) < tasks.size())
+                                 {
+                                     const Task &task = tasks[index];
+                                     bool ok = convertMusicFile(task.input, task.output, task.song);
+                                     if (!ok)
+                                     {
+                                         failed++;
+                                     }
+                                     std::lock_guard<std::mutex> lock(printMutex);
+                                     std::cerr << (ok ? "Converted " : "FAILED ") << task.output << std::endl;
+                                 } });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cerr << tasks.size() << " songs converted on " << jobs << " threads in " << seconds << " s" << std::endl;
+    return failed;
+}
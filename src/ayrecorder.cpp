@@ -0,0 +1,300 @@
+#include "ayrecorder.hpp"
+#include "formats/vgm_format.h"
+#include "chips/ay-3-8910.h"
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+static_assert(sizeof(VgmHeader) == 0x100, "VGM header must be 256 bytes");
+
+AYRecorder::AYRecorder() : requested(0), activeSession(0), sessions(0), dropped(0),
+                           flushing(false), finished(false), file(nullptr), format(AYLogFormat::VGM),
+                           started(false), stopSeen(false), startTstate(0), writtenSamples(0), pendingFrames(0), lastTstate(0)
+{
+}
+
+AYRecorder::~AYRecorder()
+{
+    stop();
+}
+
+bool AYRecorder::start(const std::string &fileName, AYLogFormat logFormat)
+{
+    if (isRecording() || flushing)
+    {
+        std::cerr << "AY recording is already running" << std::endl;
+        return false;
+    }
+    file = fopen(fileName.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to create AY log: " << fileName << std::endl;
+        return false;
+    }
+
+    format = logFormat;
+    started = false;
+    stopSeen = false;
+    startTstate = 0;
+    lastTstate = 0;
+    writtenSamples = 0;
+    pendingFrames = 0;
+    out.clear();
+    if (format == AYLogFormat::VGM)
+    {
+        // Placeholder, sizes are known at the end
+        out.resize(sizeof(VgmHeader), 0);
+    }
+    else
+    {
+        // "PSG" 1Ah, version, interrupt frequency, reserved
+        static const uint8_t psgHeader[16] = {'P', 'S', 'G', 0x1A, 10, 50};
+        out.assign(psgHeader, psgHeader + sizeof(psgHeader));
+    }
+
+    // Emulation thread pushes only after it has seen the request below
+    if (!ring)
+    {
+        ring = std::make_unique<RingBuffer<AYLogEntry>>(AYREC_RING_WRITES);
+    }
+    dropped = 0;
+    finished = false;
+    flushing = true;
+    flusher = std::thread(&AYRecorder::flushLoop, this);
+    requested.store(++sessions, std::memory_order_release);
+    return true;
+}
+
+void AYRecorder::stop()
+{
+    requestStop();
+    if (!flusher.joinable())
+    {
+        return;
+    }
+
+    // Emulation writes STOP at the end of its frame; paused emulation never will
+    for (int i = 0; i < 25 && !finished.load(std::memory_order_acquire); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(AYREC_FLUSH_MS));
+    }
+    flushing = false;
+    flusher.join();
+
+    // Without STOP (emulation paused) the emulation thread may still push, so the ring stays
+    if (stopSeen)
+    {
+        ring.reset();
+    }
+
+    if (dropped.load(std::memory_order_relaxed) > 0)
+    {
+        std::cerr << "AY log: " << dropped.load() << " register writes lost, ring was full" << std::endl;
+    }
+}
+
+// Called at every frame end by the emulation thread, costs one atomic load when idle
+void AYRecorder::frame(uint64_t tstate, const uint8_t *registers)
+{
+    uint32_t wanted = requested.load(std::memory_order_acquire);
+    if (activeSession && activeSession != wanted)
+    {
+        push(tstate, AYREC_STOP, 0);
+        activeSession = 0;
+    }
+    if (!activeSession && wanted)
+    {
+        // Start from the state the chip is in, so recording can begin in the middle of a tune
+        activeSession = wanted;
+        push(tstate, AYREC_START, 0);
+        for (uint8_t reg = 0; reg < 14; reg++)
+        {
+            push(tstate, reg, registers[reg]);
+        }
+    }
+    else if (activeSession)
+    {
+        push(tstate, AYREC_FRAME, 0);
+    }
+}
+
+void AYRecorder::flushLoop()
+{
+    AYLogEntry entries[256];
+    while (!finished.load(std::memory_order_relaxed))
+    {
+        size_t count;
+        while (!finished.load(std::memory_order_relaxed) && (count = ring->read(entries, 256)) > 0)
+        {
+            for (size_t i = 0; i < count && !finished.load(std::memory_order_relaxed); i++)
+            {
+                put(entries[i]);
+            }
+        }
+        if (!out.empty() && file)
+        {
+            fwrite(out.data(), 1, out.size(), file);
+            out.clear();
+        }
+        if (finished.load(std::memory_order_relaxed))
+        {
+            break;
+        }
+        if (!flushing.load(std::memory_order_relaxed))
+        {
+            // Given up waiting for STOP: keep what was recorded
+            finish(lastTstate);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(AYREC_FLUSH_MS));
+    }
+}
+
+void AYRecorder::put(const AYLogEntry &entry)
+{
+    if (!started)
+    {
+        // Leftovers of an earlier recording are skipped
+        if (entry.reg == AYREC_START)
+        {
+            started = true;
+            startTstate = entry.tstate;
+            lastTstate = entry.tstate;
+        }
+        return;
+    }
+    lastTstate = entry.tstate;
+
+    if (entry.reg == AYREC_STOP)
+    {
+        stopSeen = true;
+        finish(entry.tstate);
+        return;
+    }
+    if (entry.reg == AYREC_FRAME)
+    {
+        if (format == AYLogFormat::PSG)
+        {
+            pendingFrames++;
+        }
+        return;
+    }
+
+    if (format == AYLogFormat::VGM)
+    {
+        // Sample is calculated from the start, so rounding does not add up
+        uint64_t sample = (entry.tstate - startTstate) * AYREC_SAMPLE_RATE / AYREC_CPU_FREQUENCY;
+        putVgmWait(sample - writtenSamples);
+    }
+    else
+    {
+        putPsgFrames();
+    }
+
+    if (entry.reg == AYREC_RESET)
+    {
+        for (uint8_t reg = 0; reg < 14; reg++)
+        {
+            putWrite(reg, 0);
+        }
+    }
+    else if (entry.reg < 14)
+    {
+        putWrite(entry.reg, entry.value);
+    }
+}
+
+void AYRecorder::putWrite(uint8_t reg, uint8_t value)
+{
+    if (format == AYLogFormat::VGM)
+    {
+        out.push_back(0xA0); // AY8910 write
+    }
+    out.push_back(reg);
+    out.push_back(value);
+}
+
+// Shortest VGM wait commands for given number of samples
+void AYRecorder::putVgmWait(uint64_t samples)
+{
+    writtenSamples += samples;
+    while (samples > 0)
+    {
+        if (samples == 882 || samples == 882 * 2)
+        {
+            out.push_back(0x63); // 1/50 s
+            samples -= 882;
+        }
+        else if (samples == 735)
+        {
+            out.push_back(0x62); // 1/60 s
+            samples -= 735;
+        }
+        else if (samples <= 16)
+        {
+            out.push_back(static_cast<uint8_t>(0x70 + samples - 1));
+            samples = 0;
+        }
+        else
+        {
+            uint16_t wait = static_cast<uint16_t>(std::min<uint64_t>(samples, 65535));
+            out.push_back(0x61);
+            out.push_back(wait & 0xFF);
+            out.push_back(wait >> 8);
+            samples -= wait;
+        }
+    }
+}
+
+// PSG frame markers: FF ends one frame, FE nn skips nn*4 frames
+void AYRecorder::putPsgFrames()
+{
+    while (pendingFrames >= 4)
+    {
+        uint32_t skip = std::min<uint32_t>(pendingFrames / 4, 255);
+        out.push_back(0xFE);
+        out.push_back(static_cast<uint8_t>(skip));
+        pendingFrames -= skip * 4;
+    }
+    for (; pendingFrames > 0; pendingFrames--)
+    {
+        out.push_back(0xFF);
+    }
+}
+
+void AYRecorder::finish(uint64_t tstate)
+{
+    if (format == AYLogFormat::VGM)
+    {
+        uint64_t sample = (tstate - startTstate) * AYREC_SAMPLE_RATE / AYREC_CPU_FREQUENCY;
+        putVgmWait(sample - writtenSamples);
+        out.push_back(0x66); // End of sound data
+    }
+    else
+    {
+        putPsgFrames();
+        out.push_back(0xFD); // End of music
+    }
+    fwrite(out.data(), 1, out.size(), file);
+    out.clear();
+
+    if (format == AYLogFormat::VGM)
+    {
+        VgmHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.ident = 0x206D6756; // "Vgm "
+        header.eofOffset = static_cast<uint32_t>(ftell(file) - 4);
+        header.version = 0x171;
+        header.totalSamples = static_cast<uint32_t>(writtenSamples);
+        header.vgmDataOffset = sizeof(VgmHeader) - 0x34;
+        header.ay8910Clock = AYREC_CHIP_FREQUENCY;
+        header.ay8910Type = CHIP_TYPE_AY8912;
+        header.ay8910Flags = 0x01; // Legacy output
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+    }
+    fclose(file);
+    file = nullptr;
+    finished.store(true, std::memory_order_release);
+}
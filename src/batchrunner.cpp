@@ -0,0 +1,409 @@
+#include "batchrunner.hpp"
+#include "machine.hpp"
+#include "capturewriter.hpp"
+#include "workpool.hpp"
+#include "snapshot.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Key press or release of the input script
+struct KeyEvent
+{
+    long long frame;
+    int halfRow;
+    int keyBit;
+    bool down;
+};
+
+// Spectrum keyboard, half-row by half-row as ULA scans it
+static const char *const KEY_NAMES[8][5] = {
+    {"CAPS", "Z", "X", "C", "V"},
+    {"A", "S", "D", "F", "G"},
+    {"Q", "W", "E", "R", "T"},
+    {"1", "2", "3", "4", "5"},
+    {"0", "9", "8", "7", "6"},
+    {"P", "O", "I", "U", "Y"},
+    {"ENTER", "L", "K", "J", "H"},
+    {"SPACE", "SYMBOL", "M", "N", "B"}};
+
+#define INPUT_DEFAULT_HOLD 3 // Frames a key stays down, ROM scans keyboard every frame
+
+static bool findKey(std::string name, int &halfRow, int &keyBit)
+{
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    for (halfRow = 0; halfRow < 8; halfRow++)
+    {
+        for (keyBit = 0; keyBit < 5; keyBit++)
+        {
+            if (name == KEY_NAMES[halfRow][keyBit])
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool loadInput(const std::string &fileName, std::vector<KeyEvent> &events)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        std::cerr << "Failed to open input script: " << fileName << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        long long frame;
+        std::string keys;
+        if (!(fields >> frame))
+        {
+            continue; // Empty or comment
+        }
+        long long hold = INPUT_DEFAULT_HOLD;
+        long long value;
+        if (fields >> keys && fields >> value)
+        {
+            hold = value;
+        }
+        if (keys.empty() || hold < 1)
+        {
+            std::cerr << fileName << ":" << lineNumber << ": expected <frame> <key>[+<key>...] [frames held]" << std::endl;
+            return false;
+        }
+        std::istringstream names(keys);
+        std::string name;
+        while (std::getline(names, name, '+'))
+        {
+            int halfRow, keyBit;
+            if (!findKey(name, halfRow, keyBit))
+            {
+                std::cerr << fileName << ":" << lineNumber << ": unknown key " << name << std::endl;
+                return false;
+            }
+            events.push_back({frame, halfRow, keyBit, true});
+            events.push_back({frame + hold, halfRow, keyBit, false});
+        }
+    }
+    // Releases of a frame before presses of the same frame, so a key can be pressed again
+    std::stable_sort(events.begin(), events.end(), [](const KeyEvent &a, const KeyEvent &b)
+                     { return a.frame != b.frame ? a.frame < b.frame : a.down < b.down; });
+    return true;
+}
+
+// Screen as 352x288 binary PPM, readable by any image tool
+static bool writeScreen(const std::string &fileName, const uint32_t *screen)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to create screen file: " << fileName << std::endl;
+        return false;
+    }
+    file << "P6\n" << MACHINE_SCREEN_WIDTH << " " << MACHINE_SCREEN_HEIGHT << "\n255\n";
+    std::vector<uint8_t> rgb(MACHINE_SCREEN_WIDTH * MACHINE_SCREEN_HEIGHT * 3);
+    for (size_t i = 0; i < MACHINE_SCREEN_WIDTH * MACHINE_SCREEN_HEIGHT; i++)
+    {
+        // ARGB8888
+        rgb[i * 3] = (screen[i] >> 16) & 0xFF;
+        rgb[i * 3 + 1] = (screen[i] >> 8) & 0xFF;
+        rgb[i * 3 + 2] = screen[i] & 0xFF;
+    }
+    file.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+    return static_cast<bool>(file);
+}
+
+// Memory as the CPU sees it now, 0000-FFFF
+static bool writeRam(const std::string &fileName, Memory *memory)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to create RAM file: " << fileName << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data(65536);
+    for (size_t address = 0; address < data.size(); address++)
+    {
+        data[address] = memory->ReadByte(static_cast<uint16_t>(address));
+    }
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return static_cast<bool>(file);
+}
+
+BatchRunner::BatchRunner() : threadsUsed(0), wallMs(0), jobResidentKB(0)
+{
+}
+
+bool BatchRunner::loadManifest(const std::string &fileName)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        std::cerr << "Failed to open manifest: " << fileName << std::endl;
+        return false;
+    }
+    std::filesystem::path base = std::filesystem::path(fileName).parent_path();
+    auto resolve = [&base](const std::string &path)
+    {
+        return std::filesystem::path(path).is_absolute() ? path : (base / path).string();
+    };
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string field;
+        BatchJob job;
+        bool empty = true;
+        while (fields >> field)
+        {
+            empty = false;
+            size_t equals = field.find('=');
+            std::string key = equals == std::string::npos ? "image" : field.substr(0, equals);
+            std::string value = equals == std::string::npos ? field : field.substr(equals + 1);
+            if (key == "image")
+                job.imageFile = resolve(value);
+            else if (key == "rom")
+                job.romFile = resolve(value);
+            else if (key == "input")
+                job.inputFile = resolve(value);
+            else if (key == "frames")
+                job.frames = std::atoll(value.c_str());
+            else if (key == "until-pc")
+                job.untilPC = static_cast<int>(std::strtol(value.c_str(), nullptr, 0)) & 0xFFFF;
+            else if (key == "until-tape-end")
+                job.untilTapeEnd = value != "0";
+            else if (key == "screen")
+                job.screenFile = resolve(value);
+            else if (key == "ram")
+                job.ramFile = resolve(value);
+            else if (key == "wav")
+                job.wavFile = resolve(value);
+            else if (key == "snapshot")
+                job.snapshotFile = resolve(value);
+            else
+            {
+                std::cerr << fileName << ":" << lineNumber << ": unknown field " << key << std::endl;
+                return false;
+            }
+        }
+        if (!empty)
+        {
+            jobs.push_back(job);
+        }
+    }
+    return true;
+}
+
+// Peak resident size of the process in KB, 0 where the platform does not tell
+static long long peakResidentKB()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // Bytes there
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void BatchRunner::run(int threads)
+{
+    results.assign(jobs.size(), BatchResult());
+    WorkPool pool(threads);
+    threadsUsed = pool.getThreads();
+
+    long long startKB = peakResidentKB();
+    auto startTime = std::chrono::steady_clock::now();
+    pool.run(jobs.size(), [this](size_t index, int)
+             { runJob(jobs[index], results[index]); });
+    wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    // Jobs run threadsUsed at a time, the peak is reached with that many machines alive
+    size_t concurrent = std::min<size_t>(threadsUsed, jobs.size());
+    jobResidentKB = concurrent ? (peakResidentKB() - startKB) / static_cast<long long>(concurrent) : 0;
+}
+
+int BatchRunner::getFailures() const
+{
+    return static_cast<int>(std::count_if(results.begin(), results.end(), [](const BatchResult &result)
+                                          { return !result.ok; }));
+}
+
+void BatchRunner::printReport(std::ostream &out) const
+{
+    long long totalTicks = 0;
+    out << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BatchResult &result = results[i];
+        out << std::setw(5) << i + 1 << (result.ok ? "  ok   " : "  FAIL ") << std::setw(7) << result.frames << " frames "
+            << std::setw(9) << result.setupMs + result.runMs << " ms " << std::setw(7) << result.getMHz() << " MHz  "
+            << result.reason << "  " << jobs[i].imageFile << std::endl;
+        totalTicks += result.ticks;
+    }
+    // Compare with a --threads 1 run of the same manifest to see how it scales
+    out << results.size() << " jobs, " << getFailures() << " failed, " << threadsUsed << " threads: "
+        << wallMs << " ms wall, " << (wallMs > 0 ? totalTicks / wallMs / 1000.0 : 0) << " emulated MHz total";
+    if (jobResidentKB > 0)
+    {
+        out << ", " << jobResidentKB << " KB RSS per job";
+    }
+    out << std::endl;
+}
+
+bool BatchRunner::runJob(const BatchJob &job, BatchResult &result)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    result = BatchResult();
+
+    // Nobody mixes the sound of a job without wav=, small rings just drop it
+    Machine machine;
+    machine.initialize(false, job.wavFile.empty() ? MACHINE_QUIET_RING_SAMPLES : SOUND_RING_SAMPLES);
+    machine.prepare();
+    std::vector<KeyEvent> input;
+    if (!job.romFile.empty() && !machine.loadRom(job.romFile))
+    {
+        result.reason = "ROM failed";
+        return false;
+    }
+    if (!job.inputFile.empty() && !loadInput(job.inputFile, input))
+    {
+        result.reason = "input failed";
+        return false;
+    }
+    if (Snapshot::isSnapshotFile(job.imageFile))
+    {
+        if (!machine.loadSnapshot(job.imageFile))
+        {
+            result.reason = "image failed";
+            return false;
+        }
+    }
+    else if (!job.imageFile.empty())
+    {
+        if (!machine.loadTape(job.imageFile))
+        {
+            result.reason = "image failed";
+            return false;
+        }
+        machine.playTape();
+    }
+
+    WavWriter wav;
+    if (!job.wavFile.empty() && !wav.open(job.wavFile, MIXER_SAMPLE_RATE, 2, BATCH_WAV_BUFFER_BYTES))
+    {
+        result.reason = "WAV failed";
+        return false;
+    }
+
+    auto runTime = std::chrono::steady_clock::now();
+    Z80 *cpu = machine.getCpu();
+    ULA *ula = machine.getUla();
+    Tape *tape = machine.getTape();
+    AudioMixer *mixer = machine.getMixer();
+    std::vector<int16_t> samples;
+    uint64_t mixedSamples = 0;
+    size_t nextInput = 0;
+    result.reason = "frames";
+    ula->setRendering(false); // Screen is drawn once at the end if wanted
+    machine.start();
+    while (true)
+    {
+        // Keys change between frames, ROM and games read them once per frame
+        while (nextInput < input.size() && input[nextInput].frame <= machine.getFrames())
+        {
+            const KeyEvent &event = input[nextInput++];
+            if (event.down)
+                ula->setKeyDown(event.halfRow, event.keyBit);
+            else
+                ula->setKeyUp(event.halfRow, event.keyBit);
+        }
+        if (machine.getFrames() >= job.frames)
+        {
+            break;
+        }
+
+        bool frameDone = false;
+        bool reachedPC = false;
+        while (!frameDone && !reachedPC)
+        {
+            frameDone = machine.step();
+            reachedPC = job.untilPC >= 0 && cpu->PC == job.untilPC;
+        }
+        if (reachedPC)
+        {
+            result.reason = "PC";
+            break;
+        }
+
+        // Sound of the frame is rendered now, take exactly the emulated time
+        if (wav.isOpen())
+        {
+            uint64_t target = static_cast<uint64_t>(machine.getTicks()) * MIXER_SAMPLE_RATE / SOUND_CPU_FREQUENCY;
+            size_t count = target - mixedSamples;
+            samples.resize(count * 2);
+            mixer->mix(samples.data(), count);
+            mixedSamples = target;
+            wav.write(samples.data(), count);
+        }
+        if (job.untilTapeEnd && !tape->isTapePlayed)
+        {
+            result.reason = "tape end";
+            break;
+        }
+    }
+    auto endTime = std::chrono::steady_clock::now();
+
+    bool ok = true;
+    if (!job.screenFile.empty())
+    {
+        ula->redrawScreen();
+        ok = writeScreen(job.screenFile, machine.getScreen()) && ok;
+    }
+    if (!job.ramFile.empty())
+    {
+        ok = writeRam(job.ramFile, machine.getMemory()) && ok;
+    }
+    if (!job.snapshotFile.empty())
+    {
+        ok = machine.saveSnapshot(job.snapshotFile) && ok;
+    }
+    ok = wav.close() && ok;
+    if (!ok)
+    {
+        result.reason += ", output failed";
+    }
+
+    result.ok = ok;
+    result.frames = machine.getFrames();
+    result.ticks = machine.getTicks();
+    result.setupMs = std::chrono::duration<double, std::milli>(runTime - startTime).count();
+    result.runMs = std::chrono::duration<double, std::milli>(endTime - runTime).count();
+    return ok;
+}
@@ -0,0 +1,230 @@
+#include "capturewriter.hpp"
+#include "formats/wav_format.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+CaptureWriter::CaptureWriter() : file(nullptr), ownsFile(false), seekable(false), front(0), fill(0),
+                                 backPending(false), backSize(0), stopping(false), failed(false), written(0)
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+bool CaptureWriter::open(const std::string &fileName, size_t bufferBytes)
+{
+    close();
+    if (fileName == "-")
+    {
+        file = stdout;
+        ownsFile = false;
+    }
+    else
+    {
+        file = fopen(fileName.c_str(), "wb");
+        ownsFile = true;
+    }
+    if (!file)
+    {
+        std::cerr << "Failed to create capture file: " << fileName << std::endl;
+        return false;
+    }
+
+    // Pipes and terminals cannot seek back to fix the header
+    struct stat st;
+    seekable = fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode);
+
+    buffers[0].resize(bufferBytes);
+    buffers[1].resize(bufferBytes);
+    front = 0;
+    fill = 0;
+    backPending = false;
+    stopping = false;
+    failed = false;
+    written = 0;
+    writer = std::thread(&CaptureWriter::writerLoop, this);
+    return true;
+}
+
+void CaptureWriter::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        signal.wait(lock, [this]
+                    { return backPending || stopping; });
+        if (!backPending)
+        {
+            return;
+        }
+
+        // Back buffer belongs to this thread until backPending is cleared
+        const uint8_t *data = buffers[front ^ 1].data();
+        size_t size = backSize;
+        lock.unlock();
+        if (fwrite(data, 1, size, file) != size)
+        {
+            failed = true;
+        }
+        lock.lock();
+        backPending = false;
+        signal.notify_all();
+    }
+}
+
+void CaptureWriter::submit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    signal.wait(lock, [this]
+                { return !backPending; });
+    front ^= 1;
+    backSize = fill;
+    backPending = true;
+    written += fill;
+    fill = 0;
+    signal.notify_all();
+}
+
+void CaptureWriter::write(const void *data, size_t bytes)
+{
+    if (!file)
+    {
+        return;
+    }
+    const uint8_t *source = static_cast<const uint8_t *>(data);
+    while (bytes > 0)
+    {
+        size_t chunk = std::min(bytes, buffers[front].size() - fill);
+        std::memcpy(buffers[front].data() + fill, source, chunk);
+        fill += chunk;
+        source += chunk;
+        bytes -= chunk;
+        if (fill == buffers[front].size())
+        {
+            submit();
+        }
+    }
+}
+
+void CaptureWriter::flush()
+{
+    if (!file)
+    {
+        return;
+    }
+    if (fill > 0)
+    {
+        submit();
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    signal.wait(lock, [this]
+                { return !backPending; });
+    fflush(file);
+}
+
+bool CaptureWriter::rewrite(uint64_t offset, const void *data, size_t bytes)
+{
+    if (!file || !seekable)
+    {
+        return false;
+    }
+    flush();
+    bool ok = fseeko(file, offset, SEEK_SET) == 0 && fwrite(data, 1, bytes, file) == bytes;
+    fseeko(file, 0, SEEK_END);
+    return ok;
+}
+
+bool CaptureWriter::close()
+{
+    if (!file)
+    {
+        return true;
+    }
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    signal.notify_all();
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+
+    bool ok = !failed;
+    if (ownsFile)
+    {
+        ok = (fclose(file) == 0) && ok;
+    }
+    else
+    {
+        fflush(file);
+    }
+    file = nullptr;
+    buffers[0].clear();
+    buffers[0].shrink_to_fit();
+    buffers[1].clear();
+    buffers[1].shrink_to_fit();
+    return ok;
+}
+
+WavWriter::WavWriter() : sampleRate(44100), channels(2), dataBytes(0)
+{
+}
+
+void WavWriter::writeHeader(bool final)
+{
+    // Unknown length (pipe or not finished yet) is written as maximum size
+    uint32_t dataSize = final ? static_cast<uint32_t>(std::min<uint64_t>(dataBytes, UINT32_MAX - 36)) : UINT32_MAX - 36;
+    uint32_t bytesPerFrame = channels * sizeof(int16_t);
+    WaveHeader header =
+        {
+            0x46464952, dataSize + 36, 0x45564157,
+            0x20746d66, 16, 1, channels, sampleRate, sampleRate * bytesPerFrame, static_cast<uint16_t>(bytesPerFrame), 16,
+            0x61746164, dataSize};
+    if (final)
+    {
+        out.rewrite(0, &header, sizeof(header));
+    }
+    else
+    {
+        out.write(&header, sizeof(header));
+    }
+}
+
+bool WavWriter::open(const std::string &fileName, uint32_t rate, uint16_t channelCount, size_t bufferBytes)
+{
+    sampleRate = rate;
+    channels = channelCount;
+    dataBytes = 0;
+    if (!out.open(fileName, bufferBytes))
+    {
+        return false;
+    }
+    writeHeader(false);
+    return true;
+}
+
+void WavWriter::write(const int16_t *samples, size_t frames)
+{
+    size_t bytes = frames * channels * sizeof(int16_t);
+    out.write(samples, bytes);
+    dataBytes += bytes;
+}
+
+bool WavWriter::close()
+{
+    if (!out.isOpen())
+    {
+        return true;
+    }
+    if (out.isSeekable())
+    {
+        writeHeader(true);
+    }
+    return out.close();
+}
@@ -0,0 +1,195 @@
+#include "dac.hpp"
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+Dac::Dac(size_t ringSamples) : ring(ringSamples), eventCount(0), left(0), right(0), position(0),
+             accumulatedLeft(0), accumulatedRight(0), blockFrames(0), enabled(false), ticks(0)
+{
+    std::fill(levels, levels + DAC_CHANNELS, 128);
+}
+
+void Dac::writePort(uint16_t port, uint8_t value)
+{
+    if (!enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    uint8_t channel;
+    switch (port & 0xFF)
+    {
+    case DAC_PORT_COVOX:
+        channel = DAC_ALL_CHANNELS;
+        break;
+    case DAC_PORT_SOUNDRIVE1:
+        channel = 0;
+        break;
+    case DAC_PORT_SOUNDRIVE2:
+        channel = 1;
+        break;
+    case DAC_PORT_SOUNDRIVE3:
+        channel = 2;
+        break;
+    case DAC_PORT_SOUNDRIVE4:
+        channel = 3;
+        break;
+    default:
+        return;
+    }
+
+    // Array full: render what is there, the frame goes on
+    if (eventCount == DAC_MAX_EVENTS)
+    {
+        renderEvents();
+    }
+    events[eventCount++] = {static_cast<uint64_t>(ticks), channel, value};
+}
+
+void Dac::reset()
+{
+    if (eventCount == DAC_MAX_EVENTS)
+    {
+        renderEvents();
+    }
+    events[eventCount++] = {static_cast<uint64_t>(ticks), DAC_ALL_CHANNELS, 128};
+}
+
+void Dac::setClock(uint64_t tstate)
+{
+    // Switched off while playing: do not leave the last level as DC offset
+    if (!enabled.load(std::memory_order_relaxed) && (left || right) && eventCount < DAC_MAX_EVENTS)
+    {
+        events[eventCount++] = {tstate, DAC_ALL_CHANNELS, 128};
+    }
+
+    renderEvents();
+    renderTo(tstate);
+    flushBlock();
+}
+
+void Dac::renderEvents()
+{
+    for (size_t i = 0; i < eventCount; i++)
+    {
+        const DacEvent &event = events[i];
+        renderTo(event.tstate);
+        if (event.channel == DAC_ALL_CHANNELS)
+        {
+            std::fill(levels, levels + DAC_CHANNELS, event.value);
+        }
+        else
+        {
+            levels[event.channel] = event.value;
+        }
+        left = (levels[0] + levels[1] - 2 * 128) * DAC_LEVEL_SCALE;
+        right = (levels[2] + levels[3] - 2 * 128) * DAC_LEVEL_SCALE;
+    }
+    eventCount = 0;
+}
+
+void Dac::renderTo(uint64_t tstate)
+{
+    // One sample is DAC_CPU_FREQUENCY units, one T-state DAC_SAMPLE_RATE units
+    const uint64_t sampleUnits = DAC_CPU_FREQUENCY;
+    uint64_t target = tstate * DAC_SAMPLE_RATE;
+    if (target <= position)
+    {
+        return;
+    }
+
+    // Emulation was paused or jumped far ahead: do not render that gap
+    if ((target - position) / sampleUnits > DAC_RING_SAMPLES / 2)
+    {
+        position = (target / sampleUnits - DAC_RING_SAMPLES / 2) * sampleUnits;
+        accumulatedLeft = 0;
+        accumulatedRight = 0;
+    }
+
+    // Finish the sample the last event landed in, it is the average of its levels
+    uint64_t phase = position % sampleUnits;
+    if (phase)
+    {
+        uint64_t end = std::min(target, position - phase + sampleUnits);
+        accumulatedLeft += static_cast<int64_t>(left) * static_cast<int64_t>(end - position);
+        accumulatedRight += static_cast<int64_t>(right) * static_cast<int64_t>(end - position);
+        position = end;
+        if (position % sampleUnits)
+        {
+            return;
+        }
+        put(static_cast<int16_t>(accumulatedLeft / static_cast<int64_t>(sampleUnits)),
+            static_cast<int16_t>(accumulatedRight / static_cast<int64_t>(sampleUnits)));
+        accumulatedLeft = 0;
+        accumulatedRight = 0;
+    }
+
+    // Whole samples at constant level
+    uint64_t whole = (target - position) / sampleUnits;
+    fill(whole);
+    position += whole * sampleUnits;
+
+    // Beginning of the sample target is in
+    accumulatedLeft = static_cast<int64_t>(left) * static_cast<int64_t>(target - position);
+    accumulatedRight = static_cast<int64_t>(right) * static_cast<int64_t>(target - position);
+    position = target;
+}
+
+void Dac::put(int16_t l, int16_t r)
+{
+    block[blockFrames * 2] = l;
+    block[blockFrames * 2 + 1] = r;
+    if (++blockFrames == DAC_RENDER_FRAMES)
+    {
+        flushBlock();
+    }
+}
+
+void Dac::fill(size_t count)
+{
+    int16_t l = static_cast<int16_t>(left);
+    int16_t r = static_cast<int16_t>(right);
+    while (count > 0)
+    {
+        size_t frames = std::min(count, DAC_RENDER_FRAMES - blockFrames);
+        int16_t *out = block + blockFrames * 2;
+        size_t i = 0;
+#if defined(__SSE2__)
+        // Four stereo frames per store
+        __m128i frame = _mm_set1_epi32(static_cast<int>(static_cast<uint16_t>(l) | (static_cast<uint32_t>(static_cast<uint16_t>(r)) << 16)));
+        for (; i + 4 <= frames; i += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 2), frame);
+        }
+#elif defined(__ARM_NEON)
+        int16x8_t frame = vreinterpretq_s16_u32(vdupq_n_u32(static_cast<uint16_t>(l) | (static_cast<uint32_t>(static_cast<uint16_t>(r)) << 16)));
+        for (; i + 4 <= frames; i += 4)
+        {
+            vst1q_s16(out + i * 2, frame);
+        }
+#endif
+        for (; i < frames; i++)
+        {
+            out[i * 2] = l;
+            out[i * 2 + 1] = r;
+        }
+        blockFrames += frames;
+        count -= frames;
+        if (blockFrames == DAC_RENDER_FRAMES)
+        {
+            flushBlock();
+        }
+    }
+}
+
+void Dac::flushBlock()
+{
+    if (blockFrames > 0)
+    {
+        ring.write(block, blockFrames * 2);
+        blockFrames = 0;
+    }
+}
@@ -0,0 +1,161 @@
+#include "decimator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Input kept in the history before it is compacted, in frames
+static const size_t DECIMATOR_RESERVE = 16384;
+
+Decimator::Decimator(uint32_t inputRate, uint32_t outputRate) : inputRate(inputRate), outputRate(outputRate)
+{
+    left.reserve(DECIMATOR_RESERVE + DECIMATOR_TAPS);
+    right.reserve(DECIMATOR_RESERVE + DECIMATOR_TAPS);
+    kernel = kernelFor(inputRate, outputRate);
+    reset();
+}
+
+// Built once per rate pair and kept to the end, like the ROM images of RomRegistry
+std::shared_ptr<const DecimatorKernel> Decimator::kernelFor(uint32_t inputRate, uint32_t outputRate)
+{
+    static std::mutex kernelsMutex;
+    static std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<const DecimatorKernel>> kernels;
+
+    std::lock_guard<std::mutex> lock(kernelsMutex);
+    std::shared_ptr<const DecimatorKernel> &shared = kernels[{inputRate, outputRate}];
+    if (!shared)
+    {
+        auto built = std::make_shared<DecimatorKernel>();
+        buildKernel(*built, inputRate, outputRate);
+        shared = built;
+    }
+    return shared;
+}
+
+// Blackman-windowed sinc, cutoff relative to input rate is 0.85 of output Nyquist.
+// Output sample lies between taps TAPS/2-1 and TAPS/2, phase is its fractional position.
+// Each phase is normalized to sum 1, so DC level passes unchanged.
+void Decimator::buildKernel(DecimatorKernel &kernel, uint32_t inputRate, uint32_t outputRate)
+{
+    const double cutoff = 0.85 * outputRate / inputRate; // Part of input Nyquist frequency kept
+    const double half = DECIMATOR_TAPS / 2;
+    for (int phase = 0; phase < DECIMATOR_PHASES; phase++)
+    {
+        double fraction = static_cast<double>(phase) / DECIMATOR_PHASES;
+        double sum = 0;
+        for (int tap = 0; tap < DECIMATOR_TAPS; tap++)
+        {
+            double x = tap - (half - 1) - fraction; // Distance from output sample in input samples
+            double sinc = (x == 0) ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = (std::fabs(x) >= half) ? 0.0 : 0.42 + 0.5 * std::cos(M_PI * x / half) + 0.08 * std::cos(2 * M_PI * x / half);
+            kernel.taps[phase][tap] = static_cast<float>(sinc * window);
+            sum += sinc * window;
+        }
+        for (int tap = 0; tap < DECIMATOR_TAPS; tap++)
+        {
+            kernel.taps[phase][tap] = static_cast<float>(kernel.taps[phase][tap] / sum);
+        }
+    }
+}
+
+void Decimator::reset()
+{
+    left.clear();
+    right.clear();
+    inputBase = 0;
+    inputCount = 0;
+    outputCount = 0;
+}
+
+size_t Decimator::needed(size_t frames) const
+{
+    if (frames == 0)
+    {
+        return 0;
+    }
+    uint64_t last = firstInput(outputCount + frames - 1) + DECIMATOR_TAPS;
+    return last > inputCount ? static_cast<size_t>(last - inputCount) : 0;
+}
+
+void Decimator::write(const int16_t *in, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++)
+    {
+        left.push_back(in[i * 2]);
+        right.push_back(in[i * 2 + 1]);
+    }
+    inputCount += frames;
+}
+
+void Decimator::read(int16_t *out, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++)
+    {
+        uint64_t position = outputCount * inputRate;
+        uint64_t first = position / outputRate;
+        int phase = static_cast<int>((position % outputRate) * DECIMATOR_PHASES / outputRate);
+        outputCount++;
+
+        const float *taps = kernel->taps[phase];
+        const float *l = left.data() + (first - inputBase);
+        const float *r = right.data() + (first - inputBase);
+        float sumLeft;
+        float sumRight;
+#if defined(__SSE__)
+        __m128 accLeft = _mm_setzero_ps();
+        __m128 accRight = _mm_setzero_ps();
+        for (int tap = 0; tap < DECIMATOR_TAPS; tap += 4)
+        {
+            __m128 k = _mm_load_ps(taps + tap);
+            accLeft = _mm_add_ps(accLeft, _mm_mul_ps(_mm_loadu_ps(l + tap), k));
+            accRight = _mm_add_ps(accRight, _mm_mul_ps(_mm_loadu_ps(r + tap), k));
+        }
+        float partLeft[4];
+        float partRight[4];
+        _mm_storeu_ps(partLeft, accLeft);
+        _mm_storeu_ps(partRight, accRight);
+        sumLeft = (partLeft[0] + partLeft[1]) + (partLeft[2] + partLeft[3]);
+        sumRight = (partRight[0] + partRight[1]) + (partRight[2] + partRight[3]);
+#elif defined(__ARM_NEON)
+        float32x4_t accLeft = vdupq_n_f32(0);
+        float32x4_t accRight = vdupq_n_f32(0);
+        for (int tap = 0; tap < DECIMATOR_TAPS; tap += 4)
+        {
+            float32x4_t k = vld1q_f32(taps + tap);
+            accLeft = vmlaq_f32(accLeft, vld1q_f32(l + tap), k);
+            accRight = vmlaq_f32(accRight, vld1q_f32(r + tap), k);
+        }
+        float partLeft[4];
+        float partRight[4];
+        vst1q_f32(partLeft, accLeft);
+        vst1q_f32(partRight, accRight);
+        sumLeft = (partLeft[0] + partLeft[1]) + (partLeft[2] + partLeft[3]);
+        sumRight = (partRight[0] + partRight[1]) + (partRight[2] + partRight[3]);
+#else
+        sumLeft = 0;
+        sumRight = 0;
+        for (int tap = 0; tap < DECIMATOR_TAPS; tap++)
+        {
+            sumLeft += l[tap] * taps[tap];
+            sumRight += r[tap] * taps[tap];
+        }
+#endif
+        out[i * 2] = static_cast<int16_t>(std::clamp(std::lround(sumLeft), -32768L, 32767L));
+        out[i * 2 + 1] = static_cast<int16_t>(std::clamp(std::lround(sumRight), -32768L, 32767L));
+    }
+
+    // Drop input nobody needs anymore, so history does not grow
+    uint64_t keep = firstInput(outputCount);
+    if (keep > inputBase && keep - inputBase >= DECIMATOR_RESERVE / 2)
+    {
+        size_t drop = static_cast<size_t>(std::min<uint64_t>(keep - inputBase, left.size()));
+        left.erase(left.begin(), left.begin() + drop);
+        right.erase(right.begin(), right.begin() + drop);
+        inputBase += drop;
+    }
+}
@@ -6,14 +6,19 @@
 #include <atomic>
 #include <chrono>
 #include <mutex>
-#include "ula.hpp"
-#include "memory.hpp"
-#include "port.hpp"
-#include "z80.hpp"
-#include "kempston.hpp"
-#include "sound.hpp"
-#include "tape.hpp"
-#include "ay8912.hpp"
+#include <cstdlib>
+#include <vector>
+#include "machine.hpp"
+#include "snapshot.hpp"
+#include "archive.hpp"
+#include "rewind.hpp"
+#include "tapecache.hpp"
+#include "chips/ay-3-8910.h"
+#include "audiomixer.hpp"
+#include "audiooutput.hpp"
+#include "pacer.hpp"
+#include "capturewriter.hpp"
+#include "ayplayer.hpp"
 
 // ImGui includes
 #include "imgui.h"
@@ -21,9 +26,72 @@
 #include "imgui_impl_sdlrenderer3.h"
 #include "ImGuiFileDialog.h"
 
+// Command line settings of an offline run (no window, no sound device, not real time)
+struct HeadlessOptions
+{
+    long long frames = 50 * 60; // Frames to emulate (50 per second)
+    std::string wavFile;        // Mixed beeper and AY audio, "-" for stdout, empty for none
+    std::string videoFile;      // Raw 352x288 ARGB8888 frames, "-" for stdout, empty for none
+    std::string ayLogFile;      // AY register log, .psg or .vgm, empty for none
+    bool playTape = false;      // Start tape at once
+};
+
+// AY log format from file extension: .psg, anything else is VGM
+static AYLogFormat ayLogFormat(const std::string &fileName)
+{
+    std::string extension = fileName.size() >= 4 ? fileName.substr(fileName.size() - 4) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".psg" ? AYLogFormat::PSG : AYLogFormat::VGM;
+}
+
+// Play VGM/PSG/AY file through AY8912 and the sound card in real time
+static int playMusic(const std::string &fileName, int song)
+{
+    AYPlayer player;
+    if (!player.load(fileName) || !player.start(song))
+    {
+        return -1;
+    }
+    if (!SDL_Init(SDL_INIT_AUDIO))
+    {
+        std::cerr << "SDL audio could not initialize: " << SDL_GetError() << std::endl;
+        return -1;
+    }
+
+    // Same chain as the emulator: AY ring -> mixer -> device, timer paced with rate control
+    AudioMixer mixer;
+    mixer.addSource(player.getOutput());
+    AudioOutput output;
+    if (!output.initialize(&mixer))
+    {
+        SDL_Quit();
+        return -1;
+    }
+    output.setRateControl(true);
+    Pacer pacer;
+    pacer.setMixer(&mixer);
+    pacer.restart(0);
+
+    std::cout << "Playing " << fileName << " song " << song + 1 << " of " << player.getSongCount() << std::endl;
+    while (player.playFrame())
+    {
+        pacer.waitFrame(player.getTicks());
+    }
+
+    // Let the device play what is queued
+    while (mixer.getQueuedFrames() > 0 && mixer.waitForMix(std::chrono::milliseconds(PACER_AUDIO_TIMEOUT_MS)))
+    {
+    }
+    output.cleanup();
+    SDL_Quit();
+    return 0;
+}
+
 class Emulator
 {
 private:
+    bool headless; // No window, no audio device: emulation runs as fast as it can
+
     // SDL graphics components
     SDL_Window *window;     // Main window for the emulator
     SDL_Renderer *renderer; // Renderer for drawing graphics
@@ -34,15 +102,39 @@ private:
     std::thread emulationThread;     // Thread that runs the Z80 CPU emulation
     std::atomic<bool> threadRunning; // Atomic flag to safely control thread execution
 
-    // Emulator hardware components (each represents a real ZX Spectrum chip or subsystem)
-    std::unique_ptr<Memory> memory;     // RAM and ROM memory management
-    std::unique_ptr<Port> ports;        // Input/output port handling
-    std::unique_ptr<Z80> cpu;           // Zilog Z80 CPU emulation
-    std::unique_ptr<ULA> ula;           // Sinclair ULA (graphics and keyboard controller)
-    std::unique_ptr<Kempston> kempston; // Kempston joystick interface
-    std::unique_ptr<Sound> sound;       // Beeper sound system
-    std::unique_ptr<Tape> tape;         // Tape loading system
-    std::unique_ptr<AY8912> ay8912;     // AY-3-8912 sound chip (for better sound)
+    // Emulated machine (no SDL inside) and shortcuts to its chips
+    std::unique_ptr<Machine> machine;
+    Memory *memory;             // RAM and ROM memory management
+    Z80 *cpu;                   // Zilog Z80 CPU emulation
+    ULA *ula;                   // Sinclair ULA (graphics and keyboard controller)
+    Kempston *kempston;         // Kempston joystick interface
+    Sound *sound;               // Beeper sound system
+    Tape *tape;                 // Tape loading system
+    TapeRecorder *tapeRecorder; // Blocks saved by running programs
+    TurboSound *turboSound;     // AY-3-8912 sound chip, second one behind TurboSound selection
+    Dac *dac;                   // Covox and SounDrive DACs
+    AudioMixer *mixer;          // Mixes beeper, AY and other sources into one stream
+    std::unique_ptr<AudioOutput> audioOutput; // The only audio device, pulls from mixer
+
+    // Last minute of frames, stepped back while Backspace is held
+    std::unique_ptr<Rewind> rewind;
+    std::atomic<bool> rewindEnabled; // Frames are stored (UI thread switches it)
+    std::atomic<bool> rewindHeld;    // Backspace is down
+
+    // Frames run ahead of the shown one to hide the input lag of games (0 = off)
+    std::atomic<int> runAheadFrames;
+
+    // Machines stored after tapes have loaded, offered when the same tape is opened again
+    std::unique_ptr<TapeCache> tapeCache;
+    uint64_t offeredKey;     // Cached tape waiting for the user's answer
+    bool resumeOffered;      // Ask in the next UI frame
+    bool tapeCacheWaiting;   // Tape requested, looked up in the cache when it has loaded
+    uint32_t tapeCacheLoads; // Tape load count before that request
+
+    // Zip with more than one tape or snapshot: entries offered in a popup
+    std::string pickerPath;
+    std::vector<std::pair<size_t, ArchiveEntry>> pickerEntries; // Archive index and entry
+    bool pickerOffered; // Ask in the next UI frame
 
     // Thread synchronization for safely sharing data between threads
     std::mutex screenMutex; // Mutex to protect screen data when updating from different threads
@@ -62,9 +154,28 @@ private:
     // Start tape playback
     void StartTape();
 
+    // Tape browser window: block list with click-to-seek and position slider
+    bool showTapeWindow;
+    void drawTapeWindow();
+
     // CPU timing parameters
     int TARGET_FREQUENCY; // Target CPU frequency in Hz
-    int CHECK_INTERVAL;   // How often to check timing (in CPU cycles)
+    Pacer pacer;          // Keeps emulation at real speed, one frame at a time
+
+    // Frame end of the machine: screen to UI
+    void endFrame(uint64_t tstate);
+
+    // Cached tape opened: ask whether to resume from the cache
+    void drawResumePopup();
+
+    // Tape or zip from a file dialog: its only image is opened, several are offered in the picker
+    void openImage(const std::string &filePath);
+    void openEntry(const std::string &filePath, size_t index, ImageKind kind);
+    void requestTapeFile(const std::string &filePath, int entry);
+    void drawEntryPicker();
+
+    // Tape requested from the dialog has loaded (and been hashed by the loader): check the cache
+    void pollTapeCache();
 
 public:
     // Constructor - initializes all pointers to null/false
@@ -76,106 +187,121 @@ public:
         window = nullptr;
         renderer = nullptr;
         texture = nullptr;
+        headless = false;
+        memory = nullptr;
+        cpu = nullptr;
+        ula = nullptr;
+        kempston = nullptr;
+        sound = nullptr;
+        tape = nullptr;
+        tapeRecorder = nullptr;
+        turboSound = nullptr;
+        dac = nullptr;
+        mixer = nullptr;
 
         // Initialize flags to false
         // These control the state of our emulator
         quit = false;          // Not ready to quit yet
         threadRunning = false; // Emulation thread not running yet
         screenUpdated = false; // Screen hasn't been updated yet
+        showTapeWindow = false;  // Tape browser is hidden until requested
+        rewindEnabled = true;
+        rewindHeld = false;
+        runAheadFrames = 0;
+        offeredKey = 0;
+        resumeOffered = false;
+        tapeCacheWaiting = false;
+        tapeCacheLoads = 0;
+        pickerOffered = false;
     }
 
     // Run emulation in a separate thread
     void runZX();
 
+    // Emulate given number of frames on this thread at full speed, writing sound and
+    // frames to files. For regression tests and captures. Returns false on file errors
+    bool runHeadless(const HeadlessOptions &options);
+
     // Public methods for command line tape loading
     bool loadTapeFile(const std::string &filePath);
     void startTapePlayback();
 
+    // Tape loaded: offer its cached machine or store one after this load
+    void checkTapeCache();
+
+    // Snapshot or ROM from the command line, loaded when emulation starts
+    void openFile(const std::string &filePath) { machine->requestOpen(filePath); }
+
     // Destructor - automatically cleans up when Emulator object is destroyed
     ~Emulator()
     {
         cleanup();
     }
 
-    bool initialize()
+    // headlessMode skips window, UI and audio device; sound is rendered on the emulation thread
+    bool initialize(bool headlessMode = false)
     {
-        // Step 1: Initialize all core emulator components
-        // These represent the actual hardware chips in a real ZX Spectrum
-
-        // Initialize memory system (RAM and ROM)
-        memory = std::make_unique<Memory>();
-
-        // Initialize port system (input/output connections)
-        ports = std::make_unique<Port>();
-
-        // Initialize tape loading system
-        tape = std::make_unique<Tape>();
-
-        // Initialize main processor (Z80 CPU)
-        // Pass references to memory and ports so CPU can interact with them
-        cpu = std::make_unique<Z80>(memory.get(), ports.get());
-
-        // Initialize graphics and keyboard controller (ULA chip)
-        // Pass references to memory and tape systems
-        ula = std::make_unique<ULA>(memory.get(), tape.get());
-
-        // Initialize joystick interface (Kempston)
-        kempston = std::make_unique<Kempston>();
-
-        // Step 2: Connect hardware components through port handlers
-        // The ZX Spectrum uses specific port addresses to communicate with hardware
-
-        // Connect ULA (graphics/keyboard controller) to port 0xFE
-        ports->RegisterReadHandler(0xFE, [this](uint16_t port) -> uint8_t
-                                   { return ula->readPort(port); });
-        ports->RegisterWriteHandler(0xFE, [this](uint16_t port, uint8_t value)
-                                    { ula->writePort(port, value); });
-
-        // Connect Kempston joystick to port 0x1F
-        ports->RegisterReadHandler(0x1F, [this](uint16_t port) -> uint8_t
-                                   { return kempston->readPort(port); });
-
-        // Connect Memory interface to port 0xFD
-        ports->RegisterWriteHandler(0xFD, [this](uint16_t port, uint8_t value)
-                                    { return memory->writePort(port, value); });
-
-        // Step 3: Initialize SDL for graphics and sound
+        headless = headlessMode;
+
+        // Step 1: Create the machine: all chips connected through their ports
+        machine = std::make_unique<Machine>();
+        machine->initialize(!headless);
+        machine->setFrameHandler([this](uint64_t tstate)
+                                 { endFrame(tstate); });
+        memory = machine->getMemory();
+        cpu = machine->getCpu();
+        ula = machine->getUla();
+        kempston = machine->getKempston();
+        sound = machine->getSound();
+        tape = machine->getTape();
+        tapeRecorder = machine->getTapeRecorder();
+        turboSound = machine->getTurboSound();
+        dac = machine->getDac();
+        mixer = machine->getMixer();
+
+        // Step 2: Initialize SDL for graphics and sound
         // SDL is a cross-platform library for multimedia applications
-        if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
+        if (!headless && !SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
         {
             std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
             std::cerr << "SDL Error code: " << SDL_GetError() << std::endl;
             return false;
         }
 
-        // Step 4: Initialize sound systems
-        // Set up both the basic beeper and advanced AY-3-8912 sound chip
-
-        // Initialize basic beeper sound system
-        sound = std::make_unique<Sound>();
-        if (!sound->initialize())
+        // Step 3: One device for all sound sources of the machine
+        audioOutput = std::make_unique<AudioOutput>();
+        if (!headless)
         {
-            std::cerr << "Warning: Failed to initialize sound system" << std::endl;
-            // Continue without sound if initialization fails
+            if (!audioOutput->initialize(mixer))
+            {
+                std::cerr << "Warning: Failed to initialize audio output" << std::endl;
+                // Continue without sound if initialization fails
+            }
+            else
+            {
+                // Timer drives emulation, playback rate follows it to hold the latency
+                pacer.setMixer(mixer);
+                audioOutput->setRateControl(true);
+            }
         }
 
-        // Connect beeper to port 0xFE (shared with ULA)
-        ports->RegisterWriteHandler(0xFE, [this](uint16_t port, uint8_t value)
-                                    { sound->writePort(port, value); });
-
-        // Initialize AY8912 sound chip (provides better sound quality)
-        ay8912 = std::make_unique<AY8912>();
-        if (!ay8912->initialize())
+        if (headless)
         {
-            std::cerr << "Warning: Failed to initialize AY8912 sound chip" << std::endl;
-            // Continue without AY8912 sound if initialization fails
+            change48(true);
+            return true;
         }
 
-        // Connect AY8912 to port 0xFD (shared with memory)
-        ports->RegisterWriteHandler(0xFD, [this](uint16_t port, uint8_t value)
-                                    { ay8912->writePort(port, value); });
-        ports->RegisterReadHandler(0xFD, [this](uint16_t port) -> uint8_t
-                                   { return ay8912->readPort(port); });
+        // Step 4: Tape cache lives in the user's preference directory
+        char *prefPath = SDL_GetPrefPath("zxemu", "emulator");
+        if (prefPath != nullptr)
+        {
+            tapeCache = std::make_unique<TapeCache>(std::string(prefPath) + "tapecache");
+            SDL_free(prefPath);
+        }
+        else
+        {
+            std::cerr << "Warning: no preference directory, tape cache disabled: " << SDL_GetError() << std::endl;
+        }
 
         // Step 5: Create graphics window and rendering components
         window = SDL_CreateWindow("ZX Spectrum Emulator", 704, 576, SDL_WINDOW_RESIZABLE);
@@ -248,7 +374,8 @@ public:
                 if (e.type == SDL_EVENT_QUIT)
                 {
                     // User closed the window - clean up and exit
-                    ay8912->cleanup();
+                    audioOutput->cleanup();
+                    turboSound->cleanup();
                     sound->cleanup();
                     std::cout << "Quit event received" << std::endl;
                     quit = true;
@@ -276,13 +403,32 @@ public:
                 // File menu - for loading files and exiting
                 if (ImGui::BeginMenu("File"))
                 {
-                    // Option to open a ROM/BIN/Z80 file
+                    // Option to open a snapshot or ROM file
                     if (ImGui::MenuItem("Open File", "Ctrl+O"))
                     {
-                        // Configure and open file dialog for ROM files
+                        // Configure and open file dialog for snapshot and ROM files
                         IGFD::FileDialogConfig config;
                         config.path = "."; // Start in current directory
-                        ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose File", ".rom,.bin,.z80", config);
+                        ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose File", ".z80,.sna,.szx,.rom,.bin,.zip", config);
+                    }
+
+                    // Store the running machine as snapshot, format by extension
+                    if (ImGui::MenuItem("Save Snapshot"))
+                    {
+                        IGFD::FileDialogConfig config;
+                        config.path = ".";
+                        config.flags = ImGuiFileDialogFlags_ConfirmOverwrite;
+                        ImGuiFileDialog::Instance()->OpenDialog("SaveSnapshotDlgKey", "Save Snapshot", ".szx,.z80,.sna", config);
+                    }
+
+                    // Keep the last minute for hold-to-rewind
+                    if (ImGui::MenuItem("Rewind buffer", "Backspace", rewindEnabled.load()))
+                    {
+                        rewindEnabled = !rewindEnabled.load();
+                    }
+                    if (rewindEnabled.load() && rewind)
+                    {
+                        ImGui::TextDisabled("  %zu s stored, %.1f MB", rewind->getFrames() / 50, rewind->getBytes() / (1024.0 * 1024.0));
                     }
 
                     // Exit option
@@ -315,6 +461,20 @@ public:
                         SDL_SetWindowMinimumSize(window, 1056, 864);
                         SDL_SetWindowSize(window, 1056, 864);
                     }
+
+                    // Show a frame emulated ahead with the current keys: games react sooner
+                    if (ImGui::BeginMenu("Run-ahead"))
+                    {
+                        static const char *const names[] = {"Off", "1 frame", "2 frames", "3 frames"};
+                        for (int frames = 0; frames <= 3; frames++)
+                        {
+                            if (ImGui::MenuItem(names[frames], nullptr, runAheadFrames.load() == frames))
+                            {
+                                runAheadFrames = frames;
+                            }
+                        }
+                        ImGui::EndMenu();
+                    }
                     ImGui::EndMenu();
                 }
 
@@ -327,7 +487,7 @@ public:
                         // Configure and open file dialog for tape files
                         IGFD::FileDialogConfig config;
                         config.path = "."; // Start in current directory
-                        ImGuiFileDialog::Instance()->OpenDialog("ChooseTapeDlgKey", "Choose Tape File", ".TAP,.TZX,.tap,.tzx", config);
+                        ImGuiFileDialog::Instance()->OpenDialog("ChooseTapeDlgKey", "Choose Tape File", ".TAP,.TZX,.tap,.tzx,.zip", config);
                     }
 
                     // Start playing the currently loaded tape
@@ -336,6 +496,44 @@ public:
                         StartTape();
                     }
 
+                    // SAVE routine of ROM writes blocks directly into recorder
+                    if (ImGui::MenuItem("Save trap", nullptr, machine->saveTrap.load()))
+                    {
+                        machine->saveTrap = !machine->saveTrap.load();
+                    }
+
+                    // Decode MIC output of custom savers into blocks
+                    if (ImGui::MenuItem("Record MIC", nullptr, machine->recordMic.load()))
+                    {
+                        machine->recordMic = !machine->recordMic.load();
+                        if (!machine->recordMic.load())
+                        {
+                            std::lock_guard<std::mutex> lock(machine->getRecorderMutex());
+                            tapeRecorder->flush();
+                        }
+                    }
+
+                    // Write saved blocks to .tap/.tzx file
+                    // Emulation thread adds blocks while we look at them
+                    size_t recordedBlocks;
+                    {
+                        std::lock_guard<std::mutex> lock(machine->getRecorderMutex());
+                        recordedBlocks = tapeRecorder->getBlockCount();
+                    }
+                    if (ImGui::MenuItem("Save recording", nullptr, false, recordedBlocks > 0))
+                    {
+                        IGFD::FileDialogConfig config;
+                        config.path = ".";
+                        config.flags = ImGuiFileDialogFlags_ConfirmOverwrite;
+                        ImGuiFileDialog::Instance()->OpenDialog("SaveTapeDlgKey", "Save Tape File", ".tap,.tzx", config);
+                    }
+
+                    // Show list of tape blocks and position
+                    if (ImGui::MenuItem("Browser", nullptr, showTapeWindow))
+                    {
+                        showTapeWindow = !showTapeWindow;
+                    }
+
                     // Toggle turbo loading mode (faster tape loading)
                     if (ImGui::MenuItem("Turboload", nullptr, tape ? tape->isTapeTurbo : false))
                     {
@@ -346,26 +544,163 @@ public:
                     }
                     ImGui::EndMenu();
                 }
+
+                // Sound menu - audio synthesis options
+                if (ImGui::BeginMenu("Sound"))
+                {
+                    // Alias-free beeper: every edge is a band-limited step
+                    bool blep = sound->getBeeperMode() == BeeperMode::Blep;
+                    if (ImGui::MenuItem("Band-limited beeper", nullptr, blep))
+                    {
+                        sound->setBeeperMode(blep ? BeeperMode::Square : BeeperMode::Blep);
+                    }
+
+                    // Emulation speed follows the sound card instead of the system timer
+                    bool audioPacing = pacer.getMode() == PacingMode::Audio;
+                    if (ImGui::MenuItem("Sync speed to audio", nullptr, audioPacing, audioOutput && audioOutput->isRunning()))
+                    {
+                        pacer.setMode(audioPacing ? PacingMode::Timer : PacingMode::Audio);
+                        // Rate control only when timer paces emulation, otherwise they fight each other
+                        audioOutput->setRateControl(audioPacing);
+                    }
+
+                    // Audio queued ahead of the speaker, held by rate control
+                    if (audioOutput && audioOutput->getRateControl())
+                    {
+                        int latency = audioOutput->getTargetLatency();
+                        if (ImGui::SliderInt("Latency (ms)", &latency, 20, 150))
+                        {
+                            audioOutput->setTargetLatency(latency);
+                        }
+                    }
+
+                    // AY synthesis at native counter rate, decimated to output rate
+                    bool highQuality = turboSound->isHighQuality();
+                    if (ImGui::MenuItem("High quality AY", nullptr, highQuality))
+                    {
+                        turboSound->setHighQuality(!highQuality);
+                    }
+
+                    // AY channel panning
+                    if (ImGui::BeginMenu("AY stereo"))
+                    {
+                        static const struct
+                        {
+                            const char *name;
+                            uint8_t mode;
+                        } stereoModes[] = {{"Mono", AY_STEREO_MONO}, {"ABC", AY_STEREO_ABC}, {"ACB", AY_STEREO_ACB}};
+                        for (const auto &stereo : stereoModes)
+                        {
+                            if (ImGui::MenuItem(stereo.name, nullptr, turboSound->getStereoMode() == stereo.mode))
+                            {
+                                turboSound->setStereoMode(stereo.mode);
+                            }
+                        }
+                        ImGui::EndMenu();
+                    }
+
+                    // Pentagon sound extensions
+                    bool dualAY = turboSound->isEnabled();
+                    if (ImGui::MenuItem("TurboSound (2 x AY)", nullptr, dualAY))
+                    {
+                        turboSound->setEnabled(!dualAY);
+                    }
+                    bool covox = dac->isEnabled();
+                    if (ImGui::MenuItem("Covox / SounDrive", nullptr, covox))
+                    {
+                        dac->setEnabled(!covox);
+                    }
+
+                    // AY register log, tiny compared to WAV and exact for comparisons
+                    ImGui::Separator();
+                    AYRecorder *ayLog = turboSound->getChip(0)->getRecorder();
+                    if (!ayLog->isRecording())
+                    {
+                        if (ImGui::MenuItem("Record AY music..."))
+                        {
+                            IGFD::FileDialogConfig config;
+                            config.path = ".";
+                            config.flags = ImGuiFileDialogFlags_ConfirmOverwrite;
+                            ImGuiFileDialog::Instance()->OpenDialog("SaveAYLogDlgKey", "Record AY Registers", ".vgm,.psg", config);
+                        }
+                    }
+                    else if (ImGui::MenuItem("Stop AY recording"))
+                    {
+                        ayLog->stop();
+                    }
+                    ImGui::EndMenu();
+                }
+
+                // Background tape loading status
+                if (tape && tape->getLoadState() == TapeLoadState::Loading)
+                {
+                    ImGui::Text("Loading tape %d%%", (int)(tape->getLoadProgress() * 100.0f));
+                }
                 ImGui::EndMainMenuBar();
             }
 
+            // Tape browser window
+            drawTapeWindow();
+
             // Display file dialog for ROM loading if it's open
             if (ImGuiFileDialog::Instance()->Display("ChooseFileDlgKey", ImGuiWindowFlags_NoCollapse, ImVec2(400, 300)))
             {
                 // If user clicked OK in the dialog
                 if (ImGuiFileDialog::Instance()->IsOk())
                 {
-                    // Get the selected file path
+                    // Get the selected file path, emulation thread loads it before the next instruction
                     std::string filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
-                    std::string filePath = ImGuiFileDialog::Instance()->GetCurrentPath();
-                    // TODO: Actually load the selected ROM file
-                    std::cout << "Selected file: " << filePathName << std::endl;
+                    if (ImGuiFileDialog::Instance()->GetCurrentFilter() == ".zip")
+                    {
+                        openImage(filePathName);
+                    }
+                    else
+                    {
+                        machine->requestOpen(filePathName);
+                    }
                 }
 
                 // Close the file dialog
                 ImGuiFileDialog::Instance()->Close();
             }
 
+            // Display file dialog for saving a snapshot
+            if (ImGuiFileDialog::Instance()->Display("SaveSnapshotDlgKey", ImGuiWindowFlags_NoCollapse, ImVec2(400, 300)))
+            {
+                if (ImGuiFileDialog::Instance()->IsOk())
+                {
+                    machine->requestSave(ImGuiFileDialog::Instance()->GetFilePathName());
+                }
+                ImGuiFileDialog::Instance()->Close();
+            }
+
+            // Display file dialog for saving recorded blocks
+            if (ImGuiFileDialog::Instance()->Display("SaveTapeDlgKey", ImGuiWindowFlags_NoCollapse, ImVec2(400, 300)))
+            {
+                if (ImGuiFileDialog::Instance()->IsOk())
+                {
+                    std::string filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
+                    std::lock_guard<std::mutex> lock(machine->getRecorderMutex());
+                    tapeRecorder->flush();
+                    if (ImGuiFileDialog::Instance()->GetCurrentFilter() == ".tzx")
+                        tapeRecorder->saveTzx(filePathName);
+                    else
+                        tapeRecorder->saveTap(filePathName);
+                }
+                ImGuiFileDialog::Instance()->Close();
+            }
+
+            // Display file dialog for AY register recording
+            if (ImGuiFileDialog::Instance()->Display("SaveAYLogDlgKey", ImGuiWindowFlags_NoCollapse, ImVec2(400, 300)))
+            {
+                if (ImGuiFileDialog::Instance()->IsOk())
+                {
+                    std::string filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
+                    turboSound->getChip(0)->getRecorder()->start(filePathName, ayLogFormat(filePathName));
+                }
+                ImGuiFileDialog::Instance()->Close();
+            }
+
             // Display file dialog for tape loading if it's open
             if (ImGuiFileDialog::Instance()->Display("ChooseTapeDlgKey", ImGuiWindowFlags_NoCollapse, ImVec2(400, 300)))
             {
@@ -378,10 +713,10 @@ public:
 
                     // Load the selected tape file
                     std::cout << "Selected tape file: " << filePathName << std::endl;
+                    // Parsing runs in background, progress is shown in the menu bar and tape browser
                     if (tape)
                     {
-                        tape->loadFile(filePathName);
-                        tape->prepareBitStream();
+                        openImage(filePathName);
                     }
                 }
 
@@ -389,6 +724,10 @@ public:
                 ImGuiFileDialog::Instance()->Close();
             }
 
+            pollTapeCache();
+            drawResumePopup();
+            drawEntryPicker();
+
             // Check if the emulation thread has updated the screen
             // We need to synchronize access to shared data using a mutex
             bool updateScreen = false;
@@ -453,7 +792,11 @@ public:
 
     void cleanup()
     {
-        sound->cleanup();
+        // Stop audio device first, its callback reads from sound sources
+        if (audioOutput)
+        {
+            audioOutput->cleanup();
+        }
         // Stop the thread if it's running
         if (threadRunning.load())
         {
@@ -463,6 +806,17 @@ public:
                 emulationThread.join();
             }
         }
+        // Then sound render threads the emulation was feeding
+        if (machine)
+        {
+            machine->cleanup();
+        }
+
+        // Headless run never started SDL and ImGui
+        if (headless)
+        {
+            return;
+        }
 
         // Cleanup ImGui
         ImGui_ImplSDLRenderer3_Shutdown();
@@ -496,16 +850,15 @@ void Emulator::change48(bool is48)
 {
     if (is48)
     {
-        TARGET_FREQUENCY = 3500000;                // 3.5 MHz
-        CHECK_INTERVAL = TARGET_FREQUENCY / 10000; // Check timing every 0.1ms (more precise)
+        TARGET_FREQUENCY = 3500000; // 3.5 MHz
         ula->change48(true);
     }
     else
     {
-        TARGET_FREQUENCY = 3546900;                // 3.54690 Mhz
-        CHECK_INTERVAL = TARGET_FREQUENCY / 10000; // Check timing every 0.1ms (more precise)
+        TARGET_FREQUENCY = 3546900; // 3.54690 Mhz
         ula->change48(false);
     }
+    pacer.setFrequency(TARGET_FREQUENCY);
 }
 
 void Emulator::StartTape()
@@ -515,12 +868,106 @@ void Emulator::StartTape()
 
     if (tape)
     {
-        // Set the tape to played state
-        tape->isTapePlayed = true;
+        // Emulation thread starts it before the next instruction
+        machine->requestPlayTape();
         std::cout << "Tape playback started" << std::endl;
     }
 }
 
+void Emulator::drawTapeWindow()
+{
+    if (!showTapeWindow || !tape)
+    {
+        return;
+    }
+
+    ImGui::SetNextWindowSize(ImVec2(440, 320), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Tape", &showTapeWindow))
+    {
+        ImGui::End();
+        return;
+    }
+
+    // Own copy of the blocks: the loader may replace them while the window draws.
+    // Nothing is listed while a tape loads
+    std::shared_ptr<const TapeBlockList> blocks = tape->getBlockList();
+    if (tape->getLoadState() == TapeLoadState::Loading)
+    {
+        ImGui::ProgressBar(tape->getLoadProgress(), ImVec2(-1.0f, 0.0f), "Loading...");
+    }
+    else
+    {
+        if (tape->getLoadState() == TapeLoadState::Failed)
+        {
+            ImGui::TextUnformatted("Tape loading failed");
+        }
+
+        // Position slider. Tape timings are in T-states of 3.5 MHz
+        float length = blocks ? blocks->length / (float)TARGET_FREQUENCY : 0.0f;
+        float position = std::min(tape->getShownPosition() / (float)TARGET_FREQUENCY, length);
+        if (ImGui::SliderFloat("##position", &position, 0.0f, length, "%.1f s"))
+        {
+            machine->requestTapeTicks((long long)(position * TARGET_FREQUENCY));
+        }
+        ImGui::SameLine();
+        ImGui::Text("/ %.1f s", length);
+    }
+
+    // Block list. Click on a block jumps to its pilot tone
+    static const char *fileTypes[] = {"Program", "Number array", "Character array", "Bytes"};
+    if (ImGui::BeginTable("TapeBlocks", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_BordersInnerV))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("#", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Name");
+        ImGui::TableSetupColumn("Type");
+        ImGui::TableSetupColumn("Length", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Time", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableHeadersRow();
+
+        size_t current = tape->getShownBlock();
+        ImGuiListClipper clipper;
+        clipper.Begin(blocks ? (int)blocks->blocks.size() : 0);
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                const TapBlock &block = blocks->blocks[i];
+                bool isHeader = block.flag == 0x00 && block.data.size() >= 18;
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                char label[16];
+                snprintf(label, sizeof(label), "%d", i);
+                if (ImGui::Selectable(label, (size_t)i == current, ImGuiSelectableFlags_SpanAllColumns))
+                {
+                    machine->requestTapeBlock(i);
+                }
+
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(isHeader ? block.filename.c_str() : "");
+
+                ImGui::TableNextColumn();
+                if (isHeader)
+                    ImGui::TextUnformatted(block.fileType < 4 ? fileTypes[block.fileType] : "Unknown");
+                else if (block.flag == 0xFF)
+                    ImGui::TextUnformatted("Data");
+                else
+                    ImGui::Text("Flag %02X", block.flag);
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", isHeader ? (unsigned)block.dataLength : (unsigned)block.data.size());
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f s", blocks->blockTicks[i] / (float)TARGET_FREQUENCY);
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
 bool Emulator::loadTapeFile(const std::string &filePath)
 {
     if (!tape)
@@ -529,111 +976,245 @@ bool Emulator::loadTapeFile(const std::string &filePath)
         return false;
     }
 
-    std::cout << "Loading tape file: " << filePath << std::endl;
-    tape->loadFile(filePath);
-    tape->prepareBitStream();
-    std::cout << "Tape file loaded successfully" << std::endl;
-    return true;
+    return machine->loadTape(filePath);
+}
+
+void Emulator::pollTapeCache()
+{
+    // Count moves once the emulation thread has started the requested load
+    if (!tapeCacheWaiting || tape->getLoadCount() == tapeCacheLoads)
+    {
+        return;
+    }
+    TapeLoadState state = tape->getLoadState();
+    if (state == TapeLoadState::Loading)
+    {
+        return;
+    }
+    tapeCacheWaiting = false;
+    if (state == TapeLoadState::Ready)
+    {
+        checkTapeCache();
+    }
+}
+
+void Emulator::checkTapeCache()
+{
+    uint64_t imageHash = tape ? tape->getImageHash() : 0;
+    if (!tapeCache || imageHash == 0)
+    {
+        return;
+    }
+    uint64_t key = TapeCache::keyOf(imageHash, memory->getIs48());
+    if (tapeCache->has(key))
+    {
+        // Nothing is stored this time unless the user loads the tape anyway
+        tapeCache->cancel();
+        offeredKey = key;
+        resumeOffered = true;
+    }
+    else
+    {
+        tapeCache->watch(key, memory->getIs48());
+    }
+}
+
+// Resume where loading finished last time, or load the tape as usual
+void Emulator::drawResumePopup()
+{
+    if (resumeOffered)
+    {
+        ImGui::OpenPopup("Resume tape");
+        resumeOffered = false;
+    }
+    if (!ImGui::BeginPopupModal("Resume tape", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        return;
+    }
+    ImGui::TextUnformatted("This tape has been loaded before.");
+    ImGui::TextUnformatted("Resume where loading finished?");
+    if (ImGui::Button("Resume"))
+    {
+        // Snapshot loads on the emulation thread before the next instruction
+        machine->requestOpen(tapeCache->pathOf(offeredKey));
+        ImGui::CloseCurrentPopup();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load tape"))
+    {
+        // Stored again when this load finishes
+        tapeCache->watch(offeredKey, memory->getIs48());
+        ImGui::CloseCurrentPopup();
+    }
+    ImGui::EndPopup();
+}
+
+void Emulator::openImage(const std::string &filePath)
+{
+    // Only the directory is read here, the picked entry is decompressed by whoever loads it
+    Archive archive;
+    if (!archive.open(filePath))
+    {
+        return;
+    }
+    pickerPath = filePath;
+    pickerEntries.clear();
+    for (size_t i = 0; i < archive.getEntryCount(); i++)
+    {
+        const ArchiveEntry &entry = archive.getEntry(i);
+        if (entry.kind == ImageKind::Tape || entry.kind == ImageKind::Snapshot)
+        {
+            pickerEntries.emplace_back(i, entry);
+        }
+    }
+    if (pickerEntries.empty())
+    {
+        std::cerr << "No tape or snapshot found in: " << filePath << std::endl;
+        return;
+    }
+    if (pickerEntries.size() == 1)
+    {
+        openEntry(filePath, pickerEntries[0].first, pickerEntries[0].second.kind);
+        return;
+    }
+    pickerOffered = true;
+}
+
+void Emulator::openEntry(const std::string &filePath, size_t index, ImageKind kind)
+{
+    if (kind == ImageKind::Snapshot)
+    {
+        // Snapshot loads on the emulation thread before the next instruction
+        machine->requestOpen(filePath, static_cast<int>(index));
+    }
+    else if (tape)
+    {
+        requestTapeFile(filePath, static_cast<int>(index));
+    }
+}
+
+void Emulator::requestTapeFile(const std::string &filePath, int entry)
+{
+    tapeCacheLoads = tape->getLoadCount();
+    tapeCacheWaiting = tapeCache != nullptr;
+    machine->requestTape(filePath, entry);
+}
+
+// Several images in one zip: the user picks the one to open
+void Emulator::drawEntryPicker()
+{
+    if (pickerOffered)
+    {
+        ImGui::OpenPopup("Open from archive");
+        pickerOffered = false;
+    }
+    if (!ImGui::BeginPopupModal("Open from archive", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        return;
+    }
+    for (const auto &[index, entry] : pickerEntries)
+    {
+        std::string label = std::string(entry.kind == ImageKind::Snapshot ? "Snapshot  " : "Tape      ") + entry.name;
+        if (ImGui::Selectable(label.c_str()))
+        {
+            openEntry(pickerPath, index, entry.kind);
+            ImGui::CloseCurrentPopup();
+        }
+    }
+    if (ImGui::Button("Cancel"))
+    {
+        ImGui::CloseCurrentPopup();
+    }
+    ImGui::EndPopup();
 }
 
 void Emulator::startTapePlayback()
 {
     if (tape)
     {
-        tape->isTapePlayed = true;
+        machine->requestPlayTape();
         std::cout << "Tape playback started automatically" << std::endl;
     }
 }
 
+// Machine has finished a frame: show it
+void Emulator::endFrame(uint64_t)
+{
+    // Lock the mutex to safely update shared data
+    std::lock_guard<std::mutex> lock(screenMutex);
+
+    // Rate limiting for screen updates during tape turbo mode
+    // This prevents the UI from being overwhelmed during fast tape loading
+    if (!tape->isTapePlayed || !tape->isTapeTurbo)
+    {
+        // Normal operation - update screen immediately
+        screenUpdated = true;
+    }
+    else
+    {
+        // Turbo mode - limit screen updates to prevent UI lag
+        auto now = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastScreenUpdate);
+        if (elapsed >= minScreenUpdateInterval)
+        {
+            screenUpdated = true;
+            lastScreenUpdate = now;
+        }
+    }
+}
+
 void Emulator::runZX()
 {
     // Signal that the emulation thread should be running
     threadRunning = true;
 
-    // Initialize memory with 128K ROM (default mode)
-    // The ZX Spectrum 128K had more memory and additional features compared to the 48K model
-    memory->Read128();       // Load 128K ROM
-    //memory->Read48();
-    memory->change48(false); // Set memory mode to 128K
-
-    // Set CPU to CMOS mode (more accurate for later Spectrums)
-    // The Z80 CPU in later Spectrum models was a CMOS variant
-    cpu->isNMOS = false;
+    machine->prepare();
+    rewind = std::make_unique<Rewind>();
 
     // Create a new thread to run the CPU emulation
     // This allows the UI to remain responsive while the CPU emulation runs
     emulationThread = std::thread([this]()
                                   {
                                       // Timing variables for maintaining accurate CPU speed
-                                      auto startTime = std::chrono::high_resolution_clock::now();
-                                      long long totalTicks = 0; // Total CPU cycles executed
-                                      long long checkTicks = 0; // Cycles since last timing check
+                                      machine->start();
+                                      pacer.restart(machine->getTicks());
 
                                       // Track previous tape state to detect when turbo mode turns off
                                       bool prevTapePlayed = false;
                                       bool prevTapeTurbo = false;
+                                      bool rewound = false;
+                                      bool ranAhead = false;
 
                                       // Main emulation loop - runs until threadRunning is set to false
                                       while (threadRunning.load())
                                       {
-                                          // Execute one instruction and get the number of CPU cycles it took
-                                          int ticks = cpu->ExecuteOneInstruction();
-                                          // TR-DOS enable/disable block
-                                          if(cpu->PC >= 0x3d00 && cpu->PC <= 0x3dff && memory->checkTrDos() == false) {
-                                            memory->enableTrDos(true);
-                                            //printf("TRDOS enable\n");
+                                          // Hold-to-rewind: one stored frame back per frame time, nothing is emulated
+                                          if (rewindHeld.load(std::memory_order_relaxed) && rewindEnabled.load(std::memory_order_relaxed))
+                                          {
+                                              if (rewind->stepBack(*machine))
+                                              {
+                                                  ula->redrawScreen();
+                                                  std::lock_guard<std::mutex> lock(screenMutex);
+                                                  screenUpdated = true;
+                                              }
+                                              std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                                              rewound = true;
+                                              continue;
                                           }
-                                          if(cpu->PC > 0x3fff && memory->checkTrDos() == true)
+                                          if (rewound)
                                           {
-                                            memory->enableTrDos(false);
-                                            //printf("TRDOS disable\n");
+                                              pacer.restart(machine->getTicks());
+                                              rewound = false;
                                           }
 
-                                          // Update our cycle counters
-                                          totalTicks += ticks;
-                                          checkTicks += ticks;
-
-                                          // Update sound system with current cycle count
-                                          // This ensures audio stays synchronized with the CPU
-                                          sound->ticks = totalTicks;
-
-                                          // Update screen for each CPU tick
-                                          // The ULA (graphics chip) needs to be updated for each cycle
-                                          for (int i = 0; i < ticks; i++)
+                                          bool frameDone = machine->step();
+                                          if (frameDone && rewindEnabled.load(std::memory_order_relaxed))
                                           {
-                                              // oneTick() returns 0 when the screen is fully drawn
-                                              int ref = ula->oneTick();
-                                              if (ref == 0)
-                                              {
-                                                  // Screen has been updated - notify the main thread
-                                                  {
-                                                      // Lock the mutex to safely update shared data
-                                                      std::lock_guard<std::mutex> lock(screenMutex);
-
-                                                      // Rate limiting for screen updates during tape turbo mode
-                                                      // This prevents the UI from being overwhelmed during fast tape loading
-                                                      if (!tape->isTapePlayed || !tape->isTapeTurbo)
-                                                      {
-                                                          // Normal operation - update screen immediately
-                                                          screenUpdated = true;
-                                                      }
-                                                      else
-                                                      {
-                                                          // Turbo mode - limit screen updates to prevent UI lag
-                                                          auto now = std::chrono::high_resolution_clock::now();
-                                                          auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastScreenUpdate);
-                                                          if (elapsed >= minScreenUpdateInterval)
-                                                          {
-                                                              screenUpdated = true;
-                                                              lastScreenUpdate = now;
-                                                          }
-                                                      }
-
-                                                      // Signal that an interrupt should be triggered
-                                                      // This is part of the ZX Spectrum's timing system
-                                                      cpu->InterruptPending = true;
-                                                  }
-                                              }
+                                              rewind->capture(*machine);
+                                          }
+                                          if (frameDone && tapeCache)
+                                          {
+                                              tapeCache->update(*machine);
                                           }
 
                                           // Detect transition from turbo mode to normal mode
@@ -641,10 +1222,8 @@ void Emulator::runZX()
                                           if ((prevTapePlayed != tape->isTapePlayed || prevTapeTurbo != tape->isTapeTurbo) &&
                                               (!tape->isTapePlayed || !tape->isTapeTurbo))
                                           {
-                                              // Reset timing when transitioning to normal mode
-                                              startTime = std::chrono::high_resolution_clock::now();
-                                              totalTicks = 0;
-                                              checkTicks = 0;
+                                              // Count time from here. Machine ticks keep running, sound is stamped with them
+                                              pacer.restart(machine->getTicks());
                                               std::cout << "Speed limiter re-enabled after tape play" << std::endl;
                                           }
 
@@ -656,59 +1235,114 @@ void Emulator::runZX()
                                           // Speed limiting is disabled during tape turbo mode for faster loading
                                           bool shouldDisableLimiter = !tape->isTapePlayed || !tape->isTapeTurbo;
 
+                                          // Run-ahead at real speed only, turbo loading would just get slower
+                                          int ahead = runAheadFrames.load(std::memory_order_relaxed);
+                                          if (frameDone && ahead > 0 && shouldDisableLimiter)
+                                          {
+                                              machine->runAhead(ahead);
+                                              std::lock_guard<std::mutex> lock(screenMutex);
+                                              screenUpdated = true;
+                                              ranAhead = true;
+                                          }
+                                          else if (frameDone && ranAhead)
+                                          {
+                                              // Next frame is drawn as emulated again
+                                              ula->setRendering(true);
+                                              ranAhead = false;
+                                          }
+
                                           // Apply speed limiting to maintain accurate CPU frequency
-                                          // Without this, the emulator would run as fast as possible
-                                          if (shouldDisableLimiter)
+                                          // Whole frame is emulated at once, then the thread sleeps until the next one is due
+                                          if (shouldDisableLimiter && frameDone)
                                           {
-                                              // Check timing periodically (every CHECK_INTERVAL cycles)
-                                              if (checkTicks >= CHECK_INTERVAL)
-                                              {
-                                                  checkTicks = 0;
-
-                                                  // Calculate how much time has actually passed
-                                                  auto currentTime = std::chrono::high_resolution_clock::now();
-                                                  auto elapsedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(currentTime - startTime).count();
-
-                                                  // Calculate how much time should have passed for the number of cycles executed
-                                                  long long expectedTime = (totalTicks * 1000000000LL) / TARGET_FREQUENCY;
-
-                                                  // If we're ahead of schedule, we need to wait
-                                                  if (expectedTime > elapsedTime)
-                                                  {
-                                                      // Calculate how long to wait (in microseconds)
-                                                      long long sleepTime = (expectedTime - elapsedTime) / 1000;
-
-                                                      if (sleepTime > 1000)
-                                                      {
-                                                          // For longer delays, use sleep (less precise but CPU-friendly)
-                                                          std::this_thread::sleep_for(std::chrono::microseconds(sleepTime - 500));
-                                                          // Fine-tune with busy waiting for accuracy
-                                                          while (std::chrono::duration_cast<std::chrono::nanoseconds>(
-                                                                     std::chrono::high_resolution_clock::now() - startTime)
-                                                                     .count() < expectedTime)
-                                                          {
-                                                              std::this_thread::yield();
-                                                          }
-                                                      }
-                                                      else if (sleepTime > 0)
-                                                      {
-                                                          // For short delays, use busy waiting for precision
-                                                          while (std::chrono::duration_cast<std::chrono::nanoseconds>(
-                                                                     std::chrono::high_resolution_clock::now() - startTime)
-                                                                     .count() < expectedTime)
-                                                          {
-                                                              std::this_thread::yield();
-                                                          }
-                                                      }
-                                                  }
-                                              }
+                                              pacer.waitFrame(machine->getTicks());
                                           }
                                       } // End of main emulation loop
                                   }); // End of thread creation
 }
 
+// Offline run: no pacing, sound and video go to files through background writers,
+// so emulation never waits for the disk unless the disk is slower for a whole buffer
+bool Emulator::runHeadless(const HeadlessOptions &options)
+{
+    machine->prepare();
+    if (options.playTape)
+    {
+        startTapePlayback();
+    }
+
+    WavWriter wav;
+    CaptureWriter video;
+    if (!options.wavFile.empty() && !wav.open(options.wavFile, MIXER_SAMPLE_RATE, 2))
+    {
+        return false;
+    }
+    if (!options.videoFile.empty() && !video.open(options.videoFile))
+    {
+        return false;
+    }
+    AYRecorder *ayLog = turboSound->getChip(0)->getRecorder();
+    if (!options.ayLogFile.empty() && !ayLog->start(options.ayLogFile, ayLogFormat(options.ayLogFile)))
+    {
+        return false;
+    }
+
+    // Sound sources render in setClock at frame end, so the mixer always gets
+    // exactly the samples of emulated time. Position is kept in samples from T-states, nothing drifts
+    std::vector<int16_t> samples;
+    uint64_t mixedSamples = 0;
+    long long frames = 0;
+    machine->start();
+    int64_t startTime = Pacer::now();
+    while (frames < options.frames)
+    {
+        if (!machine->step())
+        {
+            continue;
+        }
+        frames++;
+
+        uint64_t target = static_cast<uint64_t>(machine->getTicks()) * MIXER_SAMPLE_RATE / SOUND_CPU_FREQUENCY;
+        size_t count = target - mixedSamples;
+        samples.resize(count * 2);
+        mixer->mix(samples.data(), count);
+        mixedSamples = target;
+        if (wav.isOpen())
+        {
+            wav.write(samples.data(), count);
+        }
+        if (video.isOpen())
+        {
+            video.write(ula->getScreenBuffer(), 352 * 288 * sizeof(uint32_t));
+        }
+    }
+    double wallSeconds = (Pacer::now() - startTime) / 1e9;
+
+    // Recorder stops at the end of a frame, emulate one more
+    if (ayLog->isRecording())
+    {
+        ayLog->requestStop();
+        while (!machine->step())
+        {
+        }
+        ayLog->stop();
+    }
+
+    bool ok = wav.close();
+    ok = video.close() && ok;
+    if (!ok)
+    {
+        std::cerr << "Failed to write capture files" << std::endl;
+    }
+
+    double emulatedSeconds = static_cast<double>(machine->getTicks()) / TARGET_FREQUENCY;
+    std::cerr << "Headless: " << frames << " frames, " << emulatedSeconds << " s emulated in "
+              << wallSeconds << " s (" << (wallSeconds > 0 ? emulatedSeconds / wallSeconds : 0) << "x real time)" << std::endl;
+    return ok;
+}
+
 // Helper function to handle Kempston joystick events
-void handleKempstonJoystick(SDL_Keycode key, bool pressed, std::unique_ptr<Kempston> &kempston)
+void handleKempstonJoystick(SDL_Keycode key, bool pressed, Kempston *kempston)
 {
     // Only process if Kempston joystick is available
     if (!kempston)
@@ -1016,27 +1650,134 @@ void mapKeyToSpectrum(SDL_Keycode key, bool pressed, ULA *ula)
 // Handle key down events
 void Emulator::handleKeyDown(SDL_Keycode key)
 {
+    if (key == SDLK_BACKSPACE)
+    {
+        rewindHeld = true;
+        return;
+    }
+
     // Handle Kempston joystick with arrow keys and Alt
     handleKempstonJoystick(key, true, kempston);
 
     // Map SDL keys to ZX Spectrum keyboard matrix
-    mapKeyToSpectrum(key, true, ula.get());
+    mapKeyToSpectrum(key, true, ula);
 }
 
 // Handle key up events
 void Emulator::handleKeyUp(SDL_Keycode key)
 {
+    if (key == SDLK_BACKSPACE)
+    {
+        rewindHeld = false;
+        return;
+    }
+
     // Handle Kempston joystick with arrow keys and Alt
     handleKempstonJoystick(key, false, kempston);
 
     // Map SDL keys to ZX Spectrum keyboard matrix
-    mapKeyToSpectrum(key, false, ula.get());
+    mapKeyToSpectrum(key, false, ula);
 }
 
 // Main entry point of the program
 // This is where execution begins when you start the emulator
 int main(int argc, char *argv[])
 {
+    // Offline mode: ./emulator --headless [--frames N] [--wav out.wav] [--video out.raw] [--aylog out.vgm|out.psg] [--play] [tape]
+    // Raw video is 352x288 ARGB8888, e.g. ffmpeg -f rawvideo -pixel_format bgra -video_size 352x288 -framerate 50 -i out.raw
+    // Music: ./emulator --play-music file [--song N] [--wav out.wav]   or   ./emulator --convert-music dir [--jobs N]
+    bool headless = false;
+    HeadlessOptions options;
+    std::string tapePath;
+    std::string musicFile;
+    std::string musicDirectory;
+    int song = 0;
+    int jobs = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--headless")
+        {
+            headless = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frames = std::atoll(argv[++i]);
+        }
+        else if (arg == "--wav" && i + 1 < argc)
+        {
+            options.wavFile = argv[++i];
+        }
+        else if (arg == "--video" && i + 1 < argc)
+        {
+            options.videoFile = argv[++i];
+        }
+        else if (arg == "--aylog" && i + 1 < argc)
+        {
+            options.ayLogFile = argv[++i];
+        }
+        else if (arg == "--play-music" && i + 1 < argc)
+        {
+            musicFile = argv[++i];
+        }
+        else if (arg == "--song" && i + 1 < argc)
+        {
+            song = std::atoi(argv[++i]);
+        }
+        else if (arg == "--convert-music" && i + 1 < argc)
+        {
+            musicDirectory = argv[++i];
+        }
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            jobs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--play")
+        {
+            options.playTape = true;
+        }
+        else
+        {
+            tapePath = arg;
+        }
+    }
+
+    if (!musicDirectory.empty())
+    {
+        return convertMusicDirectory(musicDirectory, jobs) == 0 ? 0 : -1;
+    }
+    if (!musicFile.empty())
+    {
+        // With --wav the song is rendered as fast as possible, otherwise played
+        if (!options.wavFile.empty())
+        {
+            return convertMusicFile(musicFile, options.wavFile, song) ? 0 : -1;
+        }
+        return playMusic(musicFile, song);
+    }
+
+    if (headless)
+    {
+        // Captures may go to stdout, so nothing else is printed there
+        std::cout.rdbuf(std::cerr.rdbuf());
+        Emulator emulator;
+        if (!emulator.initialize(true))
+        {
+            std::cerr << "Failed to initialize emulator!" << std::endl;
+            return -1;
+        }
+        if (Snapshot::isSnapshotFile(tapePath))
+        {
+            emulator.openFile(tapePath);
+        }
+        else if (!tapePath.empty() && !emulator.loadTapeFile(tapePath))
+        {
+            std::cerr << "Failed to load tape file: " << tapePath << std::endl;
+            return -1;
+        }
+        return emulator.runHeadless(options) ? 0 : -1;
+    }
+
     // Welcome message for users
     std::cout << "ZX Spectrum Emulator starting..." << std::endl;
 
@@ -1059,18 +1800,23 @@ int main(int argc, char *argv[])
 
     // Check if a file path was provided as a command line argument
     // This allows users to load a tape file directly when starting the emulator
-    // Usage: ./emulator myfile.tap
-    if (argc > 1)
+    // Usage: ./emulator myfile.tap   (or a .z80/.sna/.szx snapshot)
+    if (Snapshot::isSnapshotFile(tapePath))
+    {
+        std::cout << "Loading snapshot from command line: " << tapePath << std::endl;
+        emulator.openFile(tapePath);
+    }
+    else if (!tapePath.empty())
     {
         // Get the file path from command line arguments
-        // argv[0] is the program name, argv[1] is the first argument
-        std::string filePath = argv[1];
+        std::string filePath = tapePath;
         std::cout << "Loading tape file from command line: " << filePath << std::endl;
 
         // Load the tape file and prepare it for playback
         // This reads the file into memory and prepares it for the emulator to use
         if (emulator.loadTapeFile(filePath))
         {
+            emulator.checkTapeCache();
             std::cout << "Tape file loaded successfully. Use Tape->Play menu to start playback." << std::endl;
         }
         else
@@ -0,0 +1,531 @@
+#include "machine.hpp"
+#include "romregistry.hpp"
+#include "snapshot.hpp"
+#include "archive.hpp"
+#include <iostream>
+#include <vector>
+
+Machine::Machine() : totalTicks(0), frames(0), frameDone(false), silent(false), saveTrap(true), recordMic(false)
+{
+    // No tape seek requested yet
+    pendingTapeBlock = -1;
+    pendingTapeTicks = -1;
+    pendingTapePlay = false;
+    fileRequested = false;
+    pendingOpenEntry = -1;
+    pendingTapeEntry = -1;
+}
+
+Machine::~Machine()
+{
+    cleanup();
+}
+
+bool Machine::initialize(bool threadedSound, size_t ringSamples)
+{
+    // Step 1: Initialize all core emulator components
+    // These represent the actual hardware chips in a real ZX Spectrum
+
+    // Initialize memory system (RAM and ROM)
+    memory = std::make_unique<Memory>();
+
+    // Initialize port system (input/output connections)
+    ports = std::make_unique<Port>();
+
+    // Initialize tape loading system
+    tape = std::make_unique<Tape>();
+    tapeRecorder = std::make_unique<TapeRecorder>();
+
+    // Initialize main processor (Z80 CPU)
+    // Pass references to memory and ports so CPU can interact with them
+    cpu = std::make_unique<Z80>(memory.get(), ports.get());
+
+    // Initialize graphics and keyboard controller (ULA chip)
+    // Pass references to memory and tape systems
+    ula = std::make_unique<ULA>(memory.get(), tape.get());
+    ula->setScheduler(&scheduler);
+    ula->setFrameHandler([this](uint64_t tstate)
+                         { endFrame(tstate); });
+
+    // Initialize joystick interface (Kempston)
+    kempston = std::make_unique<Kempston>();
+
+    // Step 2: Connect hardware components through port handlers
+    // The ZX Spectrum uses specific port addresses to communicate with hardware
+
+    // Connect ULA (graphics/keyboard controller) to port 0xFE
+    ports->RegisterReadHandler(0xFE, [this](uint16_t port) -> uint8_t
+                               { return ula->readPort(port); });
+    ports->RegisterWriteHandler(0xFE, [this](uint16_t port, uint8_t value)
+                                { ula->writePort(port, value); });
+
+    // Connect Kempston joystick to port 0x1F
+    ports->RegisterReadHandler(0x1F, [this](uint16_t port) -> uint8_t
+                               { return kempston->readPort(port); });
+
+    // Connect Memory interface to port 0xFD
+    ports->RegisterWriteHandler(0xFD, [this](uint16_t port, uint8_t value)
+                                { return memory->writePort(port, value); });
+
+    // Step 3: Initialize sound systems
+    // Set up both the basic beeper and advanced AY-3-8912 sound chip
+
+    // Initialize basic beeper sound system
+    sound = std::make_unique<Sound>(ringSamples);
+    if (!sound->initialize())
+    {
+        std::cerr << "Warning: Failed to initialize sound system" << std::endl;
+        // Continue without sound if initialization fails
+    }
+
+    // Connect beeper to port 0xFE (shared with ULA)
+    ports->RegisterWriteHandler(0xFE, [this](uint16_t port, uint8_t value)
+                                {
+                                    if (!silent)
+                                    {
+                                        sound->writePort(port, value);
+                                    } });
+
+    // Initialize AY8912 sound chip (provides better sound quality)
+    turboSound = std::make_unique<TurboSound>(ringSamples);
+    if (!turboSound->initialize(threadedSound))
+    {
+        std::cerr << "Warning: Failed to initialize AY8912 sound chip" << std::endl;
+        // Continue without AY8912 sound if initialization fails
+    }
+
+    // Covox/SounDrive DACs, off until enabled
+    dac = std::make_unique<Dac>(ringSamples);
+
+    // One mixer for all sound sources, the host connects it to a device or a file
+    mixer = std::make_unique<AudioMixer>();
+    mixer->addSource(sound->getOutput());
+    mixer->addSource(turboSound->getChip(0)->getOutput());
+    mixer->addSource(turboSound->getChip(1)->getOutput());
+    mixer->addSource(dac->getOutput());
+    if (!threadedSound)
+    {
+        // No device: host pulls exactly what was emulated, nothing to buffer against
+        mixer->setPrefill(0);
+    }
+
+    // Connect tape recorder to MIC output of port 0xFE
+    ports->RegisterWriteHandler(0xFE, [this](uint16_t, uint8_t value)
+                                {
+                                    if (recordMic && !silent)
+                                    {
+                                        std::lock_guard<std::mutex> lock(recorderMutex);
+                                        tapeRecorder->micWrite(sound->ticks, value);
+                                    } });
+
+    // Connect AY8912 to port 0xFD (shared with memory)
+    ports->RegisterWriteHandler(0xFD, [this](uint16_t port, uint8_t value)
+                                { turboSound->writePort(port, value); });
+    ports->RegisterReadHandler(0xFD, [this](uint16_t port) -> uint8_t
+                               { return turboSound->readPort(port); });
+
+    // Connect DACs to their ports (SounDrive 0x1F is write only, Kempston reads it)
+    for (uint8_t dacPort : {DAC_PORT_COVOX, DAC_PORT_SOUNDRIVE1, DAC_PORT_SOUNDRIVE2, DAC_PORT_SOUNDRIVE3, DAC_PORT_SOUNDRIVE4})
+    {
+        ports->RegisterWriteHandler(dacPort, [this](uint16_t port, uint8_t value)
+                                    {
+                                        if (!silent)
+                                        {
+                                            dac->writePort(port, value);
+                                        } });
+    }
+    return true;
+}
+
+void Machine::cleanup()
+{
+    if (turboSound)
+    {
+        turboSound->cleanup();
+    }
+    if (sound)
+    {
+        sound->cleanup();
+    }
+}
+
+void Machine::prepare()
+{
+    // Initialize memory with 128K ROM (default mode)
+    // The ZX Spectrum 128K had more memory and additional features compared to the 48K model
+    memory->Read128();       // Load 128K ROM
+    //memory->Read48();
+    memory->change48(false); // Set memory mode to 128K
+
+    // Set CPU to CMOS mode (more accurate for later Spectrums)
+    // The Z80 CPU in later Spectrum models was a CMOS variant
+    cpu->isNMOS = false;
+}
+
+bool Machine::loadRom(const std::string &filePath)
+{
+    size_t size = 0;
+    const uint8_t *data = RomRegistry::mapFile(filePath, size);
+    if (!data)
+    {
+        return false;
+    }
+    if (size != 16384 && size != 32768)
+    {
+        std::cerr << "ROM file must be 16K or 32K: " << filePath << std::endl;
+        return false;
+    }
+
+    // Pages of the mapped file are used in place, machines with the same ROM share it
+    memory->change48(false);
+    memory->writePort(0x7ffd, 0x00);
+    memory->setRom(0, data);
+    memory->setRom(1, size == 32768 ? data + 16384 : data);
+    memory->change48(size == 16384);
+    return true;
+}
+
+void Machine::start()
+{
+    totalTicks = 0; // Total CPU cycles executed
+    frames = 0;
+    ula->start(totalTicks);
+}
+
+void Machine::restartFrame()
+{
+    // Frame starts with its interrupt, as after endFrame()
+    cpu->InterruptPending = true;
+    ula->start(totalTicks);
+}
+
+bool Machine::step()
+{
+    if (fileRequested.load(std::memory_order_relaxed) && !silent)
+    {
+        applyFileRequests();
+    }
+
+    // Execute one instruction and get the number of CPU cycles it took
+    int ticks = cpu->ExecuteOneInstruction();
+    // TR-DOS enable/disable block
+    if(cpu->PC >= 0x3d00 && cpu->PC <= 0x3dff && memory->checkTrDos() == false) {
+      memory->enableTrDos(true);
+      //printf("TRDOS enable\n");
+    }
+    if(cpu->PC > 0x3fff && memory->checkTrDos() == true)
+    {
+      memory->enableTrDos(false);
+      //printf("TRDOS disable\n");
+    }
+
+    // ROM SAVE: store the block at once instead of playing it to MIC
+    if (cpu->PC == ROM_SA_BYTES && saveTrap && isSaBytes())
+    {
+        trapSaveBytes();
+    }
+
+    // Apply tape seek requested from the tape browser
+    if (pendingTapeBlock.load(std::memory_order_relaxed) >= 0 && !silent)
+    {
+        tape->seekToBlock(pendingTapeBlock.exchange(-1));
+        ula->syncTape(totalTicks);
+    }
+    if (pendingTapePlay.load(std::memory_order_relaxed) && !silent)
+    {
+        pendingTapePlay = false;
+        playTape();
+    }
+    if (pendingTapeTicks.load(std::memory_order_relaxed) >= 0 && !silent)
+    {
+        tape->seekToTime(pendingTapeTicks.exchange(-1));
+        ula->syncTape(totalTicks);
+    }
+
+    // Update our cycle counters
+    totalTicks += ticks;
+
+    // Update sound system with current cycle count
+    // This ensures audio stays synchronized with the CPU
+    sound->ticks = totalTicks;
+    turboSound->setTicks(totalTicks);
+    dac->ticks = totalTicks;
+    ula->ticks = totalTicks;
+
+    // Timed hardware (frame end, beam lines, tape edges) due by now
+    frameDone = false;
+    scheduler.run(totalTicks);
+    return frameDone;
+}
+
+void Machine::runFrame()
+{
+    while (!step())
+    {
+    }
+}
+
+void Machine::runAhead(int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (runAheadState.empty())
+    {
+        runAheadState.resize(getStateSize());
+    }
+    saveState(runAheadState);
+    uint64_t dirty[MEMORY_DIRTY_WORDS];
+    memory->getDirty(dirty);
+
+    silent = true;
+    turboSound->setSilent(true);
+    for (int frame = 0; frame < count; frame++)
+    {
+        ula->setRendering(frame == count - 1);
+        runFrame();
+    }
+    ula->setRendering(false);
+    turboSound->setSilent(false);
+    silent = false;
+
+    // Same time as before: sound sources did not move on. RAM is as it was,
+    // so are the pages written since the last rewind frame
+    loadState(runAheadState);
+    memory->setDirty(dirty);
+}
+
+// ULA has drawn the whole screen
+void Machine::endFrame(uint64_t tstate)
+{
+    frameDone = true;
+    frames++;
+
+    // Signal that an interrupt should be triggered
+    // This is part of the ZX Spectrum's timing system
+    cpu->InterruptPending = true;
+    if (silent)
+    {
+        return;
+    }
+
+    // Tape browser reads the cursor from the UI thread
+    tape->publishCursor();
+
+    // Let sound sources render the frame with all its changes
+    sound->setClock(tstate);
+    turboSound->setClock(tstate);
+    dac->setClock(tstate);
+
+    if (frameHandler)
+    {
+        frameHandler(tstate);
+    }
+}
+
+// Every part writes its own fields straight into the block, RAM is one memcpy
+bool Machine::saveState(std::span<uint8_t> buffer) const
+{
+    if (buffer.size() < sizeof(MachineState) || reinterpret_cast<uintptr_t>(buffer.data()) % alignof(MachineState) != 0)
+    {
+        std::cerr << "Machine state buffer is too small or not aligned" << std::endl;
+        return false;
+    }
+    MachineState &state = *reinterpret_cast<MachineState *>(buffer.data());
+    state.version = MACHINE_STATE_VERSION;
+    state.size = sizeof(MachineState);
+    state.totalTicks = totalTicks;
+    state.frames = frames;
+    cpu->saveState(state.cpu);
+    ula->saveState(state.ula);
+    scheduler.saveState(state.scheduler);
+    tape->saveCursor(state.tape);
+    turboSound->saveState(state.turboSound);
+    memory->saveState(state.memory);
+    return true;
+}
+
+bool Machine::loadState(std::span<const uint8_t> buffer, bool keepClock)
+{
+    if (buffer.size() < sizeof(MachineState) || reinterpret_cast<uintptr_t>(buffer.data()) % alignof(MachineState) != 0)
+    {
+        std::cerr << "Machine state buffer is too small or not aligned" << std::endl;
+        return false;
+    }
+    const MachineState &state = *reinterpret_cast<const MachineState *>(buffer.data());
+    if (state.version != MACHINE_STATE_VERSION || state.size != sizeof(MachineState))
+    {
+        std::cerr << "Machine state of another version" << std::endl;
+        return false;
+    }
+
+    // Deadlines and beam times are absolute, all move by the same amount
+    int64_t shift = 0;
+    if (keepClock)
+    {
+        shift = totalTicks - state.totalTicks;
+    }
+    else
+    {
+        totalTicks = state.totalTicks;
+        frames = state.frames;
+    }
+    sound->ticks = totalTicks;
+    turboSound->setTicks(totalTicks);
+    dac->ticks = totalTicks;
+
+    cpu->loadState(state.cpu);
+    ula->loadState(state.ula, shift);
+    scheduler.loadState(state.scheduler, shift);
+    tape->restoreCursor(state.tape);
+    turboSound->loadState(state.turboSound);
+    memory->loadState(state.memory);
+    frameDone = false;
+    return true;
+}
+
+bool Machine::loadTape(const std::string &filePath)
+{
+    std::cout << "Loading tape file: " << filePath << std::endl;
+    // Loader thread of an earlier requestTape fills the same blocks
+    tape->stopLoading();
+    if (!tape->loadFile(filePath))
+    {
+        std::cerr << "Failed to load tape file: " << filePath << std::endl;
+        return false;
+    }
+    tape->prepareBitStream();
+    std::cout << "Tape file loaded successfully" << std::endl;
+    return true;
+}
+
+bool Machine::loadSnapshot(const std::string &filePath)
+{
+    return Snapshot::load(*this, filePath);
+}
+
+bool Machine::saveSnapshot(const std::string &filePath)
+{
+    return Snapshot::save(*this, filePath);
+}
+
+bool Machine::openFile(const std::string &filePath, int entry)
+{
+    if (entry >= 0)
+    {
+        Archive archive;
+        return archive.open(filePath) && Snapshot::load(*this, archive, entry);
+    }
+    if (Snapshot::isSnapshotFile(filePath))
+    {
+        return loadSnapshot(filePath);
+    }
+    if (!loadRom(filePath))
+    {
+        return false;
+    }
+    // New ROM starts from reset
+    cpu->PC = 0;
+    cpu->IFF1 = false;
+    cpu->IFF2 = false;
+    cpu->IM = 0;
+    cpu->HALT = false;
+    restartFrame();
+    return true;
+}
+
+void Machine::requestOpen(const std::string &filePath, int entry)
+{
+    std::lock_guard<std::mutex> lock(fileRequestMutex);
+    pendingOpen = filePath;
+    pendingOpenEntry = entry;
+    fileRequested = true;
+}
+
+void Machine::requestTape(const std::string &filePath, int entry)
+{
+    std::lock_guard<std::mutex> lock(fileRequestMutex);
+    pendingTape = filePath;
+    pendingTapeEntry = entry;
+    fileRequested = true;
+}
+
+void Machine::requestSave(const std::string &filePath)
+{
+    std::lock_guard<std::mutex> lock(fileRequestMutex);
+    pendingSave = filePath;
+    fileRequested = true;
+}
+
+void Machine::applyFileRequests()
+{
+    std::string openPath, savePath, tapePath;
+    int openEntry, tapeEntry;
+    {
+        std::lock_guard<std::mutex> lock(fileRequestMutex);
+        openPath.swap(pendingOpen);
+        savePath.swap(pendingSave);
+        tapePath.swap(pendingTape);
+        openEntry = pendingOpenEntry;
+        tapeEntry = pendingTapeEntry;
+        fileRequested = false;
+    }
+    if (!tapePath.empty())
+    {
+        // Not inside advance() here, so the player can be stopped and rewound safely
+        tape->isTapePlayed = false;
+        tape->loadFileAsync(tapePath, tapeEntry);
+        ula->syncTape(totalTicks);
+    }
+    if (!savePath.empty() && saveSnapshot(savePath))
+    {
+        std::cout << "Snapshot saved: " << savePath << std::endl;
+    }
+    if (!openPath.empty() && openFile(openPath, openEntry))
+    {
+        std::cout << "Loaded: " << openPath << std::endl;
+    }
+}
+
+void Machine::playTape()
+{
+    // First edge is due from now, not from the next frame end
+    tape->isTapePlayed = true;
+    ula->syncTape(totalTicks);
+}
+
+// SA-BYTES starts with LD HL,SA/LD-RET; PUSH HL. Checking the code itself
+// works for 48K, for ROM 1 of 128K and skips TR-DOS or 128K editor ROMs
+bool Machine::isSaBytes()
+{
+    return memory->ReadByte(ROM_SA_BYTES) == 0x21 &&
+           memory->ReadByte(ROM_SA_BYTES + 1) == (ROM_SA_LD_RET & 0xFF) &&
+           memory->ReadByte(ROM_SA_BYTES + 2) == (ROM_SA_LD_RET >> 8) &&
+           memory->ReadByte(ROM_SA_BYTES + 3) == 0xE5;
+}
+
+// Store block described by IX (start), DE (length) and A (flag)
+void Machine::trapSaveBytes()
+{
+    std::vector<uint8_t> data(cpu->DE);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = memory->ReadByte(static_cast<uint16_t>(cpu->IX + i));
+    }
+
+    if (!silent)
+    {
+        std::lock_guard<std::mutex> lock(recorderMutex);
+        tapeRecorder->addBlock(cpu->A, data);
+    }
+
+    // Registers as ROM leaves them: parity byte sent after the data (DE counted down
+    // past zero, IX one past it), A cleared and zero, half carry and carry set by the
+    // end of the last byte. SA/LD-RET restores border, enables interrupts and returns to the caller
+    cpu->IX += cpu->DE + 1;
+    cpu->DE = 0xFFFF;
+    cpu->A = 0;
+    cpu->F = FLAG_Z | FLAG_H | FLAG_C;
+    cpu->PC = ROM_SA_LD_RET;
+}
@@ -1,14 +1,8 @@
 #include <iostream>
+#include <cstring>
 
 #include "memory.hpp"
-// generated by xxd -i ...
-#include "48rom.h"
-#include "diagrom.h"
-#include "diagrom2.h"
-#include "1280.h"
-#include "1281.h"
-#include "trdos.h"
-#include "trdos604.h"
+#include "romregistry.hpp"
 
 Memory::Memory()
 {
@@ -20,7 +14,9 @@ Memory::Memory()
             bank[i][b] = 0x00;
         }
     }
-    canWriteRom = false;
+    romWritable = false;
+    romWrite = &romSink;
+    romWriteMask = 0;
     is48 = true;
     bankMapping[0] = 0; // 0 ROM - specially, mapped to 0x0000-0x3fff
     bankMapping[1] = 5; // bank 5 mapped to 0x4000-0x7fff
@@ -28,15 +24,86 @@ Memory::Memory()
     bankMapping[3] = 0; // bank 0 mapped 0xc000-0xffff
     ULAShadow = false;  // ULA reading from bank 5 (false) or bank 7 (true)
     isTrDos = false;    // No trdos at start
-    // load trdos to ROM bank 3
-    canWriteRom = true;
-    bankMapping[0] = 2;
-    for (unsigned int i = 0; i < trdos604_rom_len; i++)
+    clearDirty();
+    // 48K ROM until a machine is selected, trdos in ROM bank 3
+    rom[0] = RomRegistry::get(ROM_48);
+    rom[1] = RomRegistry::get(ROM_48);
+    rom[2] = RomRegistry::get(ROM_TRDOS_604);
+}
+
+void Memory::setRom(int slot, const uint8_t *image)
+{
+    if (romCopy)
     {
-        WriteByte(i, trdos604_rom[i]);
+        memcpy(romCopy.get() + slot * ROM_PAGE_SIZE, image, ROM_PAGE_SIZE);
+    }
+    else
+    {
+        rom[slot] = image;
     }
-    canWriteRom = false;
-    bankMapping[0] = 0;
+}
+
+void Memory::setRomWritable(bool writable)
+{
+    if (writable && !romCopy)
+    {
+        romCopy.reset(new uint8_t[3 * ROM_PAGE_SIZE]);
+        for (int slot = 0; slot < 3; slot++)
+        {
+            memcpy(romCopy.get() + slot * ROM_PAGE_SIZE, rom[slot], ROM_PAGE_SIZE);
+            rom[slot] = romCopy.get() + slot * ROM_PAGE_SIZE;
+        }
+    }
+    romWritable = writable;
+    romWrite = writable ? romCopy.get() : &romSink;
+    romWriteMask = writable ? 0xFFFF : 0; // 3 pages end below 0x10000
+}
+
+void Memory::saveState(MemoryState &state) const
+{
+    memcpy(state.rom, rom, sizeof(state.rom));
+    state.is48 = is48;
+    memcpy(state.bankMapping, bankMapping, sizeof(state.bankMapping));
+    state.ULAShadow = ULAShadow;
+    state.isTrDos = isTrDos;
+    memcpy(state.bank, bank, sizeof(state.bank));
+}
+
+void Memory::loadState(const MemoryState &state)
+{
+    if (!romWritable)
+    {
+        memcpy(rom, state.rom, sizeof(rom));
+    }
+    is48 = state.is48;
+    memcpy(bankMapping, state.bankMapping, sizeof(bankMapping));
+    ULAShadow = state.ULAShadow;
+    isTrDos = state.isTrDos;
+    memcpy(bank, state.bank, sizeof(bank));
+    memset(dirty, 0xFF, sizeof(dirty));
+}
+
+void Memory::getDirty(uint64_t pages[MEMORY_DIRTY_WORDS]) const
+{
+    memcpy(pages, dirty, sizeof(dirty));
+}
+
+void Memory::setDirty(const uint64_t pages[MEMORY_DIRTY_WORDS])
+{
+    memcpy(dirty, pages, sizeof(dirty));
+}
+
+void Memory::clearDirty()
+{
+    memset(dirty, 0, sizeof(dirty));
+}
+
+void Memory::markBankDirty(int number)
+{
+    // 16 pages of a bank are one aligned group of bits
+    const int perBank = 16384 / MEMORY_DIRTY_PAGE_SIZE;
+    int first = number * perBank;
+    dirty[first / 64] |= ((1ULL << perBank) - 1) << (first % 64);
 }
 
 void Memory::writePort(uint16_t port, uint8_t value)
@@ -50,7 +117,12 @@ void Memory::writePort(uint16_t port, uint8_t value)
         else
         {
             bankMapping[3] = value & 0x07;
-            ULAShadow = (value & 0x08) ? true : false;
+            bool shadow = (value & 0x08) != 0;
+            if (shadow != ULAShadow && screenWriteHandler)
+            {
+                screenWriteHandler();
+            }
+            ULAShadow = shadow;
             bankMapping[0] = (value & 0x10) ? 1 : 0;
             is48 = (value & 0x20) ? true : false; // disable future using of this port
             // printf("%x -> %x bank %d shadow %d rom %d\n", port, value, bankMapping[3], ULAShadow, bankMapping[0]);
@@ -58,6 +130,11 @@ void Memory::writePort(uint16_t port, uint8_t value)
     }
 }
 
+uint8_t Memory::getPort7ffd() const
+{
+    return bankMapping[3] | (ULAShadow ? 0x08 : 0x00) | (bankMapping[0] ? 0x10 : 0x00);
+}
+
 uint8_t Memory::ReadByte(uint16_t address)
 {
     if (address <= 0x3fff) // ROM 0 or ROM 1
@@ -97,26 +174,23 @@ uint8_t Memory::ULAReadByte(uint16_t address)
 
 void Memory::WriteByte(uint16_t address, uint8_t value)
 {
-    if (address < 0x4000 && canWriteRom == false)
-    {
-        // printf("Ignoring attempt to write byte to ROM %x %x\n",address,value);
-        return;
-    }
     if (address <= 0x3fff) // ROM 0 or ROM 1
     {
-        rom[bankMapping[0]][address] = value;
-    }
-    else if (address >= 0x4000 && address < 0x8000)
-    {
-        bank[bankMapping[1]][address - 0x4000] = value;
-    }
-    else if (address >= 0x8000 && address < 0xc000)
-    {
-        bank[bankMapping[2]][address - 0x8000] = value;
+        // Read-only ROM drops the byte into romSink
+        romWrite[(bankMapping[0] * ROM_PAGE_SIZE + address) & romWriteMask] = value;
     }
-    else // address >= 0xc000
+    else
     {
-        bank[bankMapping[3]][address - 0xc000] = value;
+        // Slot 1-3, page number is bank and 1K part of the offset
+        uint8_t number = bankMapping[address >> 14];
+        uint16_t offset = address & 0x3fff;
+        if (offset < MEMORY_SCREEN_SIZE && number == (ULAShadow ? 7 : 5) && screenWriteHandler)
+        {
+            screenWriteHandler();
+        }
+        bank[number][offset] = value;
+        unsigned page = number * (16384 / MEMORY_DIRTY_PAGE_SIZE) + offset / MEMORY_DIRTY_PAGE_SIZE;
+        dirty[page / 64] |= 1ULL << (page % 64);
     }
 }
 
@@ -127,52 +201,27 @@ void Memory::change48(bool is48s)
 
 void Memory::Read48(void)
 {
-    canWriteRom = true;
     bankMapping[0] = 0;
-    for (unsigned int i = 0; i < __48_rom_len; i++)
-    {
-        WriteByte(i, __48_rom[i]);
-    }
-    canWriteRom = false;
+    setRom(0, RomRegistry::get(ROM_48));
 }
 
 void Memory::Read128(void)
 {
-    canWriteRom = true;
-    bankMapping[0] = 0;
-    for (unsigned int i = 0; i < __128_0_rom_len; i++)
-    {
-        WriteByte(i, __128_0_rom[i]);
-    }
-    bankMapping[0] = 1;
-    for (unsigned int i = 0; i < __128_1_rom_len; i++)
-    {
-        WriteByte(i, __128_1_rom[i]);
-    }
     bankMapping[0] = 0;
-    canWriteRom = false;
+    setRom(0, RomRegistry::get(ROM_128_0));
+    setRom(1, RomRegistry::get(ROM_128_1));
 }
 
 void Memory::ReadDiag(void)
 {
-    canWriteRom = true;
     bankMapping[0] = 0;
-    for (unsigned int i = 0; i < testrom_bin_len; i++)
-    {
-        WriteByte(i, testrom_bin[i]);
-    }
-    canWriteRom = false;
+    setRom(0, RomRegistry::get(ROM_DIAG));
 }
 
 void Memory::ReadDiag2(void)
 {
-    canWriteRom = true;
     bankMapping[0] = 0;
-    for (unsigned int i = 0; i < DiagROMv_173_len; i++)
-    {
-        WriteByte(i, DiagROMv_173[i]);
-    }
-    canWriteRom = false;
+    setRom(0, RomRegistry::get(ROM_DIAG2));
 }
 
 void Memory::enableTrDos(bool is)
@@ -0,0 +1,82 @@
+#include "pacer.hpp"
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <time.h>
+
+Pacer::Pacer() : mode(PacingMode::Timer), frequency(3500000), activeFrequency(3500000), mixer(nullptr), startTime(0), baseTicks(0)
+{
+    restart(0);
+}
+
+int64_t Pacer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Pacer::sleepUntil(int64_t time)
+{
+#if defined(__linux__)
+    // steady_clock is CLOCK_MONOTONIC on Linux. Absolute deadline: an early wake-up
+    // or a signal does not shift the following frames
+    struct timespec deadline;
+    deadline.tv_sec = time / 1000000000LL;
+    deadline.tv_nsec = time % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+    {
+    }
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(time)));
+#endif
+}
+
+void Pacer::restart(long long ticks)
+{
+    startTime = now();
+    baseTicks = ticks;
+    activeFrequency = frequency.load(std::memory_order_relaxed);
+}
+
+void Pacer::waitTimer(long long ticks)
+{
+    int64_t due = startTime + (ticks - baseTicks) * 1000000000LL / activeFrequency;
+    int64_t current = now();
+    if (current > due + PACER_MAX_LAG_NS)
+    {
+        // Host was busy (or emulation stopped in debugger): do not run fast to catch up
+        restart(ticks);
+        return;
+    }
+    if (due > current)
+    {
+        sleepUntil(due);
+    }
+}
+
+void Pacer::waitFrame(long long ticks)
+{
+    if (frequency.load(std::memory_order_relaxed) != activeFrequency)
+    {
+        restart(ticks);
+    }
+
+    if (mode.load(std::memory_order_relaxed) == PacingMode::Audio && mixer)
+    {
+        // Next frame is emulated when the device has eaten the previous ones.
+        // Speed follows the sound card clock, so the rings neither overflow nor run dry
+        while (mixer->getQueuedFrames() > PACER_AUDIO_FRAMES)
+        {
+            if (!mixer->waitForMix(std::chrono::milliseconds(PACER_AUDIO_TIMEOUT_MS)))
+            {
+                // Nobody plays the sound: fall back to the timer for this frame
+                waitTimer(ticks);
+                return;
+            }
+        }
+        // Keep timer in step, so switching modes does not cause a jump
+        restart(ticks);
+        return;
+    }
+
+    waitTimer(ticks);
+}
@@ -0,0 +1,260 @@
+#include "rewind.hpp"
+#include "machine.hpp"
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <bit>
+#include <zlib.h>
+
+// MachineState bytes before the RAM banks: registers, beam, scheduler, paging
+static const size_t HEAD_SIZE = offsetof(MachineState, memory) + offsetof(MemoryState, bank);
+
+static int countPages(const uint64_t pages[MEMORY_DIRTY_WORDS])
+{
+    int count = 0;
+    for (int i = 0; i < MEMORY_DIRTY_WORDS; i++)
+    {
+        count += std::popcount(pages[i]);
+    }
+    return count;
+}
+
+Rewind::Rewind() : historyBytes(0), keyframes(0), busy(false), stopping(false),
+                   state(Machine::getStateSize()), pages(MEMORY_DIRTY_PAGES * MEMORY_DIRTY_PAGE_SIZE),
+                   sinceKeyframe(REWIND_KEYFRAME_INTERVAL)
+{
+    worker = std::thread(&Rewind::work, this);
+}
+
+Rewind::~Rewind()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void Rewind::capture(Machine &machine)
+{
+    // Worker behind (turbo loading): skip, written pages stay marked for the next frame
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.size() >= REWIND_MAX_PENDING)
+        {
+            return;
+        }
+    }
+    if (!machine.saveState(state))
+    {
+        return;
+    }
+    Memory *memory = machine.getMemory();
+
+    Entry entry;
+    memory->getDirty(entry.pages);
+    memory->clearDirty();
+    int count = countPages(entry.pages);
+    entry.keyframe = sinceKeyframe >= REWIND_KEYFRAME_INTERVAL || count == MEMORY_DIRTY_PAGES;
+    if (entry.keyframe)
+    {
+        memset(entry.pages, 0xFF, sizeof(entry.pages));
+        count = MEMORY_DIRTY_PAGES;
+        sinceKeyframe = 0;
+    }
+    else
+    {
+        sinceKeyframe++;
+    }
+
+    // Only copies here, the worker deflates
+    entry.head.assign(state.begin(), state.begin() + HEAD_SIZE);
+    entry.rawSize = static_cast<size_t>(count) * MEMORY_DIRTY_PAGE_SIZE;
+    entry.data.resize(entry.rawSize);
+    const uint8_t *ram = state.data() + HEAD_SIZE;
+    uint8_t *out = entry.data.data();
+    for (int page = 0; page < MEMORY_DIRTY_PAGES; page++)
+    {
+        if (entry.pages[page / 64] & (1ULL << (page % 64)))
+        {
+            memcpy(out, ram + page * MEMORY_DIRTY_PAGE_SIZE, MEMORY_DIRTY_PAGE_SIZE);
+            out += MEMORY_DIRTY_PAGE_SIZE;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(entry));
+    }
+    wake.notify_one();
+}
+
+void Rewind::work()
+{
+    std::vector<uint8_t> packed;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]
+                  { return stopping || !pending.empty(); });
+        if (stopping)
+        {
+            return;
+        }
+        Entry entry = std::move(pending.front());
+        pending.pop_front();
+        busy = true;
+        lock.unlock();
+
+        // Pages of a frame are mostly screen and variables: fastest deflate is enough
+        uLongf packedSize = compressBound(entry.rawSize);
+        packed.resize(packedSize);
+        if (entry.rawSize == 0)
+        {
+            // Nothing written that frame
+        }
+        else if (compress2(packed.data(), &packedSize, entry.data.data(), entry.rawSize, Z_BEST_SPEED) == Z_OK)
+        {
+            entry.data.assign(packed.begin(), packed.begin() + packedSize);
+        }
+        else
+        {
+            std::cerr << "Rewind: failed to compress a frame" << std::endl;
+            entry.data.clear();
+        }
+
+        lock.lock();
+        busy = false;
+        if (entry.data.empty() && entry.rawSize > 0)
+        {
+            // Frames after it cannot be rebuilt, start over
+            history.clear();
+            historyBytes = 0;
+            keyframes = 0;
+        }
+        else if (entry.keyframe || keyframes > 0)
+        {
+            historyBytes += entry.head.size() + entry.data.size();
+            keyframes += entry.keyframe ? 1 : 0;
+            history.push_back(std::move(entry));
+            trim();
+        }
+        if (pending.empty())
+        {
+            idle.notify_all();
+        }
+    }
+}
+
+void Rewind::trim()
+{
+    while (keyframes > 1)
+    {
+        // Oldest keyframe and its deltas go together, if the rest still covers the whole time
+        size_t group = 1;
+        while (!history[group].keyframe)
+        {
+            group++;
+        }
+        if (history.size() - group < REWIND_FRAMES && historyBytes <= REWIND_MAX_BYTES)
+        {
+            break;
+        }
+        for (size_t i = 0; i < group; i++)
+        {
+            historyBytes -= history.front().head.size() + history.front().data.size();
+            history.pop_front();
+        }
+        keyframes--;
+    }
+}
+
+bool Rewind::stepBack(Machine &machine)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return pending.empty() && !busy; });
+    if (history.size() < 2)
+    {
+        return false;
+    }
+    const Entry &last = history.back();
+    historyBytes -= last.head.size() + last.data.size();
+    keyframes -= last.keyframe ? 1 : 0;
+    history.pop_back();
+    return restoreLast(machine);
+}
+
+bool Rewind::restoreLast(Machine &machine)
+{
+    size_t first = history.size() - 1;
+    while (!history[first].keyframe)
+    {
+        first--;
+    }
+
+    // Keyframe, then pages of every frame after it, in order
+    uint8_t *ram = state.data() + HEAD_SIZE;
+    for (size_t index = first; index < history.size(); index++)
+    {
+        const Entry &entry = history[index];
+        if (entry.rawSize == 0)
+        {
+            continue;
+        }
+        uLongf size = entry.rawSize;
+        uint8_t *target = entry.keyframe ? ram : pages.data();
+        if (uncompress(target, &size, entry.data.data(), entry.data.size()) != Z_OK || size != entry.rawSize)
+        {
+            std::cerr << "Rewind: failed to decompress a frame" << std::endl;
+            return false;
+        }
+        if (entry.keyframe)
+        {
+            continue;
+        }
+        const uint8_t *in = pages.data();
+        for (int page = 0; page < MEMORY_DIRTY_PAGES; page++)
+        {
+            if (entry.pages[page / 64] & (1ULL << (page % 64)))
+            {
+                memcpy(ram + page * MEMORY_DIRTY_PAGE_SIZE, in, MEMORY_DIRTY_PAGE_SIZE);
+                in += MEMORY_DIRTY_PAGE_SIZE;
+            }
+        }
+    }
+    memcpy(state.data(), history.back().head.data(), HEAD_SIZE);
+
+    // Time goes on, so sound does not wait for the clock to catch up
+    if (!machine.loadState(state, true))
+    {
+        return false;
+    }
+    machine.getMemory()->clearDirty();
+    sinceKeyframe = static_cast<int>(history.size() - 1 - first);
+    return true;
+}
+
+void Rewind::clear()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return pending.empty() && !busy; });
+    history.clear();
+    historyBytes = 0;
+    keyframes = 0;
+    sinceKeyframe = REWIND_KEYFRAME_INTERVAL;
+}
+
+size_t Rewind::getFrames()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return history.size();
+}
+
+size_t Rewind::getBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return historyBytes;
+}
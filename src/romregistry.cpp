@@ -0,0 +1,108 @@
+#include "romregistry.hpp"
+#include <iostream>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// generated by xxd -i ...
+#include "48rom.h"
+#include "diagrom.h"
+#include "diagrom2.h"
+#include "1280.h"
+#include "1281.h"
+#include "trdos.h"
+#include "trdos604.h"
+
+static std::once_flag builtInOnce;
+static uint8_t *builtIn = nullptr; // ROM_IMAGE_COUNT pages
+
+static std::mutex filesMutex;
+static std::map<std::string, std::pair<const uint8_t *, size_t>> files; // Path -> mapping and size
+
+static void buildBuiltIn()
+{
+    const size_t bytes = ROM_IMAGE_COUNT * ROM_PAGE_SIZE;
+    void *pages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bool mapped = pages != MAP_FAILED;
+    if (!mapped)
+    {
+        // Still works, just without write protection
+        std::cerr << "RomRegistry: failed to map ROM pages, using unprotected memory" << std::endl;
+        pages = new uint8_t[bytes];
+    }
+    builtIn = static_cast<uint8_t *>(pages);
+
+    const struct
+    {
+        RomImage image;
+        const uint8_t *data;
+        unsigned int length;
+    } sources[] = {
+        {ROM_48, __48_rom, __48_rom_len},
+        {ROM_128_0, __128_0_rom, __128_0_rom_len},
+        {ROM_128_1, __128_1_rom, __128_1_rom_len},
+        {ROM_TRDOS_504, trdos_rom, trdos_rom_len},
+        {ROM_TRDOS_604, trdos604_rom, trdos604_rom_len},
+        {ROM_DIAG, testrom_bin, testrom_bin_len},
+        {ROM_DIAG2, DiagROMv_173, DiagROMv_173_len}};
+    for (const auto &source : sources)
+    {
+        // Shorter images are padded with FF as an empty EPROM reads
+        uint8_t *page = builtIn + source.image * ROM_PAGE_SIZE;
+        memset(page, 0xFF, ROM_PAGE_SIZE);
+        memcpy(page, source.data, source.length < ROM_PAGE_SIZE ? source.length : ROM_PAGE_SIZE);
+    }
+
+    // Heap fallback is not page aligned and must stay writable for delete[]
+    if (mapped && mprotect(builtIn, bytes, PROT_READ) != 0)
+    {
+        std::cerr << "RomRegistry: failed to protect ROM pages" << std::endl;
+    }
+}
+
+const uint8_t *RomRegistry::get(RomImage image)
+{
+    std::call_once(builtInOnce, buildBuiltIn);
+    return builtIn + image * ROM_PAGE_SIZE;
+}
+
+const uint8_t *RomRegistry::mapFile(const std::string &filePath, size_t &size)
+{
+    std::lock_guard<std::mutex> lock(filesMutex);
+    auto found = files.find(filePath);
+    if (found != files.end())
+    {
+        size = found->second.second;
+        return found->second.first;
+    }
+
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open ROM file: " << filePath << std::endl;
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0 || info.st_size % ROM_PAGE_SIZE != 0 ||
+        info.st_size > 4 * ROM_PAGE_SIZE)
+    {
+        std::cerr << "ROM file must be 16K, 32K, 48K or 64K: " << filePath << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // Mapping keeps the file
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Failed to map ROM file: " << filePath << std::endl;
+        return nullptr;
+    }
+
+    size = static_cast<size_t>(info.st_size);
+    files[filePath] = {static_cast<const uint8_t *>(data), size};
+    return static_cast<const uint8_t *>(data);
+}
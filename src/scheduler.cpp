@@ -0,0 +1,179 @@
+#include "scheduler.hpp"
+#include <iostream>
+
+Scheduler::Scheduler() : handlerCount(0), heapSize(0), nextDeadline(SCHEDULER_NEVER)
+{
+    for (int &position : positions)
+    {
+        position = -1;
+    }
+}
+
+int Scheduler::add(EventHandler handler)
+{
+    if (handlerCount >= SCHEDULER_MAX_EVENTS)
+    {
+        std::cerr << "Scheduler: no free event slots" << std::endl;
+        return -1;
+    }
+    handlers[handlerCount] = std::move(handler);
+    return handlerCount++;
+}
+
+void Scheduler::schedule(int id, uint64_t when)
+{
+    if (id < 0 || id >= handlerCount)
+    {
+        return;
+    }
+    int index = positions[id];
+    if (index < 0)
+    {
+        index = heapSize++;
+        place(index, {when, id});
+        siftUp(index);
+    }
+    else
+    {
+        // Moved earlier or later, one of the sifts does nothing
+        uint64_t old = heap[index].when;
+        heap[index].when = when;
+        if (when < old)
+        {
+            siftUp(index);
+        }
+        else
+        {
+            siftDown(index);
+        }
+    }
+    nextDeadline = heap[0].when;
+}
+
+void Scheduler::cancel(int id)
+{
+    if (isScheduled(id))
+    {
+        remove(positions[id]);
+    }
+}
+
+void Scheduler::clear()
+{
+    for (int i = 0; i < heapSize; i++)
+    {
+        positions[heap[i].id] = -1;
+    }
+    heapSize = 0;
+    nextDeadline = SCHEDULER_NEVER;
+}
+
+void Scheduler::saveState(SchedulerState &state) const
+{
+    state.size = heapSize;
+    for (int i = 0; i < heapSize; i++)
+    {
+        state.when[i] = heap[i].when;
+        state.id[i] = heap[i].id;
+    }
+}
+
+void Scheduler::loadState(const SchedulerState &state, int64_t shift)
+{
+    clear();
+    bool valid = state.size >= 0 && state.size <= handlerCount;
+    for (int i = 0; valid && i < state.size; i++)
+    {
+        valid = state.id[i] >= 0 && state.id[i] < handlerCount;
+    }
+    if (!valid)
+    {
+        std::cerr << "Scheduler: bad state, nothing scheduled" << std::endl;
+        return;
+    }
+
+    // Same shift for all keeps the heap order
+    for (int i = 0; i < state.size; i++)
+    {
+        place(i, {state.when[i] + static_cast<uint64_t>(shift), state.id[i]});
+    }
+    heapSize = state.size;
+    nextDeadline = heapSize > 0 ? heap[0].when : SCHEDULER_NEVER;
+}
+
+void Scheduler::fireDue(uint64_t now)
+{
+    while (heapSize > 0 && heap[0].when <= now)
+    {
+        Entry entry = heap[0];
+        remove(0);
+        handlers[entry.id](entry.when);
+    }
+}
+
+void Scheduler::place(int index, const Entry &entry)
+{
+    heap[index] = entry;
+    positions[entry.id] = index;
+}
+
+void Scheduler::siftUp(int index)
+{
+    Entry entry = heap[index];
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if (heap[parent].when <= entry.when)
+        {
+            break;
+        }
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, entry);
+}
+
+void Scheduler::siftDown(int index)
+{
+    Entry entry = heap[index];
+    while (true)
+    {
+        int child = index * 2 + 1;
+        if (child >= heapSize)
+        {
+            break;
+        }
+        if (child + 1 < heapSize && heap[child + 1].when < heap[child].when)
+        {
+            child++;
+        }
+        if (entry.when <= heap[child].when)
+        {
+            break;
+        }
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, entry);
+}
+
+void Scheduler::remove(int index)
+{
+    positions[heap[index].id] = -1;
+    heapSize--;
+    if (index < heapSize)
+    {
+        // Last entry fills the hole and moves to where it belongs
+        uint64_t old = heap[index].when;
+        place(index, heap[heapSize]);
+        if (heap[index].when < old)
+        {
+            siftUp(index);
+        }
+        else
+        {
+            siftDown(index);
+        }
+    }
+    nextDeadline = heapSize > 0 ? heap[0].when : SCHEDULER_NEVER;
+}
@@ -0,0 +1,861 @@
+#include "snapshot.hpp"
+#include "machine.hpp"
+#include "archive.hpp"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <zlib.h>
+
+#define SNA_HEADER_SIZE 27
+#define SNA_48K_SIZE (SNA_HEADER_SIZE + 3 * SNAPSHOT_BANK_SIZE)
+#define Z80_HEADER_SIZE 30
+#define Z80_V3_EXTRA_SIZE 54
+#define SZX_HEADER_SIZE 8
+#define SZX_Z80R_SIZE 37
+#define SZX_RAMP_COMPRESSED 0x0001
+
+// 48K pages at 4000, 8000, C000 are 128K banks 5, 2 and 0
+static const int BANKS_48K[3] = {5, 2, 0};
+
+static uint16_t readWord(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t readDword(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void putWord(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+static void putDword(std::vector<uint8_t> &out, uint32_t value)
+{
+    putWord(out, value & 0xFFFF);
+    putWord(out, value >> 16);
+}
+
+static std::string lowerExtension(const std::string &filePath)
+{
+    size_t dot = filePath.find_last_of('.');
+    if (dot == std::string::npos)
+    {
+        return "";
+    }
+    std::string extension = filePath.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+SnapshotFormat Snapshot::formatOf(const std::string &filePath)
+{
+    std::string extension = lowerExtension(filePath);
+    if (extension == "sna")
+        return SnapshotFormat::Sna;
+    if (extension == "z80")
+        return SnapshotFormat::Z80;
+    if (extension == "szx")
+        return SnapshotFormat::Szx;
+    return SnapshotFormat::Unknown;
+}
+
+bool Snapshot::unpackZ80(const uint8_t *in, size_t inSize, uint8_t *out, size_t outSize)
+{
+    const uint8_t *inEnd = in + inSize;
+    uint8_t *outEnd = out + outSize;
+    while (out < outEnd)
+    {
+        // Literal bytes up to the next ED go in one copy
+        const uint8_t *ed = static_cast<const uint8_t *>(memchr(in, 0xED, inEnd - in));
+        size_t literal = std::min<size_t>((ed ? ed : inEnd) - in, outEnd - out);
+        memcpy(out, in, literal);
+        in += literal;
+        out += literal;
+        if (out == outEnd)
+        {
+            break;
+        }
+        if (in == inEnd)
+        {
+            return false;
+        }
+
+        if (inEnd - in >= 4 && in[1] == 0xED)
+        {
+            size_t count = in[2];
+            if (count > static_cast<size_t>(outEnd - out))
+            {
+                return false;
+            }
+            memset(out, in[3], count);
+            out += count;
+            in += 4;
+        }
+        else
+        {
+            *out++ = *in++; // Single ED
+        }
+    }
+    return true;
+}
+
+void Snapshot::packZ80(const uint8_t *in, size_t size, std::vector<uint8_t> &out)
+{
+    size_t i = 0;
+    while (i < size)
+    {
+        uint8_t value = in[i];
+        size_t run = 1;
+        while (i + run < size && in[i + run] == value && run < 255)
+        {
+            run++;
+        }
+        if (run >= 5 || (value == 0xED && run >= 2))
+        {
+            out.insert(out.end(), {0xED, 0xED, static_cast<uint8_t>(run), value});
+            i += run;
+        }
+        else if (value == 0xED)
+        {
+            // Byte after a single ED never starts a run ("ED 00 00 00 00 00" is not "ED ED ED 05 00")
+            out.push_back(0xED);
+            i++;
+            if (i < size)
+            {
+                out.push_back(in[i++]);
+            }
+        }
+        else
+        {
+            out.insert(out.end(), run, value);
+            i += run;
+        }
+    }
+}
+
+bool Snapshot::decodeSna(const std::vector<uint8_t> &file, SnapshotData &data)
+{
+    if (file.size() < SNA_48K_SIZE)
+    {
+        std::cerr << "Snapshot: .sna file too short" << std::endl;
+        return false;
+    }
+    const uint8_t *h = file.data();
+    data.I = h[0];
+    data.HL_ = readWord(h + 1);
+    data.DE_ = readWord(h + 3);
+    data.BC_ = readWord(h + 5);
+    data.AF_ = readWord(h + 7);
+    data.HL = readWord(h + 9);
+    data.DE = readWord(h + 11);
+    data.BC = readWord(h + 13);
+    data.IY = readWord(h + 15);
+    data.IX = readWord(h + 17);
+    data.IFF2 = (h[19] & 0x04) != 0;
+    data.IFF1 = data.IFF2;
+    data.R = h[20];
+    data.AF = readWord(h + 21);
+    data.SP = readWord(h + 23);
+    data.IM = h[25] & 0x03;
+    data.border = h[26] & 0x07;
+
+    const uint8_t *ram = h + SNA_HEADER_SIZE;
+    if (file.size() == SNA_48K_SIZE)
+    {
+        data.is128 = false;
+        for (int page = 0; page < 3; page++)
+        {
+            memcpy(data.banks[BANKS_48K[page]], ram + page * SNAPSHOT_BANK_SIZE, SNAPSHOT_BANK_SIZE);
+        }
+        // PC was pushed to the stack, RETN pops it
+        if (data.SP < 0x4000 || data.SP == 0xFFFF)
+        {
+            std::cerr << "Snapshot: .sna stack is not in RAM" << std::endl;
+            return false;
+        }
+        data.PC = readWord(ram + data.SP - 0x4000);
+        data.SP += 2;
+        return true;
+    }
+
+    // 128K: PC, 7FFD, TR-DOS flag, then the banks not in the first 48K in ascending order
+    if (file.size() < SNA_48K_SIZE + 4)
+    {
+        std::cerr << "Snapshot: unexpected .sna size " << file.size() << std::endl;
+        return false;
+    }
+    const uint8_t *extra = ram + 3 * SNAPSHOT_BANK_SIZE;
+    data.is128 = true;
+    data.PC = readWord(extra);
+    data.port7ffd = extra[2];
+    int paged = data.port7ffd & 0x07;
+    size_t remaining = (paged == 5 || paged == 2) ? 6 : 5;
+    if (file.size() != SNA_48K_SIZE + 4 + remaining * SNAPSHOT_BANK_SIZE)
+    {
+        std::cerr << "Snapshot: unexpected .sna size " << file.size() << std::endl;
+        return false;
+    }
+    memcpy(data.banks[5], ram, SNAPSHOT_BANK_SIZE);
+    memcpy(data.banks[2], ram + SNAPSHOT_BANK_SIZE, SNAPSHOT_BANK_SIZE);
+    memcpy(data.banks[paged], ram + 2 * SNAPSHOT_BANK_SIZE, SNAPSHOT_BANK_SIZE);
+    const uint8_t *bank = extra + 4;
+    for (int i = 0; i < 8; i++)
+    {
+        if (i != 5 && i != 2 && i != paged)
+        {
+            memcpy(data.banks[i], bank, SNAPSHOT_BANK_SIZE);
+            bank += SNAPSHOT_BANK_SIZE;
+        }
+    }
+    return true;
+}
+
+bool Snapshot::decodeZ80(const std::vector<uint8_t> &file, SnapshotData &data)
+{
+    if (file.size() < Z80_HEADER_SIZE)
+    {
+        std::cerr << "Snapshot: .z80 file too short" << std::endl;
+        return false;
+    }
+    const uint8_t *h = file.data();
+    uint8_t flags = h[12] == 0xFF ? 0x01 : h[12]; // 255 means 1 for compatibility
+    data.AF = (h[0] << 8) | h[1];
+    data.BC = readWord(h + 2);
+    data.HL = readWord(h + 4);
+    data.PC = readWord(h + 6);
+    data.SP = readWord(h + 8);
+    data.I = h[10];
+    data.R = (h[11] & 0x7F) | ((flags & 0x01) << 7);
+    data.border = (flags >> 1) & 0x07;
+    data.DE = readWord(h + 13);
+    data.BC_ = readWord(h + 15);
+    data.DE_ = readWord(h + 17);
+    data.HL_ = readWord(h + 19);
+    data.AF_ = (h[21] << 8) | h[22];
+    data.IY = readWord(h + 23);
+    data.IX = readWord(h + 25);
+    data.IFF1 = h[27] != 0;
+    data.IFF2 = h[28] != 0;
+    data.IM = h[29] & 0x03;
+
+    const uint8_t *end = h + file.size();
+    if (data.PC != 0)
+    {
+        // Version 1: 48K only, RAM follows the header
+        data.is128 = false;
+        const uint8_t *in = h + Z80_HEADER_SIZE;
+        std::unique_ptr<uint8_t[]> ram(new uint8_t[3 * SNAPSHOT_BANK_SIZE]);
+        if (flags & 0x20)
+        {
+            if (!unpackZ80(in, end - in, ram.get(), 3 * SNAPSHOT_BANK_SIZE))
+            {
+                std::cerr << "Snapshot: broken .z80 compressed data" << std::endl;
+                return false;
+            }
+        }
+        else if (end - in < 3 * SNAPSHOT_BANK_SIZE)
+        {
+            std::cerr << "Snapshot: .z80 file too short" << std::endl;
+            return false;
+        }
+        else
+        {
+            memcpy(ram.get(), in, 3 * SNAPSHOT_BANK_SIZE);
+        }
+        for (int page = 0; page < 3; page++)
+        {
+            memcpy(data.banks[BANKS_48K[page]], ram.get() + page * SNAPSHOT_BANK_SIZE, SNAPSHOT_BANK_SIZE);
+        }
+        return true;
+    }
+
+    // Version 2 (23 byte extra header) or 3 (54/55): pages with own headers follow
+    if (file.size() < Z80_HEADER_SIZE + 2)
+    {
+        std::cerr << "Snapshot: .z80 file too short" << std::endl;
+        return false;
+    }
+    uint16_t extraSize = readWord(h + 30);
+    const uint8_t *extra = h + Z80_HEADER_SIZE + 2;
+    if ((extraSize != 23 && extraSize != 54 && extraSize != 55) || extra + extraSize > end)
+    {
+        std::cerr << "Snapshot: unknown .z80 version" << std::endl;
+        return false;
+    }
+    data.PC = readWord(extra);
+    uint8_t hardware = extra[2];
+    // 48K and 48K with interfaces below 3 (v2) or 4 (v3), everything above pages like 128K
+    data.is128 = extraSize == 23 ? hardware >= 3 : hardware >= 4;
+    data.port7ffd = data.is128 ? extra[3] : 0;
+    data.hasAy = data.is128 || (extra[5] & 0x04);
+    data.aySelected = extra[6] & 0x0F;
+    memcpy(data.ayRegisters, extra + 7, 16);
+
+    const uint8_t *in = extra + extraSize;
+    while (end - in >= 3)
+    {
+        uint16_t length = readWord(in);
+        int page = in[2];
+        in += 3;
+        bool compressed = length != 0xFFFF;
+        size_t blockSize = compressed ? length : SNAPSHOT_BANK_SIZE;
+        if (static_cast<size_t>(end - in) < blockSize)
+        {
+            std::cerr << "Snapshot: .z80 page " << page << " truncated" << std::endl;
+            return false;
+        }
+
+        // 128K: page 3-10 is bank 0-7. 48K: page 8, 4, 5 is 4000, 8000, C000. Others are ROMs
+        int bank = -1;
+        if (data.is128 && page >= 3 && page <= 10)
+            bank = page - 3;
+        else if (!data.is128 && page == 8)
+            bank = 5;
+        else if (!data.is128 && page == 4)
+            bank = 2;
+        else if (!data.is128 && page == 5)
+            bank = 0;
+        if (bank >= 0)
+        {
+            if (!compressed)
+            {
+                memcpy(data.banks[bank], in, SNAPSHOT_BANK_SIZE);
+            }
+            else if (!unpackZ80(in, blockSize, data.banks[bank], SNAPSHOT_BANK_SIZE))
+            {
+                std::cerr << "Snapshot: broken .z80 page " << page << std::endl;
+                return false;
+            }
+        }
+        in += blockSize;
+    }
+    return true;
+}
+
+bool Snapshot::decodeSzx(const std::vector<uint8_t> &file, SnapshotData &data)
+{
+    if (file.size() < SZX_HEADER_SIZE || memcmp(file.data(), "ZXST", 4) != 0)
+    {
+        std::cerr << "Snapshot: not a .szx file" << std::endl;
+        return false;
+    }
+    const uint8_t *h = file.data();
+    uint8_t machineId = h[6];
+    // 16K, 48K, TC2048 and 48K NTSC page like 48K, all others like 128K
+    data.is128 = !(machineId == 0 || machineId == 1 || machineId == 8 || machineId == 15);
+
+    bool haveRegisters = false;
+    const uint8_t *end = h + file.size();
+    const uint8_t *block = h + SZX_HEADER_SIZE;
+    while (end - block >= 8)
+    {
+        uint32_t size = readDword(block + 4);
+        const uint8_t *body = block + 8;
+        if (static_cast<size_t>(end - body) < size)
+        {
+            std::cerr << "Snapshot: .szx block truncated" << std::endl;
+            return false;
+        }
+
+        if (memcmp(block, "Z80R", 4) == 0 && size >= SZX_Z80R_SIZE)
+        {
+            data.AF = readWord(body);
+            data.BC = readWord(body + 2);
+            data.DE = readWord(body + 4);
+            data.HL = readWord(body + 6);
+            data.AF_ = readWord(body + 8);
+            data.BC_ = readWord(body + 10);
+            data.DE_ = readWord(body + 12);
+            data.HL_ = readWord(body + 14);
+            data.IX = readWord(body + 16);
+            data.IY = readWord(body + 18);
+            data.SP = readWord(body + 20);
+            data.PC = readWord(body + 22);
+            data.I = body[24];
+            data.R = body[25];
+            data.IFF1 = body[26] != 0;
+            data.IFF2 = body[27] != 0;
+            data.IM = body[28] & 0x03;
+            data.MEMPTR = readWord(body + 35);
+            haveRegisters = true;
+        }
+        else if (memcmp(block, "SPCR", 4) == 0 && size >= 8)
+        {
+            data.border = body[0] & 0x07;
+            data.port7ffd = body[1];
+        }
+        else if (memcmp(block, "RAMP", 4) == 0 && size >= 3)
+        {
+            int page = body[2];
+            if (page < 8)
+            {
+                if (readWord(body) & SZX_RAMP_COMPRESSED)
+                {
+                    uLongf unpacked = SNAPSHOT_BANK_SIZE;
+                    if (uncompress(data.banks[page], &unpacked, body + 3, size - 3) != Z_OK || unpacked != SNAPSHOT_BANK_SIZE)
+                    {
+                        std::cerr << "Snapshot: broken .szx page " << page << std::endl;
+                        return false;
+                    }
+                }
+                else if (size - 3 == SNAPSHOT_BANK_SIZE)
+                {
+                    memcpy(data.banks[page], body + 3, SNAPSHOT_BANK_SIZE);
+                }
+            }
+        }
+        else if (memcmp(block, "AY\0\0", 4) == 0 && size >= 18)
+        {
+            data.hasAy = true;
+            data.aySelected = body[1] & 0x0F;
+            memcpy(data.ayRegisters, body + 2, 16);
+        }
+        // Other blocks (keyboard, joystick, disk, ...) are not emulated here
+        block = body + size;
+    }
+
+    if (!haveRegisters)
+    {
+        std::cerr << "Snapshot: .szx has no Z80R block" << std::endl;
+        return false;
+    }
+    if (!data.is128)
+    {
+        data.port7ffd = 0;
+    }
+    return true;
+}
+
+static void putSnaHeader(const SnapshotData &data, uint16_t sp, std::vector<uint8_t> &file)
+{
+    file.push_back(data.I);
+    putWord(file, data.HL_);
+    putWord(file, data.DE_);
+    putWord(file, data.BC_);
+    putWord(file, data.AF_);
+    putWord(file, data.HL);
+    putWord(file, data.DE);
+    putWord(file, data.BC);
+    putWord(file, data.IY);
+    putWord(file, data.IX);
+    file.push_back(data.IFF2 ? 0x04 : 0x00);
+    file.push_back(data.R);
+    putWord(file, data.AF);
+    putWord(file, sp);
+    file.push_back(data.IM);
+    file.push_back(data.border);
+}
+
+void Snapshot::encodeSna(const SnapshotData &data, std::vector<uint8_t> &file)
+{
+    if (!data.is128)
+    {
+        // PC goes to the stack, as a NMI would have put it
+        uint16_t sp = data.SP - 2;
+        putSnaHeader(data, sp, file);
+        size_t ram = file.size();
+        for (int page : BANKS_48K)
+        {
+            file.insert(file.end(), data.banks[page], data.banks[page] + SNAPSHOT_BANK_SIZE);
+        }
+        if (sp >= 0x4000 && sp != 0xFFFF)
+        {
+            file[ram + sp - 0x4000] = data.PC & 0xFF;
+            file[ram + sp - 0x4000 + 1] = data.PC >> 8;
+        }
+        else
+        {
+            std::cerr << "Snapshot: stack is not in RAM, PC is lost in .sna" << std::endl;
+        }
+        return;
+    }
+
+    putSnaHeader(data, data.SP, file);
+    int paged = data.port7ffd & 0x07;
+    for (int bank : {5, 2, paged})
+    {
+        file.insert(file.end(), data.banks[bank], data.banks[bank] + SNAPSHOT_BANK_SIZE);
+    }
+    putWord(file, data.PC);
+    file.push_back(data.port7ffd);
+    file.push_back(0); // TR-DOS not paged
+    for (int bank = 0; bank < 8; bank++)
+    {
+        if (bank != 5 && bank != 2 && bank != paged)
+        {
+            file.insert(file.end(), data.banks[bank], data.banks[bank] + SNAPSHOT_BANK_SIZE);
+        }
+    }
+}
+
+void Snapshot::encodeZ80(const SnapshotData &data, std::vector<uint8_t> &file)
+{
+    file.push_back(data.AF >> 8);
+    file.push_back(data.AF & 0xFF);
+    putWord(file, data.BC);
+    putWord(file, data.HL);
+    putWord(file, 0); // Version 2+: PC in the extra header
+    putWord(file, data.SP);
+    file.push_back(data.I);
+    file.push_back(data.R & 0x7F);
+    file.push_back((data.R >> 7) | (data.border << 1));
+    putWord(file, data.DE);
+    putWord(file, data.BC_);
+    putWord(file, data.DE_);
+    putWord(file, data.HL_);
+    file.push_back(data.AF_ >> 8);
+    file.push_back(data.AF_ & 0xFF);
+    putWord(file, data.IY);
+    putWord(file, data.IX);
+    file.push_back(data.IFF1);
+    file.push_back(data.IFF2);
+    file.push_back(data.IM);
+
+    // Version 3 extra header
+    putWord(file, Z80_V3_EXTRA_SIZE);
+    size_t extra = file.size();
+    putWord(file, data.PC);
+    file.push_back(data.is128 ? 4 : 0);
+    file.push_back(data.is128 ? data.port7ffd : 0);
+    file.push_back(0); // Interface I not paged
+    file.push_back(!data.is128 && data.hasAy ? 0x04 : 0x00);
+    file.push_back(data.aySelected);
+    file.insert(file.end(), data.ayRegisters, data.ayRegisters + 16);
+    // T-state counter at frame start: quarter frame count 3, counting down from the quarter
+    putWord(file, data.is128 ? 17726 : 17471);
+    file.push_back(3);
+    file.resize(extra + Z80_V3_EXTRA_SIZE, 0);
+
+    std::vector<uint8_t> packed;
+    auto putPage = [&](int page, const uint8_t *bank)
+    {
+        packed.clear();
+        packZ80(bank, SNAPSHOT_BANK_SIZE, packed);
+        if (packed.size() >= SNAPSHOT_BANK_SIZE)
+        {
+            putWord(file, 0xFFFF);
+            file.push_back(page);
+            file.insert(file.end(), bank, bank + SNAPSHOT_BANK_SIZE);
+        }
+        else
+        {
+            putWord(file, packed.size());
+            file.push_back(page);
+            file.insert(file.end(), packed.begin(), packed.end());
+        }
+    };
+    if (data.is128)
+    {
+        for (int bank = 0; bank < 8; bank++)
+        {
+            putPage(bank + 3, data.banks[bank]);
+        }
+    }
+    else
+    {
+        putPage(8, data.banks[5]);
+        putPage(4, data.banks[2]);
+        putPage(5, data.banks[0]);
+    }
+}
+
+static void putSzxBlock(std::vector<uint8_t> &file, const char *id, const std::vector<uint8_t> &body)
+{
+    file.insert(file.end(), id, id + 4);
+    putDword(file, body.size());
+    file.insert(file.end(), body.begin(), body.end());
+}
+
+bool Snapshot::encodeSzx(const SnapshotData &data, std::vector<uint8_t> &file)
+{
+    const uint8_t header[SZX_HEADER_SIZE] = {'Z', 'X', 'S', 'T', 1, 4, static_cast<uint8_t>(data.is128 ? 2 : 1), 0};
+    file.insert(file.end(), header, header + SZX_HEADER_SIZE);
+
+    std::vector<uint8_t> body;
+    for (uint16_t value : {data.AF, data.BC, data.DE, data.HL, data.AF_, data.BC_, data.DE_, data.HL_,
+                           data.IX, data.IY, data.SP, data.PC})
+    {
+        putWord(body, value);
+    }
+    body.insert(body.end(), {data.I, data.R, data.IFF1, data.IFF2, data.IM});
+    putDword(body, 0);                    // Cycles since frame start
+    body.push_back(data.is128 ? 36 : 32); // Interrupt length
+    body.push_back(0);                    // No EI or HALT pending
+    putWord(body, data.MEMPTR);
+    putSzxBlock(file, "Z80R", body);
+
+    body.assign({data.border, data.port7ffd, 0, data.border, 0, 0, 0, 0});
+    putSzxBlock(file, "SPCR", body);
+
+    if (data.hasAy)
+    {
+        body.assign({0, data.aySelected});
+        body.insert(body.end(), data.ayRegisters, data.ayRegisters + 16);
+        putSzxBlock(file, "AY\0\0", body);
+    }
+
+    std::vector<uint8_t> packed(compressBound(SNAPSHOT_BANK_SIZE));
+    auto putPage = [&](int page)
+    {
+        uLongf packedSize = packed.size();
+        if (compress2(packed.data(), &packedSize, data.banks[page], SNAPSHOT_BANK_SIZE, Z_BEST_SPEED) != Z_OK)
+        {
+            return false;
+        }
+        body.clear();
+        putWord(body, SZX_RAMP_COMPRESSED);
+        body.push_back(page);
+        body.insert(body.end(), packed.begin(), packed.begin() + packedSize);
+        putSzxBlock(file, "RAMP", body);
+        return true;
+    };
+    for (int page = 0; page < 8; page++)
+    {
+        if ((data.is128 || page == 5 || page == 2 || page == 0) && !putPage(page))
+        {
+            std::cerr << "Snapshot: failed to compress page " << page << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Snapshot::decode(const std::vector<uint8_t> &file, SnapshotFormat format, SnapshotData &data)
+{
+    memset(&data, 0, sizeof(data));
+    switch (format)
+    {
+    case SnapshotFormat::Sna:
+        return decodeSna(file, data);
+    case SnapshotFormat::Z80:
+        return decodeZ80(file, data);
+    case SnapshotFormat::Szx:
+        return decodeSzx(file, data);
+    default:
+        return false;
+    }
+}
+
+bool Snapshot::encode(const SnapshotData &data, SnapshotFormat format, std::vector<uint8_t> &file)
+{
+    file.clear();
+    switch (format)
+    {
+    case SnapshotFormat::Sna:
+        encodeSna(data, file);
+        return true;
+    case SnapshotFormat::Z80:
+        encodeZ80(data, file);
+        return true;
+    case SnapshotFormat::Szx:
+        return encodeSzx(data, file);
+    default:
+        return false;
+    }
+}
+
+void Snapshot::capture(Machine &machine, SnapshotData &data)
+{
+    memset(&data, 0, sizeof(data));
+    Z80 *cpu = machine.getCpu();
+    data.AF = cpu->AF;
+    data.BC = cpu->BC;
+    data.DE = cpu->DE;
+    data.HL = cpu->HL;
+    data.AF_ = cpu->AF_;
+    data.BC_ = cpu->BC_;
+    data.DE_ = cpu->DE_;
+    data.HL_ = cpu->HL_;
+    data.IX = cpu->IX;
+    data.IY = cpu->IY;
+    data.SP = cpu->SP;
+    data.PC = cpu->PC; // In HALT PC points at the HALT, it runs again after loading
+    data.MEMPTR = cpu->MEMPTR;
+    data.I = cpu->I;
+    data.R = cpu->R;
+    data.IM = cpu->IM;
+    data.IFF1 = cpu->IFF1;
+    data.IFF2 = cpu->IFF2;
+
+    Memory *memory = machine.getMemory();
+    data.is128 = !memory->getIs48();
+    data.port7ffd = memory->getPort7ffd();
+    data.border = machine.getUla()->getBorder();
+    if (data.is128)
+    {
+        for (int bank = 0; bank < 8; bank++)
+        {
+            memcpy(data.banks[bank], memory->getBank(bank), SNAPSHOT_BANK_SIZE);
+        }
+    }
+    else
+    {
+        // 48K (or locked 128K) sees banks 5, 2 and the one paged at C000
+        memcpy(data.banks[5], memory->getBank(5), SNAPSHOT_BANK_SIZE);
+        memcpy(data.banks[2], memory->getBank(2), SNAPSHOT_BANK_SIZE);
+        memcpy(data.banks[0], memory->getBank(data.port7ffd & 0x07), SNAPSHOT_BANK_SIZE);
+        data.port7ffd = 0;
+    }
+
+    if (data.is128)
+    {
+        AY8912 *ay = machine.getTurboSound()->getChip(0);
+        data.hasAy = true;
+        data.aySelected = ay->getSelectedRegister();
+        for (int reg = 0; reg < 16; reg++)
+        {
+            data.ayRegisters[reg] = ay->getRegister(reg);
+        }
+    }
+}
+
+void Snapshot::apply(const SnapshotData &data, Machine &machine)
+{
+    Memory *memory = machine.getMemory();
+    memory->enableTrDos(false);
+    if (data.is128)
+    {
+        memory->Read128();
+        memory->change48(false);
+        memory->writePort(0x7ffd, data.port7ffd);
+        for (int bank = 0; bank < 8; bank++)
+        {
+            memcpy(memory->getBank(bank), data.banks[bank], SNAPSHOT_BANK_SIZE);
+        }
+    }
+    else
+    {
+        memory->Read48();
+        memory->change48(false);
+        memory->writePort(0x7ffd, 0x00);
+        memory->change48(true);
+        for (int bank = 0; bank < 8; bank++)
+        {
+            if (bank == 5 || bank == 2 || bank == 0)
+                memcpy(memory->getBank(bank), data.banks[bank], SNAPSHOT_BANK_SIZE);
+            else
+                memset(memory->getBank(bank), 0, SNAPSHOT_BANK_SIZE);
+        }
+    }
+
+    Z80 *cpu = machine.getCpu();
+    cpu->AF = data.AF;
+    cpu->BC = data.BC;
+    cpu->DE = data.DE;
+    cpu->HL = data.HL;
+    cpu->AF_ = data.AF_;
+    cpu->BC_ = data.BC_;
+    cpu->DE_ = data.DE_;
+    cpu->HL_ = data.HL_;
+    cpu->IX = data.IX;
+    cpu->IY = data.IY;
+    cpu->SP = data.SP;
+    cpu->PC = data.PC;
+    cpu->MEMPTR = data.MEMPTR;
+    cpu->I = data.I;
+    cpu->R = data.R;
+    cpu->IM = data.IM;
+    cpu->IFF1 = data.IFF1;
+    cpu->IFF2 = data.IFF2;
+    cpu->HALT = false;
+
+    machine.getUla()->setBorder(data.border);
+
+    if (data.hasAy)
+    {
+        AY8912 *ay = machine.getTurboSound()->getChip(0);
+        for (int reg = 0; reg < 16; reg++)
+        {
+            ay->writePort(0xFFFD, reg);
+            ay->writePort(0xBFFD, data.ayRegisters[reg]);
+        }
+        ay->writePort(0xFFFD, data.aySelected);
+    }
+
+    // Snapshot starts at frame start, interrupt first
+    machine.restartFrame();
+}
+
+bool Snapshot::load(Machine &machine, const std::string &filePath)
+{
+    SnapshotFormat format = formatOf(filePath);
+    if (format == SnapshotFormat::Unknown)
+    {
+        std::cerr << "Snapshot: unknown file type: " << filePath << std::endl;
+        return false;
+    }
+    std::ifstream in(filePath, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Failed to open snapshot file: " << filePath << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // 128K of banks, too much for the stack of a worker thread
+    std::unique_ptr<SnapshotData> data(new SnapshotData);
+    if (!decode(file, format, *data))
+    {
+        std::cerr << "Failed to load snapshot: " << filePath << std::endl;
+        return false;
+    }
+    apply(*data, machine);
+    return true;
+}
+
+bool Snapshot::load(Machine &machine, Archive &archive, size_t index)
+{
+    if (index >= archive.getEntryCount() || archive.getEntry(index).kind != ImageKind::Snapshot)
+    {
+        std::cerr << "Archive entry " << index << " is not a snapshot" << std::endl;
+        return false;
+    }
+    const std::string &name = archive.getEntry(index).name;
+    std::shared_ptr<const ImageData> image = archive.getData(index);
+    if (!image)
+    {
+        return false;
+    }
+    std::vector<uint8_t> file(image->bytes().begin(), image->bytes().end());
+
+    std::unique_ptr<SnapshotData> data(new SnapshotData);
+    if (!decode(file, formatOf(name), *data))
+    {
+        std::cerr << "Failed to load snapshot: " << name << std::endl;
+        return false;
+    }
+    apply(*data, machine);
+    return true;
+}
+
+bool Snapshot::save(Machine &machine, const std::string &filePath)
+{
+    SnapshotFormat format = formatOf(filePath);
+    if (format == SnapshotFormat::Unknown)
+    {
+        std::cerr << "Snapshot: unknown file type: " << filePath << std::endl;
+        return false;
+    }
+    std::unique_ptr<SnapshotData> data(new SnapshotData);
+    capture(machine, *data);
+    std::vector<uint8_t> file;
+    if (!encode(*data, format, file))
+    {
+        return false;
+    }
+    std::ofstream out(filePath, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Failed to create snapshot file: " << filePath << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(file.data()), file.size());
+    return static_cast<bool>(out);
+}
@@ -4,9 +4,51 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-Sound::Sound() : audioStream(nullptr), audioDevice(0), initialized(false)
+// Amplitude of beeper speaker membrane positions
+static const int16_t BEEPER_AMPLITUDE = 10000;
+// Level changes longer than this are not rendered (~0.3 sec), same limit as in writePort
+static const uint64_t BLEP_MAX_GAP = SOUND_SAMPLE_RATE * 1000000ULL / SOUND_CPU_FREQUENCY;
+// DC blocker pole, about 35 Hz cutoff at 44.1 kHz
+static const float HIGH_PASS_POLE = 0.995f;
+
+Sound::Sound(size_t ringSamples) : initialized(false), ticksPassed(0), lastMicBit(false), lastEarBit(false),
+                 ring(ringSamples), samplePhase(0), beeperMode(BeeperMode::Square),
+                 activeMode(BeeperMode::Square), blepStart(0), blepLevel(0), highPassIn(0), highPassOut(0), ticks(0)
 {
+    std::memset(blepDelta, 0, sizeof(blepDelta));
+    buildBlepKernel();
+}
+
+// Band-limited impulse: Blackman-windowed sinc with cutoff a bit below Nyquist.
+// Impulse centre is delayed by BLEP_TAPS/2 samples, so an edge only touches samples after it.
+// Each phase is normalized to sum 1, so integrated steps reach exactly the new level.
+void Sound::buildBlepKernel()
+{
+    const double cutoff = 0.9; // Part of Nyquist frequency kept
+    const double half = BLEP_TAPS / 2;
+    for (int phase = 0; phase < BLEP_PHASES; phase++)
+    {
+        double fraction = static_cast<double>(phase) / BLEP_PHASES;
+        double sum = 0;
+        for (int tap = 0; tap < BLEP_TAPS; tap++)
+        {
+            double x = tap - half - fraction + 1; // Distance from impulse centre in samples
+            double sinc = (x == 0) ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = (std::fabs(x) >= half) ? 0.0 : 0.42 + 0.5 * std::cos(M_PI * x / half) + 0.08 * std::cos(2 * M_PI * x / half);
+            blepKernel[phase][tap] = static_cast<float>(sinc * window);
+            sum += sinc * window;
+        }
+        for (int tap = 0; tap < BLEP_TAPS; tap++)
+        {
+            blepKernel[phase][tap] = static_cast<float>(blepKernel[phase][tap] / sum);
+        }
+    }
 }
 
 Sound::~Sound()
@@ -14,75 +56,19 @@ Sound::~Sound()
     cleanup();
 }
 
+// Start producing samples. Output device is not our business anymore, see AudioOutput
 bool Sound::initialize()
 {
-    // Check if audio subsystem is available
-    if (!(SDL_WasInit(SDL_INIT_AUDIO) & SDL_INIT_AUDIO))
-    {
-        std::cerr << "SDL audio subsystem not initialized, skipping sound initialization" << std::endl;
-        return false;
-    }
-
-    SDL_AudioSpec desired_spec;
-    SDL_zero(desired_spec);
-    desired_spec.format = SDL_AUDIO_S16;
-    desired_spec.freq = 44100;
-    desired_spec.channels = 2;
-
-    audioStream = SDL_CreateAudioStream(&desired_spec, &desired_spec);
-    if (!audioStream)
-    {
-        printf("Error creating audio stream: %s\n", SDL_GetError());
-        return false;
-    }
-
-    // Create and open audio device, then bind the stream to it
-    audioDevice = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &desired_spec);
-    if (!audioDevice)
-    {
-        printf("Error opening audio device: %s\n", SDL_GetError());
-        SDL_DestroyAudioStream(audioStream);
-        audioStream = nullptr;
-        return false;
-    }
-
-    // Bind the audio stream to the device
-    if (!SDL_BindAudioStream(audioDevice, audioStream))
-    {
-        printf("Error binding audio stream: %s\n", SDL_GetError());
-        SDL_CloseAudioDevice(audioDevice);
-        SDL_DestroyAudioStream(audioStream);
-        audioStream = nullptr;
-        audioDevice = 0;
-        return false;
-    }
-
-    // Start audio playback
-    SDL_ResumeAudioDevice(audioDevice);
-
     initialized = true;
     ticks = 0;
     ticksPassed = 0;
+    samplePhase = 0;
     std::cout << "Sound system initialized successfully" << std::endl;
     return true;
 }
 
 void Sound::cleanup()
 {
-    // // Close the audio device first, which should automatically unbind any streams
-    if (audioDevice)
-    {
-        SDL_CloseAudioDevice(audioDevice);
-        audioDevice = 0;
-    }
-
-    // Then destroy the audio stream
-    if (audioStream)
-    {
-        SDL_DestroyAudioStream(audioStream);
-        audioStream = nullptr;
-    }
-
     initialized = false;
 }
 
@@ -97,6 +83,33 @@ void Sound::writePort(uint16_t port, uint8_t value)
         if (micBit == lastMicBit && earBit == lastEarBit)
             return;
 
+        // Mode switched from UI: start new mode from clean state
+        BeeperMode mode = beeperMode.load(std::memory_order_relaxed);
+        if (mode != activeMode)
+        {
+            activeMode = mode;
+            std::memset(blepDelta, 0, sizeof(blepDelta));
+            blepStart = static_cast<uint64_t>(ticks) * SOUND_SAMPLE_RATE / SOUND_CPU_FREQUENCY;
+            blepLevel = lastEarBit ? BEEPER_AMPLITUDE : -BEEPER_AMPLITUDE;
+            highPassIn = blepLevel;
+            highPassOut = 0;
+        }
+
+        if (activeMode == BeeperMode::Blep)
+        {
+            // Only EAR changes are audible, MIC is mixed in at very low level on real hardware
+            if (earBit != lastEarBit)
+            {
+                blepEdge(ticks, earBit ? 2.0f * BEEPER_AMPLITUDE : -2.0f * BEEPER_AMPLITUDE);
+            }
+            lastEarBit = earBit;
+            lastMicBit = micBit;
+            ticksPassed = ticks;
+            return;
+        }
+
+        // Speaker stayed at the previous level for the whole time since last change
+        bool previousEarBit = lastEarBit;
         lastEarBit = earBit;
         lastMicBit = micBit;
         unsigned int duration = ticks - ticksPassed;
@@ -105,18 +118,7 @@ void Sound::writePort(uint16_t port, uint8_t value)
 
         if (duration < 1000000) // 3 500 000 per sec , 1000000 is ~0.3 sec.
         {
-            if (earBit)
-            { // Volume on speaker or tape raised to up
-                generateAudio(duration, true);
-                // SDL_FlushAudioStream(audioStream);
-                // printf("%d 1\n",duration);
-            }
-            else
-            {
-                generateAudio(duration, false);
-                // SDL_FlushAudioStream(audioStream);
-                // printf("%d 0\n",duration);
-            }
+            generateAudio(duration, previousEarBit);
         }
         else
         {
@@ -125,47 +127,142 @@ void Sound::writePort(uint16_t port, uint8_t value)
     }
 }
 
+// Emulation has reached given T-state
+void Sound::setClock(long long tstate)
+{
+    if (!initialized)
+    {
+        return;
+    }
+    if (activeMode == BeeperMode::Blep)
+    {
+        blepFlush(static_cast<uint64_t>(tstate) * SOUND_SAMPLE_RATE / SOUND_CPU_FREQUENCY);
+    }
+    else if (tstate > ticksPassed)
+    {
+        generateAudio(tstate - ticksPassed, lastEarBit);
+    }
+    ticksPassed = tstate;
+}
+
+// Add samples for ticks T-states of given speaker level
+// Sample position is kept as an integer fraction, so nothing drifts however long it runs
 void Sound::generateAudio(long long ticks, bool value)
 {
-    if (!initialized || !audioStream)
+    if (!initialized)
     {
         return;
     }
 
-    // Calculate duration in seconds
-    // 1 tick = 1/3500000 seconds
-    double duration = static_cast<double>(ticks) / 3500000.0;
+    samplePhase += static_cast<uint64_t>(ticks) * SOUND_SAMPLE_RATE;
+    uint64_t numSamples = samplePhase / SOUND_CPU_FREQUENCY;
+    samplePhase %= SOUND_CPU_FREQUENCY;
 
-    // Calculate number of samples (assuming 44100 Hz sample rate)
-    int sampleRate = 44100;
-    // Use proper rounding instead of truncation + arbitrary offset
-    int numSamples = static_cast<int>(std::round(duration * sampleRate));
+    // Amplitude for up/down position of speaker membrane
+    int16_t sampleValue = value ? BEEPER_AMPLITUDE : -BEEPER_AMPLITUDE;
 
-    // numSamples = numSamples - 10; // Lets try to pitch up tone
-    //  If no samples to generate, return early
-    if (numSamples <= 0)
+    // Copy from a small block on stack. If the ring is full (emulation runs ahead), the rest is dropped
+    int16_t block[512];
+    std::fill(std::begin(block), std::end(block), sampleValue);
+    while (numSamples > 0)
+    {
+        size_t frames = std::min<uint64_t>(numSamples, sizeof(block) / sizeof(block[0]) / 2);
+        if (ring.write(block, frames * 2) < frames * 2)
+        {
+            break;
+        }
+        numSamples -= frames;
+    }
+}
+
+// Add band-limited step at absolute T-state
+// Cost depends only on number of edges: one kernel of BLEP_TAPS floats per edge
+void Sound::blepEdge(long long tstate, float delta)
+{
+    if (!initialized)
     {
         return;
     }
 
-    // Create buffer for samples (16-bit stereo)
-    // Allocate memory for stereo samples (2 channels)
-    std::vector<int16_t> buffer(numSamples * 2);
+    // Position of the edge in samples, integer part and sub-sample phase
+    uint64_t position = static_cast<uint64_t>(tstate) * SOUND_SAMPLE_RATE;
+    uint64_t sample = position / SOUND_CPU_FREQUENCY;
+    int phase = static_cast<int>((position % SOUND_CPU_FREQUENCY) * BLEP_PHASES / SOUND_CPU_FREQUENCY);
 
-    // Generate samples based on speaker membrane position
-    int16_t sampleValue = value ? 10000 : -10000; // Amplitude for up/down position
+    // All samples before the edge are final now
+    blepFlush(sample);
+    if (sample < blepStart)
+    {
+        // Edge inside skipped silence or right after mode switch
+        sample = blepStart;
+    }
 
-    // Fill buffer with samples
-    for (int i = 0; i < numSamples; i++)
+    const float *kernel = blepKernel[phase];
+    float *out = blepDelta + (sample - blepStart);
+#if defined(__SSE__)
+    __m128 scale = _mm_set1_ps(delta);
+    for (int i = 0; i < BLEP_TAPS; i += 4)
     {
-        // Stereo - same value for both channels
-        buffer[i * 2] = sampleValue;     // Left channel
-        buffer[i * 2 + 1] = sampleValue; // Right channel
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_load_ps(kernel + i), scale)));
+    }
+#elif defined(__ARM_NEON)
+    for (int i = 0; i < BLEP_TAPS; i += 4)
+    {
+        vst1q_f32(out + i, vmlaq_n_f32(vld1q_f32(out + i), vld1q_f32(kernel + i), delta));
+    }
+#else
+    for (int i = 0; i < BLEP_TAPS; i++)
+    {
+        out[i] += kernel[i] * delta;
+    }
+#endif
+}
+
+// Integrate pending level changes and output all samples before given one
+void Sound::blepFlush(uint64_t sample)
+{
+    if (sample <= blepStart)
+    {
+        return;
+    }
+
+    // Long silence (or emulation was paused): skip it, nothing happened there
+    if (sample - blepStart > BLEP_MAX_GAP + BLEP_TAPS)
+    {
+        blepFlush(blepStart + BLEP_TAPS);
+        blepStart = sample;
+        return;
     }
 
-    // Put audio data into the stream
-    if (!SDL_PutAudioStreamData(audioStream, buffer.data(), numSamples * 2 * sizeof(int16_t)))
+    // Only first BLEP_TAPS samples have pending changes, the level is constant after them
+    uint64_t samples = sample - blepStart;
+    size_t pending = std::min<uint64_t>(samples, BLEP_TAPS);
+
+    int16_t block[512];
+    size_t count = 0;
+    for (uint64_t i = 0; i < samples; i++)
     {
-        printf("Put audio failed: %s\n", SDL_GetError());
+        // Integrate impulses into steps, then remove DC so speaker rest position is silence
+        if (i < pending)
+        {
+            blepLevel += blepDelta[i];
+        }
+        highPassOut = blepLevel - highPassIn + HIGH_PASS_POLE * highPassOut;
+        highPassIn = blepLevel;
+        int16_t value = static_cast<int16_t>(std::clamp(highPassOut, -32767.0f, 32767.0f));
+
+        block[count++] = value; // Left channel
+        block[count++] = value; // Right channel
+        if (count == sizeof(block) / sizeof(block[0]))
+        {
+            ring.write(block, count);
+            count = 0;
+        }
     }
+    ring.write(block, count);
+
+    // Drop used changes, keep the rest for following samples
+    std::memmove(blepDelta, blepDelta + pending, (BLEP_TAPS - pending) * sizeof(float));
+    std::memset(blepDelta + BLEP_TAPS - pending, 0, pending * sizeof(float));
+    blepStart = sample;
 }
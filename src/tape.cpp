@@ -4,19 +4,20 @@
 #include <cstring>
 #include <algorithm>
 #include <string>
-#include <zip.h>
 
 // Constructor
 // Initializes the tape object with default values by calling reset()
-Tape::Tape()
+Tape::Tape() : loadState(TapeLoadState::Idle), cancelLoad(false), readyImpulses(0), readyBlocks(0), parsedBlocks(0),
+               imageHash(0), loadCount(0), shownPosition(0), shownBlock(0)
 {
     reset();
 }
 
 // Destructor
+// Background loader works with our containers, so it has to finish first
 Tape::~Tape()
 {
-    // Nothing to clean up
+    stopLoading();
 }
 
 // Reset tape state
@@ -27,14 +28,30 @@ void Tape::reset()
     isTapePlayed = false; // Tape is not currently playing
     isTapeTurbo = true;   // Initialize turboload mode to true (faster loading)
 
+    // Background loader must not touch containers we are going to clear
+    stopLoading();
+    loadState.store(TapeLoadState::Idle, std::memory_order_release);
+    readyImpulses.store(0, std::memory_order_release);
+    readyBlocks.store(0, std::memory_order_release);
+    parsedBlocks.store(0, std::memory_order_release);
+    imageHash.store(0, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(blockListMutex);
+        blockList.reset();
+    }
+
     // Clear all data containers
-    tapeData.clear();  // Raw tape data from file
+    tapeImage.reset(); // Raw tape data from file
     tapBlocks.clear(); // Parsed blocks from TAP/TZX files
     bitStream.clear(); // Generated bit stream for playback
+    blockStarts.clear();
+    checkpoints.clear();
+    totalTicks = 0;
 
     // Reset playback position counters
     currentImpulseIndex = 0; // Index of current impulse in bit stream
     currentImpulseTicks = 0; // Tick counter within current impulse
+    publishCursor();
 
     // ZX Spectrum tape timing parameters (in CPU ticks)
     tapePilotLenHeader = 3000; // Number of pilot pulses for header blocks
@@ -70,9 +87,9 @@ bool endsWith(const std::string &str, const std::string &suffix)
 // This function checks if the last byte of a block is a valid checksum
 // The checksum is calculated by XORing all bytes except the last one
 // Parameters:
-//   blockData: vector containing the block data (including checksum)
+//   blockData: view of the block data (including checksum)
 // Returns: true if checksum is valid, false otherwise
-bool Tape::validateChecksum(const std::vector<uint8_t> &blockData)
+bool Tape::validateChecksum(std::span<const uint8_t> blockData)
 {
     // Need at least 2 bytes (data + checksum)
     if (blockData.size() < 2)
@@ -92,205 +109,215 @@ bool Tape::validateChecksum(const std::vector<uint8_t> &blockData)
 }
 
 // Helper function to parse header information
+// Header fields follow the flag byte: type, 10 chars name, length, param1, param2
 void Tape::parseHeaderInfo(TapBlock &block)
 {
-    if (block.flag != 0x00 || block.data.size() < 17)
+    if (block.flag != 0x00 || block.data.size() < 18)
     {
-        // Not a header block or insufficient data
+        // Not a header block or insufficient data (flag + 17 header bytes)
         return;
     }
 
+    std::span<const uint8_t> header = block.data.subspan(1, 17);
+
     // Parse header fields
-    block.fileType = block.data[0];
+    block.fileType = header[0];
 
     // Extract filename (10 characters)
-    block.filename = std::string(reinterpret_cast<const char *>(block.data.data() + 1), 10);
+    block.filename = std::string(reinterpret_cast<const char *>(header.data() + 1), 10);
 
     // Extract data length (2 bytes, little-endian)
-    block.dataLength = static_cast<uint16_t>(block.data[11]) |
-                       (static_cast<uint16_t>(block.data[12]) << 8);
+    block.dataLength = static_cast<uint16_t>(header[11]) |
+                       (static_cast<uint16_t>(header[12]) << 8);
 
     // Extract parameters (2 bytes each, little-endian)
-    block.param1 = static_cast<uint16_t>(block.data[13]) |
-                   (static_cast<uint16_t>(block.data[14]) << 8);
+    block.param1 = static_cast<uint16_t>(header[13]) |
+                   (static_cast<uint16_t>(header[14]) << 8);
 
-    block.param2 = static_cast<uint16_t>(block.data[15]) |
-                   (static_cast<uint16_t>(block.data[16]) << 8);
+    block.param2 = static_cast<uint16_t>(header[15]) |
+                   (static_cast<uint16_t>(header[16]) << 8);
 }
 
-// Load tape file
-bool Tape::loadFile(const std::string &fileName)
+// Build a block from its payload (flag + data + checksum)
+// No bytes are copied: the block only views the tape image
+void Tape::addBlock(std::span<const uint8_t> payload)
 {
-    // Convert filename to lowercase for comparison
-    std::string lowerFileName = fileName;
-    std::transform(lowerFileName.begin(), lowerFileName.end(), lowerFileName.begin(), ::tolower);
+    TapBlock block;
+    block.length = static_cast<uint16_t>(payload.size() & 0xFFFF); // Truncate to 16-bit for compatibility
+    block.data = payload;
 
-    // Check if file is zipped
-    if (endsWith(lowerFileName, ".zip"))
+    if (!payload.empty())
     {
-        std::cout << "ZIP file detected: " << fileName << std::endl;
-
-        // Open ZIP archive
-        int err = 0;
-        zip_t *archive = zip_open(fileName.c_str(), 0, &err);
-        if (!archive)
-        {
-            std::cerr << "Failed to open ZIP file: " << fileName << " (error: " << err << ")" << std::endl;
-            return false;
-        }
+        // Flag byte indicates if this is a header (0x00) or data (0xFF) block
+        block.flag = payload.front();
+        // Checksum is the last byte of the data and is used for error detection
+        block.checksum = payload.back();
+    }
 
-        // Get the number of entries in the ZIP
-        zip_int64_t num_entries = zip_get_num_entries(archive, 0);
-        if (num_entries <= 0)
-        {
-            std::cerr << "ZIP file is empty: " << fileName << std::endl;
-            zip_close(archive);
-            return false;
-        }
+    // Validate checksum to check data integrity
+    block.isValid = validateChecksum(payload);
 
-        // Look for the first file with .tap or .tzx extension
-        zip_int64_t target_index = -1;
-        std::string target_filename;
-        bool is_tap = false;
+    // Header blocks contain metadata about the following data block
+    parseHeaderInfo(block);
 
-        for (zip_int64_t i = 0; i < num_entries; i++)
-        {
-            const char *entry_name = zip_get_name(archive, i, 0);
-            if (!entry_name)
-                continue;
+    tapBlocks.push_back(block);
+}
 
-            std::string entry_name_str(entry_name);
-            std::transform(entry_name_str.begin(), entry_name_str.end(), entry_name_str.begin(), ::tolower);
+// Load tape file
+// Plain files are memory-mapped, zip archives are indexed and only the tape entry is decompressed
+bool Tape::loadFile(const std::string &fileName, int entry)
+{
+    Archive archive;
+    if (!archive.open(fileName))
+    {
+        return false;
+    }
 
-            if (endsWith(entry_name_str, ".tap"))
-            {
-                target_index = i;
-                target_filename = entry_name;
-                is_tap = true;
-                break;
-            }
-            else if (endsWith(entry_name_str, ".tzx"))
-            {
-                target_index = i;
-                target_filename = entry_name;
-                is_tap = false;
-                break;
-            }
-        }
+    // Entry picked from the archive, or the first file with .tap or .tzx extension
+    int index = entry >= 0 ? entry : archive.findFirst(ImageKind::Tape);
+    if (index < 0)
+    {
+        std::cerr << "No supported tape file (.tap or .tzx) found in: " << fileName << std::endl;
+        return false;
+    }
 
-        if (target_index == -1)
-        {
-            std::cerr << "No supported tape file (.tap or .tzx) found in ZIP: " << fileName << std::endl;
-            zip_close(archive);
-            return false;
-        }
+    return loadEntry(archive, index);
+}
 
-        // Open the target file from ZIP
-        zip_file_t *file = zip_fopen_index(archive, target_index, 0);
-        if (!file)
-        {
-            std::cerr << "Failed to open file from ZIP: " << target_filename << std::endl;
-            zip_close(archive);
-            return false;
-        }
+// Load and prepare tape file on a worker thread
+// The UI stays responsive on big TZX/zip files and playback can start
+// on the first block while the rest of the tape is still being generated
+void Tape::loadFileAsync(const std::string &fileName, int entry)
+{
+    stopLoading();
+
+    // Nothing is ready before the state says loading, so readers of the block count
+    // never see the old count while the worker refills the blocks.
+    // From now on getNextBit waits instead of stopping the tape
+    readyImpulses.store(0, std::memory_order_release);
+    readyBlocks.store(0, std::memory_order_release);
+    parsedBlocks.store(0, std::memory_order_release);
+    imageHash.store(0, std::memory_order_release);
+    {
+        // Readers keep the copy they hold, new ones wait for this load
+        std::lock_guard<std::mutex> lock(blockListMutex);
+        blockList.reset();
+    }
+    currentImpulseIndex = 0;
+    currentImpulseTicks = 0;
+    loadState.store(TapeLoadState::Loading, std::memory_order_release);
+    // Counted after the state, so whoever sees the new count sees this load's state
+    loadCount.fetch_add(1, std::memory_order_release);
 
-        // Read the file data
-        std::vector<uint8_t> data;
-        char buffer[8192];
-        zip_int64_t bytes_read;
+    loaderThread = std::thread(&Tape::loadWorker, this, fileName, entry);
+}
 
-        while ((bytes_read = zip_fread(file, buffer, sizeof(buffer))) > 0)
-        {
-            data.insert(data.end(), buffer, buffer + bytes_read);
-        }
+// Worker thread body: parse the file, then generate impulses block by block
+void Tape::loadWorker(std::string fileName, int entry)
+{
+    if (!loadFile(fileName, entry))
+    {
+        std::cerr << "Background tape loading failed: " << fileName << std::endl;
+        loadState.store(TapeLoadState::Failed, std::memory_order_release);
+        return;
+    }
 
-        // Close the file and archive
-        zip_fclose(file);
-        zip_close(archive);
+    prepareBitStream();
 
-        if (bytes_read < 0)
-        {
-            std::cerr << "Error reading file from ZIP: " << target_filename << std::endl;
-            return false;
-        }
+    if (cancelLoad.load(std::memory_order_acquire))
+    {
+        loadState.store(TapeLoadState::Idle, std::memory_order_release);
+        return;
+    }
+    loadState.store(TapeLoadState::Ready, std::memory_order_release);
+    std::cout << "Tape loaded in background: " << fileName << std::endl;
+}
 
-        std::cout << "Extracted " << data.size() << " bytes from " << target_filename << std::endl;
+// Stop the worker (if any) and wait for it
+// A cancelled or finished load no longer describes the tape, whatever loads next
+void Tape::stopLoading()
+{
+    if (loaderThread.joinable())
+    {
+        cancelLoad.store(true, std::memory_order_release);
+        loaderThread.join();
+        cancelLoad.store(false, std::memory_order_release);
+        loadState.store(TapeLoadState::Idle, std::memory_order_release);
+    }
+}
 
-        // Parse the extracted data
-        if (is_tap)
-        {
-            parseTap(data);
-        }
-        else
-        {
-            parseTzx(data);
-        }
+// Background loading progress (0.0 - 1.0)
+float Tape::getLoadProgress() const
+{
+    TapeLoadState state = getLoadState();
+    if (state == TapeLoadState::Ready)
+    {
+        return 1.0f;
+    }
+    size_t total = parsedBlocks.load(std::memory_order_acquire);
+    if (state != TapeLoadState::Loading || total == 0)
+    {
+        return 0.0f;
+    }
+    return static_cast<float>(readyBlocks.load(std::memory_order_acquire)) / total;
+}
 
-        return true;
+// FNV-1a of the image bytes, done here on the loader thread while the image is hot
+static uint64_t hashImage(std::span<const uint8_t> data)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint8_t byte : data)
+    {
+        hash = (hash ^ byte) * 0x100000001B3ULL;
     }
+    return hash;
+}
 
-    // Handle non-zipped files
-    if (endsWith(lowerFileName, ".tap"))
+// Load given tape entry of an already opened archive
+bool Tape::loadEntry(Archive &archive, size_t index)
+{
+    if (index >= archive.getEntryCount() || archive.getEntry(index).kind != ImageKind::Tape)
     {
-        // Read file data
-        std::ifstream file(fileName, std::ios::binary | std::ios::ate);
-        if (!file.is_open())
-        {
-            std::cerr << "Failed to open file: " << fileName << std::endl;
-            return false;
-        }
+        std::cerr << "Archive entry " << index << " is not a tape" << std::endl;
+        return false;
+    }
 
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
+    std::shared_ptr<const ImageData> image = archive.getData(index);
+    if (!image)
+    {
+        return false;
+    }
 
-        tapeData.resize(size);
-        if (!file.read(reinterpret_cast<char *>(tapeData.data()), size))
-        {
-            std::cerr << "Failed to read file: " << fileName << std::endl;
-            return false;
-        }
+    // Keep the image alive while blocks point into it
+    tapeImage = image;
+    imageHash.store(hashImage(tapeImage->bytes()), std::memory_order_release);
 
-        parseTap(tapeData);
-        return true;
+    std::string lowerName = archive.getEntry(index).name;
+    std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+    if (endsWith(lowerName, ".tzx"))
+    {
+        parseTzx(tapeImage->bytes());
     }
-    else if (endsWith(lowerFileName, ".tzx"))
+    else
     {
-        // Read file data
-        std::ifstream file(fileName, std::ios::binary | std::ios::ate);
-        if (!file.is_open())
-        {
-            std::cerr << "Failed to open file: " << fileName << std::endl;
-            return false;
-        }
-
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        tapeData.resize(size);
-        if (!file.read(reinterpret_cast<char *>(tapeData.data()), size))
-        {
-            std::cerr << "Failed to read file: " << fileName << std::endl;
-            return false;
-        }
-
-        parseTzx(tapeData);
-        return true;
+        parseTap(tapeImage->bytes());
     }
-
-    std::cerr << "Unsupported file format: " << fileName << std::endl;
-    return false;
+    return true;
 }
 
 // Load virtual tape data directly
-void Tape::loadVirtualTape(const std::vector<uint8_t> &data)
+void Tape::loadVirtualTape(std::span<const uint8_t> data)
 {
     std::cout << "Loading virtual tape with " << data.size() << " bytes" << std::endl;
-    tapeData = data;
-    parseTap(tapeData);
+    auto image = std::make_shared<ImageData>();
+    image->assign(std::vector<uint8_t>(data.begin(), data.end()));
+    tapeImage = image;
+    imageHash.store(hashImage(tapeImage->bytes()), std::memory_order_release);
+    parseTap(tapeImage->bytes());
 }
 
 // Parse TAP file format
-void Tape::parseTap(const std::vector<uint8_t> &data)
+void Tape::parseTap(std::span<const uint8_t> data)
 {
     // std::cout << "Parsing TAP file with " << data.size() << " bytes" << std::endl;
 
@@ -311,50 +338,8 @@ void Tape::parseTap(const std::vector<uint8_t> &data)
             break;
         }
 
-        // Create a new block
-        TapBlock block;
-        block.length = blockLength;
-
-        // Extract all data (including flag and checksum)
-        if (blockLength > 0)
-        {
-            block.data.assign(data.begin() + pos + 2, data.begin() + pos + 2 + blockLength);
-        }
-
-        // Extract flag byte from data for compatibility
-        if (block.data.size() > 0)
-        {
-            block.flag = block.data[0];
-        }
-
-        // Extract checksum from data for compatibility
-        if (block.data.size() > 0)
-        {
-            block.checksum = block.data.back();
-        }
-
-        // Validate checksum
-        block.isValid = validateChecksum(block.data);
-
-        // Parse header information if this is a header block
-        if (block.flag == 0x00 && block.data.size() >= 18)
-        { // Need at least 18 bytes for header (flag + 17 header bytes)
-            // For header blocks, we need to parse the header info from data[1] to data[17]
-            // We temporarily modify the block to match the expected format for parseHeaderInfo
-            std::vector<uint8_t> tempData(block.data.begin() + 1, block.data.end() - 1); // Exclude flag and checksum
-            TapBlock tempBlock = block;
-            tempBlock.data = tempData;
-            parseHeaderInfo(tempBlock);
-            // Copy back the parsed header info
-            block.fileType = tempBlock.fileType;
-            block.filename = tempBlock.filename;
-            block.dataLength = tempBlock.dataLength;
-            block.param1 = tempBlock.param1;
-            block.param2 = tempBlock.param2;
-        }
-
-        // Add block to our collection
-        tapBlocks.push_back(block);
+        // Create a new block viewing flag, data and checksum
+        addBlock(data.subspan(pos + 2, blockLength));
 
         // Move to next block
         pos += 2 + blockLength;
@@ -371,7 +356,7 @@ void Tape::parseTap(const std::vector<uint8_t> &data)
 // Parse TZX file format
 // TZX is a more advanced tape format that supports various block types and timing parameters
 // This function parses the TZX file header and then processes each block according to its type
-void Tape::parseTzx(const std::vector<uint8_t> &data)
+void Tape::parseTzx(std::span<const uint8_t> data)
 {
     std::cout << "Parsing TZX file with " << data.size() << " bytes" << std::endl;
 
@@ -551,7 +536,7 @@ void Tape::parseTzx(const std::vector<uint8_t> &data)
 // Parse TZX Standard Speed Data Block (ID 10)
 // This is the most common block type, equivalent to the TAP format blocks
 // It contains data with standard ZX Spectrum timing parameters
-size_t Tape::parseTzxStandardSpeedBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxStandardSpeedBlock(std::span<const uint8_t> data, size_t pos)
 {
     // Check if we have enough data for the block header (4 bytes minimum)
     if (pos + 4 > data.size())
@@ -579,54 +564,8 @@ size_t Tape::parseTzxStandardSpeedBlock(const std::vector<uint8_t> &data, size_t
         return data.size();
     }
 
-    // Create a new TapBlock to store this data
-    TapBlock block;
-    block.length = dataLength;
-
-    // Extract all data (including flag and checksum)
-    // The data includes the flag byte (first), the actual data, and the checksum (last)
-    if (dataLength > 0)
-    {
-        block.data.assign(data.begin() + pos, data.begin() + pos + dataLength);
-    }
-
-    // Extract flag byte from data for compatibility
-    // The flag byte indicates if this is a header (0x00) or data (0xFF) block
-    if (block.data.size() > 0)
-    {
-        block.flag = block.data[0];
-    }
-
-    // Extract checksum from data for compatibility
-    // The checksum is the last byte of the data and is used for error detection
-    if (block.data.size() > 0)
-    {
-        block.checksum = block.data.back();
-    }
-
-    // Validate checksum to check data integrity
-    block.isValid = validateChecksum(block.data);
-
-    // Parse header information if this is a header block
-    // Header blocks contain metadata about the following data block
-    if (block.flag == 0x00 && block.data.size() >= 18)
-    { // Need at least 18 bytes for header (flag + 17 header bytes)
-        // For header blocks, we need to parse the header info from data[1] to data[17]
-        // We temporarily modify the block to match the expected format for parseHeaderInfo
-        std::vector<uint8_t> tempData(block.data.begin() + 1, block.data.end() - 1); // Exclude flag and checksum
-        TapBlock tempBlock = block;
-        tempBlock.data = tempData;
-        parseHeaderInfo(tempBlock);
-        // Copy back the parsed header info
-        block.fileType = tempBlock.fileType;
-        block.filename = tempBlock.filename;
-        block.dataLength = tempBlock.dataLength;
-        block.param1 = tempBlock.param1;
-        block.param2 = tempBlock.param2;
-    }
-
-    // Add block to our collection
-    tapBlocks.push_back(block);
+    // Create a new block viewing the data (flag, actual data and checksum)
+    addBlock(data.subspan(pos, dataLength));
 
     // Move position past the data to the next block
     pos += dataLength;
@@ -637,7 +576,7 @@ size_t Tape::parseTzxStandardSpeedBlock(const std::vector<uint8_t> &data, size_t
 // Parse TZX Turbo Speed Data Block (ID 11)
 // This block type allows custom timing parameters for faster loading
 // It's an enhanced version of the standard speed block with configurable pulse durations
-size_t Tape::parseTzxTurboSpeedBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxTurboSpeedBlock(std::span<const uint8_t> data, size_t pos)
 {
     // Check if we have enough data for the block header (18 bytes minimum)
     if (pos + 18 > data.size())
@@ -710,54 +649,8 @@ size_t Tape::parseTzxTurboSpeedBlock(const std::vector<uint8_t> &data, size_t po
         return data.size();
     }
 
-    // Create a new TapBlock to store this data
-    TapBlock block;
-    block.length = static_cast<uint16_t>(dataLength & 0xFFFF); // Truncate to 16-bit for compatibility
-
-    // Extract all data (including flag and checksum)
-    // The data includes the flag byte (first), the actual data, and the checksum (last)
-    if (dataLength > 0)
-    {
-        block.data.assign(data.begin() + pos, data.begin() + pos + dataLength);
-    }
-
-    // Extract flag byte from data for compatibility
-    // The flag byte indicates if this is a header (0x00) or data (0xFF) block
-    if (block.data.size() > 0)
-    {
-        block.flag = block.data[0];
-    }
-
-    // Extract checksum from data for compatibility
-    // The checksum is the last byte of the data and is used for error detection
-    if (block.data.size() > 0)
-    {
-        block.checksum = block.data.back();
-    }
-
-    // Validate checksum to check data integrity
-    block.isValid = validateChecksum(block.data);
-
-    // Parse header information if this is a header block
-    // Header blocks contain metadata about the following data block
-    if (block.flag == 0x00 && block.data.size() >= 18)
-    { // Need at least 18 bytes for header (flag + 17 header bytes)
-        // For header blocks, we need to parse the header info from data[1] to data[17]
-        // We temporarily modify the block to match the expected format for parseHeaderInfo
-        std::vector<uint8_t> tempData(block.data.begin() + 1, block.data.end() - 1); // Exclude flag and checksum
-        TapBlock tempBlock = block;
-        tempBlock.data = tempData;
-        parseHeaderInfo(tempBlock);
-        // Copy back the parsed header info
-        block.fileType = tempBlock.fileType;
-        block.filename = tempBlock.filename;
-        block.dataLength = tempBlock.dataLength;
-        block.param1 = tempBlock.param1;
-        block.param2 = tempBlock.param2;
-    }
-
-    // Add block to our collection
-    tapBlocks.push_back(block);
+    // Create a new block viewing the data (flag, actual data and checksum)
+    addBlock(data.subspan(pos, dataLength));
 
     // Move position past the data to the next block
     pos += dataLength;
@@ -768,7 +661,7 @@ size_t Tape::parseTzxTurboSpeedBlock(const std::vector<uint8_t> &data, size_t po
 // Parse TZX Pure Tone Block (ID 12)
 // This block generates a series of pulses with the same duration
 // Often used for the initial pilot tone that helps the Spectrum detect the start of data
-size_t Tape::parseTzxPureToneBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxPureToneBlock(std::span<const uint8_t> data, size_t pos)
 {
     // Check if we have enough data for the block header (4 bytes minimum)
     if (pos + 4 > data.size())
@@ -799,7 +692,7 @@ size_t Tape::parseTzxPureToneBlock(const std::vector<uint8_t> &data, size_t pos)
 // Parse TZX Pulse Sequence Block (ID 13)
 // This block defines a sequence of pulses with different durations
 // Useful for non-standard tape encoding schemes
-size_t Tape::parseTzxPulseSequenceBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxPulseSequenceBlock(std::span<const uint8_t> data, size_t pos)
 {
     // Check if we have enough data for the pulse count byte
     if (pos + 1 > data.size())
@@ -834,7 +727,7 @@ size_t Tape::parseTzxPulseSequenceBlock(const std::vector<uint8_t> &data, size_t
 // Parse TZX Pure Data Block (ID 14)
 // This block contains raw data bits with custom timing parameters
 // Unlike standard blocks, it doesn't include pilot or sync pulses
-size_t Tape::parseTzxPureDataBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxPureDataBlock(std::span<const uint8_t> data, size_t pos)
 {
     // Check if we have enough data for the block header (10 bytes minimum)
     if (pos + 10 > data.size())
@@ -880,54 +773,8 @@ size_t Tape::parseTzxPureDataBlock(const std::vector<uint8_t> &data, size_t pos)
         return data.size();
     }
 
-    // Create a new TapBlock to store this data
-    TapBlock block;
-    block.length = static_cast<uint16_t>(dataLength & 0xFFFF); // Truncate to 16-bit for compatibility
-
-    // Extract all data (including flag and checksum)
-    // The data includes the flag byte (first), the actual data, and the checksum (last)
-    if (dataLength > 0)
-    {
-        block.data.assign(data.begin() + pos, data.begin() + pos + dataLength);
-    }
-
-    // Extract flag byte from data for compatibility
-    // The flag byte indicates if this is a header (0x00) or data (0xFF) block
-    if (block.data.size() > 0)
-    {
-        block.flag = block.data[0];
-    }
-
-    // Extract checksum from data for compatibility
-    // The checksum is the last byte of the data and is used for error detection
-    if (block.data.size() > 0)
-    {
-        block.checksum = block.data.back();
-    }
-
-    // Validate checksum to check data integrity
-    block.isValid = validateChecksum(block.data);
-
-    // Parse header information if this is a header block
-    // Header blocks contain metadata about the following data block
-    if (block.flag == 0x00 && block.data.size() >= 18)
-    { // Need at least 18 bytes for header (flag + 17 header bytes)
-        // For header blocks, we need to parse the header info from data[1] to data[17]
-        // We temporarily modify the block to match the expected format for parseHeaderInfo
-        std::vector<uint8_t> tempData(block.data.begin() + 1, block.data.end() - 1); // Exclude flag and checksum
-        TapBlock tempBlock = block;
-        tempBlock.data = tempData;
-        parseHeaderInfo(tempBlock);
-        // Copy back the parsed header info
-        block.fileType = tempBlock.fileType;
-        block.filename = tempBlock.filename;
-        block.dataLength = tempBlock.dataLength;
-        block.param1 = tempBlock.param1;
-        block.param2 = tempBlock.param2;
-    }
-
-    // Add block to our collection
-    tapBlocks.push_back(block);
+    // Create a new block viewing the data (flag, actual data and checksum)
+    addBlock(data.subspan(pos, dataLength));
 
     // Move position past the data to the next block
     pos += dataLength;
@@ -936,7 +783,7 @@ size_t Tape::parseTzxPureDataBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Direct Recording Block (ID 15)
-size_t Tape::parseTzxDirectRecordingBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxDirectRecordingBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 8 > data.size())
     {
@@ -982,7 +829,7 @@ size_t Tape::parseTzxDirectRecordingBlock(const std::vector<uint8_t> &data, size
 }
 
 // Parse TZX Pause Block (ID 20)
-size_t Tape::parseTzxPauseBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxPauseBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1002,7 +849,7 @@ size_t Tape::parseTzxPauseBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Group Start Block (ID 21)
-size_t Tape::parseTzxGroupStartBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxGroupStartBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 1 > data.size())
     {
@@ -1032,7 +879,7 @@ size_t Tape::parseTzxGroupStartBlock(const std::vector<uint8_t> &data, size_t po
 }
 
 // Parse TZX Group End Block (ID 22)
-size_t Tape::parseTzxGroupEndBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxGroupEndBlock(std::span<const uint8_t> data, size_t pos)
 {
     // This block has no body, so we just return the current position
     std::cout << "Skipping TZX Group End Block" << std::endl;
@@ -1040,7 +887,7 @@ size_t Tape::parseTzxGroupEndBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Jump Block (ID 23)
-size_t Tape::parseTzxJumpBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxJumpBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1060,7 +907,7 @@ size_t Tape::parseTzxJumpBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Loop Start Block (ID 24)
-size_t Tape::parseTzxLoopStartBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxLoopStartBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1080,7 +927,7 @@ size_t Tape::parseTzxLoopStartBlock(const std::vector<uint8_t> &data, size_t pos
 }
 
 // Parse TZX Loop End Block (ID 25)
-size_t Tape::parseTzxLoopEndBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxLoopEndBlock(std::span<const uint8_t> data, size_t pos)
 {
     // This block has no body, so we just return the current position
     std::cout << "Skipping TZX Loop End Block" << std::endl;
@@ -1088,7 +935,7 @@ size_t Tape::parseTzxLoopEndBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Call Sequence Block (ID 26)
-size_t Tape::parseTzxCallSequenceBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxCallSequenceBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1118,7 +965,7 @@ size_t Tape::parseTzxCallSequenceBlock(const std::vector<uint8_t> &data, size_t
 }
 
 // Parse TZX Return Sequence Block (ID 27)
-size_t Tape::parseTzxReturnSequenceBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxReturnSequenceBlock(std::span<const uint8_t> data, size_t pos)
 {
     // This block has no body, so we just return the current position
     std::cout << "Skipping TZX Return Sequence Block" << std::endl;
@@ -1126,7 +973,7 @@ size_t Tape::parseTzxReturnSequenceBlock(const std::vector<uint8_t> &data, size_
 }
 
 // Parse TZX Select Block (ID 28)
-size_t Tape::parseTzxSelectBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxSelectBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1156,7 +1003,7 @@ size_t Tape::parseTzxSelectBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Stop the Tape if in 48K Mode Block (ID 2A)
-size_t Tape::parseTzxStop48KBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxStop48KBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 4 > data.size())
     {
@@ -1178,7 +1025,7 @@ size_t Tape::parseTzxStop48KBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Set Signal Level Block (ID 2B)
-size_t Tape::parseTzxSetLevelBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxSetLevelBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 5 > data.size())
     {
@@ -1204,7 +1051,7 @@ size_t Tape::parseTzxSetLevelBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Text Description Block (ID 30)
-size_t Tape::parseTzxTextDescriptionBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxTextDescriptionBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 1 > data.size())
     {
@@ -1234,7 +1081,7 @@ size_t Tape::parseTzxTextDescriptionBlock(const std::vector<uint8_t> &data, size
 }
 
 // Parse TZX Message Block (ID 31)
-size_t Tape::parseTzxMessageBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxMessageBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1268,7 +1115,7 @@ size_t Tape::parseTzxMessageBlock(const std::vector<uint8_t> &data, size_t pos)
 }
 
 // Parse TZX Archive Info Block (ID 32)
-size_t Tape::parseTzxArchiveInfoBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxArchiveInfoBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 2 > data.size())
     {
@@ -1333,7 +1180,7 @@ size_t Tape::parseTzxArchiveInfoBlock(const std::vector<uint8_t> &data, size_t p
 }
 
 // Parse TZX Hardware Type Block (ID 33)
-size_t Tape::parseTzxHardwareTypeBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxHardwareTypeBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 1 > data.size())
     {
@@ -1362,7 +1209,7 @@ size_t Tape::parseTzxHardwareTypeBlock(const std::vector<uint8_t> &data, size_t
 }
 
 // Parse TZX Custom Info Block (ID 35)
-size_t Tape::parseTzxCustomInfoBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxCustomInfoBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 14 > data.size())
     {
@@ -1398,7 +1245,7 @@ size_t Tape::parseTzxCustomInfoBlock(const std::vector<uint8_t> &data, size_t po
 }
 
 // Parse TZX Glue Block (ID 5A)
-size_t Tape::parseTzxGlueBlock(const std::vector<uint8_t> &data, size_t pos)
+size_t Tape::parseTzxGlueBlock(std::span<const uint8_t> data, size_t pos)
 {
     if (pos + 9 > data.size())
     {
@@ -1427,14 +1274,42 @@ size_t Tape::parseTzxGlueBlock(const std::vector<uint8_t> &data, size_t pos)
 // Get number of parsed blocks
 size_t Tape::getBlockCount() const
 {
+    // While loading, tapBlocks may still be filled by the worker thread
+    if (getLoadState() == TapeLoadState::Loading)
+    {
+        return readyBlocks.load(std::memory_order_acquire);
+    }
     return tapBlocks.size();
 }
 
+// Blocks are copied, tapBlocks is cleared and refilled by the next load
+void Tape::publishBlockList()
+{
+    auto list = std::make_shared<TapeBlockList>();
+    list->image = tapeImage;
+    list->blocks = tapBlocks;
+    list->blockTicks.reserve(blockStarts.size());
+    for (const TapeBlockStart &start : blockStarts)
+    {
+        list->blockTicks.push_back(start.ticks);
+    }
+    list->length = totalTicks;
+
+    std::lock_guard<std::mutex> lock(blockListMutex);
+    blockList = std::move(list);
+}
+
+std::shared_ptr<const TapeBlockList> Tape::getBlockList() const
+{
+    std::lock_guard<std::mutex> lock(blockListMutex);
+    return blockList;
+}
+
 // Get a specific block
 const TapBlock &Tape::getBlock(size_t index) const
 {
     static TapBlock emptyBlock; // Return empty block if index is out of bounds
-    if (index >= tapBlocks.size())
+    if (index >= getBlockCount())
     {
         return emptyBlock;
     }
@@ -1453,137 +1328,345 @@ void Tape::setTestBitStream(const std::vector<TapeImpulse> &testStream)
     bitStream = testStream;
     currentImpulseIndex = 0;
     currentImpulseTicks = 0;
+    blockStarts.clear();
+    buildCheckpoints();
+    readyImpulses.store(bitStream.size(), std::memory_order_release);
+    readyBlocks.store(0, std::memory_order_release);
+}
+
+// Store running tick total every TAPE_CHECKPOINT_STEP impulses and block start offsets
+// Seeking by time finds the checkpoint by binary search and walks at most one step of impulses
+void Tape::buildCheckpoints()
+{
+    checkpoints.clear();
+    checkpoints.reserve(bitStream.size() / TAPE_CHECKPOINT_STEP + 1);
+
+    uint64_t ticks = 0;
+    size_t block = 0;
+    for (size_t i = 0; i < bitStream.size(); i++)
+    {
+        if (i % TAPE_CHECKPOINT_STEP == 0)
+        {
+            checkpoints.push_back(ticks);
+        }
+        while (block < blockStarts.size() && blockStarts[block].impulseIndex == i)
+        {
+            blockStarts[block++].ticks = ticks;
+        }
+        ticks += bitStream[i].ticks;
+    }
+    totalTicks = ticks;
+}
+
+// Move playback to the start of block n
+bool Tape::seekToBlock(size_t n)
+{
+    if (getLoadState() == TapeLoadState::Loading || n >= blockStarts.size())
+    {
+        return false;
+    }
+    currentImpulseIndex = blockStarts[n].impulseIndex;
+    currentImpulseTicks = 0;
+    return true;
+}
+
+// Move playback to given T-state offset from the tape start
+bool Tape::seekToTime(uint64_t ticks)
+{
+    if (getLoadState() == TapeLoadState::Loading || checkpoints.empty() || ticks >= totalTicks)
+    {
+        return false;
+    }
+
+    // Last checkpoint not after the requested time
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), ticks);
+    size_t step = (it - checkpoints.begin()) - 1;
+    size_t index = step * TAPE_CHECKPOINT_STEP;
+    uint64_t position = checkpoints[step];
+
+    // Walk impulses inside the step
+    while (index < bitStream.size() && position + bitStream[index].ticks <= ticks)
+    {
+        position += bitStream[index].ticks;
+        index++;
+    }
+
+    currentImpulseIndex = index;
+    currentImpulseTicks = static_cast<uint32_t>(ticks - position);
+    return true;
+}
+
+void Tape::saveCursor(TapeState &state) const
+{
+    state.impulseIndex = currentImpulseIndex;
+    state.impulseTicks = currentImpulseTicks;
+    state.played = isTapePlayed;
+}
+
+void Tape::restoreCursor(const TapeState &state)
+{
+    currentImpulseIndex = static_cast<size_t>(state.impulseIndex);
+    currentImpulseTicks = state.impulseTicks;
+    isTapePlayed = state.played;
+}
+
+// Current playback position in T-states from the tape start
+uint64_t Tape::getPosition() const
+{
+    // Index is still growing while loading
+    if (getLoadState() == TapeLoadState::Loading)
+    {
+        return 0;
+    }
+
+    size_t index = currentImpulseIndex;
+    if (checkpoints.empty() || index >= bitStream.size())
+    {
+        return totalTicks;
+    }
+
+    size_t step = index / TAPE_CHECKPOINT_STEP;
+    uint64_t position = checkpoints[step];
+    for (size_t i = step * TAPE_CHECKPOINT_STEP; i < index; i++)
+    {
+        position += bitStream[i].ticks;
+    }
+    return position + currentImpulseTicks;
+}
+
+// Block being played now
+size_t Tape::getCurrentBlock() const
+{
+    if (getLoadState() == TapeLoadState::Loading || blockStarts.empty())
+    {
+        return 0;
+    }
+    size_t index = currentImpulseIndex;
+    auto it = std::upper_bound(blockStarts.begin(), blockStarts.end(), index,
+                               [](size_t value, const TapeBlockStart &start)
+                               { return value < start.impulseIndex; });
+    if (it == blockStarts.begin())
+    {
+        return 0;
+    }
+    return (it - blockStarts.begin()) - 1;
+}
+
+void Tape::publishCursor()
+{
+    shownPosition.store(getPosition(), std::memory_order_relaxed);
+    shownBlock.store(getCurrentBlock(), std::memory_order_relaxed);
+}
+
+// Position of block start in T-states
+uint64_t Tape::getBlockTicks(size_t n) const
+{
+    // Published blocks never move, so their offsets can be read during loading too
+    if (n >= getBlockCount())
+    {
+        return getLength();
+    }
+    return blockStarts[n].ticks;
+}
+
+// Total tape length in T-states
+uint64_t Tape::getLength() const
+{
+    if (getLoadState() == TapeLoadState::Loading)
+    {
+        return 0;
+    }
+    return totalTicks;
+}
+
+// Add one impulse, keeping tick checkpoints and tape length up to date
+void Tape::pushImpulse(uint32_t ticks, bool value)
+{
+    if (bitStream.size() % TAPE_CHECKPOINT_STEP == 0)
+    {
+        checkpoints.push_back(totalTicks);
+    }
+    bitStream.push_back({ticks, value});
+    totalTicks += ticks;
 }
 
 // Prepare bit stream from parsed blocks
 // This function generates a byte stream where each impulse is represented as (uint32_t ticks, bool value)
+// Blocks are published one by one, so playback may already run while later blocks are generated
 void Tape::prepareBitStream()
 {
+    // Nothing is playable until the first block is ready
+    readyImpulses.store(0, std::memory_order_release);
+    readyBlocks.store(0, std::memory_order_release);
+
     // Clear any existing bit stream
     bitStream.clear();
+    blockStarts.clear();
+    checkpoints.clear();
+    totalTicks = 0;
+
+    // Reserve final sizes, so the player never sees published impulses move
+    // Every block: pilot (2 impulses per pulse), 2 sync, 16 per byte, final sync and pause
+    size_t totalImpulses = 0;
+    for (const TapBlock &block : tapBlocks)
+    {
+        uint pilotLength = (block.flag == 0x00) ? tapePilotLenHeader : tapePilotLenData;
+        totalImpulses += pilotLength * 2 + 2 + block.data.size() * 16 + 2;
+    }
+    bitStream.reserve(totalImpulses);
+    blockStarts.reserve(tapBlocks.size());
+    checkpoints.reserve(totalImpulses / TAPE_CHECKPOINT_STEP + 1);
+    parsedBlocks.store(tapBlocks.size(), std::memory_order_release);
 
     // Process each block and generate the corresponding impulses
     for (size_t i = 0; i < tapBlocks.size(); ++i)
     {
-        const TapBlock &block = tapBlocks[i];
+        if (cancelLoad.load(std::memory_order_relaxed))
+        {
+            break;
+        }
 
-        // Determine if this is a header or data block to set appropriate pilot tone length
-        uint pilotLength = (block.flag == 0x00) ? tapePilotLenHeader : tapePilotLenData;
+        appendBlockImpulses(tapBlocks[i]);
+
+        // Publish the block: its impulses are complete and will not move
+        readyImpulses.store(bitStream.size(), std::memory_order_release);
+        readyBlocks.store(i + 1, std::memory_order_release);
+    }
+    if (!cancelLoad.load(std::memory_order_relaxed))
+    {
+        publishBlockList();
+    }
+    printf("Consumed %lu bytes for bitStream\n", bitStream.size() * sizeof(TapeImpulse));
+}
+
+// Generate impulses of one block
+void Tape::appendBlockImpulses(const TapBlock &block)
+{
+    // Remember where the block starts, so playback can jump right here
+    blockStarts.push_back({bitStream.size(), totalTicks});
 
-        // Generate pilot tone
-        // For each impulse: value=1 for tapePilot ticks, then value=0 for tapePilot ticks
+    // Determine if this is a header or data block to set appropriate pilot tone length
+    uint pilotLength = (block.flag == 0x00) ? tapePilotLenHeader : tapePilotLenData;
 
-        for (uint j = 0; j < pilotLength; ++j)
+    // Generate pilot tone
+    // For each impulse: value=1 for tapePilot ticks, then value=0 for tapePilot ticks
+    for (uint j = 0; j < pilotLength; ++j)
+    {
+        pushImpulse(tapePilot, true);  // High impulse
+        pushImpulse(tapePilot, false); // Low impulse
+    }
+
+    // Generate sync pulses
+    // First sync pulse: tapeSync1 ticks with value=1
+    pushImpulse(tapeSync1, true);
+    // Second sync pulse: tapeSync2 ticks with value=0
+    pushImpulse(tapeSync2, false);
+
+    // Generate data bits
+    // For each byte in the block (including flag, data, and checksum):
+    //   - For each bit (MSB first):
+    //     - Generate bit impulse (tape0 for 0, tape1 for 1)
+    //     - Each impulse consists of value=1 then value=0
+    for (size_t byteIndex = 0; byteIndex < block.data.size(); ++byteIndex)
+    {
+        uint8_t byte = block.data[byteIndex];
+        // Process each bit (MSB first)
+        for (int bitIndex = 7; bitIndex >= 0; --bitIndex)
         {
-            // High impulse
-            TapeImpulse highImpulse;
-            highImpulse.ticks = tapePilot;
-            highImpulse.value = true;
-            bitStream.push_back(highImpulse);
-
-            // Low impulse
-            TapeImpulse lowImpulse;
-            lowImpulse.ticks = tapePilot;
-            lowImpulse.value = false;
-            bitStream.push_back(lowImpulse);
+            bool bitValue = (byte >> bitIndex) & 1;
+
+            // Determine pulse length based on bit value
+            uint pulseLength = bitValue ? tape1 : tape0;
+
+            pushImpulse(pulseLength, true);  // value=1 for pulseLength ticks
+            pushImpulse(pulseLength, false); // value=0 for pulseLength ticks
         }
+    }
 
-        // Generate sync pulses
-        // First sync pulse: tapeSync1 ticks with value=1
-        TapeImpulse sync1Impulse;
-        sync1Impulse.ticks = tapeSync1;
-        sync1Impulse.value = true;
-        bitStream.push_back(sync1Impulse);
-
-        // Second sync pulse: tapeSync2 ticks with value=0
-        TapeImpulse sync2Impulse;
-        sync2Impulse.ticks = tapeSync2;
-        sync2Impulse.value = false;
-        bitStream.push_back(sync2Impulse);
-
-        // Generate data bits
-        // For each byte in the block (including flag, data, and checksum):
-        //   - For each bit (MSB first):
-        //     - Generate bit impulse (tape0 for 0, tape1 for 1)
-        //     - Each impulse consists of value=1 then value=0
-
-        // Process each byte directly from block.data
-        for (size_t byteIndex = 0; byteIndex < block.data.size(); ++byteIndex)
+    pushImpulse(tapeFinalSync, true);
+    // Generate pause between blocks
+    // Pause is all 0 for tapePilotPause length
+    pushImpulse(tapePilotPause, false);
+}
+
+// Get next audio input state for ULA
+bool Tape::getNextBit()
+{
+    return advance(1);
+}
+
+// Play ticks T-states at once. Same as ticks calls of getNextBit(), but whole impulses are skipped
+bool Tape::advance(uint32_t ticks)
+{
+    bool level = false;
+    while (ticks > 0)
+    {
+        // If no tape played, return
+        if (!isTapePlayed)
+            return false;
+        // Impulses past this point may still be written by the background loader
+        size_t ready = readyImpulses.load(std::memory_order_acquire);
+        if (currentImpulseIndex >= ready && loadState.load(std::memory_order_acquire) == TapeLoadState::Loading)
         {
-            uint8_t byte = block.data[byteIndex];
-            // printf("Parse %d %zu\n", i,byteIndex);
-            //  Process each bit (MSB first)
-            for (int bitIndex = 7; bitIndex >= 0; --bitIndex)
-            {
-                // for (int bitIndex = 0; bitIndex <7; bitIndex++)  {
-                bool bitValue = (byte >> bitIndex) & 1;
-
-                // Determine pulse length based on bit value
-                uint pulseLength = bitValue ? tape1 : tape0;
-
-                // Generate impulse: value=1 for pulseLength ticks
-                TapeImpulse highImpulse;
-                highImpulse.ticks = pulseLength;
-                highImpulse.value = true;
-                bitStream.push_back(highImpulse);
-
-                // Generate impulse: value=0 for pulseLength ticks
-                TapeImpulse lowImpulse;
-                lowImpulse.ticks = pulseLength;
-                lowImpulse.value = false;
-                bitStream.push_back(lowImpulse);
-            }
+            // Next block is not generated yet - keep the tape running silent and wait for it
+            return false;
+        }
+
+        // If no bit stream has been generated, return false
+        if (ready == 0)
+        {
+            isTapePlayed = false;
+            printf("TAPE STOP1\n");
+            return false;
+        }
+
+        // If we've processed all impulses, return false (pause state)
+        if (currentImpulseIndex >= ready)
+        {
+            isTapePlayed = false;
+            printf("TAPE STOP2\n");
+            return false;
         }
 
-        sync2Impulse.ticks = tapeFinalSync;
-        sync2Impulse.value = true;
-        bitStream.push_back(sync2Impulse);
-        // Generate pause between blocks
-        // Pause is all 0 for tapePilotPause length
-        TapeImpulse pauseImpulse;
-        pauseImpulse.ticks = tapePilotPause;
-        pauseImpulse.value = false;
-        bitStream.push_back(pauseImpulse);
+        // Get the current impulse
+        const TapeImpulse &currentImpulse = bitStream[currentImpulseIndex];
+
+        // Consume the rest of the impulse or all ticks, an empty impulse still takes one tick
+        uint32_t left = currentImpulse.ticks > currentImpulseTicks ? currentImpulse.ticks - currentImpulseTicks : 1;
+        uint32_t step = std::min(ticks, left);
+        currentImpulseTicks += step;
+        ticks -= step;
+        level = currentImpulse.value;
+
+        // Check if we've exhausted the current impulse
+        if (currentImpulseTicks >= currentImpulse.ticks)
+        {
+            // Move to the next impulse
+            currentImpulseIndex++;
+            currentImpulseTicks = 0;
+        }
     }
-    printf("Consumed %lu bytes for bitStream\n", bitStream.size() * sizeof(TapeImpulse));
+    return level;
 }
 
-// Get next audio input state for ULA
-bool Tape::getNextBit()
+// T-states until advance() returns the level of the next impulse
+uint32_t Tape::ticksToEdge() const
 {
-    // If no tape played, return
     if (!isTapePlayed)
-        return false;
-    // If no bit stream has been generated, return false
-    if (bitStream.empty())
     {
-        isTapePlayed = false;
-        printf("TAPE STOP1\n");
-        return false;
+        return 0;
     }
-
-    // If we've processed all impulses, return false (pause state)
-    if (currentImpulseIndex >= bitStream.size())
+    size_t ready = readyImpulses.load(std::memory_order_acquire);
+    if (currentImpulseIndex >= ready)
     {
-        isTapePlayed = false;
-        printf("TAPE STOP2\n");
-        return false;
+        // Loader has not caught up (or the tape ends): look again a bit later
+        return loadState.load(std::memory_order_acquire) == TapeLoadState::Loading ? TAPE_WAIT_TICKS : 1;
     }
-
-    // Get the current impulse
-    const TapeImpulse &currentImpulse = bitStream[currentImpulseIndex];
-
-    // Increment the tick counter for the current impulse
-    currentImpulseTicks++;
-
-    // Check if we've exhausted the current impulse
-    if (currentImpulseTicks >= currentImpulse.ticks)
+    if (currentImpulseTicks == 0)
     {
-        // Move to the next impulse
-        currentImpulseIndex++;
-        currentImpulseTicks = 0;
+        // Last tick played belongs to the previous impulse, first one of this changes the level
+        return 1;
     }
-    // printf("%d ",currentImpulseIndex);
-    //  Return the value of the current impulse
-    return currentImpulse.value;
+    const TapeImpulse &currentImpulse = bitStream[currentImpulseIndex];
+    return currentImpulse.ticks - currentImpulseTicks + 1;
 }
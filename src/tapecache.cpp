@@ -0,0 +1,120 @@
+#include "tapecache.hpp"
+#include "machine.hpp"
+#include "snapshot.hpp"
+#include <iostream>
+#include <filesystem>
+#include <cstdio>
+
+TapeCache::TapeCache(const std::string &directory) : directory(directory), watching(false), watchedKey(0),
+                                                     watchedIs48(false), tapeStarted(false), settled(0)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        std::cerr << "Tape cache: cannot create " << directory << ": " << error.message() << std::endl;
+    }
+}
+
+uint64_t TapeCache::keyOf(uint64_t imageHash, bool is48)
+{
+    // Same tape loads into another machine on the other model (one more FNV-1a step)
+    return (imageHash ^ (is48 ? 48 : 128)) * 0x100000001B3ULL;
+}
+
+std::string TapeCache::pathOf(uint64_t key) const
+{
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.szx", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool TapeCache::has(uint64_t key) const
+{
+    std::error_code error;
+    return std::filesystem::is_regular_file(pathOf(key), error);
+}
+
+bool TapeCache::store(Machine &machine, uint64_t key)
+{
+    // Written aside and renamed, so a lookup never finds half a file
+    std::string path = pathOf(key);
+    std::string partial = path.substr(0, path.size() - 4) + ".part.szx";
+    if (!Snapshot::save(machine, partial))
+    {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(partial, path, error);
+    if (error)
+    {
+        std::cerr << "Tape cache: cannot store " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(partial, error);
+        return false;
+    }
+    return true;
+}
+
+bool TapeCache::restore(Machine &machine, uint64_t key)
+{
+    return Snapshot::load(machine, pathOf(key));
+}
+
+void TapeCache::watch(uint64_t key, bool is48)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    watching = true;
+    watchedKey = key;
+    watchedIs48 = is48;
+    tapeStarted = false;
+    settled = 0;
+}
+
+void TapeCache::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    watching = false;
+}
+
+bool TapeCache::update(Machine &machine)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!watching)
+    {
+        return false;
+    }
+    if (machine.getMemory()->getIs48() != watchedIs48)
+    {
+        // Model changed under the tape, the key would not match the machine
+        watching = false;
+        return false;
+    }
+
+    Tape *tape = machine.getTape();
+    if (tape->isTapePlayed)
+    {
+        tapeStarted = true;
+    }
+    size_t blocks = tape->getBlockCount();
+    bool tapeDone = tapeStarted && !tape->isTapePlayed && tape->getLoadState() != TapeLoadState::Loading &&
+                    blocks > 0 && tape->getCurrentBlock() + 1 >= blocks;
+    uint16_t pc = machine.getCpu()->PC;
+    bool inLoader = pc >= TAPE_CACHE_LOADER_START && pc <= TAPE_CACHE_LOADER_END;
+    if (!tapeDone || inLoader)
+    {
+        settled = 0;
+        return false;
+    }
+    if (++settled < TAPE_CACHE_SETTLE_FRAMES)
+    {
+        return false;
+    }
+
+    watching = false;
+    if (!store(machine, watchedKey))
+    {
+        return false;
+    }
+    std::cout << "Tape cache: machine stored after loading" << std::endl;
+    return true;
+}
@@ -0,0 +1,219 @@
+#include "taperecorder.hpp"
+#include <iostream>
+#include <fstream>
+
+TapeRecorder::TapeRecorder()
+{
+    clear();
+}
+
+// Forget all recorded blocks and decoder state
+void TapeRecorder::clear()
+{
+    blocks.clear();
+    micLevel = false;
+    haveEdge = false;
+    lastEdge = 0;
+    bitThreshold = 0;
+    firstHalf = 0;
+    restartPilot();
+}
+
+// Start looking for the next pilot tone
+void TapeRecorder::restartPilot()
+{
+    state = DecoderState::Pilot;
+    pilotCount = 0;
+    pilotSum = 0;
+    haveHalf = false;
+    currentByte = 0;
+    bitCount = 0;
+    current.clear();
+}
+
+// Add block from SAVE trap
+// TAP block is flag, data and XOR of all of them as checksum
+void TapeRecorder::addBlock(uint8_t flag, std::span<const uint8_t> data)
+{
+    std::vector<uint8_t> block;
+    block.reserve(data.size() + 2);
+    block.push_back(flag);
+    block.insert(block.end(), data.begin(), data.end());
+
+    uint8_t checksum = 0;
+    for (uint8_t byte : block)
+    {
+        checksum ^= byte;
+    }
+    block.push_back(checksum);
+
+    blocks.push_back(std::move(block));
+    std::cout << "Tape recorder: saved block flag " << (int)flag << ", " << data.size() << " bytes" << std::endl;
+}
+
+// Write to port 0xFE. MIC is bit 3
+void TapeRecorder::micWrite(uint64_t tstate, uint8_t value)
+{
+    bool level = (value & 0x08) != 0;
+    if (level != micLevel)
+    {
+        micLevel = level;
+        micEdge(tstate);
+    }
+}
+
+// MIC level changed. Only the time between edges matters, not the level itself
+void TapeRecorder::micEdge(uint64_t tstate)
+{
+    if (haveEdge)
+    {
+        uint64_t ticks = tstate - lastEdge;
+        halfPulse(ticks > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ticks));
+    }
+    haveEdge = true;
+    lastEdge = tstate;
+}
+
+// Decode one half pulse
+// Pilot tone is a long run of equal halves, then two short sync halves, then data:
+// every bit is two equal halves, bit 1 is twice as long as bit 0.
+// Bit threshold is taken from the pilot length (ROM: pilot 2168, bit pair 1710 or 3420),
+// so custom savers with other speeds are decoded too.
+void TapeRecorder::halfPulse(uint32_t ticks)
+{
+    // Long silence ends the block
+    if (ticks > RECORDER_GAP_TICKS)
+    {
+        flush();
+        return;
+    }
+
+    switch (state)
+    {
+    case DecoderState::Pilot:
+        if (pilotCount > 0)
+        {
+            uint32_t average = static_cast<uint32_t>(pilotSum / pilotCount);
+            if (ticks + average / 4 < average || ticks > average + average / 4)
+            {
+                // Much shorter half after long enough pilot is the first sync pulse
+                if (pilotCount >= RECORDER_MIN_PILOT && ticks < average * 2 / 3)
+                {
+                    state = DecoderState::Sync;
+                    bitThreshold = average * 2565 / 2168;
+                    return;
+                }
+                // Not a pilot tone, start counting again from this half
+                pilotCount = 0;
+                pilotSum = 0;
+            }
+        }
+        pilotCount++;
+        pilotSum += ticks;
+        break;
+
+    case DecoderState::Sync:
+        // Second sync half, data bits follow
+        state = DecoderState::Data;
+        haveHalf = false;
+        currentByte = 0;
+        bitCount = 0;
+        current.clear();
+        break;
+
+    case DecoderState::Data:
+        // Half much longer than bit 1 - saver has stopped
+        if (ticks > bitThreshold * 2)
+        {
+            flush();
+            return;
+        }
+        if (!haveHalf)
+        {
+            firstHalf = ticks;
+            haveHalf = true;
+            break;
+        }
+        haveHalf = false;
+        currentByte = (currentByte << 1) | ((firstHalf + ticks > bitThreshold) ? 1 : 0);
+        if (++bitCount == 8)
+        {
+            current.push_back(currentByte);
+            currentByte = 0;
+            bitCount = 0;
+        }
+        break;
+    }
+}
+
+// Finish block being decoded
+void TapeRecorder::flush()
+{
+    if (state == DecoderState::Data && !current.empty())
+    {
+        std::cout << "Tape recorder: decoded block flag " << (int)current[0] << ", " << current.size() << " bytes" << std::endl;
+        blocks.push_back(current);
+    }
+    restartPilot();
+}
+
+// Write recorded blocks as .tap
+bool TapeRecorder::saveTap(const std::string &fileName) const
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to create tape file: " << fileName << std::endl;
+        return false;
+    }
+
+    for (const std::vector<uint8_t> &block : blocks)
+    {
+        // Every block is prefixed with its length (little-endian)
+        uint8_t length[2] = {static_cast<uint8_t>(block.size() & 0xFF), static_cast<uint8_t>(block.size() >> 8)};
+        file.write(reinterpret_cast<const char *>(length), 2);
+        file.write(reinterpret_cast<const char *>(block.data()), block.size());
+    }
+
+    if (!file.good())
+    {
+        std::cerr << "Failed to write tape file: " << fileName << std::endl;
+        return false;
+    }
+    std::cout << "Saved " << blocks.size() << " blocks to " << fileName << std::endl;
+    return true;
+}
+
+// Write recorded blocks as .tzx
+bool TapeRecorder::saveTzx(const std::string &fileName) const
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to create tape file: " << fileName << std::endl;
+        return false;
+    }
+
+    // Header: signature, end of text marker, version 1.20
+    const uint8_t header[10] = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    for (const std::vector<uint8_t> &block : blocks)
+    {
+        // Standard speed data block: ID, pause after block in ms, length, data
+        const uint16_t pause = 1000;
+        uint8_t blockHeader[5] = {0x10,
+                                  static_cast<uint8_t>(pause & 0xFF), static_cast<uint8_t>(pause >> 8),
+                                  static_cast<uint8_t>(block.size() & 0xFF), static_cast<uint8_t>(block.size() >> 8)};
+        file.write(reinterpret_cast<const char *>(blockHeader), sizeof(blockHeader));
+        file.write(reinterpret_cast<const char *>(block.data()), block.size());
+    }
+
+    if (!file.good())
+    {
+        std::cerr << "Failed to write tape file: " << fileName << std::endl;
+        return false;
+    }
+    std::cout << "Saved " << blocks.size() << " blocks to " << fileName << std::endl;
+    return true;
+}
@@ -0,0 +1,103 @@
+#include "turbosound.hpp"
+
+TurboSound::TurboSound(size_t ringSamples) : selected(0), enabled(false)
+{
+    for (auto &chip : chips)
+    {
+        chip = std::make_unique<AY8912>(false, ringSamples);
+    }
+}
+
+bool TurboSound::initialize(bool threaded)
+{
+    bool ok = true;
+    for (auto &chip : chips)
+    {
+        ok = chip->initialize(threaded) && ok;
+    }
+    return ok;
+}
+
+void TurboSound::cleanup()
+{
+    for (auto &chip : chips)
+    {
+        chip->cleanup();
+    }
+}
+
+void TurboSound::checkSelection()
+{
+    if (selected != 0 && !enabled.load(std::memory_order_relaxed))
+    {
+        selected = 0;
+        chips[1]->clearLatch();
+    }
+}
+
+void TurboSound::writePort(uint16_t port, uint8_t value)
+{
+    checkSelection();
+    // Chip select shares the register select port: FFFD with FFh or FEh
+    if ((port & 0xC001) == 0xC001 && value >= TURBOSOUND_SELECT_SECOND && enabled.load(std::memory_order_relaxed))
+    {
+        selected = (value == TURBOSOUND_SELECT_FIRST) ? 0 : 1;
+        return;
+    }
+    chips[selected]->writePort(port, value);
+}
+
+uint8_t TurboSound::readPort(uint16_t port)
+{
+    checkSelection();
+    return chips[selected]->readPort(port);
+}
+
+void TurboSound::reset()
+{
+    selected = 0;
+    for (auto &chip : chips)
+    {
+        chip->reset();
+    }
+}
+
+void TurboSound::saveState(TurboSoundState &state) const
+{
+    // Selection not yet dropped after disabling is stored as dropped
+    state.selected = enabled.load(std::memory_order_relaxed) ? selected : 0;
+    for (int i = 0; i < TURBOSOUND_CHIPS; i++)
+    {
+        chips[i]->saveState(state.chips[i]);
+    }
+}
+
+void TurboSound::loadState(const TurboSoundState &state)
+{
+    selected = state.selected == 1 ? 1 : 0;
+    for (int i = 0; i < TURBOSOUND_CHIPS; i++)
+    {
+        chips[i]->loadState(state.chips[i]);
+    }
+}
+
+void TurboSound::setEnabled(bool enable)
+{
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void TurboSound::setStereoMode(uint8_t mode)
+{
+    for (auto &chip : chips)
+    {
+        chip->setStereoMode(mode);
+    }
+}
+
+void TurboSound::setHighQuality(bool highQuality)
+{
+    for (auto &chip : chips)
+    {
+        chip->setHighQuality(highQuality);
+    }
+}
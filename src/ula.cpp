@@ -8,8 +8,8 @@ ULA::ULA(Memory *mem, Tape *tap)
 {
     memory = mem;
     tape = tap;
-    // Allocate screen buffer (352x288 to accommodate borders)
-    screenBuffer = new uint32_t[(352 * 288) + 2]; // +2 to prevent buffer overflow
+    // Screen buffer is allocated on first draw
+    screenBuffer = nullptr;
 
     // Initialize state variables
     clock = 0;
@@ -20,6 +20,18 @@ ULA::ULA(Memory *mem, Tape *tap)
     borderColor = 0;
     horClock = 0;
     audioState = false;
+    frameStart = 0;
+    ticks = 0;
+    tapeClock = 0;
+    rendering = true;
+    scheduler = nullptr;
+    frameEvent = -1;
+    lineEvent = -1;
+    tapeEvent = -1;
+
+    // Screen memory writes, like border changes, first let the beam draw up to them
+    memory->setScreenWriteHandler([this]()
+                                  { renderTo(static_cast<uint32_t>(ticks - frameStart)); });
 
     // Initialize keyboard state (all keys released)
     for (int i = 0; i < 8; i++)
@@ -44,16 +56,13 @@ ULA::ULA(Memory *mem, Tape *tap)
     colors[14] = 0xFF00FFFF; // Bright Yellow
     colors[15] = 0xFFFFFFFF; // Bright White
 
-    for (int i = 0; i < 352 * 288; i++)
-    {
-        screenBuffer[i] = colors[0];
-    }
     change48(true);
 }
 
 // Destructor
 ULA::~ULA()
 {
+    memory->setScreenWriteHandler(nullptr);
     delete[] screenBuffer;
 }
 
@@ -106,10 +115,16 @@ void ULA::writePort(uint16_t port, uint8_t value)
     // printf("port %d", port);
     if ((port & 0xFF) == 0xFE)
     {
+        // Beam draws the old border up to this moment
+        renderTo(static_cast<uint32_t>(ticks - frameStart));
         borderColor = value & 0x07;
         bool earBit = (value & 0x10) != 0; // EAR is bit 4 (0x10) - active high
 
-        audioState = earBit; // This is stub for tests. Actual sound handling in sound.cpp
+        // Playing tape drives EAR input, its edges set audioState
+        if (!tape->isTapePlayed)
+        {
+            audioState = earBit; // This is stub for tests. Actual sound handling in sound.cpp
+        }
     }
 }
 
@@ -131,9 +146,22 @@ void ULA::change48(bool is48)
     }
 }
 
+// Screen buffer (352x288 to accommodate borders), black until drawn. Machines with
+// rendering off (batch jobs) never need the 405 KB
+void ULA::allocateScreen()
+{
+    if (screenBuffer)
+    {
+        return;
+    }
+    screenBuffer = new uint32_t[(352 * 288) + 2]; // +2 to prevent buffer overflow
+    std::fill(screenBuffer, screenBuffer + 352 * 288, colors[0]);
+}
+
 // Get screen buffer
 uint32_t *ULA::getScreenBuffer()
 {
+    allocateScreen();
     return screenBuffer;
 }
 // 48 version
@@ -166,87 +194,182 @@ uint32_t *ULA::getScreenBuffer()
 // 1876 overscan.
 // 3368 + 10944 + 43776 + 10944 + 1876 = 70908
 
-// Process a single ULA tick
-// Returns internal clock state.
-int ULA::oneTick()
+// Attach to scheduler: frame end, beam lines and tape edges become events
+void ULA::setScheduler(Scheduler *sched)
 {
-    // Process one clock tick
-    clock++;
+    scheduler = sched;
+    frameEvent = scheduler->add([this](uint64_t tstate)
+                                { endFrame(tstate); });
+    lineEvent = scheduler->add([this](uint64_t tstate)
+                               { endLine(tstate); });
+    tapeEvent = scheduler->add([this](uint64_t tstate)
+                               { tapeEdge(tstate); });
+}
 
-    if (tape->isTapePlayed)
-    { // if tape is playing something, set input bit
-        audioState = tape->getNextBit();
-    }
+// Start first frame at given T-state
+void ULA::start(uint64_t tstate)
+{
+    frameStart = tstate;
+    ticks = tstate;
+    clock = 0;
+    line = 0;
+    scheduler->schedule(frameEvent, frameStart + clockEndFrame);
+    scheduler->schedule(lineEvent, frameStart + clockFlyback + clockPerLine);
+    syncTape(tstate);
+}
 
-    if (clock <= clockFlyback)
+// Draw beam positions up to given clock of the frame.
+// Flyback and overscan draw nothing and are skipped at once
+void ULA::renderTo(uint32_t target)
+{
+    if (target > clockBottomRight)
+    {
+        target = clockBottomRight;
+    }
+    if (clock < clockFlyback)
     { // we are on flyback
-        return clock;
+        clock = std::min(target, clockFlyback);
     }
-
-    if (clock > clockBottomRight && clock < clockEndFrame)
-    { // we are on over scan
-        return clock;
+    if (!rendering)
+    {
+        // Beam where the loop below would leave it
+        if (clock < target)
+        {
+            clock = target;
+            line = (clock - clockFlyback) / clockPerLine;
+            horClock = (clock - clockFlyback) % clockPerLine;
+        }
+        return;
     }
+    allocateScreen();
 
-    // Check if we've completed a frame
-    if (clock >= clockEndFrame)
+    while (clock < target)
     {
-        // Reset counters for next frame
-        clock = 0;
-        line = 0;
-
-        // Increment frame counter for flash timing
-        frameCnt++;
+        clock++;
+        line = (clock - clockFlyback) / clockPerLine;
 
-        // Handle flash counter (every 16 frames)
-        if (frameCnt >= 16)
+        // now lets draw screen
+        if (horClock <= 24)
+        { // beam on left border
+            drawPixel(borderColor);
+        }
+        if (horClock > 23 && horClock <= (24 + 128 - 1))
         {
-            flash = !flash;
-            flashCnt = (flashCnt + 1) & 0x0F;
-            frameCnt = 0;
+            if (line <= 47 || line >= (192 + 48)) // its up border, still no need to access screen
+            {
+                drawPixel(borderColor);
+            }
+            else
+            {
+                int x = (horClock - 24) * 2;
+                int y = line - 48;
+                screenBuffer[(y + 48) * 352 + x + 48] = getPixelColorFast(x, y);
+                screenBuffer[(y + 48) * 352 + x + 48 + 1] = getPixelColorFast(x + 1, y);
+            }
         }
-        return 0;
+
+        if (horClock >= (24 + 128) && horClock <= (24 + 128 + 24))
+        { // beam on right border
+            drawPixel(borderColor);
+        }
+
+        horClock++;
+        if (horClock > (clockPerLine - 1))
+        { // beam end line and return back
+            horClock = 0;
+        }
+    }
+}
+
+// Beam finished a line: draw the rest of it. Screen memory writes and border changes
+// have drawn it up to their own time already (screen write handler, writePort)
+void ULA::endLine(uint64_t tstate)
+{
+    uint32_t lineClock = static_cast<uint32_t>(tstate - frameStart);
+    renderTo(lineClock);
+    if (lineClock + clockPerLine <= clockBottomRight)
+    {
+        scheduler->schedule(lineEvent, tstate + clockPerLine);
     }
+}
+
+// Screen is fully drawn: start next frame and let the machine generate interrupt
+void ULA::endFrame(uint64_t tstate)
+{
+    renderTo(clockBottomRight);
 
-    line = (clock - clockFlyback) / clockPerLine;
+    // Reset counters for next frame
+    clock = 0;
+    line = 0;
+    frameStart = tstate;
+
+    // Increment frame counter for flash timing
+    frameCnt++;
 
-    // now lets draw screen
-    if (horClock <= 24)
-    { // beam on left border
-        drawPixel(borderColor);
+    // Handle flash counter (every 16 frames)
+    if (frameCnt >= 16)
+    {
+        flash = !flash;
+        flashCnt = (flashCnt + 1) & 0x0F;
+        frameCnt = 0;
     }
-    if (horClock > 23 && horClock <= (24 + 128 - 1))
+
+    scheduler->schedule(frameEvent, frameStart + clockEndFrame);
+    scheduler->schedule(lineEvent, frameStart + clockFlyback + clockPerLine);
+
+    // Tape started by setting isTapePlayed alone (Machine::playTape syncs at once)
+    if (tape->isTapePlayed && !scheduler->isScheduled(tapeEvent))
     {
-        if (line <= 47 || line >= (192 + 48)) // its up border, still no need to access screen
-        {
-            drawPixel(borderColor);
-        }
-        else
-        {
-            int x = (horClock - 24) * 2;
-            int y = line - 48;
-            // printf("%d %d\n", x, y);
-            screenBuffer[(y + 48) * 352 + x + 48] = getPixelColorFast(x, y);
-            screenBuffer[(y + 48) * 352 + x + 48 + 1] = getPixelColorFast(x + 1, y);
-            // screenBuffer[(y + 48) * 352 + x + 48] = colors[2];
-            // screenBuffer[(y + 48) * 352 + x + 48 + 1] = colors[0];
-        }
+        syncTape(tstate);
     }
 
-    if (horClock >= (24 + 128) && horClock <= (24 + 128 + 24))
-    { // beam on right border
-        drawPixel(borderColor);
+    if (frameHandler)
+    {
+        frameHandler(tstate);
     }
+}
 
-    horClock++;
-    if (horClock > (clockPerLine - 1))
-    { // beam end line and return back
-        horClock = 0;
-        // printf("---- %d %d \n", clock, clock-3560);
+void ULA::redrawScreen()
+{
+    uint32_t savedClock = clock;
+    uint32_t savedHorClock = horClock;
+    int savedLine = line;
+    bool savedRendering = rendering;
+    clock = 0;
+    horClock = 0;
+    line = 0;
+    rendering = true;
+    renderTo(clockBottomRight);
+    rendering = savedRendering;
+    clock = savedClock;
+    horClock = savedHorClock;
+    line = savedLine;
+}
+
+// Tape moved to another position or started: play it from given T-state
+void ULA::syncTape(uint64_t tstate)
+{
+    tapeClock = tstate;
+    uint32_t next = tape->ticksToEdge();
+    if (next > 0)
+    {
+        scheduler->schedule(tapeEvent, tstate + next);
     }
+    else
+    {
+        scheduler->cancel(tapeEvent);
+    }
+}
 
-    // printf("%d %d %d \n", clock, horClock, line);
-    return clock;
+// Tape level changes: it goes to EAR input bit
+void ULA::tapeEdge(uint64_t tstate)
+{
+    if (!tape->isTapePlayed)
+    {
+        return;
+    }
+    audioState = tape->advance(static_cast<uint32_t>(tstate - tapeClock));
+    syncTape(tstate);
 }
 
 // Draw the current pixel
@@ -331,9 +454,9 @@ void ULA::reset()
     frameCnt = 0;
     borderColor = 0;
 
-    // Reinitialize screen with black border
+    // Reinitialize screen with black border (if there is one yet)
     uint32_t blackColor = colors[0];
-    for (int i = 0; i < 320 * 240; i++)
+    for (int i = 0; screenBuffer != nullptr && i < 320 * 240; i++)
     {
         screenBuffer[i] = blackColor;
     }
@@ -345,6 +468,44 @@ void ULA::reset()
     }
 }
 
+void ULA::saveState(ULAState &state) const
+{
+    state.frameStart = frameStart;
+    state.tapeClock = tapeClock;
+    state.ticks = ticks;
+    state.clock = clock;
+    state.horClock = horClock;
+    state.line = line;
+    state.flash = flash;
+    state.flashCnt = flashCnt;
+    state.frameCnt = frameCnt;
+    state.borderColor = borderColor;
+    state.audioState = audioState;
+    state.clockFlyback = clockFlyback;
+    state.clockEndFrame = clockEndFrame;
+    state.clockBottomRight = clockBottomRight;
+    state.clockPerLine = clockPerLine;
+}
+
+void ULA::loadState(const ULAState &state, int64_t shift)
+{
+    frameStart = state.frameStart + shift;
+    tapeClock = state.tapeClock + shift;
+    ticks = state.ticks + shift;
+    clock = state.clock;
+    horClock = state.horClock;
+    line = state.line;
+    flash = state.flash;
+    flashCnt = state.flashCnt;
+    frameCnt = state.frameCnt;
+    borderColor = state.borderColor;
+    audioState = state.audioState;
+    clockFlyback = state.clockFlyback;
+    clockEndFrame = state.clockEndFrame;
+    clockBottomRight = state.clockBottomRight;
+    clockPerLine = state.clockPerLine;
+}
+
 // Set the state of a key in the keyboard matrix
 void ULA::setKeyState(int halfRow, uint8_t keyMask)
 {
@@ -0,0 +1,76 @@
+#include "workpool.hpp"
+#include <thread>
+
+WorkPool::WorkPool(int threads)
+{
+    threadCount = threads > 0 ? threads : static_cast<int>(std::thread::hardware_concurrency());
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    for (int i = 0; i < threadCount; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+bool WorkPool::takeOwn(int worker, size_t &task)
+{
+    Queue &queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool WorkPool::steal(int worker, size_t &task)
+{
+    // Start with the next worker, so thieves spread over victims
+    for (int i = 1; i < threadCount; i++)
+    {
+        Queue &queue = *queues[(worker + i) % threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::run(size_t count, const std::function<void(size_t, int)> &task)
+{
+    // Contiguous slices: neighbouring tasks (often similar in size) stay on one worker
+    for (int i = 0; i < threadCount; i++)
+    {
+        size_t first = count * i / threadCount;
+        size_t last = count * (i + 1) / threadCount;
+        for (size_t index = first; index < last; index++)
+        {
+            queues[i]->tasks.push_back(index);
+        }
+    }
+
+    // No task adds new ones, so a worker that finds every queue empty is done
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back([this, i, &task]()
+                             {
+                                 size_t index;
+                                 while (takeOwn(i, index) || steal(i, index))
+                                 {
+                                     task(index, i);
+                                 } });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
@@ -87,6 +87,56 @@ int Z80::ExecuteOneInstruction()
     }
 }
 
+void Z80::saveState(Z80State &state) const
+{
+    state.AF = AF;
+    state.BC = BC;
+    state.DE = DE;
+    state.HL = HL;
+    state.AF_ = AF_;
+    state.BC_ = BC_;
+    state.DE_ = DE_;
+    state.HL_ = HL_;
+    state.IX = IX;
+    state.IY = IY;
+    state.SP = SP;
+    state.PC = PC;
+    state.MEMPTR = MEMPTR;
+    state.I = I;
+    state.R = R;
+    state.IM = IM;
+    state.IFF1 = IFF1;
+    state.IFF2 = IFF2;
+    state.HALT = HALT;
+    state.InterruptPending = InterruptPending;
+    state.isNMOS = isNMOS;
+}
+
+void Z80::loadState(const Z80State &state)
+{
+    AF = state.AF;
+    BC = state.BC;
+    DE = state.DE;
+    HL = state.HL;
+    AF_ = state.AF_;
+    BC_ = state.BC_;
+    DE_ = state.DE_;
+    HL_ = state.HL_;
+    IX = state.IX;
+    IY = state.IY;
+    SP = state.SP;
+    PC = state.PC;
+    MEMPTR = state.MEMPTR;
+    I = state.I;
+    R = state.R;
+    IM = state.IM;
+    IFF1 = state.IFF1;
+    IFF2 = state.IFF2;
+    HALT = state.HALT;
+    InterruptPending = state.InterruptPending;
+    isNMOS = state.isNMOS;
+}
+
 void Z80::NMI()
 {
     IFF2 = IFF1;
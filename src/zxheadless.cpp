@@ -0,0 +1,99 @@
+// Command line runner on libzxcore: no window, no audio device, no real time.
+// ./zxheadless [--rom file.rom] [--frames N] [--until-pc ADDR] [--until-tape-end] [--input keys.txt]
+//              [--screen out.ppm] [--ram out.bin] [--wav out.wav] [--snapshot out.szx] [tape or snapshot]
+// ./zxheadless --batch manifest.txt [--threads N]   (format in batchrunner.hpp)
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "batchrunner.hpp"
+
+int main(int argc, char *argv[])
+{
+    BatchJob options;
+    std::string manifestFile;
+    int threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--rom" && i + 1 < argc)
+        {
+            options.romFile = argv[++i];
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frames = std::atoll(argv[++i]);
+        }
+        else if (arg == "--until-pc" && i + 1 < argc)
+        {
+            options.untilPC = static_cast<int>(std::strtol(argv[++i], nullptr, 0)) & 0xFFFF;
+        }
+        else if (arg == "--input" && i + 1 < argc)
+        {
+            options.inputFile = argv[++i];
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            manifestFile = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            threads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--until-tape-end")
+        {
+            options.untilTapeEnd = true;
+        }
+        else if (arg == "--screen" && i + 1 < argc)
+        {
+            options.screenFile = argv[++i];
+        }
+        else if (arg == "--ram" && i + 1 < argc)
+        {
+            options.ramFile = argv[++i];
+        }
+        else if (arg == "--wav" && i + 1 < argc)
+        {
+            options.wavFile = argv[++i];
+        }
+        else if (arg == "--snapshot" && i + 1 < argc)
+        {
+            options.snapshotFile = argv[++i];
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: zxheadless [--rom file] [--frames N] [--until-pc ADDR] [--until-tape-end] [--input keys.txt]"
+                         " [--screen out.ppm] [--ram out.bin] [--wav out.wav] [--snapshot out.szx] [tape or snapshot]" << std::endl;
+            std::cerr << "       zxheadless --batch manifest.txt [--threads N]" << std::endl;
+            return -1;
+        }
+        else
+        {
+            options.imageFile = arg;
+        }
+    }
+
+    if (!manifestFile.empty())
+    {
+        BatchRunner batch;
+        if (!batch.loadManifest(manifestFile))
+        {
+            return -1;
+        }
+        // Progress lines of thousands of machines say nothing, errors still go to stderr
+        std::streambuf *report = std::cout.rdbuf(nullptr);
+        batch.run(threads);
+        std::cout.rdbuf(report);
+        batch.printReport(std::cout);
+        return batch.getFailures() ? -1 : 0;
+    }
+
+    // Chips print progress on stdout, keep stdout clean for scripts
+    std::cout.rdbuf(std::cerr.rdbuf());
+    BatchResult result;
+    BatchRunner::runJob(options, result);
+    std::cerr << "Stopped on " << result.reason << " after " << result.frames << " frames, "
+              << result.ticks << " T-states. Setup " << result.setupMs << " ms, run " << result.runMs << " ms ("
+              << result.getMHz() << " emulated MHz)" << std::endl;
+    return result.ok ? 0 : -1;
+}
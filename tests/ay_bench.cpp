@@ -0,0 +1,156 @@
+#include "chips/ay-3-8910.h"
+#include "../include/decimator.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+// Same clock and rates as AY8912
+static const uint32_t CHIP_FREQUENCY = 1773400;
+static const uint32_t SAMPLE_RATE = 44100;
+static const uint32_t NATIVE_RATE = CHIP_FREQUENCY / 8;
+static const size_t BLOCK_FRAMES = 256;
+static const int SECONDS = 60;
+
+// Busy tune: three tones, noise and envelope, registers changed every 50 Hz frame
+static void playFrame(AY38910 &chip, int frame) {
+    chip.write(0, (frame * 7) & 0xFF);
+    chip.write(1, 0x01);
+    chip.write(2, 0x40 + (frame & 0x3F));
+    chip.write(4, 0x1C);
+    chip.write(6, 0x08);
+    chip.write(7, 0x30);
+    chip.write(8, 0x0F);
+    chip.write(9, 0x0B);
+    chip.write(10, 0x10);
+    if (frame % 25 == 0) {
+        chip.write(11, 0x40);
+        chip.write(13, 0x0C);
+    }
+}
+
+static void setupChip(AY38910 &chip, uint32_t sampleRate) {
+    chip.setType(CHIP_TYPE_AY8910, 0);
+    chip.setFrequency(CHIP_FREQUENCY);
+    chip.setSampleFrequency(sampleRate);
+    chip.setVolume(100);
+    chip.setStereoMode(AY_STEREO_ABC);
+}
+
+// getSample() for every output sample (path used before block rendering)
+static std::vector<int16_t> runGetSample() {
+    AY38910 chip;
+    setupChip(chip, SAMPLE_RATE);
+    std::vector<int16_t> out;
+    out.reserve(SAMPLE_RATE * SECONDS * 2);
+    for (int frame = 0; frame < SECONDS * 50; frame++) {
+        playFrame(chip, frame);
+        for (uint32_t i = 0; i < SAMPLE_RATE / 50; i++) {
+            uint32_t sample = chip.getSample();
+            out.push_back(static_cast<int16_t>((sample >> 16) >> 1));
+            out.push_back(static_cast<int16_t>((sample & 0xFFFF) >> 1));
+        }
+    }
+    return out;
+}
+
+// render() at output rate (default AY8912 mode)
+static std::vector<int16_t> runRender() {
+    AY38910 chip;
+    setupChip(chip, SAMPLE_RATE);
+    std::vector<int16_t> out(SAMPLE_RATE * SECONDS * 2);
+    size_t done = 0;
+    for (int frame = 0; frame < SECONDS * 50; frame++) {
+        playFrame(chip, frame);
+        chip.render(out.data() + done * 2, SAMPLE_RATE / 50);
+        done += SAMPLE_RATE / 50;
+    }
+    return out;
+}
+
+// render() at native rate and polyphase decimation (AY8912 high quality mode)
+static std::vector<int16_t> runHighQuality() {
+    AY38910 chip;
+    setupChip(chip, NATIVE_RATE);
+    Decimator decimator(NATIVE_RATE, SAMPLE_RATE);
+    std::vector<int16_t> native(BLOCK_FRAMES * 2 * 8);
+    std::vector<int16_t> out(SAMPLE_RATE * SECONDS * 2);
+    size_t done = 0;
+    for (int frame = 0; frame < SECONDS * 50; frame++) {
+        playFrame(chip, frame);
+        size_t end = done + SAMPLE_RATE / 50;
+        while (done < end) {
+            size_t frames = std::min(end - done, BLOCK_FRAMES);
+            size_t needed = decimator.needed(frames);
+            chip.render(native.data(), needed);
+            decimator.write(native.data(), needed);
+            decimator.read(out.data() + done * 2, frames);
+            done += frames;
+        }
+    }
+    return out;
+}
+
+template <typename Function>
+static void measure(const char *name, Function run) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int16_t> out = run();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    int64_t checksum = 0;
+    for (int16_t sample : out) {
+        checksum += sample;
+    }
+    std::cout << name << ": " << ms << " ms for " << SECONDS << " s of sound ("
+              << (SECONDS * 1000.0 / ms) << "x real time), checksum " << checksum << std::endl;
+}
+
+// Tone far above hearing (period 1, ~110 kHz) must not fold back into audible range
+static double ultrasonicRms(bool highQuality) {
+    AY38910 chip;
+    setupChip(chip, highQuality ? NATIVE_RATE : SAMPLE_RATE);
+    chip.setStereoMode(AY_STEREO_MONO);
+    chip.write(0, 0x01);
+    chip.write(7, 0x3E);
+    chip.write(8, 0x0F);
+
+    Decimator decimator(NATIVE_RATE, SAMPLE_RATE);
+    std::vector<int16_t> native(BLOCK_FRAMES * 2 * 8);
+    std::vector<int16_t> out((SAMPLE_RATE + BLOCK_FRAMES) * 2);
+    for (size_t done = 0; done < SAMPLE_RATE; done += BLOCK_FRAMES) {
+        if (highQuality) {
+            size_t needed = decimator.needed(BLOCK_FRAMES);
+            chip.render(native.data(), needed);
+            decimator.write(native.data(), needed);
+            decimator.read(out.data() + done * 2, BLOCK_FRAMES);
+        } else {
+            chip.render(out.data() + done * 2, BLOCK_FRAMES);
+        }
+    }
+
+    // Skip filter start, measure deviation from average (DC is fine)
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 4096; i < SAMPLE_RATE; i++, count++) {
+        sum += out[i * 2];
+    }
+    double mean = sum / count;
+    double power = 0;
+    for (size_t i = 4096; i < SAMPLE_RATE; i++) {
+        power += (out[i * 2] - mean) * (out[i * 2] - mean);
+    }
+    return std::sqrt(power / count);
+}
+
+int main() {
+    std::cout << "AY-3-8910 Benchmark" << std::endl;
+    std::cout << "===================" << std::endl;
+
+    measure("getSample at 44100 Hz", runGetSample);
+    measure("render at 44100 Hz", runRender);
+    measure("render at clock/8 + decimator", runHighQuality);
+
+    std::cout << "Aliasing of 110 kHz tone (RMS): 44100 Hz " << ultrasonicRms(false)
+              << ", high quality " << ultrasonicRms(true) << std::endl;
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "chips/ay-3-8910.h"
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+// Register write applied before given frame
+struct RegisterWrite {
+    size_t frame;
+    uint8_t reg;
+    uint8_t value;
+};
+
+// Chip set up the same way as in the emulator
+static void setupChip(AY38910 &chip, uint8_t stereoMode) {
+    chip.setType(CHIP_TYPE_AY8910, 0);
+    chip.setFrequency(1773400);
+    chip.setSampleFrequency(44100);
+    chip.setVolume(100);
+    chip.setStereoMode(stereoMode);
+    chip.reset();
+}
+
+// Play the program through getSample() and through render() in blocks of
+// varying size, output must be the same sample by sample
+static bool compareProgram(const char *name, const std::vector<RegisterWrite> &program, size_t frames, uint8_t stereoMode) {
+    AY38910 reference;
+    AY38910 block;
+    setupChip(reference, stereoMode);
+    setupChip(block, stereoMode);
+
+    std::vector<int16_t> expected(frames * 2);
+    std::vector<int16_t> rendered(frames * 2);
+
+    size_t next = 0;
+    for (size_t frame = 0; frame < frames; frame++) {
+        while (next < program.size() && program[next].frame == frame) {
+            reference.write(program[next].reg, program[next].value);
+            next++;
+        }
+        uint32_t sample = reference.getSample();
+        expected[frame * 2] = static_cast<int16_t>((sample >> 16) >> 1);
+        expected[frame * 2 + 1] = static_cast<int16_t>((sample & 0xFFFF) >> 1);
+    }
+
+    // Blocks end at register writes and at pseudo-random points between them
+    srand(1234);
+    next = 0;
+    size_t frame = 0;
+    while (frame < frames) {
+        while (next < program.size() && program[next].frame == frame) {
+            block.write(program[next].reg, program[next].value);
+            next++;
+        }
+        size_t end = next < program.size() ? program[next].frame : frames;
+        size_t count = std::min<size_t>(end - frame, 1 + rand() % 700);
+        block.render(rendered.data() + frame * 2, count);
+        frame += count;
+    }
+
+    for (size_t i = 0; i < frames * 2; i++) {
+        if (expected[i] != rendered[i]) {
+            std::cout << "FAIL: " << name << " (stereo mode " << (int)stereoMode << "): frame " << i / 2
+                      << (i & 1 ? " right" : " left") << " is " << rendered[i] << ", expected " << expected[i] << std::endl;
+            return false;
+        }
+    }
+    std::cout << "PASS: " << name << " (stereo mode " << (int)stereoMode << ")" << std::endl;
+    return true;
+}
+
+static bool testRenderMatchesGetSample() {
+    bool success = true;
+    for (uint8_t mode = AY_STEREO_MONO; mode <= AY_STEREO_ACB; mode++) {
+        // Three tones of different pitch, one of them very high (period shorter than a sample)
+        success &= compareProgram("tones", {
+            {0, 0, 0xFE}, {0, 1, 0x01}, {0, 2, 0x7D}, {0, 4, 0x03},
+            {0, 7, 0x38}, {0, 8, 0x0F}, {0, 9, 0x0A}, {0, 10, 0x05},
+            {20000, 2, 0x40}, {20000, 3, 0x02}, {30000, 9, 0x00},
+        }, 44100, mode);
+
+        // Noise on two channels, tone on the third, noise period changes
+        success &= compareProgram("noise", {
+            {0, 6, 0x1F}, {0, 7, 0x2B}, {0, 8, 0x0C}, {0, 9, 0x0F}, {0, 10, 0x08},
+            {0, 4, 0x50}, {11025, 6, 0x01}, {22050, 6, 0x00}, {33075, 6, 0x10},
+        }, 44100, mode);
+
+        // All envelope shapes one after another, envelope on tone and on silent channel
+        std::vector<RegisterWrite> envelope = {
+            {0, 11, 0x30}, {0, 12, 0x00}, {0, 0, 0x20}, {0, 7, 0x3E}, {0, 8, 0x10}, {0, 9, 0x10},
+        };
+        for (uint8_t shape = 0; shape < 16; shape++) {
+            envelope.push_back({static_cast<size_t>(1 + shape * 2400), 13, shape});
+        }
+        envelope.push_back({40000, 11, 0x00}); // Zero period: envelope stops
+        envelope.push_back({50000, 11, 0x01});
+        envelope.push_back({50000, 13, 0x0E});
+        success &= compareProgram("envelope", envelope, 66150, mode);
+
+        // Digidrum-like: volume written every few samples
+        std::vector<RegisterWrite> drum = {{0, 7, 0x3E}, {0, 0, 0x10}};
+        for (size_t frame = 0; frame < 8000; frame += 3) {
+            drum.push_back({frame, 8, static_cast<uint8_t>((frame / 3) & 0x0F)});
+        }
+        success &= compareProgram("digidrum", drum, 8000, mode);
+    }
+    return success;
+}
+
+int main() {
+    std::cout << "AY-3-8910 Render Test" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    bool success = testRenderMatchesGetSample();
+
+    std::cout << (success ? "All AY tests passed" : "Some AY tests failed") << std::endl;
+    return success ? 0 : 1;
+}
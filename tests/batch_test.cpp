@@ -0,0 +1,48 @@
+#include "../include/batchrunner.hpp"
+#include <iostream>
+#include <sstream>
+
+// Job whose image cannot be loaded fails at once with its reason, others in the same batch still run
+static bool testMissingImage() {
+    BatchJob missing;
+    missing.imageFile = "testdata/no_such_file.tzx";
+    missing.frames = 10;
+    BatchResult result;
+    bool ok = true;
+    if (BatchRunner::runJob(missing, result) || result.ok || result.reason != "image failed" || result.frames != 0) {
+        std::cout << "  Missing image gave \"" << result.reason << "\" after " << result.frames << " frames" << std::endl;
+        ok = false;
+    }
+
+    BatchJob loaded;
+    loaded.imageFile = "testdata/ABC.tzx";
+    loaded.frames = 10;
+    BatchRunner batch;
+    batch.addJob(missing);
+    batch.addJob(loaded);
+    batch.run(2);
+    const std::vector<BatchResult> &results = batch.getResults();
+    if (batch.getFailures() != 1 || results[0].ok || !results[1].ok || results[1].frames != 10) {
+        std::cout << "  Batch reports " << batch.getFailures() << " failed jobs" << std::endl;
+        ok = false;
+    }
+    std::ostringstream report;
+    batch.printReport(report);
+    if (report.str().find("FAIL") == std::string::npos || report.str().find("image failed") == std::string::npos) {
+        std::cout << "  Report does not show the failed job:\n" << report.str();
+        ok = false;
+    }
+    std::cout << "  Missing image: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Batch Test" << std::endl;
+    std::cout << "==========" << std::endl;
+
+    bool missingSuccess = testMissingImage();
+
+    bool success = missingSuccess;
+    std::cout << (success ? "All batch tests passed" : "Batch tests FAILED") << std::endl;
+    return success ? 0 : 1;
+}
@@ -331,7 +331,7 @@ public:
         cpu.IM = test.IM;
         cpu.HALT = test.HALT;
 
-        memory.canWriteRom = true;
+        memory.setRomWritable(true);
         cpu.isNMOS = false;
 
         // Initialize memory
@@ -0,0 +1,22 @@
+#ifndef MACHINE_SETUP_HPP
+#define MACHINE_SETUP_HPP
+
+#include "../include/machine.hpp"
+
+// Machine as the tests run it: sound rendered on the calling thread, 128K ROM
+// (or 48K) paged in, started and then run for the given number of frames.
+// 100 frames take the 128K ROM to its menu and the 48K ROM to the copyright message
+static inline void startMachine(Machine &machine, int frames = 0, bool is48 = false) {
+    machine.initialize(false);
+    machine.prepare();
+    if (is48) {
+        machine.getMemory()->Read48();
+        machine.getMemory()->change48(true);
+    }
+    machine.start();
+    for (int frame = 0; frame < frames; frame++) {
+        machine.runFrame();
+    }
+}
+
+#endif // MACHINE_SETUP_HPP
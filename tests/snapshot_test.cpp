@@ -0,0 +1,405 @@
+#include "machine_setup.hpp"
+#include "../include/snapshot.hpp"
+#include "../include/rewind.hpp"
+#include "../include/tapecache.hpp"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <filesystem>
+
+// Pack and unpack must give the input back, also for ED sequences the format treats specially
+static bool testRle() {
+    std::vector<std::vector<uint8_t>> inputs = {
+        {0xED, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0xED, 0xED},
+        {0x01, 0xED},
+        {0xED, 0xED, 0xED, 0x05, 0x00},
+        std::vector<uint8_t>(1000, 0xED),
+        std::vector<uint8_t>(600, 0x00),
+    };
+    srand(42);
+    std::vector<uint8_t> noise(16384);
+    for (uint8_t &value : noise) {
+        // Few different values, so runs and EDs are common
+        value = (rand() % 4 == 0) ? 0xED : static_cast<uint8_t>(rand() % 3);
+    }
+    inputs.push_back(noise);
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::vector<uint8_t> packed;
+        Snapshot::packZ80(inputs[i].data(), inputs[i].size(), packed);
+        std::vector<uint8_t> unpacked(inputs[i].size());
+        if (!Snapshot::unpackZ80(packed.data(), packed.size(), unpacked.data(), unpacked.size()) ||
+            unpacked != inputs[i]) {
+            std::cout << "  RLE round trip failed for input " << i << std::endl;
+            return false;
+        }
+    }
+
+    // Run longer than the output is an error, not an overflow
+    const uint8_t overflow[] = {0xED, 0xED, 0x10, 0xAA};
+    uint8_t small[8];
+    if (Snapshot::unpackZ80(overflow, sizeof(overflow), small, sizeof(small))) {
+        std::cout << "  RLE accepted a run past the output" << std::endl;
+        return false;
+    }
+    std::cout << "  RLE round trip: PASSED" << std::endl;
+    return true;
+}
+
+// Machine state written to every format and read back must be the same
+static bool testFormats(bool is48) {
+    Machine machine;
+    startMachine(machine, 100, is48);
+    machine.getMemory()->getBank(7)[123] = 0x5A; // Something outside the paged banks
+
+    std::unique_ptr<SnapshotData> original(new SnapshotData);
+    std::unique_ptr<SnapshotData> loaded(new SnapshotData);
+    Snapshot::capture(machine, *original);
+
+    bool ok = true;
+    for (SnapshotFormat format : {SnapshotFormat::Sna, SnapshotFormat::Z80, SnapshotFormat::Szx}) {
+        std::vector<uint8_t> file;
+        if (!Snapshot::encode(*original, format, file) || !Snapshot::decode(file, format, *loaded)) {
+            std::cout << "  Format " << static_cast<int>(format) << " failed to encode or decode" << std::endl;
+            ok = false;
+            continue;
+        }
+        // .sna and .z80 have no MEMPTR
+        loaded->MEMPTR = original->MEMPTR;
+        if (format == SnapshotFormat::Sna) {
+            // .sna has no AY registers
+            loaded->hasAy = original->hasAy;
+            loaded->aySelected = original->aySelected;
+            memcpy(loaded->ayRegisters, original->ayRegisters, sizeof(loaded->ayRegisters));
+        }
+        if (format == SnapshotFormat::Sna && is48) {
+            // 48K .sna keeps PC on the stack, below SP
+            for (uint16_t address = original->SP - 2; address != original->SP; address++) {
+                int bank = address < 0x8000 ? 5 : (address < 0xC000 ? 2 : 0);
+                loaded->banks[bank][address & 0x3FFF] = original->banks[bank][address & 0x3FFF];
+            }
+        }
+        if (memcmp(original.get(), loaded.get(), sizeof(SnapshotData)) != 0) {
+            std::cout << "  Format " << static_cast<int>(format) << " does not round trip" << std::endl;
+            ok = false;
+        }
+    }
+    std::cout << "  " << (is48 ? "48K" : "128K") << " formats: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+// Snapshot picked as an archive entry loads as the file itself, other entries are refused
+static bool testArchiveEntry() {
+    Machine machine;
+    startMachine(machine, 100);
+    std::string path = (std::filesystem::temp_directory_path() / "zx_entry_test.szx").string();
+    std::unique_ptr<SnapshotData> saved(new SnapshotData);
+    std::unique_ptr<SnapshotData> opened(new SnapshotData);
+    Snapshot::capture(machine, *saved);
+    bool ok = Snapshot::save(machine, path);
+
+    Machine entry;
+    startMachine(entry);
+    ok = ok && entry.openFile(path, 0);
+    Snapshot::capture(entry, *opened);
+    ok = ok && memcmp(saved.get(), opened.get(), sizeof(SnapshotData)) == 0 && !entry.openFile("testdata/ABC.tzx", 0);
+    if (!ok) {
+        std::cout << "  Snapshot entry did not open as the file" << std::endl;
+    }
+    std::filesystem::remove(path);
+    std::cout << "  Archive entry: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+// 128K machine that has booted to its menu, chose the tape loader with ENTER and has just
+// started playing ABC.tzx. Tape loading writes all over the screen and RAM from here on
+static void startAbcLoad(Machine &machine) {
+    startMachine(machine);
+    machine.loadTape("testdata/ABC.tzx");
+    for (int frame = 0; frame < 100; frame++) {
+        machine.runFrame();
+    }
+    // ENTER on the 128K menu starts the tape loader
+    machine.getUla()->setKeyDown(6, 0);
+    for (int frame = 0; frame < 3; frame++) {
+        machine.runFrame();
+    }
+    machine.getUla()->setKeyUp(6, 0);
+    machine.playTape();
+}
+
+// Everything the machine did after saveState happens again after loadState, from the middle of a frame
+static bool testMachineState() {
+    Machine machine;
+    startAbcLoad(machine);
+    for (int frame = 0; frame < 50; frame++) {
+        machine.runFrame();
+    }
+    for (int i = 0; i < 5000; i++) {
+        machine.step();
+    }
+
+    std::vector<uint8_t> state(Machine::getStateSize());
+    machine.saveState(state);
+    long long ticks = machine.getTicks();
+    auto runAndCapture = [&machine](SnapshotData &data, std::vector<uint32_t> &screen) {
+        for (int frame = 0; frame < 150; frame++) {
+            machine.runFrame();
+        }
+        Snapshot::capture(machine, data);
+        screen.assign(machine.getScreen(), machine.getScreen() + MACHINE_SCREEN_WIDTH * MACHINE_SCREEN_HEIGHT);
+    };
+    std::unique_ptr<SnapshotData> first(new SnapshotData);
+    std::unique_ptr<SnapshotData> second(new SnapshotData);
+    std::vector<uint32_t> firstScreen, secondScreen;
+    runAndCapture(*first, firstScreen);
+    long long firstTicks = machine.getTicks();
+    uint64_t tapePosition = machine.getTape()->getPosition();
+
+    bool ok = true;
+    if (!machine.loadState(state) || machine.getTicks() != ticks) {
+        std::cout << "  State did not load" << std::endl;
+        ok = false;
+    }
+    runAndCapture(*second, secondScreen);
+    if (memcmp(first.get(), second.get(), sizeof(SnapshotData)) != 0 || firstScreen != secondScreen ||
+        machine.getTicks() != firstTicks || machine.getTape()->getPosition() != tapePosition) {
+        std::cout << "  Run after loadState differs" << std::endl;
+        ok = false;
+    }
+
+    // Same state continued from the machine's own time
+    machine.loadState(state, true);
+    runAndCapture(*second, secondScreen);
+    if (memcmp(first.get(), second.get(), sizeof(SnapshotData)) != 0 || machine.getTicks() != 2 * firstTicks - ticks) {
+        std::cout << "  Run after loadState with kept clock differs" << std::endl;
+        ok = false;
+    }
+
+    // Other versions are refused
+    std::vector<uint8_t> broken = state;
+    reinterpret_cast<MachineState *>(broken.data())->version++;
+    if (machine.loadState(broken)) {
+        std::cout << "  State of another version was loaded" << std::endl;
+        ok = false;
+    }
+
+    const int rounds = 1000;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        machine.saveState(state);
+        machine.loadState(state);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / rounds;
+    std::cout << "  State is " << Machine::getStateSize() << " bytes, save + load " << us << " us" << std::endl;
+    std::cout << "  Machine state: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+// Stepping back rebuilds a frame from its keyframe and the written pages after it
+static bool testRewind() {
+    Machine machine;
+    startAbcLoad(machine);
+    Rewind rewind;
+    std::unique_ptr<SnapshotData> expected(new SnapshotData);
+    std::unique_ptr<SnapshotData> restored(new SnapshotData);
+    bool ok = true;
+
+    // More frames than rewind keeps
+    const int frames = 60 * 50 + 400;
+    double captureUs = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        machine.runFrame();
+        auto captureBegin = std::chrono::steady_clock::now();
+        rewind.capture(machine);
+        captureUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - captureBegin).count();
+        if (frame == frames - 80) {
+            Snapshot::capture(machine, *expected);
+        }
+    }
+    size_t stored = rewind.getFrames();
+    size_t bytes = rewind.getBytes();
+    if (stored < 60 * 50 || stored > 60 * 50 + REWIND_KEYFRAME_INTERVAL || bytes > REWIND_MAX_BYTES) {
+        std::cout << "  Rewind keeps " << stored << " frames in " << bytes << " bytes" << std::endl;
+        ok = false;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int step = 0; step < 79; step++) {
+        if (!rewind.stepBack(machine)) {
+            std::cout << "  Rewind stopped after " << step << " steps" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / 79;
+    Snapshot::capture(machine, *restored);
+    if (memcmp(expected.get(), restored.get(), sizeof(SnapshotData)) != 0) {
+        std::cout << "  Rewound machine differs" << std::endl;
+        ok = false;
+    }
+
+    // Emulation goes on from there and can be rewound again
+    machine.runFrame();
+    rewind.capture(machine);
+    rewind.stepBack(machine);
+    Snapshot::capture(machine, *restored);
+    if (memcmp(expected.get(), restored.get(), sizeof(SnapshotData)) != 0) {
+        std::cout << "  Rewind after continuing differs" << std::endl;
+        ok = false;
+    }
+
+    std::cout << "  Rewind: " << stored << " frames in " << bytes / 1024 << " KB, capture " << captureUs / frames
+              << " us, step back " << us << " us" << std::endl;
+    std::cout << "  Rewind: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+// Run-ahead shows the frame that comes later and leaves no trace: machine, screen and sound
+// go on exactly as without it
+static bool testRunAhead() {
+    const int ahead = 2;
+    Machine plain, runAhead;
+    for (Machine *machine : {&plain, &runAhead}) {
+        startAbcLoad(*machine);
+    }
+    auto drainSound = [](Machine &machine, std::vector<int16_t> &out) {
+        RingBuffer<int16_t> *rings[] = {machine.getSound()->getOutput(), machine.getTurboSound()->getChip(0)->getOutput(),
+                                        machine.getTurboSound()->getChip(1)->getOutput(), machine.getDac()->getOutput()};
+        for (RingBuffer<int16_t> *ring : rings) {
+            size_t start = out.size();
+            out.resize(start + ring->available());
+            ring->read(out.data() + start, out.size() - start);
+        }
+    };
+
+    const int frames = 300;
+    std::vector<std::vector<uint32_t>> predicted(frames);
+    std::vector<int16_t> plainSound, runAheadSound;
+    bool ok = true;
+    double us = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        for (Machine *machine : {&plain, &runAhead}) {
+            machine->runFrame();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        runAhead.runAhead(ahead);
+        us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        predicted[frame].assign(runAhead.getScreen(), runAhead.getScreen() + MACHINE_SCREEN_WIDTH * MACHINE_SCREEN_HEIGHT);
+        drainSound(plain, plainSound);
+        drainSound(runAhead, runAheadSound);
+
+        // Keys do not change while the tape loads, so every prediction holds
+        int shown = frame - ahead;
+        if (shown >= 0 &&
+            memcmp(predicted[shown].data(), plain.getScreen(), predicted[shown].size() * sizeof(uint32_t)) != 0) {
+            std::cout << "  Frame " << frame << " differs from the one run ahead" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    std::unique_ptr<SnapshotData> first(new SnapshotData);
+    std::unique_ptr<SnapshotData> second(new SnapshotData);
+    Snapshot::capture(plain, *first);
+    Snapshot::capture(runAhead, *second);
+    if (memcmp(first.get(), second.get(), sizeof(SnapshotData)) != 0 || plain.getTicks() != runAhead.getTicks() ||
+        plain.getTape()->getPosition() != runAhead.getTape()->getPosition()) {
+        std::cout << "  Machine with run-ahead went elsewhere" << std::endl;
+        ok = false;
+    }
+    if (plainSound != runAheadSound) {
+        std::cout << "  Sound with run-ahead differs" << std::endl;
+        ok = false;
+    }
+    std::cout << "  Run-ahead of " << ahead << " frames: " << us / frames << " us per frame" << std::endl;
+    std::cout << "  Run-ahead: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+// Machine is stored once the tape has loaded and comes back from the cache whole and quickly
+static bool testTapeCache() {
+    std::string directory = (std::filesystem::temp_directory_path() / "zx_tape_cache_test").string();
+    std::filesystem::remove_all(directory);
+    TapeCache cache(directory);
+    bool ok = true;
+
+    // Keys come from the image hash of the tape loader, a zipped tape is the same tape
+    Tape tzx, zipped, tap;
+    if (!tzx.loadFile("testdata/ABC.tzx") || !zipped.loadFile("testdata/ABC.tzx.zip") || !tap.loadFile("testdata/ABC.TAP")) {
+        std::cout << "  Test tapes do not load" << std::endl;
+        return false;
+    }
+    uint64_t key = TapeCache::keyOf(tzx.getImageHash(), false);
+    uint64_t key48 = TapeCache::keyOf(tzx.getImageHash(), true);
+    uint64_t otherKey = TapeCache::keyOf(tap.getImageHash(), false);
+    if (key == key48 || key == otherKey || TapeCache::keyOf(zipped.getImageHash(), false) != key) {
+        std::cout << "  Tape keys do not tell tapes and models apart" << std::endl;
+        return false;
+    }
+
+    Machine machine;
+    startAbcLoad(machine);
+    cache.watch(key, machine.getMemory()->getIs48());
+    std::unique_ptr<SnapshotData> stored(new SnapshotData);
+    int frame = 0;
+    for (; frame < 9000; frame++) {
+        machine.runFrame();
+        if (cache.update(machine)) {
+            Snapshot::capture(machine, *stored);
+            break;
+        }
+        if (frame < 100 && cache.has(key)) {
+            std::cout << "  Stored before the tape was loaded" << std::endl;
+            ok = false;
+        }
+    }
+    if (!cache.has(key) || machine.getTape()->isTapePlayed) {
+        std::cout << "  Nothing stored after " << frame << " frames" << std::endl;
+        std::filesystem::remove_all(directory);
+        return false;
+    }
+
+    // Lookup as on opening the tape, then decompression into a fresh machine
+    Machine resumed;
+    startMachine(resumed);
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t lookup = TapeCache::keyOf(tzx.getImageHash(), false);
+    bool found = cache.has(lookup) && cache.restore(resumed, lookup);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    std::unique_ptr<SnapshotData> restored(new SnapshotData);
+    Snapshot::capture(resumed, *restored);
+    if (!found || memcmp(stored.get(), restored.get(), sizeof(SnapshotData)) != 0) {
+        std::cout << "  Cached machine differs from the stored one" << std::endl;
+        ok = false;
+    }
+    // Reported only, timing depends on the machine the test runs on
+    std::cout << "  Tape cache: stored " << frame << " frames after play, " << std::filesystem::file_size(cache.pathOf(key))
+              << " bytes, lookup + restore " << ms << " ms" << std::endl;
+    std::cout << "  Tape cache: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    std::filesystem::remove_all(directory);
+    return ok;
+}
+
+int main() {
+    std::cout << "Snapshot Test" << std::endl;
+    std::cout << "=============" << std::endl;
+
+    bool rleSuccess = testRle();
+    bool success128 = testFormats(false);
+    bool success48 = testFormats(true);
+    bool entrySuccess = testArchiveEntry();
+    bool stateSuccess = testMachineState();
+    bool rewindSuccess = testRewind();
+    bool runAheadSuccess = testRunAhead();
+    bool tapeCacheSuccess = testTapeCache();
+
+    bool success = rleSuccess && success128 && success48 && entrySuccess && stateSuccess && rewindSuccess && runAheadSuccess &&
+                   tapeCacheSuccess;
+    std::cout << (success ? "All snapshot tests passed" : "Snapshot tests FAILED") << std::endl;
+    return success ? 0 : 1;
+}
@@ -1,10 +1,15 @@
 #include "../include/tape.hpp"
+#include "../include/taperecorder.hpp"
+#include "machine_setup.hpp"
 #include <iostream>
 #include <vector>
 #include <string>
 #include <dirent.h>
 #include <fnmatch.h>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
 
 class TapeTester {
 private:
@@ -173,6 +178,417 @@ public:
         return true;
     }
     
+    // Test that TAP and TZX versions of the same tape give the same blocks
+    // Both files are memory-mapped and blocks are views into the mapping
+    bool testMappedFiles() {
+        std::cout << "\nTesting memory-mapped TAP and TZX loading..." << std::endl;
+
+        Tape tap;
+        Tape tzx;
+        if (!tap.loadFile("testdata/ABC.TAP") || !tzx.loadFile("testdata/ABC.tzx")) {
+            std::cout << "  FAILED: Could not load test files" << std::endl;
+            return false;
+        }
+
+        if (tap.getBlockCount() == 0 || tap.getBlockCount() != tzx.getBlockCount()) {
+            std::cout << "  FAILED: Block count mismatch " << tap.getBlockCount()
+                      << " vs " << tzx.getBlockCount() << std::endl;
+            return false;
+        }
+
+        for (size_t i = 0; i < tap.getBlockCount(); i++) {
+            const TapBlock& a = tap.getBlock(i);
+            const TapBlock& b = tzx.getBlock(i);
+            if (a.data.size() != b.data.size() ||
+                !std::equal(a.data.begin(), a.data.end(), b.data.begin()) ||
+                a.isValid != b.isValid || a.filename != b.filename) {
+                std::cout << "  FAILED: Block " << i << " differs" << std::endl;
+                return false;
+            }
+        }
+
+        const TapBlock& header = tap.getBlock(0);
+        if (header.flag != 0x00 || header.filename != "A.B.C.    " || !header.isValid) {
+            std::cout << "  FAILED: Header block is not parsed: '" << header.filename << "'" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: " << tap.getBlockCount() << " blocks are identical" << std::endl;
+        return true;
+    }
+
+    // Test block index and seeking
+    // After a seek the tape must play exactly as if it had been played up to that point
+    bool testSeek() {
+        std::cout << "\nTesting tape seek..." << std::endl;
+
+        Tape tape;
+        if (!tape.loadFile("testdata/ABC.TAP")) {
+            std::cout << "  FAILED: Could not load test file" << std::endl;
+            return false;
+        }
+        tape.prepareBitStream();
+
+        if (!tape.seekToBlock(1) || tape.getCurrentBlock() != 1 || tape.getPosition() != tape.getBlockTicks(1)) {
+            std::cout << "  FAILED: seekToBlock(1) position " << tape.getPosition() << std::endl;
+            return false;
+        }
+        if (tape.seekToBlock(tape.getBlockCount())) {
+            std::cout << "  FAILED: seek beyond last block accepted" << std::endl;
+            return false;
+        }
+
+        // Other threads see the cursor only once it has been published
+        if (tape.getShownBlock() != 0 || tape.getShownPosition() != 0) {
+            std::cout << "  FAILED: cursor shown before it was published" << std::endl;
+            return false;
+        }
+        tape.publishCursor();
+        if (tape.getShownBlock() != 1 || tape.getShownPosition() != tape.getBlockTicks(1)) {
+            std::cout << "  FAILED: published cursor " << tape.getShownPosition() << std::endl;
+            return false;
+        }
+
+        // Play from the start and compare with seeking to a few positions
+        const uint64_t probes[] = {1, 2168, 4337, 4336 * 100 + 7, tape.getBlockTicks(1) + 12345};
+        Tape reference;
+        reference.loadFile("testdata/ABC.TAP");
+        reference.prepareBitStream();
+        reference.isTapePlayed = true;
+        uint64_t played = 0;
+        for (uint64_t probe : probes) {
+            while (played < probe) {
+                reference.getNextBit();
+                played++;
+            }
+            if (!tape.seekToTime(probe) || tape.getPosition() != probe) {
+                std::cout << "  FAILED: seekToTime(" << probe << ") position " << tape.getPosition() << std::endl;
+                return false;
+            }
+            tape.isTapePlayed = true;
+            for (int i = 0; i < 1000; i++) {
+                if (tape.getNextBit() != reference.getNextBit()) {
+                    std::cout << "  FAILED: signal differs " << i << " ticks after " << probe << std::endl;
+                    return false;
+                }
+            }
+            played += 1000;
+        }
+
+        std::cout << "  SUCCESS: seek matches continuous playback" << std::endl;
+        return true;
+    }
+
+    // Test background loading
+    // Result must be the same as synchronous loadFile + prepareBitStream
+    bool testBackgroundLoad() {
+        std::cout << "\nTesting background tape loading..." << std::endl;
+
+        Tape reference;
+        reference.loadFile("testdata/ABC.TAP");
+        reference.prepareBitStream();
+
+        Tape tape;
+        tape.loadFileAsync("testdata/ABC.TAP");
+        tape.isTapePlayed = true;
+        while (tape.getLoadState() == TapeLoadState::Loading) {
+            // Tape must keep playing (waiting for data), not stop
+            tape.getNextBit();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        if (tape.getLoadState() != TapeLoadState::Ready || tape.getLoadProgress() != 1.0f) {
+            std::cout << "  FAILED: loading did not finish" << std::endl;
+            return false;
+        }
+        if (tape.getBlockCount() != reference.getBlockCount() ||
+            tape.getBitStream().size() != reference.getBitStream().size() ||
+            tape.getLength() != reference.getLength()) {
+            std::cout << "  FAILED: result differs from synchronous loading" << std::endl;
+            return false;
+        }
+
+        Tape missing;
+        missing.loadFileAsync("testdata/no_such_file.tap");
+        while (missing.getLoadState() == TapeLoadState::Loading) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (missing.getLoadState() != TapeLoadState::Failed) {
+            std::cout << "  FAILED: missing file is not reported" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: " << tape.getBlockCount() << " blocks loaded in background" << std::endl;
+        return true;
+    }
+
+    // Tape picked by its archive entry loads as the first tape of the archive does,
+    // entries that are not tapes are refused
+    bool testArchiveEntry() {
+        std::cout << "\nTesting tape loading by archive entry..." << std::endl;
+
+        Archive archive;
+        if (!archive.open("testdata/ABC.tzx.zip")) {
+            std::cout << "  FAILED: Could not open archive" << std::endl;
+            return false;
+        }
+        int index = archive.findFirst(ImageKind::Tape);
+        Tape first, picked, plain;
+        if (index < 0 || !first.loadFile("testdata/ABC.tzx.zip") || !picked.loadFile("testdata/ABC.tzx.zip", index) ||
+            first.getImageHash() != picked.getImageHash() || picked.getBlockCount() != first.getBlockCount()) {
+            std::cout << "  FAILED: Picked entry " << index << " differs from the first tape" << std::endl;
+            return false;
+        }
+        if (!plain.loadFile("testdata/ABC.TAP", 0) || plain.loadFile("testdata/ABC.TAP", 1) ||
+            plain.loadFile("testdata/ABC.tzx.zip", static_cast<int>(archive.getEntryCount()))) {
+            std::cout << "  FAILED: Entry outside the archive was accepted" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: Entry " << index << " of " << archive.getEntryCount() << " loaded" << std::endl;
+        return true;
+    }
+
+    // Block list taken by another thread stays whole while the next tape loads over it
+    bool testBlockList() {
+        std::cout << "\nTesting published block list..." << std::endl;
+
+        Tape tape;
+        auto waitLoaded = [&tape]() {
+            while (tape.getLoadState() == TapeLoadState::Loading) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+        tape.loadFileAsync("testdata/ABC.tzx");
+        waitLoaded();
+        std::shared_ptr<const TapeBlockList> first = tape.getBlockList();
+        if (!first || first->blocks.size() != tape.getBlockCount() || first->blockTicks.size() != first->blocks.size() ||
+            first->length != tape.getLength() || first->blockTicks.back() != tape.getBlockTicks(first->blocks.size() - 1)) {
+            std::cout << "  FAILED: list does not match the loaded tape" << std::endl;
+            return false;
+        }
+        std::vector<uint8_t> firstBytes(first->blocks[0].data.begin(), first->blocks[0].data.end());
+
+        tape.loadFileAsync("testdata/ABC.TAP");
+        if (tape.getBlockList()) {
+            std::cout << "  FAILED: old list published while loading" << std::endl;
+            return false;
+        }
+        waitLoaded();
+        std::shared_ptr<const TapeBlockList> second = tape.getBlockList();
+        tape.reset();
+        if (!second || second == first || tape.getBlockList() ||
+            !std::equal(firstBytes.begin(), firstBytes.end(), first->blocks[0].data.begin(), first->blocks[0].data.end())) {
+            std::cout << "  FAILED: list taken before does not survive the next load" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: " << first->blocks.size() << " blocks kept while " << second->blocks.size()
+                  << " were loaded over them" << std::endl;
+        return true;
+    }
+
+    // Test tape recorder
+    // Blocks from SAVE trap must load back, MIC decoder must restore blocks from ROM timings
+    bool testRecorder() {
+        std::cout << "\nTesting tape recorder..." << std::endl;
+
+        Tape source;
+        if (!source.loadFile("testdata/ABC.TAP")) {
+            std::cout << "  FAILED: Could not load test file" << std::endl;
+            return false;
+        }
+        source.prepareBitStream();
+
+        // Same blocks through SAVE trap path, written to disk and loaded again
+        TapeRecorder trap;
+        for (size_t i = 0; i < source.getBlockCount(); i++) {
+            std::span<const uint8_t> payload = source.getBlock(i).data;
+            trap.addBlock(payload[0], payload.subspan(1, payload.size() - 2));
+        }
+        const char *savedName = "/tmp/tape_test_saved.tap";
+        Tape saved;
+        if (!trap.saveTap(savedName) || !saved.loadFile(savedName) || saved.getBlockCount() != source.getBlockCount()) {
+            std::cout << "  FAILED: saved tape could not be loaded back" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < saved.getBlockCount(); i++) {
+            const TapBlock &block = saved.getBlock(i);
+            if (!block.isValid || !std::equal(block.data.begin(), block.data.end(), source.getBlock(i).data.begin())) {
+                std::cout << "  FAILED: saved block " << i << " differs" << std::endl;
+                return false;
+            }
+        }
+        std::remove(savedName);
+
+        // Every impulse of the generated stream is one MIC half pulse
+        TapeRecorder mic;
+        uint64_t tstate = 0;
+        for (const TapeImpulse &impulse : source.getBitStream()) {
+            mic.micEdge(tstate);
+            tstate += impulse.ticks;
+        }
+        mic.micEdge(tstate);
+        mic.flush();
+        if (mic.getBlockCount() != source.getBlockCount()) {
+            std::cout << "  FAILED: decoded " << mic.getBlockCount() << " blocks instead of " << source.getBlockCount() << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < mic.getBlockCount(); i++) {
+            const std::vector<uint8_t> &decoded = mic.getBlock(i);
+            std::span<const uint8_t> expected = source.getBlock(i).data;
+            if (decoded.size() != expected.size() || !std::equal(decoded.begin(), decoded.end(), expected.begin())) {
+                std::cout << "  FAILED: decoded block " << i << " differs" << std::endl;
+                return false;
+            }
+        }
+
+        std::cout << "  SUCCESS: " << mic.getBlockCount() << " blocks saved and decoded" << std::endl;
+        return true;
+    }
+
+    // Test SAVE trap of a running machine
+    // Registers and the block must be as the ROM routine leaves them when it plays the block to MIC
+    bool testSaveTrap() {
+        std::cout << "\nTesting SAVE trap against the ROM saving to MIC..." << std::endl;
+
+        Machine trapped, played;
+        played.saveTrap = false;
+        played.recordMic = true;
+        for (Machine *machine : {&trapped, &played}) {
+            startMachine(*machine, 100, true);
+
+            // CALL SA-BYTES with three data bytes at 8000, returning to JR $ at 9000
+            Memory *memory = machine->getMemory();
+            Z80 *cpu = machine->getCpu();
+            memory->WriteByte(0x8000, 0x12);
+            memory->WriteByte(0x8001, 0xED);
+            memory->WriteByte(0x8002, 0x00);
+            memory->WriteByte(0x9000, 0x18);
+            memory->WriteByte(0x9001, 0xFE);
+            cpu->SP -= 2;
+            memory->WriteByte(cpu->SP, 0x00);
+            memory->WriteByte(cpu->SP + 1, 0x90);
+            cpu->IX = 0x8000;
+            cpu->DE = 3;
+            cpu->A = 0xFF;
+            cpu->PC = ROM_SA_BYTES;
+            long long steps = 0;
+            while (cpu->PC != 0x9000 && steps++ < 50000000) {
+                machine->step();
+            }
+            machine->getTapeRecorder()->flush();
+        }
+
+        Z80 *a = trapped.getCpu();
+        Z80 *b = played.getCpu();
+        if (a->PC != 0x9000 || b->PC != 0x9000 || a->IX != b->IX || a->DE != b->DE || a->A != b->A || a->F != b->F ||
+            a->A != 0 || a->F != (FLAG_Z | FLAG_H | FLAG_C)) {
+            std::cout << "  FAILED: trap returns IX=" << std::hex << a->IX << " DE=" << a->DE << " AF=" << int(a->A) << int(a->F)
+                      << ", ROM returns IX=" << b->IX << " DE=" << b->DE << " AF=" << int(b->A) << int(b->F) << std::dec << std::endl;
+            return false;
+        }
+        TapeRecorder *trappedBlocks = trapped.getTapeRecorder();
+        TapeRecorder *playedBlocks = played.getTapeRecorder();
+        if (trappedBlocks->getBlockCount() != 1 || playedBlocks->getBlockCount() != 1 ||
+            trappedBlocks->getBlock(0) != playedBlocks->getBlock(0)) {
+            std::cout << "  FAILED: trapped block differs from the played one" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: trapped block and registers match the ROM" << std::endl;
+        return true;
+    }
+
+    // Test play pressed in the middle of a frame
+    // Tape must play from that moment, not from the next frame
+    bool testTapeStart() {
+        std::cout << "\nTesting tape start in the middle of a frame..." << std::endl;
+
+        Machine machine;
+        startMachine(machine);
+        machine.loadTape("testdata/ABC.tzx");
+        for (int frame = 0; frame < 10; frame++) {
+            machine.runFrame();
+        }
+        for (int i = 0; i < 1000; i++) {
+            machine.step();
+        }
+        machine.playTape();
+        long long started = machine.getTicks();
+        for (int i = 0; i < 1000; i++) {
+            machine.step();
+        }
+        uint64_t played = machine.getTape()->getPosition();
+        uint64_t expected = machine.getTicks() - started;
+        // Position counts up to the last edge played
+        if (played == 0 || played > expected || expected - played > 2168) {
+            std::cout << "  FAILED: tape played " << played << " T-states of " << expected << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: " << played << " of " << expected << " T-states played" << std::endl;
+        return true;
+    }
+
+    // Test tape opened while another one plays
+    // Player must stop and start again from the new tape
+    bool testTapeSwap() {
+        std::cout << "\nTesting tape opened during playback..." << std::endl;
+
+        Machine machine;
+        startMachine(machine);
+        machine.loadTape("testdata/ABC.tzx");
+        machine.playTape();
+        for (int frame = 0; frame < 20; frame++) {
+            machine.runFrame();
+        }
+        Tape *tape = machine.getTape();
+        uint32_t loads = tape->getLoadCount();
+        machine.requestTape("testdata/ABC.TAP");
+        machine.step();
+        if (tape->isTapePlayed || tape->getLoadCount() == loads) {
+            std::cout << "  FAILED: player did not stop for the new tape" << std::endl;
+            return false;
+        }
+        while (tape->getLoadState() == TapeLoadState::Loading) {
+            machine.runFrame();
+        }
+
+        // Loader publishes the hash of the new image with the finished load
+        Tape tap;
+        if (tape->getLoadState() != TapeLoadState::Ready || tape->getPosition() != 0 || tape->getBlockCount() == 0 ||
+            !tap.loadFile("testdata/ABC.TAP") || tape->getImageHash() != tap.getImageHash()) {
+            std::cout << "  FAILED: new tape does not start over" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: new tape starts from 0" << std::endl;
+        return true;
+    }
+
+    // Test tape loaded directly while a requested one is still loading in the background
+    // Background load must be stopped and the direct one must replace it
+    bool testLoadOverRequest() {
+        std::cout << "\nTesting direct load over a background load..." << std::endl;
+
+        Machine machine;
+        startMachine(machine);
+        machine.requestTape("testdata/ABC.TAP");
+        machine.step();
+        bool loaded = machine.loadTape("testdata/ABC.tzx");
+        Tape *tape = machine.getTape();
+        Tape tzx;
+        if (!loaded || !tzx.loadFile("testdata/ABC.tzx") || tape->getLoadState() != TapeLoadState::Idle ||
+            tape->getImageHash() != tzx.getImageHash() || tape->getBlockCount() != tzx.getBlockCount()) {
+            std::cout << "  FAILED: background load was not stopped before the direct one" << std::endl;
+            return false;
+        }
+
+        std::cout << "  SUCCESS: " << tape->getBlockCount() << " blocks of the direct load kept" << std::endl;
+        return true;
+    }
+
     // Test getNextBit function with specific bit stream
     bool testGetNextBit() {
         std::cout << "\nTesting getNextBit function..." << std::endl;
@@ -188,6 +604,7 @@ public:
         
         // Set up the test bit stream using the public method
         tape.setTestBitStream(testBitStream);
+        tape.isTapePlayed = true; // getNextBit returns nothing while tape is stopped
         
         bool result = true;
         
@@ -243,5 +660,30 @@ int main() {
     // Test getNextBit function
     bool getNextBitSuccess = tester.testGetNextBit();
 
-    return (virtualSuccess && getNextBitSuccess) ? 0 : 1;
+    // Test mapped file loading
+    bool mappedSuccess = tester.testMappedFiles();
+
+    // Test tape index and seeking
+    bool seekSuccess = tester.testSeek();
+
+    // Test background loading
+    bool backgroundSuccess = tester.testBackgroundLoad();
+
+    // Test tape picked from an archive
+    bool entrySuccess = tester.testArchiveEntry();
+
+    // Test block list of the tape browser
+    bool blockListSuccess = tester.testBlockList();
+
+    // Test tape saving
+    bool recorderSuccess = tester.testRecorder();
+    bool saveTrapSuccess = tester.testSaveTrap();
+
+    // Test tape in a running machine
+    bool startSuccess = tester.testTapeStart();
+    bool swapSuccess = tester.testTapeSwap();
+    bool loadOverSuccess = tester.testLoadOverRequest();
+
+    return (virtualSuccess && getNextBitSuccess && mappedSuccess && seekSuccess && backgroundSuccess && entrySuccess &&
+            blockListSuccess && recorderSuccess && saveTrapSuccess && startSuccess && swapSuccess && loadOverSuccess) ? 0 : 1;
 }
@@ -0,0 +1,53 @@
+#include "machine_setup.hpp"
+#include <iostream>
+
+// Attribute written while the beam is in the middle of a pixel line: the part already drawn keeps
+// the old colour, the rest of the line and the lines after it get the new one
+static bool testBeamRacing() {
+    Machine machine;
+    startMachine(machine, 100);
+    Memory *memory = machine.getMemory();
+    for (int line = 0; line < 8; line++) {
+        for (int column = 0; column < 32; column++) {
+            memory->WriteByte(0x4000 + line * 256 + column, 0x00);
+        }
+    }
+    for (int column = 0; column < 32; column++) {
+        memory->WriteByte(0x5800 + column, 0x38); // White paper
+    }
+    machine.runFrame();
+    machine.runFrame();
+
+    // Beam in the middle of the first pixel line
+    ULAState beam;
+    machine.getUla()->saveState(beam);
+    long long middle = beam.frameStart + beam.clockFlyback + 48 * beam.clockPerLine + 24 + 64;
+    while (machine.getTicks() < middle) {
+        machine.step();
+    }
+    memory->WriteByte(0x5800, 0x10);  // Red paper, left cell already drawn
+    memory->WriteByte(0x581F, 0x10);  // and right cell not yet
+    machine.runFrame();
+
+    const uint32_t *screen = machine.getScreen();
+    auto pixel = [screen](int x, int y) { return screen[(y + 48) * MACHINE_SCREEN_WIDTH + x + 48]; };
+    uint32_t white = pixel(128, 0);
+    uint32_t red = pixel(0, 1);
+    bool ok = white != red && pixel(0, 0) == white && pixel(248, 0) == red && pixel(248, 1) == red;
+    if (!ok) {
+        std::cout << "  Attribute write in the middle of a line drawn at the wrong time" << std::endl;
+    }
+    std::cout << "  Beam racing: " << (ok ? "PASSED" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "ULA Test" << std::endl;
+    std::cout << "========" << std::endl;
+
+    bool beamRacingSuccess = testBeamRacing();
+
+    bool success = beamRacingSuccess;
+    std::cout << (success ? "All ULA tests passed" : "ULA tests FAILED") << std::endl;
+    return success ? 0 : 1;
+}